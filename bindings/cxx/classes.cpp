@@ -869,7 +869,11 @@ void DatafeedCallbackData::run(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *pkt)
 {
 	auto device = _session->get_device(sdi);
-	shared_ptr<Packet> packet {new Packet{device, pkt}, default_delete<Packet>{}};
+	/* Keep pooled packets alive for as long as the user holds them. */
+	auto retained = sr_packet_retain(pkt, FALSE);
+	shared_ptr<Packet> packet {new Packet{device, retained ? retained : pkt},
+		default_delete<Packet>{}};
+	packet->_retained = retained;
 	_callback(move(device), move(packet));
 }
 
@@ -1042,6 +1046,7 @@ shared_ptr<Context> Session::context()
 Packet::Packet(shared_ptr<Device> device,
 	const struct sr_datafeed_packet *structure) :
 	_structure(structure),
+	_retained(nullptr),
 	_device(move(device))
 {
 	switch (structure->type)
@@ -1071,6 +1076,7 @@ Packet::Packet(shared_ptr<Device> device,
 
 Packet::~Packet()
 {
+	sr_packet_unref(_retained);
 }
 
 const PacketType *Packet::type() const
@@ -671,6 +671,8 @@ private:
 		const struct sr_datafeed_packet *structure);
 	~Packet();
 	const struct sr_datafeed_packet *_structure;
+	/* Reference held on a pooled packet, if any. */
+	struct sr_datafeed_packet *_retained;
 	shared_ptr<Device> _device;
 	unique_ptr<PacketPayload> _payload;
 
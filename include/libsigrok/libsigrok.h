@@ -168,6 +168,8 @@ enum sr_packettype {
 	SR_DF_FRAME_END,
 	/** Payload is struct sr_datafeed_analog. */
 	SR_DF_ANALOG,
+	/** Payload is struct sr_datafeed_logic_rle. */
+	SR_DF_LOGIC_RLE,
 
 	/* Update datafeed_dump() (session.c) upon changes! */
 };
@@ -465,6 +467,45 @@ struct sr_context;
  */
 struct sr_session;
 
+/**
+ * @struct sr_session_file
+ * Opaque structure representing a session file opened for random access.
+ *
+ * None of the fields of this structure are meant to be accessed directly.
+ *
+ * @see sr_session_file_open(), sr_session_file_close().
+ */
+struct sr_session_file;
+
+/**
+ * What a threaded datafeed callback's queue does when it is full.
+ *
+ * @see sr_session_dispatch_set().
+ */
+enum sr_dispatch_policy {
+	/** Make the session thread wait for the callback (backpressure). */
+	SR_DISPATCH_BLOCK = 10000,
+	/**
+	 * Drop incoming logic and analog packets. Other packets, such as
+	 * SR_DF_HEADER and SR_DF_END, are never dropped.
+	 */
+	SR_DISPATCH_DROP,
+};
+
+/** Statistics of a threaded datafeed callback. */
+struct sr_datafeed_stats {
+	/** Number of packets queued for the callback. */
+	uint64_t packets;
+	/** Number of packets dropped because the queue was full. */
+	uint64_t dropped;
+	/** Number of times the session thread waited for the queue. */
+	uint64_t stalls;
+	/** Number of packets currently in the queue. */
+	unsigned int queue_depth;
+	/** Highest number of packets in the queue so far. */
+	unsigned int max_queue_depth;
+};
+
 struct sr_rational {
 	/** Numerator of the rational number. */
 	int64_t p;
@@ -496,6 +537,33 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/**
+ * Run-length encoded logic datafeed payload for type SR_DF_LOGIC_RLE.
+ *
+ * The samples are num_runs runs of identical samples. Datafeed callbacks
+ * only receive these when registered with
+ * sr_session_datafeed_rle_callback_add(), all others receive the same
+ * samples as SR_DF_LOGIC packets.
+ */
+struct sr_datafeed_logic_rle {
+	/** Number of runs. */
+	uint64_t num_runs;
+	/** Size of a sample in bytes. */
+	uint16_t unitsize;
+	/** The sample value of each run, unitsize bytes each. */
+	void *data;
+	/** The number of samples in each run, each at least 1. */
+	uint64_t *lengths;
+};
+
+/** A position within the samples of a struct sr_datafeed_logic_rle. */
+struct sr_logic_rle_pos {
+	/** Index of the current run. */
+	uint64_t run;
+	/** Number of samples of the current run before the position. */
+	uint64_t offset;
+};
+
 /** Analog datafeed payload for type SR_DF_ANALOG. */
 struct sr_datafeed_analog {
 	void *data;
@@ -575,6 +643,8 @@ struct sr_resource {
 enum sr_output_flag {
 	/** If set, this output module writes the output itself. */
 	SR_OUTPUT_INTERNAL_IO_HANDLING = 0x01,
+	/** If set, this output module handles SR_DF_LOGIC_RLE packets. */
+	SR_OUTPUT_LOGIC_RLE = 0x02,
 };
 
 struct sr_input;
@@ -1061,6 +1131,12 @@ enum sr_configkey {
 	/** Self test mode. */
 	SR_CONF_TEST_MODE,
 
+	/**
+	 * Produce samples as fast as possible instead of in real time.
+	 * The sample rate then only determines the timing of the data.
+	 */
+	SR_CONF_UNTHROTTLED,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 };
 
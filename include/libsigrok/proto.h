@@ -57,6 +57,16 @@ SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count);
+SR_API int sr_a2l_threshold_logic(const struct sr_datafeed_analog *analog,
+		float threshold, struct sr_datafeed_logic *logic,
+		unsigned int bit);
+SR_API int sr_a2l_schmitt_trigger_logic(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state,
+		struct sr_datafeed_logic *logic, unsigned int bit);
+SR_API uint64_t sr_logic_rle_num_samples(
+		const struct sr_datafeed_logic_rle *rle);
+SR_API uint64_t sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		struct sr_logic_rle_pos *pos, void *buf, uint64_t max_samples);
 
 /*--- log.c -----------------------------------------------------------------*/
 
@@ -144,6 +154,15 @@ SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger
 SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session);
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_rle_callback_add(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_dispatch_set(struct sr_session *session,
+		gboolean threaded, unsigned int queue_size, int policy);
+SR_API int sr_session_usb_thread_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_datafeed_stats_get(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data,
+		struct sr_datafeed_stats *stats);
 
 /* Session control */
 SR_API int sr_session_start(struct sr_session *session);
@@ -153,6 +172,35 @@ SR_API int sr_session_is_running(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
 
+/* Datafeed packets */
+SR_API int sr_session_packet_pool_set(struct sr_session *session,
+		size_t logic_size, size_t analog_size, unsigned int num_buffers);
+SR_API struct sr_datafeed_packet *sr_packet_retain(
+		const struct sr_datafeed_packet *packet, gboolean copy);
+SR_API struct sr_datafeed_packet *sr_packet_ref(
+		struct sr_datafeed_packet *packet);
+SR_API void sr_packet_unref(struct sr_datafeed_packet *packet);
+
+/* Random access to session files */
+SR_API int sr_session_file_open(const char *filename,
+		struct sr_session_file **sf);
+SR_API int sr_session_file_close(struct sr_session_file *sf);
+SR_API int sr_session_file_info_get(struct sr_session_file *sf,
+		uint64_t *samplerate, unsigned int *unitsize,
+		uint64_t *num_logic_samples, unsigned int *num_analog_channels);
+SR_API int sr_session_file_analog_samples_get(struct sr_session_file *sf,
+		unsigned int channel, uint64_t *num_samples);
+SR_API int sr_session_file_logic_read(struct sr_session_file *sf,
+		uint64_t start, uint64_t count, uint8_t *buf);
+SR_API int sr_session_file_analog_read(struct sr_session_file *sf,
+		unsigned int channel, uint64_t start, uint64_t count, float *buf);
+SR_API int sr_session_file_logic_decimate(struct sr_session_file *sf,
+		uint64_t start, uint64_t step, uint64_t num_bins,
+		uint8_t *min, uint8_t *max);
+SR_API int sr_session_file_analog_decimate(struct sr_session_file *sf,
+		unsigned int channel, uint64_t start, uint64_t step,
+		uint64_t num_bins, float *min, float *max);
+
 /*--- input/input.c ---------------------------------------------------------*/
 
 SR_API const struct sr_input_module **sr_input_list(void);
@@ -172,6 +220,9 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in);
 SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in);
 SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in);
 SR_API int sr_input_send(const struct sr_input *in, GString *buf);
+SR_API int sr_input_map_file(const struct sr_input *in, const char *filename);
+SR_API int sr_input_send_mapped(const struct sr_input *in, size_t len,
+		size_t *remaining);
 SR_API int sr_input_end(const struct sr_input *in);
 SR_API int sr_input_reset(const struct sr_input *in);
 SR_API void sr_input_free(const struct sr_input *in);
@@ -154,6 +154,530 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
+/*
+ * Analog-to-float conversion kernels.
+ *
+ * Every kernel converts a run of samples of one fixed encoding into
+ * native floats, computing (sample * scale) + offset. The generic C
+ * kernels handle any CPU and the tails of the vector kernels. The vector
+ * kernels are built with per-function target attributes, and the best
+ * set the CPU supports is picked once, at the first conversion.
+ */
+
+enum analog_format {
+	ANALOG_S8,
+	ANALOG_U8,
+	ANALOG_S16LE,
+	ANALOG_U16LE,
+	ANALOG_S16BE,
+	ANALOG_U16BE,
+	ANALOG_S32LE,
+	ANALOG_U32LE,
+	ANALOG_S32BE,
+	ANALOG_U32BE,
+	ANALOG_F32LE,
+	ANALOG_F32BE,
+	ANALOG_NUM_FORMATS,
+};
+
+typedef void (*analog_convert_func)(const uint8_t *in, float *out,
+		size_t count, float scale, float offset);
+
+#define RS8(x) ((int8_t)R8(x))
+
+#define C_KERNEL(name, size, read) \
+static void convert_##name##_c(const uint8_t *in, float *out, \
+		size_t count, float scale, float offset) \
+{ \
+	size_t i; \
+\
+	for (i = 0; i < count; i++, in += size) \
+		out[i] = scale * (float)read(in) + offset; \
+}
+
+C_KERNEL(s8, 1, RS8)
+C_KERNEL(u8, 1, R8)
+C_KERNEL(s16le, 2, RL16S)
+C_KERNEL(u16le, 2, RL16)
+C_KERNEL(s16be, 2, RB16S)
+C_KERNEL(u16be, 2, RB16)
+C_KERNEL(s32le, 4, RL32S)
+C_KERNEL(u32le, 4, RL32)
+C_KERNEL(s32be, 4, RB32S)
+C_KERNEL(u32be, 4, RB32)
+C_KERNEL(f32le, 4, RLFL)
+C_KERNEL(f32be, 4, RBFL)
+
+static const analog_convert_func convert_c[ANALOG_NUM_FORMATS] = {
+	convert_s8_c, convert_u8_c,
+	convert_s16le_c, convert_u16le_c, convert_s16be_c, convert_u16be_c,
+	convert_s32le_c, convert_u32le_c, convert_s32be_c, convert_u32be_c,
+	convert_f32le_c, convert_f32be_c,
+};
+
+/*
+ * A vector kernel runs the loader over as many full vectors as fit, and
+ * leaves the rest to the C kernel. Every loader returns the next 'lanes'
+ * samples as floats, before scale and offset are applied. Multiply and
+ * add are separate operations, exactly like in the C kernels.
+ */
+#define VECTOR_KERNEL(isa, target, name, size, lanes, vtype, set1, mul, add, \
+		store) \
+static target void convert_##name##_##isa(const uint8_t *in, \
+		float *out, size_t count, float scale, float offset) \
+{ \
+	const vtype vscale = set1(scale); \
+	const vtype voffset = set1(offset); \
+	size_t i; \
+\
+	for (i = 0; i + lanes <= count; i += lanes, in += lanes * size) \
+		store(out + i, add(mul(isa##_load_##name(in), vscale), voffset)); \
+	convert_##name##_c(in, out + i, count - i, scale, offset); \
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+		&& !defined(WORDS_BIGENDIAN)
+#define HAVE_ANALOG_X86
+#include <immintrin.h>
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static inline SSE2_TARGET __m128i sse2_load32(const uint8_t *in)
+{
+	int32_t v;
+
+	memcpy(&v, in, sizeof(v));
+
+	return _mm_cvtsi32_si128(v);
+}
+
+static inline SSE2_TARGET __m128i sse2_bswap16(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static inline SSE2_TARGET __m128i sse2_bswap32(__m128i x)
+{
+	x = sse2_bswap16(x);
+
+	return _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16));
+}
+
+/* Exact for all of uint32_t: both halves convert without rounding. */
+static inline SSE2_TARGET __m128 sse2_cvtepu32_ps(__m128i x)
+{
+	__m128 hi, lo;
+
+	hi = _mm_cvtepi32_ps(_mm_srli_epi32(x, 16));
+	lo = _mm_cvtepi32_ps(_mm_and_si128(x, _mm_set1_epi32(0xffff)));
+
+	return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+static inline SSE2_TARGET __m128 sse2_load_s8(const uint8_t *in)
+{
+	__m128i x = sse2_load32(in);
+
+	x = _mm_unpacklo_epi8(x, x);
+	x = _mm_unpacklo_epi16(x, x);
+
+	return _mm_cvtepi32_ps(_mm_srai_epi32(x, 24));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_u8(const uint8_t *in)
+{
+	__m128i x = sse2_load32(in);
+
+	x = _mm_unpacklo_epi8(x, _mm_setzero_si128());
+	x = _mm_unpacklo_epi16(x, _mm_setzero_si128());
+
+	return _mm_cvtepi32_ps(x);
+}
+
+static inline SSE2_TARGET __m128 sse2_s16(__m128i x)
+{
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+}
+
+static inline SSE2_TARGET __m128 sse2_u16(__m128i x)
+{
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(x, _mm_setzero_si128()));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_s16le(const uint8_t *in)
+{
+	return sse2_s16(_mm_loadl_epi64((const __m128i *)in));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_u16le(const uint8_t *in)
+{
+	return sse2_u16(_mm_loadl_epi64((const __m128i *)in));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_s16be(const uint8_t *in)
+{
+	return sse2_s16(sse2_bswap16(_mm_loadl_epi64((const __m128i *)in)));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_u16be(const uint8_t *in)
+{
+	return sse2_u16(sse2_bswap16(_mm_loadl_epi64((const __m128i *)in)));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_s32le(const uint8_t *in)
+{
+	return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)in));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_u32le(const uint8_t *in)
+{
+	return sse2_cvtepu32_ps(_mm_loadu_si128((const __m128i *)in));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_s32be(const uint8_t *in)
+{
+	return _mm_cvtepi32_ps(sse2_bswap32(
+			_mm_loadu_si128((const __m128i *)in)));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_u32be(const uint8_t *in)
+{
+	return sse2_cvtepu32_ps(sse2_bswap32(
+			_mm_loadu_si128((const __m128i *)in)));
+}
+
+static inline SSE2_TARGET __m128 sse2_load_f32le(const uint8_t *in)
+{
+	return _mm_loadu_ps((const float *)in);
+}
+
+static inline SSE2_TARGET __m128 sse2_load_f32be(const uint8_t *in)
+{
+	return _mm_castsi128_ps(sse2_bswap32(
+			_mm_loadu_si128((const __m128i *)in)));
+}
+
+#define SSE2_KERNEL(name, size) \
+	VECTOR_KERNEL(sse2, SSE2_TARGET, name, size, 4, __m128, _mm_set1_ps, \
+		_mm_mul_ps, _mm_add_ps, _mm_storeu_ps)
+
+SSE2_KERNEL(s8, 1)
+SSE2_KERNEL(u8, 1)
+SSE2_KERNEL(s16le, 2)
+SSE2_KERNEL(u16le, 2)
+SSE2_KERNEL(s16be, 2)
+SSE2_KERNEL(u16be, 2)
+SSE2_KERNEL(s32le, 4)
+SSE2_KERNEL(u32le, 4)
+SSE2_KERNEL(s32be, 4)
+SSE2_KERNEL(u32be, 4)
+SSE2_KERNEL(f32le, 4)
+SSE2_KERNEL(f32be, 4)
+
+static const analog_convert_func convert_sse2[ANALOG_NUM_FORMATS] = {
+	convert_s8_sse2, convert_u8_sse2,
+	convert_s16le_sse2, convert_u16le_sse2,
+	convert_s16be_sse2, convert_u16be_sse2,
+	convert_s32le_sse2, convert_u32le_sse2,
+	convert_s32be_sse2, convert_u32be_sse2,
+	convert_f32le_sse2, convert_f32be_sse2,
+};
+
+static inline AVX2_TARGET __m256i avx2_bswap32(__m256i x)
+{
+	const __m256i mask = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	return _mm256_shuffle_epi8(x, mask);
+}
+
+static inline AVX2_TARGET __m128i avx2_bswap16(__m128i x)
+{
+	const __m128i mask = _mm_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	return _mm_shuffle_epi8(x, mask);
+}
+
+static inline AVX2_TARGET __m256 avx2_cvtepu32_ps(__m256i x)
+{
+	__m256 hi, lo;
+
+	hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 16));
+	lo = _mm256_cvtepi32_ps(_mm256_and_si256(x, _mm256_set1_epi32(0xffff)));
+
+	return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+static inline AVX2_TARGET __m256 avx2_load_s8(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+			_mm_loadl_epi64((const __m128i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_u8(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_s16le(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+			_mm_loadu_si128((const __m128i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_u16le(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_s16be(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(avx2_bswap16(
+			_mm_loadu_si128((const __m128i *)in))));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_u16be(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(avx2_bswap16(
+			_mm_loadu_si128((const __m128i *)in))));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_s32le(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)in));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_u32le(const uint8_t *in)
+{
+	return avx2_cvtepu32_ps(_mm256_loadu_si256((const __m256i *)in));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_s32be(const uint8_t *in)
+{
+	return _mm256_cvtepi32_ps(avx2_bswap32(
+			_mm256_loadu_si256((const __m256i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_u32be(const uint8_t *in)
+{
+	return avx2_cvtepu32_ps(avx2_bswap32(
+			_mm256_loadu_si256((const __m256i *)in)));
+}
+
+static inline AVX2_TARGET __m256 avx2_load_f32le(const uint8_t *in)
+{
+	return _mm256_loadu_ps((const float *)in);
+}
+
+static inline AVX2_TARGET __m256 avx2_load_f32be(const uint8_t *in)
+{
+	return _mm256_castsi256_ps(avx2_bswap32(
+			_mm256_loadu_si256((const __m256i *)in)));
+}
+
+#define AVX2_KERNEL(name, size) \
+	VECTOR_KERNEL(avx2, AVX2_TARGET, name, size, 8, __m256, _mm256_set1_ps, \
+		_mm256_mul_ps, _mm256_add_ps, _mm256_storeu_ps)
+
+AVX2_KERNEL(s8, 1)
+AVX2_KERNEL(u8, 1)
+AVX2_KERNEL(s16le, 2)
+AVX2_KERNEL(u16le, 2)
+AVX2_KERNEL(s16be, 2)
+AVX2_KERNEL(u16be, 2)
+AVX2_KERNEL(s32le, 4)
+AVX2_KERNEL(u32le, 4)
+AVX2_KERNEL(s32be, 4)
+AVX2_KERNEL(u32be, 4)
+AVX2_KERNEL(f32le, 4)
+AVX2_KERNEL(f32be, 4)
+
+static const analog_convert_func convert_avx2[ANALOG_NUM_FORMATS] = {
+	convert_s8_avx2, convert_u8_avx2,
+	convert_s16le_avx2, convert_u16le_avx2,
+	convert_s16be_avx2, convert_u16be_avx2,
+	convert_s32le_avx2, convert_u32le_avx2,
+	convert_s32be_avx2, convert_u32be_avx2,
+	convert_f32le_avx2, convert_f32be_avx2,
+};
+#endif
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(WORDS_BIGENDIAN)
+#define HAVE_ANALOG_NEON
+#include <arm_neon.h>
+
+/*
+ * Only built when the compiler targets NEON, in which case the CPU is
+ * guaranteed to have it; no runtime check is needed.
+ */
+
+static inline float32x4_t neon_load_s8(const uint8_t *in)
+{
+	uint32_t v;
+	int16x8_t x;
+
+	memcpy(&v, in, sizeof(v));
+	x = vmovl_s8(vreinterpret_s8_u32(vdup_n_u32(v)));
+
+	return vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+}
+
+static inline float32x4_t neon_load_u8(const uint8_t *in)
+{
+	uint32_t v;
+	uint16x8_t x;
+
+	memcpy(&v, in, sizeof(v));
+	x = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)));
+
+	return vcvtq_f32_u32(vmovl_u16(vget_low_u16(x)));
+}
+
+static inline float32x4_t neon_load_s16le(const uint8_t *in)
+{
+	return vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_u8(vld1_u8(in))));
+}
+
+static inline float32x4_t neon_load_u16le(const uint8_t *in)
+{
+	return vcvtq_f32_u32(vmovl_u16(vreinterpret_u16_u8(vld1_u8(in))));
+}
+
+static inline float32x4_t neon_load_s16be(const uint8_t *in)
+{
+	return vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_u8(
+			vrev16_u8(vld1_u8(in)))));
+}
+
+static inline float32x4_t neon_load_u16be(const uint8_t *in)
+{
+	return vcvtq_f32_u32(vmovl_u16(vreinterpret_u16_u8(
+			vrev16_u8(vld1_u8(in)))));
+}
+
+static inline float32x4_t neon_load_s32le(const uint8_t *in)
+{
+	return vcvtq_f32_s32(vreinterpretq_s32_u8(vld1q_u8(in)));
+}
+
+static inline float32x4_t neon_load_u32le(const uint8_t *in)
+{
+	return vcvtq_f32_u32(vreinterpretq_u32_u8(vld1q_u8(in)));
+}
+
+static inline float32x4_t neon_load_s32be(const uint8_t *in)
+{
+	return vcvtq_f32_s32(vreinterpretq_s32_u8(vrev32q_u8(vld1q_u8(in))));
+}
+
+static inline float32x4_t neon_load_u32be(const uint8_t *in)
+{
+	return vcvtq_f32_u32(vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in))));
+}
+
+static inline float32x4_t neon_load_f32le(const uint8_t *in)
+{
+	return vreinterpretq_f32_u8(vld1q_u8(in));
+}
+
+static inline float32x4_t neon_load_f32be(const uint8_t *in)
+{
+	return vreinterpretq_f32_u8(vrev32q_u8(vld1q_u8(in)));
+}
+
+#define NEON_KERNEL(name, size) \
+	VECTOR_KERNEL(neon, , name, size, 4, float32x4_t, vdupq_n_f32, \
+		vmulq_f32, vaddq_f32, vst1q_f32)
+
+NEON_KERNEL(s8, 1)
+NEON_KERNEL(u8, 1)
+NEON_KERNEL(s16le, 2)
+NEON_KERNEL(u16le, 2)
+NEON_KERNEL(s16be, 2)
+NEON_KERNEL(u16be, 2)
+NEON_KERNEL(s32le, 4)
+NEON_KERNEL(u32le, 4)
+NEON_KERNEL(s32be, 4)
+NEON_KERNEL(u32be, 4)
+NEON_KERNEL(f32le, 4)
+NEON_KERNEL(f32be, 4)
+
+static const analog_convert_func convert_neon[ANALOG_NUM_FORMATS] = {
+	convert_s8_neon, convert_u8_neon,
+	convert_s16le_neon, convert_u16le_neon,
+	convert_s16be_neon, convert_u16be_neon,
+	convert_s32le_neon, convert_u32le_neon,
+	convert_s32be_neon, convert_u32be_neon,
+	convert_f32le_neon, convert_f32be_neon,
+};
+#endif
+
+static const analog_convert_func *analog_convert_funcs(void)
+{
+	static const analog_convert_func *funcs;
+	static gsize init = 0;
+	const analog_convert_func *best;
+	const char *name;
+
+	if (g_once_init_enter(&init)) {
+		best = convert_c;
+		name = "generic C";
+#ifdef HAVE_ANALOG_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			best = convert_avx2;
+			name = "AVX2";
+		} else if (__builtin_cpu_supports("sse2")) {
+			best = convert_sse2;
+			name = "SSE2";
+		}
+#endif
+#ifdef HAVE_ANALOG_NEON
+		best = convert_neon;
+		name = "NEON";
+#endif
+		sr_dbg("Using %s analog-to-float conversion.", name);
+		funcs = best;
+		g_once_init_leave(&init, 1);
+	}
+
+	return funcs;
+}
+
+static int analog_format_get(const struct sr_analog_encoding *encoding)
+{
+	gboolean be, is_signed;
+
+	be = encoding->is_bigendian;
+	is_signed = encoding->is_signed;
+
+	if (encoding->is_float) {
+		if (encoding->unitsize != sizeof(float))
+			return -1;
+		return be ? ANALOG_F32BE : ANALOG_F32LE;
+	}
+
+	switch (encoding->unitsize) {
+	case 1:
+		return is_signed ? ANALOG_S8 : ANALOG_U8;
+	case 2:
+		if (be)
+			return is_signed ? ANALOG_S16BE : ANALOG_U16BE;
+		return is_signed ? ANALOG_S16LE : ANALOG_U16LE;
+	case 4:
+		if (be)
+			return is_signed ? ANALOG_S32BE : ANALOG_U32BE;
+		return is_signed ? ANALOG_S32LE : ANALOG_U32LE;
+	default:
+		return -1;
+	}
+}
+
 /**
  * Convert an analog datafeed payload to an array of floats.
  *
@@ -174,9 +698,7 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *outbuf)
 {
-	float offset;
-	unsigned int b, i, count;
-	gboolean bigendian;
+	size_t count;
 
 	if (!analog || !(analog->data) || !(analog->meaning)
 			|| !(analog->encoding) || !outbuf)
@@ -184,113 +706,48 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 
 	count = analog->num_samples * g_slist_length(analog->meaning->channels);
 
+	return sr_analog_to_float_range(analog, 0, count, outbuf);
+}
+
+/**
+ * Convert part of an analog datafeed payload to floats.
+ *
+ * Converts count values, starting at value start of the payload, with the
+ * channels interleaved as they are in the payload. This lets a caller
+ * work through a large packet in blocks that stay in the cache.
+ *
+ * @private
+ */
+SR_PRIV int sr_analog_to_float_range(const struct sr_datafeed_analog *analog,
+		size_t start, size_t count, float *outbuf)
+{
+	const struct sr_analog_encoding *encoding;
+	const uint8_t *in;
+	float scale, offset;
+	int format;
+
+	encoding = analog->encoding;
+	if ((format = analog_format_get(encoding)) < 0) {
+		sr_err("Unsupported unit size '%d' for analog-to-float"
+		       " conversion.", encoding->unitsize);
+		return SR_ERR;
+	}
+
+	scale = encoding->scale.p / (float)encoding->scale.q;
+	offset = encoding->offset.p / (float)encoding->offset.q;
+	in = (const uint8_t *)analog->data + start * encoding->unitsize;
+
 #ifdef WORDS_BIGENDIAN
-	bigendian = TRUE;
+	if (format == ANALOG_F32BE && scale == 1 && offset == 0) {
 #else
-	bigendian = FALSE;
+	if (format == ANALOG_F32LE && scale == 1 && offset == 0) {
 #endif
-
-	if (!analog->encoding->is_float) {
-		float offset = analog->encoding->offset.p / (float)analog->encoding->offset.q;
-		float scale = analog->encoding->scale.p / (float)analog->encoding->scale.q;
-		gboolean is_signed = analog->encoding->is_signed;
-		gboolean is_bigendian = analog->encoding->is_bigendian;
-		int8_t *data8 = (int8_t *)(analog->data);
-		int16_t *data16 = (int16_t *)(analog->data);
-		int32_t *data32 = (int32_t *)(analog->data);
-
-		switch (analog->encoding->unitsize) {
-		case 1:
-			if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * data8[i];
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * R8(data8 + i);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		case 2:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16S(&data16[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL16(&data16[i]);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		case 4:
-			if (is_signed && is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_bigendian) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RB32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else if (is_signed) {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32S(&data32[i]);
-					outbuf[i] += offset;
-				}
-			} else {
-				for (unsigned int i = 0; i < count; i++) {
-					outbuf[i] = scale * RL32(&data32[i]);
-					outbuf[i] += offset;
-				}
-			}
-			break;
-		default:
-			sr_err("Unsupported unit size '%d' for analog-to-float"
-			       " conversion.", analog->encoding->unitsize);
-			return SR_ERR;
-		}
+		/* The data is already in the right format. */
+		memcpy(outbuf, in, count * sizeof(float));
 		return SR_OK;
 	}
 
-	if (analog->encoding->unitsize == sizeof(float)
-			&& analog->encoding->is_bigendian == bigendian
-			&& analog->encoding->scale.p == 1
-			&& analog->encoding->scale.q == 1
-			&& analog->encoding->offset.p / (float)analog->encoding->offset.q == 0) {
-		/* The data is already in the right format. */
-		memcpy(outbuf, analog->data, count * sizeof(float));
-	} else {
-		for (i = 0; i < count; i += analog->encoding->unitsize) {
-			for (b = 0; b < analog->encoding->unitsize; b++) {
-				if (analog->encoding->is_bigendian == bigendian)
-					((uint8_t *)outbuf)[i + b] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-				else
-					((uint8_t *)outbuf)[i + (analog->encoding->unitsize - b)] =
-						((uint8_t *)analog->data)[i * analog->encoding->unitsize + b];
-			}
-			if (analog->encoding->scale.p != 1
-					|| analog->encoding->scale.q != 1)
-				outbuf[i] = (outbuf[i] * analog->encoding->scale.p) / analog->encoding->scale.q;
-			offset = ((float)analog->encoding->offset.p / (float)analog->encoding->offset.q);
-			outbuf[i] += offset;
-		}
-	}
+	analog_convert_funcs()[format](in, outbuf, count, scale, offset);
 
 	return SR_OK;
 }
@@ -573,6 +573,7 @@ SR_API int sr_init(struct sr_context **ctx)
 		ret = SR_ERR;
 		goto done;
 	}
+	sr_usb_trace_init();
 #endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
@@ -611,6 +612,7 @@ SR_API int sr_exit(struct sr_context *ctx)
 #endif
 
 #ifdef HAVE_LIBUSB_1_0
+	sr_usb_trace_exit();
 	libusb_exit(ctx->libusb_ctx);
 #endif
 
@@ -23,14 +23,585 @@
  * Conversion helper functions.
  */
 
+#include <config.h>
+#include <math.h>
+#include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+#define A2L_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(WORDS_BIGENDIAN)
+#define A2L_NEON
+#include <arm_neon.h>
+#endif
+
 #define LOG_PREFIX "conv"
 
+/*
+ * The conversions below never convert samples to float. A comparison of
+ * the scaled sample value against a threshold is turned into a comparison
+ * of the raw sample against a limit in the sample's own encoding, which
+ * the kernels then evaluate for up to 64 samples at a time, yielding one
+ * bit per sample. Integer samples are always compared as "raw > limit",
+ * possibly with the result inverted, float samples with the requested
+ * operator (which keeps comparisons against NaN false).
+ */
+
+enum a2l_op {
+	A2L_GE,
+	A2L_GT,
+	A2L_LT,
+	A2L_LE,
+};
+
+struct a2l_cmp;
+
+typedef uint64_t (*a2l_kernel)(const uint8_t *in, unsigned int n,
+		const struct a2l_cmp *cmp);
+
+struct a2l_cmp {
+	/* NULL if the result is the same for all samples. */
+	a2l_kernel kernel;
+	int64_t limit;
+	float flimit;
+	enum a2l_op op;
+	/* XORed into the kernel result, ~0 to invert it. */
+	uint64_t invert;
+};
+
+static inline gboolean a2l_fcmp(float v, float t, enum a2l_op op)
+{
+	switch (op) {
+	case A2L_GE:
+		return v >= t;
+	case A2L_GT:
+		return v > t;
+	case A2L_LT:
+		return v < t;
+	default:
+		return v <= t;
+	}
+}
+
+#if defined(A2L_SSE2)
+
+static inline __m128i a2l_bswap16(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static inline __m128i a2l_bswap32(__m128i x)
+{
+	x = a2l_bswap16(x);
+
+	return _mm_or_si128(_mm_slli_epi32(x, 16), _mm_srli_epi32(x, 16));
+}
+
+/*
+ * SSE2 only has signed integer compares. Unsigned samples and limits
+ * get their sign bit flipped, which maps them onto the signed range
+ * with the order preserved.
+ */
+static inline unsigned int a2l_simd_8(const uint8_t *in, int64_t limit,
+		gboolean is_signed)
+{
+	__m128i x, t;
+
+	x = _mm_loadu_si128((const __m128i *)in);
+	if (!is_signed) {
+		x = _mm_xor_si128(x, _mm_set1_epi8(-0x80));
+		limit -= 0x80;
+	}
+	t = _mm_set1_epi8(limit);
+
+	return _mm_movemask_epi8(_mm_cmpgt_epi8(x, t));
+}
+
+static inline __m128i a2l_load_16(const uint8_t *in, gboolean is_signed,
+		gboolean swap)
+{
+	__m128i x;
+
+	x = _mm_loadu_si128((const __m128i *)in);
+	if (swap)
+		x = a2l_bswap16(x);
+	if (!is_signed)
+		x = _mm_xor_si128(x, _mm_set1_epi16(-0x8000));
+
+	return x;
+}
+
+static inline unsigned int a2l_simd_16(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	__m128i a, b, t;
+
+	a = a2l_load_16(in, is_signed, swap);
+	b = a2l_load_16(in + 16, is_signed, swap);
+	t = _mm_set1_epi16(is_signed ? limit : limit - 0x8000);
+
+	return _mm_movemask_epi8(_mm_packs_epi16(
+			_mm_cmpgt_epi16(a, t), _mm_cmpgt_epi16(b, t)));
+}
+
+static inline __m128i a2l_gt_32(const uint8_t *in, __m128i t,
+		gboolean is_signed, gboolean swap)
+{
+	__m128i x;
+
+	x = _mm_loadu_si128((const __m128i *)in);
+	if (swap)
+		x = a2l_bswap32(x);
+	if (!is_signed)
+		x = _mm_xor_si128(x, _mm_set1_epi32(INT32_MIN));
+
+	return _mm_cmpgt_epi32(x, t);
+}
+
+/* Four vectors of 32 bit masks, packed down to one 16 bit movemask. */
+static inline unsigned int a2l_movemask_32(__m128i a, __m128i b,
+		__m128i c, __m128i d)
+{
+	return _mm_movemask_epi8(_mm_packs_epi16(
+			_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+}
+
+static inline unsigned int a2l_simd_32(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	__m128i t;
+
+	t = _mm_set1_epi32(is_signed ? limit : limit + INT32_MIN);
+
+	return a2l_movemask_32(a2l_gt_32(in, t, is_signed, swap),
+			a2l_gt_32(in + 16, t, is_signed, swap),
+			a2l_gt_32(in + 32, t, is_signed, swap),
+			a2l_gt_32(in + 48, t, is_signed, swap));
+}
+
+static inline __m128i a2l_cmp_f32(const uint8_t *in, __m128 t,
+		enum a2l_op op, gboolean swap)
+{
+	__m128 x;
+
+	if (swap)
+		x = _mm_castsi128_ps(a2l_bswap32(
+				_mm_loadu_si128((const __m128i *)in)));
+	else
+		x = _mm_loadu_ps((const float *)in);
+
+	switch (op) {
+	case A2L_GE:
+		return _mm_castps_si128(_mm_cmpge_ps(x, t));
+	case A2L_GT:
+		return _mm_castps_si128(_mm_cmpgt_ps(x, t));
+	case A2L_LT:
+		return _mm_castps_si128(_mm_cmplt_ps(x, t));
+	default:
+		return _mm_castps_si128(_mm_cmple_ps(x, t));
+	}
+}
+
+static inline unsigned int a2l_simd_f32(const uint8_t *in, float limit,
+		enum a2l_op op, gboolean swap)
+{
+	__m128 t;
+
+	t = _mm_set1_ps(limit);
+
+	return a2l_movemask_32(a2l_cmp_f32(in, t, op, swap),
+			a2l_cmp_f32(in + 16, t, op, swap),
+			a2l_cmp_f32(in + 32, t, op, swap),
+			a2l_cmp_f32(in + 48, t, op, swap));
+}
+
+#elif defined(A2L_NEON)
+
+/* NEON has no movemask, add up the lanes' bit weights instead. */
+static inline unsigned int a2l_movemask(uint8x16_t m)
+{
+	static const uint8_t weights[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	uint8x16_t x;
+	uint8x8_t p;
+
+	x = vandq_u8(m, vld1q_u8(weights));
+	p = vpadd_u8(vget_low_u8(x), vget_high_u8(x));
+	p = vpadd_u8(p, p);
+	p = vpadd_u8(p, p);
+
+	return vget_lane_u8(p, 0) | (vget_lane_u8(p, 1) << 8);
+}
+
+static inline unsigned int a2l_simd_8(const uint8_t *in, int64_t limit,
+		gboolean is_signed)
+{
+	uint8x16_t x;
+
+	x = vld1q_u8(in);
+	if (is_signed)
+		return a2l_movemask(vcgtq_s8(vreinterpretq_s8_u8(x),
+				vdupq_n_s8(limit)));
+
+	return a2l_movemask(vcgtq_u8(x, vdupq_n_u8(limit)));
+}
+
+static inline uint8x8_t a2l_gt_16(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	uint8x16_t x;
+
+	x = vld1q_u8(in);
+	if (swap)
+		x = vrev16q_u8(x);
+	if (is_signed)
+		return vmovn_u16(vcgtq_s16(vreinterpretq_s16_u8(x),
+				vdupq_n_s16(limit)));
+
+	return vmovn_u16(vcgtq_u16(vreinterpretq_u16_u8(x),
+			vdupq_n_u16(limit)));
+}
+
+static inline unsigned int a2l_simd_16(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	return a2l_movemask(vcombine_u8(a2l_gt_16(in, limit, is_signed, swap),
+			a2l_gt_16(in + 16, limit, is_signed, swap)));
+}
+
+static inline uint16x4_t a2l_gt_32(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	uint8x16_t x;
+
+	x = vld1q_u8(in);
+	if (swap)
+		x = vrev32q_u8(x);
+	if (is_signed)
+		return vmovn_u32(vcgtq_s32(vreinterpretq_s32_u8(x),
+				vdupq_n_s32(limit)));
+
+	return vmovn_u32(vcgtq_u32(vreinterpretq_u32_u8(x),
+			vdupq_n_u32(limit)));
+}
+
+static inline uint16x4_t a2l_cmp_f32(const uint8_t *in, float limit,
+		enum a2l_op op, gboolean swap)
+{
+	uint8x16_t x;
+	float32x4_t v, t;
+
+	x = vld1q_u8(in);
+	if (swap)
+		x = vrev32q_u8(x);
+	v = vreinterpretq_f32_u8(x);
+	t = vdupq_n_f32(limit);
+
+	switch (op) {
+	case A2L_GE:
+		return vmovn_u32(vcgeq_f32(v, t));
+	case A2L_GT:
+		return vmovn_u32(vcgtq_f32(v, t));
+	case A2L_LT:
+		return vmovn_u32(vcltq_f32(v, t));
+	default:
+		return vmovn_u32(vcleq_f32(v, t));
+	}
+}
+
+/* Four vectors of 32 bit masks, narrowed down to one 16 bit movemask. */
+static inline unsigned int a2l_movemask_32(uint16x4_t a, uint16x4_t b,
+		uint16x4_t c, uint16x4_t d)
+{
+	return a2l_movemask(vcombine_u8(vmovn_u16(vcombine_u16(a, b)),
+			vmovn_u16(vcombine_u16(c, d))));
+}
+
+static inline unsigned int a2l_simd_32(const uint8_t *in, int64_t limit,
+		gboolean is_signed, gboolean swap)
+{
+	return a2l_movemask_32(a2l_gt_32(in, limit, is_signed, swap),
+			a2l_gt_32(in + 16, limit, is_signed, swap),
+			a2l_gt_32(in + 32, limit, is_signed, swap),
+			a2l_gt_32(in + 48, limit, is_signed, swap));
+}
+
+static inline unsigned int a2l_simd_f32(const uint8_t *in, float limit,
+		enum a2l_op op, gboolean swap)
+{
+	return a2l_movemask_32(a2l_cmp_f32(in, limit, op, swap),
+			a2l_cmp_f32(in + 16, limit, op, swap),
+			a2l_cmp_f32(in + 32, limit, op, swap),
+			a2l_cmp_f32(in + 48, limit, op, swap));
+}
+
+#endif
+
+/* Runs the vector kernel over as many blocks of 16 samples as possible. */
+#if defined(A2L_SSE2) || defined(A2L_NEON)
+#define A2L_SIMD_LOOP(size, simd) \
+	for (; i + 16 <= n; i += 16, in += 16 * (size)) \
+		bits |= (uint64_t)(simd) << i;
+#else
+#define A2L_SIMD_LOOP(size, simd)
+#endif
+
+#define A2L_INT_KERNEL(name, size, read, simd) \
+static uint64_t a2l_##name(const uint8_t *in, unsigned int n, \
+		const struct a2l_cmp *cmp) \
+{ \
+	uint64_t bits; \
+	unsigned int i; \
+\
+	bits = 0; \
+	i = 0; \
+	A2L_SIMD_LOOP(size, simd) \
+	for (; i < n; i++, in += size) \
+		if ((int64_t)read(in) > cmp->limit) \
+			bits |= UINT64_C(1) << i; \
+\
+	return bits; \
+}
+
+#define A2L_FLOAT_KERNEL(name, read, swap) \
+static uint64_t a2l_##name(const uint8_t *in, unsigned int n, \
+		const struct a2l_cmp *cmp) \
+{ \
+	uint64_t bits; \
+	unsigned int i; \
+\
+	bits = 0; \
+	i = 0; \
+	A2L_SIMD_LOOP(4, a2l_simd_f32(in, cmp->flimit, cmp->op, swap)) \
+	for (; i < n; i++, in += 4) \
+		if (a2l_fcmp(read(in), cmp->flimit, cmp->op)) \
+			bits |= UINT64_C(1) << i; \
+\
+	return bits; \
+}
+
+#define RS8(x) ((int8_t)R8(x))
+
+A2L_INT_KERNEL(s8, 1, RS8, a2l_simd_8(in, cmp->limit, TRUE))
+A2L_INT_KERNEL(u8, 1, R8, a2l_simd_8(in, cmp->limit, FALSE))
+A2L_INT_KERNEL(s16le, 2, RL16S, a2l_simd_16(in, cmp->limit, TRUE, FALSE))
+A2L_INT_KERNEL(u16le, 2, RL16, a2l_simd_16(in, cmp->limit, FALSE, FALSE))
+A2L_INT_KERNEL(s16be, 2, RB16S, a2l_simd_16(in, cmp->limit, TRUE, TRUE))
+A2L_INT_KERNEL(u16be, 2, RB16, a2l_simd_16(in, cmp->limit, FALSE, TRUE))
+A2L_INT_KERNEL(s32le, 4, RL32S, a2l_simd_32(in, cmp->limit, TRUE, FALSE))
+A2L_INT_KERNEL(u32le, 4, RL32, a2l_simd_32(in, cmp->limit, FALSE, FALSE))
+A2L_INT_KERNEL(s32be, 4, RB32S, a2l_simd_32(in, cmp->limit, TRUE, TRUE))
+A2L_INT_KERNEL(u32be, 4, RB32, a2l_simd_32(in, cmp->limit, FALSE, TRUE))
+A2L_FLOAT_KERNEL(f32le, RLFL, FALSE)
+A2L_FLOAT_KERNEL(f32be, RBFL, TRUE)
+
+static a2l_kernel a2l_kernel_get(const struct sr_analog_encoding *encoding)
+{
+	static const a2l_kernel kernels[3][2][2] = {
+		/* [unitsize / 2][is_bigendian][is_signed] */
+		{ { a2l_u8, a2l_s8 }, { a2l_u8, a2l_s8 } },
+		{ { a2l_u16le, a2l_s16le }, { a2l_u16be, a2l_s16be } },
+		{ { a2l_u32le, a2l_s32le }, { a2l_u32be, a2l_s32be } },
+	};
+	gboolean be, is_signed;
+
+	be = encoding->is_bigendian != 0;
+	is_signed = encoding->is_signed != 0;
+
+	if (encoding->is_float)
+		return encoding->unitsize == 4 ? (be ? a2l_f32be : a2l_f32le) : NULL;
+	if (encoding->unitsize != 1 && encoding->unitsize != 2
+			&& encoding->unitsize != 4)
+		return NULL;
+
+	return kernels[encoding->unitsize / 2][be][is_signed];
+}
+
+/*
+ * Set up the evaluation of "sample * scale + offset <op> threshold" for
+ * the given encoding.
+ */
+static int a2l_cmp_init(struct a2l_cmp *cmp,
+		const struct sr_analog_encoding *encoding,
+		float threshold, enum a2l_op op)
+{
+	static const enum a2l_op flipped[] = {
+		[A2L_GE] = A2L_LE, [A2L_GT] = A2L_LT,
+		[A2L_LT] = A2L_GT, [A2L_LE] = A2L_GE,
+	};
+	double scale, offset, x, limit, min, max;
+	int bits;
+
+	memset(cmp, 0, sizeof(*cmp));
+	if (!(cmp->kernel = a2l_kernel_get(encoding))) {
+		sr_err("Unsupported unit size '%d' for analog-to-logic"
+		       " conversion.", encoding->unitsize);
+		return SR_ERR;
+	}
+
+	scale = encoding->scale.p / (double)encoding->scale.q;
+	offset = encoding->offset.p / (double)encoding->offset.q;
+	if (scale == 0 || isnan(threshold)) {
+		cmp->kernel = NULL;
+		cmp->invert = a2l_fcmp(offset, threshold, op) ? ~UINT64_C(0) : 0;
+		return SR_OK;
+	}
+	x = (threshold - offset) / scale;
+
+	if (encoding->is_float) {
+		cmp->flimit = x;
+		cmp->op = scale < 0 ? flipped[op] : op;
+		return SR_OK;
+	}
+
+	/* Only "greater than" remains, with the result maybe inverted. */
+	if (op == A2L_LT || op == A2L_LE) {
+		op = op == A2L_LT ? A2L_GE : A2L_GT;
+		cmp->invert = ~cmp->invert;
+	}
+	if ((op == A2L_GE) == (scale > 0))
+		limit = ceil(x) - 1;
+	else
+		limit = floor(x);
+	if (scale < 0)
+		cmp->invert = ~cmp->invert;
+
+	/* A limit outside of the sample range gives a constant result. */
+	bits = 8 * encoding->unitsize;
+	min = encoding->is_signed ? -ldexp(1, bits - 1) : 0;
+	max = ldexp(1, bits - encoding->is_signed) - 1;
+	if (limit < min) {
+		cmp->kernel = NULL;
+		cmp->invert = ~cmp->invert;
+	} else if (limit >= max) {
+		cmp->kernel = NULL;
+	} else {
+		cmp->limit = limit;
+	}
+
+	return SR_OK;
+}
+
+static inline uint64_t a2l_cmp_run(const struct a2l_cmp *cmp,
+		const uint8_t *in, unsigned int n)
+{
+	uint64_t bits;
+
+	bits = cmp->kernel ? cmp->kernel(in, n, cmp) : 0;
+
+	return bits ^ cmp->invert;
+}
+
+/*
+ * The Schmitt trigger output for a block of 64 samples: every sample is
+ * 1 if the last event (going low or high) up to and including it was
+ * going high, or if there was no event so far and the state was 1. The
+ * addition propagates every high event through the run of event-less
+ * samples following it as a carry, and the state enters as carry-in.
+ */
+static inline uint64_t a2l_schmitt(uint64_t low, uint64_t high,
+		uint8_t *state, unsigned int n)
+{
+	uint64_t set, quiet, carry, out;
+
+	set = high & ~low;
+	quiet = ~(set | low);
+	carry = (set | quiet) ^ set ^ ((set | quiet) + set + (*state != 0));
+	out = set | (quiet & carry);
+	*state = (out >> (n - 1)) & 1;
+
+	return out;
+}
+
+/*
+ * Store one bit per sample into the given bit of unitsize-sized logic
+ * samples. With 'exclusive', write whole bytes instead (unitsize 1).
+ */
+static inline void a2l_store(uint8_t *out, uint64_t bits, unsigned int n,
+		unsigned int unitsize, unsigned int bit, gboolean exclusive)
+{
+	unsigned int i;
+	uint8_t mask;
+
+	if (exclusive) {
+		for (i = 0; i < n; i++)
+			out[i] = (bits >> i) & 1;
+		return;
+	}
+
+	out += bit / 8;
+	mask = 1 << (bit % 8);
+	for (i = 0; i < n; i++, out += unitsize)
+		*out = (*out & ~mask) | (-(uint8_t)((bits >> i) & 1) & mask);
+}
+
+static int a2l_threshold(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, unsigned int unitsize,
+		unsigned int bit, gboolean exclusive, uint64_t count)
+{
+	struct a2l_cmp high;
+	const uint8_t *in;
+	uint64_t i;
+	unsigned int n;
+	int ret;
+
+	if ((ret = a2l_cmp_init(&high, analog->encoding, threshold,
+			A2L_GE)) != SR_OK)
+		return ret;
+
+	in = analog->data;
+	for (i = 0; i < count; i += n) {
+		n = MIN(count - i, 64);
+		a2l_store(output + i * unitsize, a2l_cmp_run(&high, in, n),
+			n, unitsize, bit, exclusive);
+		in += n * analog->encoding->unitsize;
+	}
+
+	return SR_OK;
+}
+
+static int a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		unsigned int unitsize, unsigned int bit, gboolean exclusive,
+		uint64_t count)
+{
+	struct a2l_cmp low, high;
+	const uint8_t *in;
+	uint64_t i, bits;
+	unsigned int n;
+	int ret;
+
+	if ((ret = a2l_cmp_init(&low, analog->encoding, lo_thr,
+			A2L_LT)) != SR_OK)
+		return ret;
+	if ((ret = a2l_cmp_init(&high, analog->encoding, hi_thr,
+			A2L_GT)) != SR_OK)
+		return ret;
+
+	in = analog->data;
+	for (i = 0; i < count; i += n) {
+		n = MIN(count - i, 64);
+		bits = a2l_schmitt(a2l_cmp_run(&low, in, n),
+			a2l_cmp_run(&high, in, n), state, n);
+		a2l_store(output + i * unitsize, bits, n, unitsize, bit,
+			exclusive);
+		in += n * analog->encoding->unitsize;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Convert analog values to logic values by using a fixed threshold.
  *
+ * The threshold applies to the sample values after the encoding's scale
+ * and offset, as returned by sr_analog_to_float(). This holds for float
+ * samples too since 0.6.0; before, float samples were compared as they
+ * were, in host byte order, ignoring the scale and offset.
+ *
  * @param[in] analog The analog input values.
  * @param[in] threshold The threshold to use.
  * @param[out] output The converted output values; either 0 or 1. Must provide
@@ -42,29 +613,18 @@
 SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 		float threshold, uint8_t *output, uint64_t count)
 {
-	float *input;
-
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
-		if (!input)
-			return SR_ERR;
-
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+	if (!analog || !analog->encoding || !analog->data || !output)
+		return SR_ERR_ARG;
 
-	for (uint64_t i = 0; i < count; i++)
-		output[i] = (input[i] >= threshold) ? 1 : 0;
-
-	if (!analog->encoding->is_float)
-		g_free(input);
-
-	return SR_OK;
+	return a2l_threshold(analog, threshold, output, 1, 0, TRUE, count);
 }
 
 /**
  * Convert analog values to logic values by using a Schmitt-trigger algorithm.
  *
+ * Like for sr_a2l_threshold(), the thresholds apply to the sample values
+ * after the encoding's scale and offset, for float samples too since 0.6.0.
+ *
  * @param analog The analog input values.
  * @param lo_thr The low threshold - result becomes 0 below it.
  * @param lo_thr The high threshold - result becomes 1 above it.
@@ -80,28 +640,174 @@ SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count)
 {
-	float *input;
+	if (!analog || !analog->encoding || !analog->data || !state || !output)
+		return SR_ERR_ARG;
+
+	return a2l_schmitt_trigger(analog, lo_thr, hi_thr, state, output,
+			1, 0, TRUE, count);
+}
+
+/**
+ * Convert analog values to one channel of a logic payload by using a
+ * fixed threshold.
+ *
+ * The analog samples are compared in their own encoding, without
+ * converting them to float first, and without allocating memory. Only the
+ * given bit of every logic sample is changed, so several analog channels
+ * can be converted into one logic payload. As for sr_a2l_threshold(), the
+ * threshold applies to the values after the encoding's scale and offset.
+ *
+ * @param[in] analog The analog input values.
+ * @param[in] threshold The threshold to use.
+ * @param[in,out] logic The logic payload to store the result in. Only as
+ *                      many samples as both it and the analog payload
+ *                      hold are processed, the rest is left alone.
+ * @param[in] bit The bit (logic channel) to store the result in.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported analog encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_threshold_logic(const struct sr_datafeed_analog *analog,
+		float threshold, struct sr_datafeed_logic *logic,
+		unsigned int bit)
+{
+	if (!analog || !analog->encoding || !analog->data)
+		return SR_ERR_ARG;
+	if (!logic || !logic->data || !logic->unitsize
+			|| bit >= 8 * logic->unitsize)
+		return SR_ERR_ARG;
+
+	return a2l_threshold(analog, threshold, logic->data, logic->unitsize,
+			bit, FALSE, MIN(logic->length / logic->unitsize,
+			analog->num_samples));
+}
+
+/**
+ * Convert analog values to one channel of a logic payload by using a
+ * Schmitt-trigger algorithm.
+ *
+ * Like sr_a2l_threshold_logic(), this works on the analog samples in their
+ * own encoding and only changes the given bit of every logic sample.
+ *
+ * @param[in] analog The analog input values.
+ * @param[in] lo_thr The low threshold - result becomes 0 below it.
+ * @param[in] hi_thr The high threshold - result becomes 1 above it.
+ * @param[in,out] state The internal converter state. Must contain the state
+ *                      of the sample before the first one, will contain
+ *                      the state of the last sample upon exit.
+ * @param[in,out] logic The logic payload to store the result in. Only as
+ *                      many samples as both it and the analog payload
+ *                      hold are processed, the rest is left alone.
+ * @param[in] bit The bit (logic channel) to store the result in.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported analog encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_schmitt_trigger_logic(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state,
+		struct sr_datafeed_logic *logic, unsigned int bit)
+{
+	if (!analog || !analog->encoding || !analog->data || !state)
+		return SR_ERR_ARG;
+	if (!logic || !logic->data || !logic->unitsize
+			|| bit >= 8 * logic->unitsize)
+		return SR_ERR_ARG;
+
+	return a2l_schmitt_trigger(analog, lo_thr, hi_thr, state, logic->data,
+			logic->unitsize, bit, FALSE, MIN(logic->length
+			/ logic->unitsize, analog->num_samples));
+}
+
+/**
+ * Count the samples in a run-length encoded logic payload.
+ *
+ * @param[in] rle The run-length encoded logic payload.
+ *
+ * @return The number of samples, 0 if @a rle is NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_logic_rle_num_samples(
+		const struct sr_datafeed_logic_rle *rle)
+{
+	uint64_t i, count;
+
+	if (!rle)
+		return 0;
 
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
-		if (!input)
-			return SR_ERR;
+	count = 0;
+	for (i = 0; i < rle->num_runs; i++)
+		count += rle->lengths[i];
 
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+	return count;
+}
 
-	for (uint64_t i = 0; i < count; i++) {
-		if (input[i] < lo_thr)
-			*state = 0;
-		else if (input[i] > hi_thr)
-			*state = 1;
+/* Fill count samples with the value, doubling the filled part. */
+static void rle_fill(uint8_t *buf, const uint8_t *value, uint16_t unitsize,
+		uint64_t count)
+{
+	size_t done, total;
 
-		output[i] = *state;
+	total = count * unitsize;
+	if (!total)
+		return;
+	if (unitsize == 1) {
+		memset(buf, *value, total);
+		return;
 	}
+	memcpy(buf, value, unitsize);
+	for (done = unitsize; done < total; done *= 2)
+		memcpy(buf + done, buf, MIN(done, total - done));
+}
+
+/**
+ * Expand run-length encoded logic samples.
+ *
+ * Expands the samples from @a pos on into @a buf, and advances @a pos
+ * past them. Large payloads can so be expanded in pieces of a fixed
+ * size. Start with a zeroed position.
+ *
+ * @param[in] rle The run-length encoded logic payload.
+ * @param[in,out] pos The position of the first sample to expand.
+ * @param[out] buf The output buffer, with room for at least @a max_samples
+ *                 samples of rle->unitsize bytes.
+ * @param[in] max_samples The maximum number of samples to expand.
+ *
+ * @return The number of samples written to @a buf, 0 once all samples
+ *         were expanded or upon invalid arguments.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_logic_rle_expand(const struct sr_datafeed_logic_rle *rle,
+		struct sr_logic_rle_pos *pos, void *buf, uint64_t max_samples)
+{
+	const uint8_t *values;
+	uint8_t *out;
+	uint64_t count, n;
 
-	if (!analog->encoding->is_float)
-		g_free(input);
+	if (!rle || !pos || !buf || !rle->unitsize)
+		return 0;
 
-	return SR_OK;
+	values = rle->data;
+	out = buf;
+	count = 0;
+	while (count < max_samples && pos->run < rle->num_runs) {
+		n = MIN(rle->lengths[pos->run] - pos->offset, max_samples - count);
+		rle_fill(out + count * rle->unitsize,
+			values + pos->run * rle->unitsize, rle->unitsize, n);
+		count += n;
+		pos->offset += n;
+		if (pos->offset >= rle->lengths[pos->run]) {
+			pos->run++;
+			pos->offset = 0;
+		}
+	}
+
+	return count;
 }
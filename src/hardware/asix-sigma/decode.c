@@ -0,0 +1,142 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Decoding of the sample memory ("DRAM") content. This has no device
+ * access, so that it can be tested without hardware.
+ */
+
+#include <config.h>
+#include "protocol.h"
+
+/*
+ * Return the timestamp of "DRAM cluster".
+ */
+SR_PRIV uint16_t sigma_dram_cluster_ts(const struct sigma_dram_cluster *cluster)
+{
+	return (cluster->timestamp_hi << 8) | cluster->timestamp_lo;
+}
+
+/*
+ * Return one 16bit data entity of a DRAM cluster at the specified index.
+ */
+static uint16_t sigma_dram_cluster_data(const struct sigma_dram_cluster *cl,
+					int idx)
+{
+	return (cl->samples[idx].sample_lo << 8) | cl->samples[idx].sample_hi;
+}
+
+/*
+ * Deinterlace sample data that was retrieved at 100MHz samplerate.
+ * One 16bit item contains two samples of 8bits each. The bits of
+ * multiple samples are interleaved: the even bits are the first
+ * sample, the odd bits the second.
+ *
+ * This handles four items at once, one in each 16bit lane of the
+ * value. In each lane the first sample ends up in the low byte, the
+ * second sample in the high byte.
+ */
+SR_PRIV uint64_t sigma_deinterlace_100mhz_data(uint64_t indata)
+{
+	uint64_t t;
+
+	/* Unshuffle the bits of each lane, in three swap steps. */
+	t = (indata ^ (indata >> 1)) & 0x2222222222222222ULL;
+	indata ^= t ^ (t << 1);
+	t = (indata ^ (indata >> 2)) & 0x0c0c0c0c0c0c0c0cULL;
+	indata ^= t ^ (t << 2);
+	t = (indata ^ (indata >> 4)) & 0x00f000f000f000f0ULL;
+	indata ^= t ^ (t << 4);
+
+	return indata;
+}
+
+/*
+ * Deinterlace sample data that was retrieved at 200MHz samplerate.
+ * One 16bit item contains four samples of 4bits each. The bits of
+ * multiple samples are interleaved: bits 0, 4, 8 and 12 are the
+ * first sample, and so on.
+ *
+ * This handles four items at once, one in each 16bit lane of the
+ * value. In each lane sample n ends up in nibble n.
+ */
+SR_PRIV uint64_t sigma_deinterlace_200mhz_data(uint64_t indata)
+{
+	/* Unshuffling twice gathers every fourth bit. */
+	return sigma_deinterlace_100mhz_data(
+		sigma_deinterlace_100mhz_data(indata));
+}
+
+/*
+ * Decode the events of one DRAM cluster into 16bit samples.
+ *
+ * Returns the number of samples, which is events_in_cluster times the
+ * number of samples per event. The number of events between the end
+ * of the previous cluster and this one goes to gap; these repeat the
+ * last sample of the previous cluster.
+ */
+SR_PRIV size_t sigma_decode_cluster(struct sigma_state *ss,
+		const struct sigma_dram_cluster *cluster,
+		unsigned int events_in_cluster, int samples_per_event,
+		uint16_t *gap, uint8_t *samples)
+{
+	uint64_t lanes;
+	unsigned int i, j, k;
+	size_t count;
+	uint16_t ts;
+
+	ts = sigma_dram_cluster_ts(cluster);
+	*gap = ts - ss->lastts;
+	ss->lastts = ts + EVENTS_PER_CLUSTER;
+
+	count = 0;
+	for (i = 0; i < events_in_cluster; i += 4) {
+		/* Up to four events at a time, one per 16bit lane. */
+		lanes = 0;
+		k = MIN(4, events_in_cluster - i);
+		for (j = 0; j < k; j++)
+			lanes |= (uint64_t)sigma_dram_cluster_data(cluster,
+				i + j) << (16 * j);
+
+		switch (samples_per_event) {
+		case 4:
+			lanes = sigma_deinterlace_200mhz_data(lanes);
+			for (j = 0; j < 4 * k; j++, count++)
+				WL16(&samples[2 * count],
+					(lanes >> (4 * j)) & 0x0f);
+			break;
+		case 2:
+			lanes = sigma_deinterlace_100mhz_data(lanes);
+			for (j = 0; j < 2 * k; j++, count++)
+				WL16(&samples[2 * count],
+					(lanes >> (8 * j)) & 0xff);
+			break;
+		default:
+			for (j = 0; j < k; j++, count++)
+				WL16(&samples[2 * count],
+					(lanes >> (16 * j)) & 0xffff);
+			break;
+		}
+	}
+
+	if (count)
+		ss->lastsample = RL16(&samples[2 * (count - 1)]);
+
+	return count;
+}
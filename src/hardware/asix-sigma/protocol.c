@@ -706,74 +706,6 @@ static int get_trigger_offset(uint8_t *samples, uint16_t last_sample,
 	return i & 0x7;
 }
 
-/*
- * Return the timestamp of "DRAM cluster".
- */
-static uint16_t sigma_dram_cluster_ts(struct sigma_dram_cluster *cluster)
-{
-	return (cluster->timestamp_hi << 8) | cluster->timestamp_lo;
-}
-
-/*
- * Return one 16bit data entity of a DRAM cluster at the specified index.
- */
-static uint16_t sigma_dram_cluster_data(struct sigma_dram_cluster *cl, int idx)
-{
-	uint16_t sample;
-
-	sample = 0;
-	sample |= cl->samples[idx].sample_lo << 0;
-	sample |= cl->samples[idx].sample_hi << 8;
-	sample = (sample >> 8) | (sample << 8);
-	return sample;
-}
-
-/*
- * Deinterlace sample data that was retrieved at 100MHz samplerate.
- * One 16bit item contains two samples of 8bits each. The bits of
- * multiple samples are interleaved.
- */
-static uint16_t sigma_deinterlace_100mhz_data(uint16_t indata, int idx)
-{
-	uint16_t outdata;
-
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 2 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 2 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 2 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 2 - 3)) & (1 << 3);
-	outdata |= (indata >> (4 * 2 - 4)) & (1 << 4);
-	outdata |= (indata >> (5 * 2 - 5)) & (1 << 5);
-	outdata |= (indata >> (6 * 2 - 6)) & (1 << 6);
-	outdata |= (indata >> (7 * 2 - 7)) & (1 << 7);
-	return outdata;
-}
-
-/*
- * Deinterlace sample data that was retrieved at 200MHz samplerate.
- * One 16bit item contains four samples of 4bits each. The bits of
- * multiple samples are interleaved.
- */
-static uint16_t sigma_deinterlace_200mhz_data(uint16_t indata, int idx)
-{
-	uint16_t outdata;
-
-	indata >>= idx;
-	outdata = 0;
-	outdata |= (indata >> (0 * 4 - 0)) & (1 << 0);
-	outdata |= (indata >> (1 * 4 - 1)) & (1 << 1);
-	outdata |= (indata >> (2 * 4 - 2)) & (1 << 2);
-	outdata |= (indata >> (3 * 4 - 3)) & (1 << 3);
-	return outdata;
-}
-
-static void store_sr_sample(uint8_t *samples, int idx, uint16_t data)
-{
-	samples[2 * idx + 0] = (data >> 0) & 0xff;
-	samples[2 * idx + 1] = (data >> 8) & 0xff;
-}
-
 /*
  * Local wrapper around sr_session_send() calls. Make sure to not send
  * more samples to the session's datafeed than what was requested by a
@@ -803,11 +735,41 @@ static void sigma_session_send(struct sr_dev_inst *sdi,
 }
 
 /*
- * This size translates to: event count (1K events per cluster), times
- * the sample width (unitsize, 16bits per event), times the maximum
- * number of samples per event.
+ * Send a run of identical samples, as the hardware's RLE compressed
+ * them. Like sigma_session_send(), this respects the sample count limit.
+ */
+static void sigma_session_send_run(struct sr_dev_inst *sdi, uint16_t value,
+				   uint64_t length)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	uint8_t data[2];
+
+	devc = sdi->priv;
+	if (devc->limit_samples) {
+		length = MIN(length, devc->limit_samples - devc->sent_samples);
+		devc->sent_samples += length;
+	}
+	if (!length)
+		return;
+
+	WL16(data, value);
+	rle.num_runs = 1;
+	rle.unitsize = 2;
+	rle.data = data;
+	rle.lengths = &length;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	sr_session_send(sdi, &packet);
+}
+
+/*
+ * This size translates to: events in a cluster, times the sample width
+ * (unitsize, 16bits per event), times the maximum number of samples per
+ * event.
  */
-#define SAMPLES_BUFFER_SIZE	(1024 * 2 * 4)
+#define SAMPLES_BUFFER_SIZE	(EVENTS_PER_CLUSTER * 2 * 4)
 
 static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 				      unsigned int events_in_cluster,
@@ -818,74 +780,29 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 	struct sigma_state *ss = &devc->state;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	uint16_t tsdiff, ts, sample, item16;
+	uint16_t tsdiff, lastsample;
 	uint8_t samples[SAMPLES_BUFFER_SIZE];
 	uint8_t *send_ptr;
 	size_t send_count, trig_count;
-	unsigned int i;
-	int j;
 
-	ts = sigma_dram_cluster_ts(dram_cluster);
-	tsdiff = ts - ss->lastts;
-	ss->lastts = ts + EVENTS_PER_CLUSTER;
-
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = 2;
-	logic.data = samples;
+	lastsample = ss->lastsample;
+	send_count = sigma_decode_cluster(ss, dram_cluster, events_in_cluster,
+					  devc->samples_per_event, &tsdiff,
+					  samples);
 
 	/*
 	 * If this cluster is not adjacent to the previously received
-	 * cluster, then send the appropriate number of samples with the
-	 * previous values to the sigrok session. This "decodes RLE".
+	 * cluster, then the previous values lasted until this one. Send
+	 * them as a single run, this "decodes RLE" for the session.
 	 */
-	for (ts = 0; ts < tsdiff; ts++) {
-		i = ts % 1024;
-		store_sr_sample(samples, i, ss->lastsample);
+	if (tsdiff)
+		sigma_session_send_run(sdi, lastsample,
+				       (uint64_t)tsdiff * devc->samples_per_event);
 
-		/*
-		 * If we have 1024 samples ready or we're at the
-		 * end of submitting the padding samples, submit
-		 * the packet to Sigrok. Since constant data is
-		 * sent, duplication of data for rates above 50MHz
-		 * is simple.
-		 */
-		if ((i == 1023) || (ts == tsdiff - 1)) {
-			logic.length = (i + 1) * logic.unitsize;
-			for (j = 0; j < devc->samples_per_event; j++)
-				sigma_session_send(sdi, &packet);
-		}
-	}
-
-	/*
-	 * Parse the samples in current cluster and prepare them
-	 * to be submitted to Sigrok. Cope with memory layouts that
-	 * vary with the samplerate.
-	 */
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = 2;
 	send_ptr = &samples[0];
-	send_count = 0;
-	sample = 0;
-	for (i = 0; i < events_in_cluster; i++) {
-		item16 = sigma_dram_cluster_data(dram_cluster, i);
-		if (devc->cur_samplerate == SR_MHZ(200)) {
-			sample = sigma_deinterlace_200mhz_data(item16, 0);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 1);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 2);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_200mhz_data(item16, 3);
-			store_sr_sample(samples, send_count++, sample);
-		} else if (devc->cur_samplerate == SR_MHZ(100)) {
-			sample = sigma_deinterlace_100mhz_data(item16, 0);
-			store_sr_sample(samples, send_count++, sample);
-			sample = sigma_deinterlace_100mhz_data(item16, 1);
-			store_sr_sample(samples, send_count++, sample);
-		} else {
-			sample = item16;
-			store_sr_sample(samples, send_count++, sample);
-		}
-	}
 
 	/*
 	 * If a trigger position applies, then provide the datafeed with
@@ -901,12 +818,13 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 		 * samples to pinpoint the exact position of the trigger.
 		 */
 		trigger_offset = get_trigger_offset(samples,
-					ss->lastsample, &devc->trigger);
+					lastsample, &devc->trigger);
 
 		if (trigger_offset > 0) {
 			trig_count = trigger_offset * devc->samples_per_event;
-			packet.type = SR_DF_LOGIC;
+			trig_count = MIN(trig_count, send_count);
 			logic.length = trig_count * logic.unitsize;
+			logic.data = send_ptr;
 			sigma_session_send(sdi, &packet);
 			send_ptr += trig_count * logic.unitsize;
 			send_count -= trig_count;
@@ -916,6 +834,7 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 		if (devc->use_triggers) {
 			packet.type = SR_DF_TRIGGER;
 			sr_session_send(sdi, &packet);
+			packet.type = SR_DF_LOGIC;
 		}
 	}
 
@@ -924,13 +843,10 @@ static void sigma_decode_dram_cluster(struct sigma_dram_cluster *dram_cluster,
 	 * if no trigger position applies.
 	 */
 	if (send_count) {
-		packet.type = SR_DF_LOGIC;
 		logic.length = send_count * logic.unitsize;
 		logic.data = send_ptr;
 		sigma_session_send(sdi, &packet);
 	}
-
-	ss->lastsample = sample;
 }
 
 /*
@@ -992,43 +908,114 @@ static int decode_chunk_ts(struct sigma_dram_line *dram_line,
 	return SR_OK;
 }
 
-static int download_capture(struct sr_dev_inst *sdi)
+/*
+ * The DRAM download runs on a thread of its own, reading batches of
+ * lines into a ring of buffers while the session thread decodes the
+ * previous ones. Only the download thread talks to the device until
+ * all lines were read.
+ */
+static gpointer download_thread(gpointer data)
+{
+	struct sigma_download *dl;
+	uint32_t lines_done, lines_curr, slot;
+	gboolean failed;
+	int ret;
+
+	dl = data;
+	lines_done = 0;
+	slot = 0;
+	while (lines_done < dl->lines_total) {
+		g_mutex_lock(&dl->mutex);
+		while (dl->filled == DOWNLOAD_BUFFERS && !dl->stop)
+			g_cond_wait(&dl->cond, &dl->mutex);
+		if (dl->stop) {
+			g_mutex_unlock(&dl->mutex);
+			break;
+		}
+		g_mutex_unlock(&dl->mutex);
+
+		/* We can download only up-to 32 DRAM lines in one go! */
+		lines_curr = MIN(CHUNKS_PER_READ, dl->lines_total - lines_done);
+		ret = sigma_read_dram((dl->first_line + lines_done) % 0x8000,
+				      lines_curr, (uint8_t *)dl->lines[slot],
+				      dl->devc);
+		/* A short read would leave stale lines in the buffer. */
+		failed = ret != (int)(lines_curr * CHUNK_SIZE);
+		if (failed && ret >= 0)
+			sr_err("Short DRAM read: %d of %u bytes.", ret,
+			       lines_curr * CHUNK_SIZE);
+
+		g_mutex_lock(&dl->mutex);
+		if (failed)
+			dl->failed = TRUE;
+		else
+			dl->filled++;
+		g_cond_signal(&dl->cond);
+		g_mutex_unlock(&dl->mutex);
+		if (failed)
+			break;
+
+		lines_done += lines_curr;
+		slot = (slot + 1) % DOWNLOAD_BUFFERS;
+	}
+
+	return NULL;
+}
+
+/* Ask the hardware to stop data acquisition, and wait until it did. */
+static int sigma_force_stop(struct dev_context *devc)
 {
-	const uint32_t chunks_per_read = 32;
+	uint64_t deadline;
+	uint8_t modestatus;
 
+	/*
+	 * Reception of the FORCESTOP request makes the hardware "disable
+	 * RLE" (store clusters to DRAM regardless of whether pin state
+	 * changes) and raise the POSTTRIGGERED flag.
+	 */
+	sigma_set_register(WRITE_MODE, WMR_FORCESTOP | WMR_SDRAMWRITEEN, devc);
+	deadline = g_get_monotonic_time() + STOP_TIMEOUT_US;
+	while (1) {
+		modestatus = sigma_get_register(READ_MODE, devc);
+		if (modestatus & RMR_POSTTRIGGERED)
+			return SR_OK;
+		if (g_get_monotonic_time() > deadline)
+			break;
+		g_usleep(STOP_POLL_US);
+	}
+	sr_err("Timeout waiting for the acquisition to stop.");
+
+	return SR_ERR_TIMEOUT;
+}
+
+static int download_capture(struct sr_dev_inst *sdi)
+{
 	struct dev_context *devc;
 	struct sigma_dram_line *dram_line;
-	int bufsz;
+	struct sigma_download dl;
 	uint32_t stoppos, triggerpos;
 	uint8_t modestatus;
 	uint32_t i;
-	uint32_t dl_lines_total, dl_lines_curr, dl_lines_done;
-	uint32_t dl_first_line, dl_line;
+	uint32_t dl_lines_curr, dl_lines_done;
 	uint32_t dl_events_in_line;
 	uint32_t trg_line, trg_event;
+	uint32_t slot;
+	gboolean failed;
 
 	devc = sdi->priv;
 	dl_events_in_line = 64 * 7;
 	trg_line = ~0;
 	trg_event = ~0;
 
-	dram_line = g_try_malloc0(chunks_per_read * sizeof(*dram_line));
-	if (!dram_line)
-		return FALSE;
-
 	sr_info("Downloading sample data.");
 	devc->state.state = SIGMA_DOWNLOAD;
 
-	/*
-	 * Ask the hardware to stop data acquisition. Reception of the
-	 * FORCESTOP request makes the hardware "disable RLE" (store
-	 * clusters to DRAM regardless of whether pin state changes) and
-	 * raise the POSTTRIGGERED flag.
-	 */
-	sigma_set_register(WRITE_MODE, WMR_FORCESTOP | WMR_SDRAMWRITEEN, devc);
-	do {
-		modestatus = sigma_get_register(READ_MODE, devc);
-	} while (!(modestatus & RMR_POSTTRIGGERED));
+	if (sigma_force_stop(devc) != SR_OK) {
+		std_session_send_df_end(sdi);
+		devc->state.state = SIGMA_IDLE;
+		sr_dev_acquisition_stop(sdi);
+		return TRUE;
+	}
 
 	/* Set SDRAM Read Enable. */
 	sigma_set_register(WRITE_MODE, WMR_SDRAMREADEN, devc);
@@ -1045,6 +1032,9 @@ static int download_capture(struct sr_dev_inst *sdi)
 
 	devc->sent_samples = 0;
 
+	memset(&dl, 0, sizeof(dl));
+	dl.devc = devc;
+
 	/*
 	 * Determine how many "DRAM lines" of 1024 bytes each we need to
 	 * retrieve from the Sigma hardware, so that we have a complete
@@ -1056,24 +1046,40 @@ static int download_capture(struct sr_dev_inst *sdi)
 	 * that case, we skip it and start reading from the next line. The
 	 * circular buffer has 32K lines (0x8000).
 	 */
-	dl_lines_total = (stoppos >> 9) + 1;
+	dl.lines_total = (stoppos >> 9) + 1;
 	if (modestatus & RMR_ROUND) {
-		dl_first_line = dl_lines_total + 1;
-		dl_lines_total = 0x8000 - 2;
+		dl.first_line = dl.lines_total + 1;
+		dl.lines_total = 0x8000 - 2;
 	} else {
-		dl_first_line = 0;
+		dl.first_line = 0;
 	}
+
+	dl.lines[0] = g_try_malloc0(DOWNLOAD_BUFFERS * CHUNKS_PER_READ
+				    * sizeof(*dram_line));
+	if (!dl.lines[0])
+		return FALSE;
+	for (slot = 1; slot < DOWNLOAD_BUFFERS; slot++)
+		dl.lines[slot] = dl.lines[slot - 1] + CHUNKS_PER_READ;
+	g_mutex_init(&dl.mutex);
+	g_cond_init(&dl.cond);
+	dl.thread = g_thread_new("sigma-download", download_thread, &dl);
+
 	dl_lines_done = 0;
-	while (dl_lines_total > dl_lines_done) {
-		/* We can download only up-to 32 DRAM lines in one go! */
-		dl_lines_curr = MIN(chunks_per_read, dl_lines_total - dl_lines_done);
+	slot = 0;
+	while (dl.lines_total > dl_lines_done) {
+		g_mutex_lock(&dl.mutex);
+		while (!dl.filled && !dl.failed)
+			g_cond_wait(&dl.cond, &dl.mutex);
+		failed = !dl.filled;
+		g_mutex_unlock(&dl.mutex);
+		if (failed) {
+			sr_err("Failed to download the sample data.");
+			break;
+		}
 
-		dl_line = dl_first_line + dl_lines_done;
-		dl_line %= 0x8000;
-		bufsz = sigma_read_dram(dl_line, dl_lines_curr,
-					(uint8_t *)dram_line, devc);
-		/* TODO: Check bufsz. For now, just avoid compiler warnings. */
-		(void)bufsz;
+		dl_lines_curr = MIN(CHUNKS_PER_READ,
+				    dl.lines_total - dl_lines_done);
+		dram_line = dl.lines[slot];
 
 		/* This is the first DRAM line, so find the initial timestamp. */
 		if (dl_lines_done == 0) {
@@ -1085,7 +1091,7 @@ static int download_capture(struct sr_dev_inst *sdi)
 		for (i = 0; i < dl_lines_curr; i++) {
 			uint32_t trigger_event = ~0;
 			/* The last "DRAM line" can be only partially full. */
-			if (dl_lines_done + i == dl_lines_total - 1)
+			if (dl_lines_done + i == dl.lines_total - 1)
 				dl_events_in_line = stoppos & 0x1ff;
 
 			/* Test if the trigger happened on this line. */
@@ -1096,9 +1102,24 @@ static int download_capture(struct sr_dev_inst *sdi)
 					trigger_event, sdi);
 		}
 
+		/* Hand the buffer back to the download thread. */
+		g_mutex_lock(&dl.mutex);
+		dl.filled--;
+		g_cond_signal(&dl.cond);
+		g_mutex_unlock(&dl.mutex);
+
 		dl_lines_done += dl_lines_curr;
+		slot = (slot + 1) % DOWNLOAD_BUFFERS;
 	}
-	g_free(dram_line);
+
+	g_mutex_lock(&dl.mutex);
+	dl.stop = TRUE;
+	g_cond_signal(&dl.cond);
+	g_mutex_unlock(&dl.mutex);
+	g_thread_join(dl.thread);
+	g_cond_clear(&dl.cond);
+	g_mutex_clear(&dl.mutex);
+	g_free(dl.lines[0]);
 
 	std_session_send_df_end(sdi);
 
@@ -96,6 +96,14 @@ enum sigma_read_register {
 
 #define CHUNK_SIZE		1024
 
+/* DRAM lines per read request, and buffers of that size in flight. */
+#define CHUNKS_PER_READ		32
+#define DOWNLOAD_BUFFERS	4
+
+/* How long to wait for the hardware to stop, and how often to check. */
+#define STOP_TIMEOUT_US		(1000 * 1000)
+#define STOP_POLL_US		1000
+
 /* WRITE_MODE register fields. */
 #define WMR_SDRAMWRITEEN	(1 << 0)
 #define WMR_SDRAMREADEN		(1 << 1)
@@ -253,6 +261,21 @@ struct sigma_state {
 	uint16_t lastsample;
 };
 
+/* State of a DRAM download, shared with the download thread. */
+struct sigma_download {
+	struct dev_context *devc;
+	uint32_t first_line;
+	uint32_t lines_total;
+	struct sigma_dram_line *lines[DOWNLOAD_BUFFERS];
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	/* Buffers read but not yet decoded. */
+	uint32_t filled;
+	gboolean failed;
+	gboolean stop;
+};
+
 struct dev_context {
 	struct ftdi_context ftdic;
 	uint64_t cur_samplerate;
@@ -284,4 +307,12 @@ SR_PRIV int sigma_convert_trigger(const struct sr_dev_inst *sdi);
 SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data);
 SR_PRIV int sigma_build_basic_trigger(struct triggerlut *lut, struct dev_context *devc);
 
+SR_PRIV uint16_t sigma_dram_cluster_ts(const struct sigma_dram_cluster *cluster);
+SR_PRIV uint64_t sigma_deinterlace_100mhz_data(uint64_t indata);
+SR_PRIV uint64_t sigma_deinterlace_200mhz_data(uint64_t indata);
+SR_PRIV size_t sigma_decode_cluster(struct sigma_state *ss,
+		const struct sigma_dram_cluster *cluster,
+		unsigned int events_in_cluster, int samples_per_event,
+		uint16_t *gap, uint8_t *samples);
+
 #endif
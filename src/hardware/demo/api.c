@@ -64,6 +64,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_AVERAGING | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_AVG_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_UNTHROTTLED | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t devopts_cg_logic[] = {
@@ -225,6 +226,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_AVG_SAMPLES:
 		*data = g_variant_new_uint64(devc->avg_samples);
 		break;
+	case SR_CONF_UNTHROTTLED:
+		*data = g_variant_new_boolean(devc->unthrottled);
+		break;
 	case SR_CONF_PATTERN_MODE:
 		if (!cg)
 			return SR_ERR_CHANNEL_GROUP;
@@ -288,6 +292,9 @@ static int config_set(uint32_t key, GVariant *data,
 		devc->avg_samples = g_variant_get_uint64(data);
 		sr_dbg("Setting averaging rate to %" PRIu64, devc->avg_samples);
 		break;
+	case SR_CONF_UNTHROTTLED:
+		devc->unthrottled = g_variant_get_boolean(data);
+		break;
 	case SR_CONF_PATTERN_MODE:
 		if (!cg)
 			return SR_ERR_CHANNEL_GROUP;
@@ -448,7 +455,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	while (g_hash_table_iter_next(&iter, NULL, &value))
 		demo_generate_analog_pattern(value, devc->cur_samplerate);
 
-	sr_session_source_add(sdi->session, -1, 0, 100,
+	/* Unthrottled, produce the next chunk whenever the session is idle. */
+	sr_session_source_add(sdi->session, -1, 0, devc->unthrottled ? 0 : 100,
 			demo_prepare_data, (struct sr_dev_inst *)sdi);
 
 	std_session_send_df_header(sdi);
@@ -448,9 +448,15 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 		return G_SOURCE_CONTINUE;
 	}
 
-	/* What time span should we send samples for? */
+	/*
+	 * What time span should we send samples for? When unthrottled,
+	 * the sample time runs ahead of the wall clock.
+	 */
 	elapsed_us = g_get_monotonic_time() - devc->start_us;
 	limit_us = 1000 * devc->limit_msec;
+	if (devc->unthrottled)
+		elapsed_us = devc->spent_us + 1 + (int64_t)(G_USEC_PER_SEC
+			* (uint64_t)UNTHROTTLED_SAMPLES / devc->cur_samplerate);
 	if (limit_us > 0 && limit_us < elapsed_us)
 		todo_us = MAX(0, limit_us - devc->spent_us);
 	else
@@ -33,6 +33,8 @@
 #define LOGIC_BUFSIZE			4096
 /* Size of the analog pattern space per channel. */
 #define ANALOG_BUFSIZE			4096
+/* Samples to send per round when unthrottled. */
+#define UNTHROTTLED_SAMPLES		(256 * 1024)
 /* This is a development feature: it starts a new frame every n samples. */
 #define SAMPLES_PER_FRAME		0
 
@@ -55,6 +57,7 @@ struct dev_context {
 	GHashTable *ch_ag;
 	gboolean avg; /* True if averaging is enabled */
 	uint64_t avg_samples;
+	gboolean unthrottled; /* True if not bound to real time */
 	size_t enabled_logic_channels;
 	size_t enabled_analog_channels;
 	size_t first_partial_logic_index;
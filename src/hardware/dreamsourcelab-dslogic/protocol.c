@@ -660,89 +660,51 @@ SR_PRIV struct dev_context *dslogic_dev_new(void)
 
 static void abort_acquisition(struct dev_context *devc)
 {
-	int i;
-
-	devc->acq_aborted = TRUE;
-
-	for (i = devc->num_transfers - 1; i >= 0; i--) {
-		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
-	}
+	if (devc->trigger_transfer)
+		libusb_cancel_transfer(devc->trigger_transfer);
+	else if (devc->stream)
+		sr_usb_stream_abort(devc->stream);
 }
 
-static void finish_acquisition(struct sr_dev_inst *sdi)
+static void finish_acquisition(void *cb_data)
 {
+	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 
+	sdi = cb_data;
 	devc = sdi->priv;
 
 	std_session_send_df_end(sdi);
 
 	usb_source_remove(sdi->session, devc->ctx);
 
-	devc->num_transfers = 0;
-	g_free(devc->transfers);
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
 	g_free(devc->deinterleave_buffer);
-}
-
-static void free_transfer(struct libusb_transfer *transfer)
-{
-	struct sr_dev_inst *sdi;
-	struct dev_context *devc;
-	unsigned int i;
-
-	sdi = transfer->user_data;
-	devc = sdi->priv;
-
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
-	for (i = 0; i < devc->num_transfers; i++) {
-		if (devc->transfers[i] == transfer) {
-			devc->transfers[i] = NULL;
-			break;
-		}
-	}
-
-	devc->submitted_transfers--;
-	if (devc->submitted_transfers == 0)
-		finish_acquisition(sdi);
-}
-
-static void resubmit_transfer(struct libusb_transfer *transfer)
-{
-	int ret;
-
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
-		return;
-
-	sr_err("%s: %s", __func__, libusb_error_name(ret));
-	free_transfer(transfer);
-
+	devc->deinterleave_buffer = NULL;
 }
 
 static void deinterleave_buffer(const uint8_t *src, size_t length,
 	uint16_t *dst_ptr, size_t channel_count, uint16_t channel_mask)
 {
-	uint16_t sample;
+	uint64_t planes[16];
+	unsigned int channel;
 
+	/*
+	 * Each block holds 64 samples of every enabled channel, one word
+	 * per channel. Put the words into the bit-planes of their channels
+	 * and transpose all 64 samples at once.
+	 */
+	memset(planes, 0, sizeof(planes));
 	for (const uint64_t *src_ptr = (uint64_t*)src;
 		src_ptr < (uint64_t*)(src + length);
 		src_ptr += channel_count) {
-		for (int bit = 0; bit != 64; bit++) {
-			const uint64_t *word_ptr = src_ptr;
-			sample = 0;
-			for (unsigned int channel = 0; channel != 16;
-				channel++) {
-				const uint16_t m = channel_mask >> channel;
-				if (!m)
-					break;
-				if ((m & 1) && ((*word_ptr++ >> bit) & 1ULL))
-					sample |= 1 << channel;
-			}
-			*dst_ptr++ = sample;
-		}
+		const uint64_t *word_ptr = src_ptr;
+		for (channel = 0; channel != 16; channel++)
+			if (channel_mask & (1 << channel))
+				planes[channel] = *word_ptr++;
+		sr_transpose_planes16(planes, dst_ptr, 64, FALSE);
+		dst_ptr += 64;
 	}
 }
 
@@ -763,65 +725,19 @@ static void send_data(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+static gboolean receive_samples(uint8_t *data, size_t length, void *cb_data)
 {
-	struct sr_dev_inst *const sdi = transfer->user_data;
+	struct sr_dev_inst *const sdi = cb_data;
 	struct dev_context *const devc = sdi->priv;
 	const size_t channel_count = enabled_channel_count(sdi);
 	const uint16_t channel_mask = enabled_channel_mask(sdi);
 	const unsigned int cur_sample_count = DSLOGIC_ATOMIC_SAMPLES *
-		transfer->actual_length /
-		(DSLOGIC_ATOMIC_BYTES * channel_count);
+		length / (DSLOGIC_ATOMIC_BYTES * channel_count);
 
-	gboolean packet_has_error = FALSE;
 	struct sr_datafeed_packet packet;
 	unsigned int num_samples;
 	int trigger_offset;
 
-	/*
-	 * If acquisition has already ended, just free any queued up
-	 * transfer that come in.
-	 */
-	if (devc->acq_aborted) {
-		free_transfer(transfer);
-		return;
-	}
-
-	sr_dbg("receive_transfer(): status %s received %d bytes.",
-		libusb_error_name(transfer->status), transfer->actual_length);
-
-	/* Save incoming transfer before reusing the transfer struct. */
-
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		abort_acquisition(devc);
-		free_transfer(transfer);
-		return;
-	case LIBUSB_TRANSFER_COMPLETED:
-	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
-		break;
-	default:
-		packet_has_error = TRUE;
-		break;
-	}
-
-	if (transfer->actual_length == 0 || packet_has_error) {
-		devc->empty_transfer_count++;
-		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
-			/*
-			 * The FX2 gave up. End the acquisition, the frontend
-			 * will work out that the samplecount is short.
-			 */
-			abort_acquisition(devc);
-			free_transfer(transfer);
-		} else {
-			resubmit_transfer(transfer);
-		}
-		return;
-	} else {
-		devc->empty_transfer_count = 0;
-	}
-
 	if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
 		if (devc->limit_samples && devc->sent_samples + cur_sample_count > devc->limit_samples)
 			num_samples = devc->limit_samples - devc->sent_samples;
@@ -839,9 +755,9 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		 *
 		 * Hopefully in future it will be possible to pass the data on as-is.
 		 */
-		if (transfer->actual_length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
+		if (length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
 			sr_err("Invalid transfer length!");
-		deinterleave_buffer(transfer->buffer, transfer->actual_length,
+		deinterleave_buffer(data, length,
 			devc->deinterleave_buffer, channel_count, channel_mask);
 
 		/* Send the incoming transfer to the session bus. */
@@ -868,11 +784,8 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		}
 	}
 
-	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
-		abort_acquisition(devc);
-		free_transfer(transfer);
-	} else
-		resubmit_transfer(transfer);
+	/* Stop the stream once the limit is reached. */
+	return !devc->limit_samples || devc->sent_samples < devc->limit_samples;
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
@@ -906,92 +819,51 @@ static size_t to_bytes_per_ms(const struct sr_dev_inst *sdi)
 	return 35000000 / (1000 * 10);
 }
 
-static size_t get_buffer_size(const struct sr_dev_inst *sdi)
+static struct sr_usb_stream *new_stream(const struct sr_dev_inst *sdi)
 {
+	struct sr_usb_stream_config config;
+
 	/*
-	 * The buffer should be large enough to hold 10ms of data and
-	 * a multiple of the size of a data atom.
+	 * Transfers hold 10ms of data at first, in a multiple of the size
+	 * of a data atom, and there are enough of them for about 100ms.
+	 * The stream adapts this as it goes.
 	 */
-	const size_t block_size = enabled_channel_count(sdi) * 512;
-	const size_t s = 10 * to_bytes_per_ms(sdi);
-	return ((s + block_size - 1) / block_size) * block_size;
-}
-
-static unsigned int get_number_of_transfers(const struct sr_dev_inst *sdi)
-{
-	/* Total buffer size should be able to hold about 100ms of data. */
-	const unsigned int s = get_buffer_size(sdi);
-	const unsigned int n = (100 * to_bytes_per_ms(sdi) + s - 1) / s;
-	return (n > NUM_SIMUL_TRANSFERS) ? NUM_SIMUL_TRANSFERS : n;
-}
-
-static unsigned int get_timeout(const struct sr_dev_inst *sdi)
-{
-	const size_t total_size = get_buffer_size(sdi) *
-		get_number_of_transfers(sdi);
-	const unsigned int timeout = total_size / to_bytes_per_ms(sdi);
-	return timeout + timeout / 4; /* Leave a headroom of 25% percent. */
+	memset(&config, 0, sizeof(config));
+	config.endpoint = 6 | LIBUSB_ENDPOINT_IN;
+	config.bytes_per_ms = to_bytes_per_ms(sdi);
+	config.block_size = enabled_channel_count(sdi) * 512;
+	config.transfer_ms = 10;
+	config.total_ms = 100;
+	config.max_transfers = NUM_SIMUL_TRANSFERS;
+	config.max_empty_transfers = MAX_EMPTY_TRANSFERS;
+	config.session = sdi->session;
+
+	return sr_usb_stream_new(sdi->conn, &config, receive_samples,
+		finish_acquisition, (void *)sdi);
 }
 
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	const size_t channel_count = enabled_channel_count(sdi);
-	const size_t size = get_buffer_size(sdi);
-	const unsigned int num_transfers = get_number_of_transfers(sdi);
-	const unsigned int timeout = get_timeout(sdi);
 
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
-	struct libusb_transfer *transfer;
-	unsigned int i;
+	size_t size;
 	int ret;
-	unsigned char *buf;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
 
 	devc->sent_samples = 0;
-	devc->acq_aborted = FALSE;
-	devc->empty_transfer_count = 0;
-	devc->submitted_transfers = 0;
-
-	g_free(devc->transfers);
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
-	if (!devc->transfers) {
-		sr_err("USB transfers malloc failed.");
-		return SR_ERR_MALLOC;
-	}
 
+	size = devc->stream->config.max_transfer_size;
 	devc->deinterleave_buffer = g_try_malloc(DSLOGIC_ATOMIC_SAMPLES *
 		(size / (channel_count * DSLOGIC_ATOMIC_BYTES)) * sizeof(uint16_t));
 	if (!devc->deinterleave_buffer) {
 		sr_err("Deinterleave buffer malloc failed.");
-		g_free(devc->deinterleave_buffer);
 		return SR_ERR_MALLOC;
 	}
 
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				6 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
-	}
+	if ((ret = sr_usb_stream_start(devc->stream)) != SR_OK)
+		return ret;
 
 	std_session_send_df_header(sdi);
 
@@ -1006,29 +878,28 @@ static void LIBUSB_CALL trigger_receive(struct libusb_transfer *transfer)
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
+	devc->trigger_transfer = NULL;
 	if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
 		sr_dbg("Trigger transfer canceled.");
 		/* Terminate session. */
 		std_session_send_df_end(sdi);
 		usb_source_remove(sdi->session, devc->ctx);
-		devc->num_transfers = 0;
-		g_free(devc->transfers);
+		sr_usb_stream_free(devc->stream);
+		devc->stream = NULL;
 	} else if (transfer->status == LIBUSB_TRANSFER_COMPLETED
 			&& transfer->actual_length == sizeof(struct dslogic_trigger_pos)) {
 		tpos = (struct dslogic_trigger_pos *)transfer->buffer;
 		sr_info("tpos real_pos %d ram_saddr %d cnt %d", tpos->real_pos,
 			tpos->ram_saddr, tpos->remain_cnt);
 		devc->trigger_pos = tpos->real_pos;
-		g_free(tpos);
 		start_transfers(sdi);
 	}
+	g_free(transfer->buffer);
 	libusb_free_transfer(transfer);
 }
 
 SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 {
-	const unsigned int timeout = get_timeout(sdi);
-
 	struct sr_dev_driver *di;
 	struct drv_context *drvc;
 	struct dev_context *devc;
@@ -1044,10 +915,13 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 
 	devc->ctx = drvc->sr_ctx;
 	devc->sent_samples = 0;
-	devc->empty_transfer_count = 0;
-	devc->acq_aborted = FALSE;
 
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+	/* The stream starts once the trigger position is in. */
+	sr_usb_stream_free(devc->stream);
+	devc->stream = new_stream(sdi);
+
+	usb_source_add(sdi->session, devc->ctx, devc->stream->timeout,
+		receive_data, drvc);
 
 	if ((ret = command_stop_acquisition(sdi)) != SR_OK)
 		return ret;
@@ -1070,15 +944,7 @@ SR_PRIV int dslogic_acquisition_start(const struct sr_dev_inst *sdi)
 		g_free(tpos);
 		return SR_ERR;
 	}
-
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers));
-	if (!devc->transfers) {
-		sr_err("USB trigger_pos transfer malloc failed.");
-		return SR_ERR_MALLOC;
-	}
-	devc->num_transfers = 1;
-	devc->submitted_transfers++;
-	devc->transfers[0] = transfer;
+	devc->trigger_transfer = transfer;
 
 	return ret;
 }
@@ -119,14 +119,10 @@ struct dev_context {
 	uint64_t limit_samples;
 	uint64_t capture_ratio;
 
-	gboolean acq_aborted;
-
 	unsigned int sent_samples;
-	int submitted_transfers;
-	int empty_transfer_count;
 
-	unsigned int num_transfers;
-	struct libusb_transfer **transfers;
+	struct sr_usb_stream *stream;
+	struct libusb_transfer *trigger_transfer;
 	struct sr_context *ctx;
 
 	uint16_t *deinterleave_buffer;
@@ -265,28 +265,24 @@ SR_PRIV struct dev_context *fx2lafw_dev_new(void)
 
 SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc)
 {
-	int i;
-
-	devc->acq_aborted = TRUE;
-
-	for (i = devc->num_transfers - 1; i >= 0; i--) {
-		if (devc->transfers[i])
-			libusb_cancel_transfer(devc->transfers[i]);
-	}
+	if (devc->stream)
+		sr_usb_stream_abort(devc->stream);
 }
 
-static void finish_acquisition(struct sr_dev_inst *sdi)
+static void finish_acquisition(void *cb_data)
 {
+	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 
+	sdi = cb_data;
 	devc = sdi->priv;
 
 	std_session_send_df_end(sdi);
 
 	usb_source_remove(sdi->session, devc->ctx);
 
-	devc->num_transfers = 0;
-	g_free(devc->transfers);
+	sr_usb_stream_free(devc->stream);
+	devc->stream = NULL;
 
 	/* Free the deinterlace buffers if we had them. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
@@ -300,43 +296,6 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 	}
 }
 
-static void free_transfer(struct libusb_transfer *transfer)
-{
-	struct sr_dev_inst *sdi;
-	struct dev_context *devc;
-	unsigned int i;
-
-	sdi = transfer->user_data;
-	devc = sdi->priv;
-
-	g_free(transfer->buffer);
-	transfer->buffer = NULL;
-	libusb_free_transfer(transfer);
-
-	for (i = 0; i < devc->num_transfers; i++) {
-		if (devc->transfers[i] == transfer) {
-			devc->transfers[i] = NULL;
-			break;
-		}
-	}
-
-	devc->submitted_transfers--;
-	if (devc->submitted_transfers == 0)
-		finish_acquisition(sdi);
-}
-
-static void resubmit_transfer(struct libusb_transfer *transfer)
-{
-	int ret;
-
-	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
-		return;
-
-	sr_err("%s: %s", __func__, libusb_error_name(ret));
-	free_transfer(transfer);
-
-}
-
 static void mso_send_data_proc(struct sr_dev_inst *sdi,
 	uint8_t *data, size_t length, size_t sample_width)
 {
@@ -406,63 +365,20 @@ static void la_send_data_proc(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+static gboolean receive_samples(uint8_t *data, size_t length, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	gboolean packet_has_error = FALSE;
 	unsigned int num_samples;
 	int trigger_offset, cur_sample_count, unitsize;
 	int pre_trigger_samples;
 
-	sdi = transfer->user_data;
+	sdi = cb_data;
 	devc = sdi->priv;
 
-	/*
-	 * If acquisition has already ended, just free any queued up
-	 * transfer that come in.
-	 */
-	if (devc->acq_aborted) {
-		free_transfer(transfer);
-		return;
-	}
-
-	sr_dbg("receive_transfer(): status %s received %d bytes.",
-		libusb_error_name(transfer->status), transfer->actual_length);
-
-	/* Save incoming transfer before reusing the transfer struct. */
 	unitsize = devc->sample_wide ? 2 : 1;
-	cur_sample_count = transfer->actual_length / unitsize;
-
-	switch (transfer->status) {
-	case LIBUSB_TRANSFER_NO_DEVICE:
-		fx2lafw_abort_acquisition(devc);
-		free_transfer(transfer);
-		return;
-	case LIBUSB_TRANSFER_COMPLETED:
-	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
-		break;
-	default:
-		packet_has_error = TRUE;
-		break;
-	}
+	cur_sample_count = length / unitsize;
 
-	if (transfer->actual_length == 0 || packet_has_error) {
-		devc->empty_transfer_count++;
-		if (devc->empty_transfer_count > MAX_EMPTY_TRANSFERS) {
-			/*
-			 * The FX2 gave up. End the acquisition, the frontend
-			 * will work out that the samplecount is short.
-			 */
-			fx2lafw_abort_acquisition(devc);
-			free_transfer(transfer);
-		} else {
-			resubmit_transfer(transfer);
-		}
-		return;
-	} else {
-		devc->empty_transfer_count = 0;
-	}
 	if (devc->trigger_fired) {
 		if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
 			/* Send the incoming transfer to the session bus. */
@@ -471,13 +387,13 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 			else
 				num_samples = cur_sample_count;
 
-			devc->send_data_proc(sdi, (uint8_t *)transfer->buffer,
+			devc->send_data_proc(sdi, data,
 				num_samples * unitsize, unitsize);
 			devc->sent_samples += num_samples;
 		}
 	} else {
 		trigger_offset = soft_trigger_logic_check(devc->stl,
-			transfer->buffer, transfer->actual_length, &pre_trigger_samples);
+			data, length, &pre_trigger_samples);
 		if (trigger_offset > -1) {
 			devc->sent_samples += pre_trigger_samples;
 			num_samples = cur_sample_count - trigger_offset;
@@ -485,7 +401,7 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 					num_samples > devc->limit_samples - devc->sent_samples)
 				num_samples = devc->limit_samples - devc->sent_samples;
 
-			devc->send_data_proc(sdi, (uint8_t *)transfer->buffer
+			devc->send_data_proc(sdi, data
 					+ trigger_offset * unitsize,
 					num_samples * unitsize, unitsize);
 			devc->sent_samples += num_samples;
@@ -494,11 +410,8 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		}
 	}
 
-	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples) {
-		fx2lafw_abort_acquisition(devc);
-		free_transfer(transfer);
-	} else
-		resubmit_transfer(transfer);
+	/* Stop the stream once the limit is reached. */
+	return !devc->limit_samples || devc->sent_samples < devc->limit_samples;
 }
 
 static int configure_channels(const struct sr_dev_inst *sdi)
@@ -535,48 +448,6 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static unsigned int to_bytes_per_ms(unsigned int samplerate)
-{
-	return samplerate / 1000;
-}
-
-static size_t get_buffer_size(struct dev_context *devc)
-{
-	size_t s;
-
-	/*
-	 * The buffer should be large enough to hold 10ms of data and
-	 * a multiple of 512.
-	 */
-	s = 10 * to_bytes_per_ms(devc->cur_samplerate);
-	return (s + 511) & ~511;
-}
-
-static unsigned int get_number_of_transfers(struct dev_context *devc)
-{
-	unsigned int n;
-
-	/* Total buffer size should be able to hold about 500ms of data. */
-	n = (500 * to_bytes_per_ms(devc->cur_samplerate) /
-		get_buffer_size(devc));
-
-	if (n > NUM_SIMUL_TRANSFERS)
-		return NUM_SIMUL_TRANSFERS;
-
-	return n;
-}
-
-static unsigned int get_timeout(struct dev_context *devc)
-{
-	size_t total_size;
-	unsigned int timeout;
-
-	total_size = get_buffer_size(devc) *
-			get_number_of_transfers(devc);
-	timeout = total_size / to_bytes_per_ms(devc->cur_samplerate);
-	return timeout + timeout / 4; /* Leave a headroom of 25% percent. */
-}
-
 static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
@@ -596,20 +467,12 @@ static int receive_data(int fd, int revents, void *cb_data)
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	struct sr_usb_dev_inst *usb;
 	struct sr_trigger *trigger;
-	struct libusb_transfer *transfer;
-	unsigned int i, num_transfers;
-	int timeout, ret;
-	unsigned char *buf;
-	size_t size;
+	int ret;
 
 	devc = sdi->priv;
-	usb = sdi->conn;
 
 	devc->sent_samples = 0;
-	devc->acq_aborted = FALSE;
-	devc->empty_transfer_count = 0;
 
 	if ((trigger = sr_session_trigger_get(sdi->session))) {
 		int pre_trigger_samples = 0;
@@ -622,41 +485,6 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	} else
 		devc->trigger_fired = TRUE;
 
-	num_transfers = get_number_of_transfers(devc);
-
-	size = get_buffer_size(devc);
-	devc->submitted_transfers = 0;
-
-	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
-	if (!devc->transfers) {
-		sr_err("USB transfers malloc failed.");
-		return SR_ERR_MALLOC;
-	}
-
-	timeout = get_timeout(devc);
-	devc->num_transfers = num_transfers;
-	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
-		transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(transfer, usb->devhdl,
-				2 | LIBUSB_ENDPOINT_IN, buf, size,
-				receive_transfer, (void *)sdi, timeout);
-		sr_info("submitting transfer: %d", i);
-		if ((ret = libusb_submit_transfer(transfer)) != 0) {
-			sr_err("Failed to submit transfer: %s.",
-			       libusb_error_name(ret));
-			libusb_free_transfer(transfer);
-			g_free(buf);
-			fx2lafw_abort_acquisition(devc);
-			return SR_ERR;
-		}
-		devc->transfers[i] = transfer;
-		devc->submitted_transfers++;
-	}
-
 	/*
 	 * If this device has analog channels and at least one of them is
 	 * enabled, use mso_send_data_proc() to properly handle the analog
@@ -667,6 +495,9 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	else
 		devc->send_data_proc = la_send_data_proc;
 
+	if ((ret = sr_usb_stream_start(devc->stream)) != SR_OK)
+		return ret;
+
 	std_session_send_df_header(sdi);
 
 	return SR_OK;
@@ -677,7 +508,8 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 	struct sr_dev_driver *di;
 	struct drv_context *drvc;
 	struct dev_context *devc;
-	int timeout, ret;
+	struct sr_usb_stream_config config;
+	int ret;
 	size_t size;
 
 	di = sdi->driver;
@@ -686,18 +518,32 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 
 	devc->ctx = drvc->sr_ctx;
 	devc->sent_samples = 0;
-	devc->empty_transfer_count = 0;
-	devc->acq_aborted = FALSE;
 
 	if (configure_channels(sdi) != SR_OK) {
 		sr_err("Failed to configure channels.");
 		return SR_ERR;
 	}
 
-	timeout = get_timeout(devc);
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
-
-	size = get_buffer_size(devc);
+	/*
+	 * Transfers hold 10ms of data at first, and there are enough of
+	 * them for about 500ms. The stream adapts this as it goes.
+	 */
+	memset(&config, 0, sizeof(config));
+	config.endpoint = 2 | LIBUSB_ENDPOINT_IN;
+	config.bytes_per_ms = devc->cur_samplerate / 1000
+		* (devc->sample_wide ? 2 : 1);
+	config.transfer_ms = 10;
+	config.total_ms = 500;
+	config.max_transfers = NUM_SIMUL_TRANSFERS;
+	config.max_empty_transfers = MAX_EMPTY_TRANSFERS;
+	config.session = sdi->session;
+	devc->stream = sr_usb_stream_new(sdi->conn, &config,
+		receive_samples, finish_acquisition, (void *)sdi);
+
+	usb_source_add(sdi->session, devc->ctx, devc->stream->timeout,
+		receive_data, drvc);
+
+	size = devc->stream->config.max_transfer_size;
 	/* Prepare for analog sampling. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
 		/* We need a buffer half the size of a transfer. */
@@ -37,6 +37,7 @@
 #define CLOCK_RATE                 SR_MHZ(100)
 #define MIN_NUM_SAMPLES            4
 #define DEFAULT_SAMPLERATE         SR_KHZ(200)
+#define OLS_READ_SIZE              4096
 
 /* Command opcodes */
 #define CMD_RESET                  0x00
@@ -90,17 +91,7 @@ struct dev_context {
 	uint16_t flag_reg;
 
 	unsigned int num_transfers;
-	unsigned int num_samples;
-	int num_bytes;
-	int cnt_bytes;
-	unsigned int cnt_samples;
-	int cnt_samples_rle;
-
-	unsigned int rle_count;
-	unsigned char sample[4];
-	unsigned char tmp_sample[4];
-	unsigned char tmp_sample2[4];
-	unsigned char *raw_sample_buf;
+	struct sr_ols_decoder decoder;
 };
 
 SR_PRIV extern const char *ols_channel_names[];
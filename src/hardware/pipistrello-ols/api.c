@@ -605,10 +605,9 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 
 	/* Reset all operational states. */
-	devc->rle_count = devc->num_transfers = 0;
-	devc->num_samples = devc->num_bytes = 0;
-	devc->cnt_bytes = devc->cnt_samples = devc->cnt_samples_rle = 0;
-	memset(devc->sample, 0, 4);
+	devc->num_transfers = 0;
+	sr_ols_decoder_init(&devc->decoder, devc->flag_reg,
+			devc->limit_samples);
 
 	std_session_send_df_header(sdi);
 
@@ -632,6 +631,7 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	write_shortcommand(devc, CMD_RESET);
 
 	sr_session_source_remove(sdi->session, -1);
+	sr_ols_decoder_clear(&devc->decoder);
 
 	std_session_send_df_end(sdi);
 
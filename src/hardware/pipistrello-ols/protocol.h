@@ -97,17 +97,7 @@ struct dev_context {
 	uint16_t flag_reg;
 
 	unsigned int num_transfers;
-	unsigned int num_samples;
-	int num_bytes;
-	int cnt_bytes;
-	unsigned int cnt_samples;
-	int cnt_samples_rle;
-
-	unsigned int rle_count;
-	unsigned char sample[4];
-	unsigned char tmp_sample[4];
-	unsigned char tmp_sample2[4];
-	unsigned char *raw_sample_buf;
+	struct sr_ols_decoder decoder;
 };
 
 SR_PRIV extern const char *p_ols_channel_names[];
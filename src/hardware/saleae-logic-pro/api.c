@@ -407,7 +407,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	usb = sdi->conn;
 
-	devc->conv_buffer = g_malloc(CONV_BUFFER_SIZE);
+	devc->conv_buffer = g_malloc0(CONV_BATCH_SIZE);
 
 	devc->num_transfers = BUF_COUNT;
 	devc->transfers = g_malloc0(sizeof(*devc->transfers) * BUF_COUNT);
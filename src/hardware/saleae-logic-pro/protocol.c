@@ -829,44 +829,56 @@ SR_PRIV int saleae_logic_pro_stop(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void saleae_logic_pro_send_data(const struct sr_dev_inst *sdi,
-				      void *data, size_t length, size_t unitsize)
-{
-	const struct sr_datafeed_logic logic = {
-		.length = length,
-		.unitsize = unitsize,
-		.data = data
-	};
-
-	const struct sr_datafeed_packet packet = {
-		.type = SR_DF_LOGIC,
-		.payload = &logic
-	};
-
-	sr_session_send(sdi, &packet);
-}
-
 /*
  * One batch from the device consists of 32 samples per active digital channel.
  * This stream of batches is packed into USB packets with 16384 bytes each.
  */
 static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
-					 const uint32_t *src, size_t srccnt)
+					 const uint32_t *src, size_t srccnt,
+					 uint8_t *dst)
 {
 	struct dev_context *devc = sdi->priv;
-	uint8_t *dst = devc->conv_buffer;
-	uint32_t samples;
+	uint32_t samples, lo, hi;
 	uint16_t channel_mask;
-	unsigned int sample_index, batch_index;
+	unsigned int sample_index, batch_index, i;
+	unsigned int channel_bits[16];
+	uint64_t planes[16];
 	uint16_t *dst_batch;
 
-	/* Copy partial batch to the beginning. */
-	memcpy(dst, dst + devc->conv_size, CONV_BATCH_SIZE);
+	/* Continue the partial batch of the previous USB packet. */
+	memcpy(dst, devc->conv_buffer, CONV_BATCH_SIZE);
 	/* Reset converted size. */
 	devc->conv_size = 0;
 
+	for (i = 0; i < devc->dig_channel_cnt; i++)
+		for (channel_bits[i] = 0; channel_bits[i] < 15; channel_bits[i]++)
+			if (devc->dig_channel_masks[i] & (1 << channel_bits[i]))
+				break;
+	memset(planes, 0, sizeof(planes));
+
 	batch_index = devc->batch_index;
-	while (srccnt--) {
+	while (srccnt) {
+		/*
+		 * Two whole batches: transpose their 64 samples at once.
+		 * Each word holds 32 samples of one channel, the first one
+		 * in its MSB, so the byte-swapped words are the planes.
+		 */
+		if (batch_index == 0 && devc->dig_channel_cnt
+				&& srccnt >= 2 * devc->dig_channel_cnt) {
+			for (i = 0; i < devc->dig_channel_cnt; i++) {
+				lo = GUINT32_SWAP_LE_BE(src[i]);
+				hi = GUINT32_SWAP_LE_BE(src[devc->dig_channel_cnt + i]);
+				planes[channel_bits[i]] = lo | (uint64_t)hi << 32;
+			}
+			sr_transpose_planes16(planes, (uint16_t *)dst, 64, TRUE);
+			src += 2 * devc->dig_channel_cnt;
+			srccnt -= 2 * devc->dig_channel_cnt;
+			devc->conv_size += 2 * CONV_BATCH_SIZE;
+			dst += 2 * CONV_BATCH_SIZE;
+			continue;
+		}
+
+		srccnt--;
 		samples = *src++;
 		dst_batch = (uint16_t*)dst;
 
@@ -888,12 +900,17 @@ static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
 		}
 	}
 	devc->batch_index = batch_index;
+
+	/* Keep the partial batch, dst is handed over to the session. */
+	memcpy(devc->conv_buffer, dst, CONV_BATCH_SIZE);
 }
 
 SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *transfer)
 {
 	const struct sr_dev_inst *sdi = transfer->user_data;
 	struct dev_context *devc = sdi->priv;
+	struct sr_datafeed_packet *packet;
+	struct sr_datafeed_logic *logic;
 	int ret;
 
 	switch (transfer->status) {
@@ -908,8 +925,13 @@ SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *t
 		return;
 	}
 
-	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer, 16 * 1024 / 4);
-	saleae_logic_pro_send_data(sdi, devc->conv_buffer, devc->conv_size, 2);
+	/* Convert straight into a pooled buffer, owned by the session. */
+	packet = sr_session_logic_packet_new(sdi->session, 2, CONV_BUFFER_SIZE);
+	logic = (struct sr_datafeed_logic *)packet->payload;
+	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer,
+				      16 * 1024 / 4, logic->data);
+	logic->length = devc->conv_size;
+	sr_session_send_owned(sdi, packet);
 
 	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS)
 		sr_dbg("FIXME resubmit failed");
@@ -48,6 +48,7 @@ struct dev_context {
 	unsigned int submitted_transfers;
 	struct libusb_transfer **transfers;
 
+	/* Partial batch carried over to the next USB packet. */
 	uint8_t *conv_buffer;
 	unsigned int conv_size;
 	unsigned int batch_index;
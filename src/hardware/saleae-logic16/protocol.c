@@ -808,7 +808,9 @@ static size_t convert_sample_data(struct dev_context *devc,
 		uint8_t *dest, size_t destcnt, const uint8_t *src, size_t srccnt)
 {
 	uint16_t *channel_data;
-	int i, cur_channel;
+	uint64_t planes[16];
+	unsigned int channel_bits[16];
+	int i, cur_channel, blk, num_blocks;
 	size_t ret = 0;
 	uint16_t sample, channel_mask;
 
@@ -817,7 +819,41 @@ static size_t convert_sample_data(struct dev_context *devc,
 	channel_data = devc->channel_data;
 	cur_channel = devc->cur_channel;
 
-	while (srccnt--) {
+	for (i = 0; i < devc->num_channels; i++)
+		for (channel_bits[i] = 0; channel_bits[i] < 15; channel_bits[i]++)
+			if (devc->channel_masks[i] & (1 << channel_bits[i]))
+				break;
+
+	while (srccnt) {
+		/*
+		 * Whole blocks of 16 samples of every channel: transpose up
+		 * to four of them at once. Each word holds 16 samples of one
+		 * channel, the first one in its MSB.
+		 */
+		if (cur_channel == 0 && srccnt >= (size_t)devc->num_channels
+				&& destcnt >= 16 * 2) {
+			num_blocks = MIN(srccnt / devc->num_channels,
+				destcnt / (16 * 2));
+			num_blocks = MIN(num_blocks, 4);
+			memset(planes, 0, sizeof(planes));
+			for (blk = 0; blk < num_blocks; blk++) {
+				for (i = 0; i < devc->num_channels; i++) {
+					sample = src[1] | (src[0] << 8);
+					src += 2;
+					planes[channel_bits[i]] |=
+						(uint64_t)sample << (16 * blk);
+				}
+			}
+			sr_transpose_planes16(planes, (uint16_t *)dest,
+				16 * num_blocks, TRUE);
+			srccnt -= num_blocks * devc->num_channels;
+			dest += num_blocks * 16 * 2;
+			ret += num_blocks * 16;
+			destcnt -= num_blocks * 16 * 2;
+			continue;
+		}
+
+		srccnt--;
 		sample = src[0] | (src[1] << 8);
 		src += 2;
 
@@ -831,6 +867,7 @@ static size_t convert_sample_data(struct dev_context *devc,
 			cur_channel = 0;
 			if (destcnt < 16 * 2) {
 				sr_err("Conversion buffer too small!");
+				memset(channel_data, 0, 16 * 2);
 				break;
 			}
 			memcpy(dest, channel_data, 16 * 2);
@@ -211,6 +211,8 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Device mode", NULL},
 	{SR_CONF_TEST_MODE, SR_T_STRING, "test_mode",
 		"Test mode", NULL},
+	{SR_CONF_UNTHROTTLED, SR_T_BOOL, "unthrottled",
+		"Unthrottled", NULL},
 
 	ALL_ZERO
 };
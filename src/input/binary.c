@@ -63,14 +63,16 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of the data, returns how many bytes they take. */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+		size_t len)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
 	struct sr_datafeed_logic logic;
 	struct sr_config *src;
 	struct context *inc;
-	gsize chunk_size, i;
+	gsize chunk_size, max_chunk, i;
 	int chunk;
 
 	inc = in->priv;
@@ -95,23 +97,31 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
 
 	/* Cut off at multiple of unitsize. */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
+
+	/* Packets of whole samples, too. */
+	max_chunk = MAX(MAX_CHUNK_SIZE / logic.unitsize, 1) * logic.unitsize;
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
-		chunk = MIN(MAX_CHUNK_SIZE, chunk_size - i);
+		logic.data = (uint8_t *)data + i;
+		chunk = MIN(max_chunk, chunk_size - i);
 		logic.length = chunk;
 		sr_session_send(in->sdi, &packet);
 	}
-	g_string_erase(in->buf, 0, chunk_size);
 
-	return SR_OK;
+	return chunk_size;
 }
 
-static int receive(struct sr_input *in, GString *buf)
+static void process_buffer(struct sr_input *in)
 {
-	int ret;
+	size_t len;
 
+	len = process_data(in, (const uint8_t *)in->buf->str, in->buf->len);
+	g_string_erase(in->buf, 0, len);
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
 	g_string_append_len(in->buf, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
@@ -120,26 +130,41 @@ static int receive(struct sr_input *in, GString *buf)
 		return SR_OK;
 	}
 
-	ret = process_buffer(in);
+	process_buffer(in);
 
-	return ret;
+	return SR_OK;
+}
+
+static int receive_window(struct sr_input *in, const uint8_t *data,
+		size_t len, size_t *consumed, gboolean is_final)
+{
+	(void)is_final;
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		*consumed = 0;
+		return SR_OK;
+	}
+
+	/* The samples go out straight from the window. */
+	*consumed = process_data(in, data, len);
+
+	return SR_OK;
 }
 
 static int end(struct sr_input *in)
 {
 	struct context *inc;
-	int ret;
 
 	if (in->sdi_ready)
-		ret = process_buffer(in);
-	else
-		ret = SR_OK;
+		process_buffer(in);
 
 	inc = in->priv;
 	if (inc->started)
 		std_session_send_df_end(in->sdi);
 
-	return ret;
+	return SR_OK;
 }
 
 static int reset(struct sr_input *in)
@@ -176,6 +201,7 @@ SR_PRIV struct sr_input_module input_binary = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_window = receive_window,
 	.end = end,
 	.reset = reset,
 };
@@ -20,6 +20,9 @@
 #include <config.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -28,6 +31,14 @@
 
 #define DATAFEED_MAX_SAMPLES	(128 * 1024)
 
+/* Less text than this is not worth splitting up across threads. */
+#define THREAD_MIN_TEXT		(256 * 1024)
+
+/* Marks characters which are no digit of the single column format. */
+#define NO_DIGIT		0xff
+
+#define REPEAT_BYTE(b)		(0x0101010101010101ULL * (uint8_t)(b))
+
 /*
  * The CSV input module has the following options:
  *
@@ -67,6 +78,11 @@
  *
  * startline:     Line number to start processing sample data. Must be greater
  *                than 0. The default line number to start processing is 1.
+ *
+ * threads:       Number of additional threads which parse large blocks of
+ *                lines in parallel with the calling thread. The samples are
+ *                sent in the order of the lines. Default value is 0, which
+ *                parses all lines in the calling thread.
  */
 
 /*
@@ -155,11 +171,17 @@ struct context {
 	 */
 	gboolean header;
 
+	/* The header line of the current stream is still to be skipped. */
+	gboolean skip_header;
+
 	/* Format sample data is stored in single column mode. */
 	int format;
 
+	/* Value of each character as a digit of the format, or NO_DIGIT. */
+	uint8_t digit_value[256];
+	unsigned int digit_bits;
+
 	size_t sample_unit_size;	/**!< Byte count for a single sample. */
-	uint8_t *sample_buffer;		/**!< Buffer for a single sample. */
 
 	uint8_t *datafeed_buffer;	/**!< Queue for datafeed submission. */
 	size_t datafeed_buf_size;
@@ -167,132 +189,340 @@ struct context {
 
 	/* Current line number. */
 	size_t line_number;
+
+	/* Additional parser threads. */
+	guint num_threads;
+	GThreadPool *pool;
+	GMutex mutex;
+	GCond cond;
 };
 
-static void strip_comment(char *buf, const GString *prefix)
-{
-	char *ptr;
+/* A range of complete lines, and the samples parsed from it. */
+struct text_block {
+	const char *start;
+	const char *pos;	/* Start of the lines not parsed yet. */
+	const char *end;
+	uint8_t *samples;
+	size_t num_samples;
+	size_t max_samples;
+	size_t line_number;	/* Number of the last line seen. */
+	/* Parser threads don't know line numbers, nor log errors. */
+	gboolean quiet;
+	int ret;
+	gboolean done;
+};
 
-	if (!prefix->len)
-		return;
+/* Returns the first CR or LF character in the text, or its end. */
+static const char *find_eol(const char *p, const char *end)
+{
+	uint64_t cr, lf;
+#ifdef __SSE2__
+	__m128i v, vcr, vlf;
+	int mask;
+
+	vcr = _mm_set1_epi8('\r');
+	vlf = _mm_set1_epi8('\n');
+	while (end - p >= 16) {
+		v = _mm_loadu_si128((const __m128i *)p);
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, vcr),
+			_mm_cmpeq_epi8(v, vlf)));
+		if (mask)
+			return p + sr_lowest_bit(mask);
+		p += 16;
+	}
+#endif
+
+	/* Eight characters at a time, the last word is searched bytewise. */
+	while (end - p >= 8) {
+		cr = RL64(p) ^ REPEAT_BYTE('\r');
+		lf = RL64(p) ^ REPEAT_BYTE('\n');
+		if (((cr - REPEAT_BYTE(0x01)) & ~cr & REPEAT_BYTE(0x80))
+				|| ((lf - REPEAT_BYTE(0x01)) & ~lf & REPEAT_BYTE(0x80)))
+			break;
+		p += 8;
+	}
+	while (p < end && *p != '\r' && *p != '\n')
+		p++;
 
-	if ((ptr = strstr(buf, prefix->str)))
-		*ptr = '\0';
+	return p;
 }
 
-static int parse_binstr(const char *str, struct context *inc)
+/* Returns the first occurrence of the string in the text, or NULL. */
+static const char *find_str(const char *p, const char *end, const GString *s)
 {
-	gsize i, j, length;
-
-	length = strlen(str);
+	if (s->len == 1)
+		return memchr(p, s->str[0], end - p);
 
-	if (!length) {
-		sr_err("Column %u in line %zu is empty.", inc->single_column,
-			inc->line_number);
-		return SR_ERR;
+	while ((size_t)(end - p) >= s->len) {
+		p = memchr(p, s->str[0], end - p - s->len + 1);
+		if (!p)
+			return NULL;
+		if (!memcmp(p, s->str, s->len))
+			return p;
+		p++;
 	}
 
-	/* Clear buffer in order to set bits only. */
-	memset(inc->sample_buffer, 0, inc->sample_unit_size);
+	return NULL;
+}
 
-	i = inc->first_channel;
+static void strip_space(const char **start, const char **end)
+{
+	while (*start < *end && g_ascii_isspace(**start))
+		(*start)++;
+	while (*end > *start && g_ascii_isspace((*end)[-1]))
+		(*end)--;
+}
 
-	for (j = 0; i < length && j < inc->num_channels; i++, j++) {
-		if (str[length - i - 1] == '1') {
-			inc->sample_buffer[j / 8] |= (1 << (j % 8));
-		} else if (str[length - i - 1] != '0') {
-			sr_err("Invalid value '%s' in column %u in line %zu.",
-				str, inc->single_column, inc->line_number);
-			return SR_ERR;
+/*
+ * Get the next line of the block which has content, without a comment
+ * and surrounding white space. Returns FALSE at the end of the block.
+ */
+static gboolean next_line(const struct context *inc, struct text_block *b,
+		const char **start, const char **end)
+{
+	const char *s, *e, *c;
+
+	while (b->pos < b->end) {
+		s = b->pos;
+		e = find_eol(s, b->end);
+		b->pos = (e < b->end) ? e + 1 : e;
+		b->line_number++;
+
+		if (!b->quiet && inc->start_line > b->line_number) {
+			sr_spew("Line %zu skipped.", b->line_number);
+			continue;
 		}
+
+		/* Remove trailing comment. */
+		if (inc->comment->len && (c = find_str(s, e, inc->comment)))
+			e = c;
+		strip_space(&s, &e);
+		if (s == e) {
+			if (!b->quiet)
+				sr_spew("Blank or comment-only line %zu skipped.",
+					b->line_number);
+			continue;
+		}
+
+		*start = s;
+		*end = e;
+		return TRUE;
 	}
 
-	return SR_OK;
+	return FALSE;
 }
 
-static int parse_hexstr(const char *str, struct context *inc)
+/* Skip the columns before the first one of interest, NULL if missing. */
+static const char *skip_columns(const struct context *inc,
+		const char *p, const char *end)
 {
-	gsize i, j, k, length;
-	uint8_t value;
-	char c;
-
-	length = strlen(str);
+	unsigned int n;
 
-	if (!length) {
-		sr_err("Column %u in line %zu is empty.", inc->single_column,
-			inc->line_number);
-		return SR_ERR;
+	for (n = 0; n < inc->first_column; n++) {
+		if (!(p = find_str(p, end, inc->delimiter)))
+			return NULL;
+		p += inc->delimiter->len;
 	}
 
-	/* Clear buffer in order to set bits only. */
-	memset(inc->sample_buffer, 0, inc->sample_unit_size);
-
-	/* Calculate the position of the first hexadecimal digit. */
-	i = inc->first_channel / 4;
+	return p;
+}
 
-	for (j = 0; i < length && j < inc->num_channels; i++) {
-		c = str[length - i - 1];
+/* Gathers the lowest bits of bytes 0, 2, 4 and 6 of the word. */
+#define PACK_EVEN_BYTES(w) \
+	((((w) & 0x0001000100010001ULL) * 0x0001000200040008ULL) >> 48 & 0x0f)
 
-		if (!g_ascii_isxdigit(c)) {
-			sr_err("Invalid value '%s' in column %u in line %zu.",
-				str, inc->single_column, inc->line_number);
-			return SR_ERR;
-		}
+/*
+ * Decode eight columns at once, for the common "0,1,1,0,..." layout.
+ * Returns -1 unless the 16 characters are eight single digit columns
+ * which are each followed by the (single character) delimiter.
+ */
+static int parse_eight_columns(const char *p, char delimiter)
+{
+	uint64_t lo, hi, delims;
+
+	lo = RL64(p);
+	hi = RL64(p + 8);
+	delims = REPEAT_BYTE(delimiter) & 0xff00ff00ff00ff00ULL;
+	if ((lo & 0xff00ff00ff00ff00ULL) != delims
+			|| (hi & 0xff00ff00ff00ff00ULL) != delims)
+		return -1;
+	if ((lo & 0x00fe00fe00fe00feULL) != 0x0030003000300030ULL
+			|| (hi & 0x00fe00fe00fe00feULL) != 0x0030003000300030ULL)
+		return -1;
+
+	return PACK_EVEN_BYTES(lo) | PACK_EVEN_BYTES(hi) << 4;
+}
 
-		value = g_ascii_xdigit_value(c);
+static int parse_multi_columns(const struct context *inc,
+		const struct text_block *b, const char *p, const char *end,
+		uint8_t *sample)
+{
+	const char *s, *e, *d;
+	char last[16], delimiter;
+	size_t i;
+	int bits;
 
-		k = (inc->first_channel + j) % 4;
+	if (!(p = skip_columns(inc, p, end))) {
+		if (!b->quiet)
+			sr_err("Column %u in line %zu is out of bounds.",
+				inc->first_column, b->line_number);
+		return SR_ERR;
+	}
 
-		for (; j < inc->num_channels && k < 4; k++) {
-			if (value & (1 << k))
-				inc->sample_buffer[j / 8] |= (1 << (j % 8));
+	i = 0;
+	if (inc->delimiter->len == 1) {
+		delimiter = inc->delimiter->str[0];
+		for (; i + 8 <= inc->num_channels; i += 8) {
+			if (end - p >= 16) {
+				bits = parse_eight_columns(p, delimiter);
+			} else if (end - p == 15 && i + 8 == inc->num_channels) {
+				/* The last column has no delimiter after it. */
+				memcpy(last, p, 15);
+				last[15] = delimiter;
+				bits = parse_eight_columns(last, delimiter);
+			} else {
+				break;
+			}
+			if (bits < 0)
+				break;
+			sample[i / 8] = bits;
+			p += 16;
+		}
+		if (i == inc->num_channels)
+			return SR_OK;
+	}
 
-			j++;
+	for (; i < inc->num_channels; i++) {
+		d = find_str(p, end, inc->delimiter);
+		if (!d && i + 1 < inc->num_channels) {
+			if (!b->quiet)
+				sr_err("Not enough columns for desired number of channels in line %zu.",
+					b->line_number);
+			return SR_ERR;
 		}
+		s = p;
+		e = d ? d : end;
+		strip_space(&s, &e);
+		if (s == e) {
+			if (!b->quiet)
+				sr_err("Column %zu in line %zu is empty.",
+					inc->first_channel + i, b->line_number);
+			return SR_ERR;
+		} else if (*s == '1') {
+			sample[i / 8] |= 1 << (i % 8);
+		} else if (*s != '0') {
+			if (!b->quiet)
+				sr_err("Invalid value '%.*s' in column %zu in line %zu.",
+					(int)(e - s), s, inc->first_channel + i,
+					b->line_number);
+			return SR_ERR;
+		}
+		if (d)
+			p = d + inc->delimiter->len;
 	}
 
 	return SR_OK;
 }
 
-static int parse_octstr(const char *str, struct context *inc)
+/*
+ * Decode the single column of binary, octal or hexadecimal digits. The
+ * rightmost digit holds the lowest bits, 'first-channel' is the number
+ * of low bits to skip.
+ */
+static int parse_single_column(const struct context *inc,
+		const struct text_block *b, const char *p, const char *end,
+		uint8_t *sample)
 {
-	gsize i, j, k, length;
+	const char *s, *e, *d;
+	uint64_t word, acc;
+	size_t i, len, pos;
+	unsigned int j, shift, nbits;
 	uint8_t value;
-	char c;
 
-	length = strlen(str);
-
-	if (!length) {
-		sr_err("Column %u in line %zu is empty.", inc->single_column,
-			inc->line_number);
+	if (!(s = skip_columns(inc, p, end))) {
+		if (!b->quiet)
+			sr_err("Column %u in line %zu is out of bounds.",
+				inc->first_column, b->line_number);
+		return SR_ERR;
+	}
+	d = find_str(s, end, inc->delimiter);
+	e = d ? d : end;
+	strip_space(&s, &e);
+	len = e - s;
+	if (!len) {
+		if (!b->quiet)
+			sr_err("Column %u in line %zu is empty.",
+				inc->single_column, b->line_number);
 		return SR_ERR;
 	}
 
-	/* Clear buffer in order to set bits only. */
-	memset(inc->sample_buffer, 0, inc->sample_unit_size);
-
-	/* Calculate the position of the first octal digit. */
-	i = inc->first_channel / 3;
-
-	for (j = 0; i < length && j < inc->num_channels; i++) {
-		c = str[length - i - 1];
+	/* Digit i counts from the right, j is the next channel. */
+	i = inc->first_channel / inc->digit_bits;
+	shift = inc->first_channel % inc->digit_bits;
+	j = 0;
+	pos = 0;
+
+	/* Binary digits go eight at a time while they fill whole bytes. */
+	if (inc->digit_bits == 1) {
+		while (i + 8 <= len && j + 8 <= inc->num_channels) {
+			word = RL64(e - i - 8);
+			if ((word & ~REPEAT_BYTE(0x01)) != REPEAT_BYTE('0'))
+				break;
+			sample[pos++] = ((word & REPEAT_BYTE(0x01))
+				* 0x8040201008040201ULL) >> 56;
+			i += 8;
+			j += 8;
+		}
+	}
 
-		if (c < '0' || c > '7') {
-			sr_err("Invalid value '%s' in column %u in line %zu.",
-				str, inc->single_column, inc->line_number);
+	acc = 0;
+	nbits = 0;
+	for (; i < len && j < inc->num_channels; i++) {
+		value = inc->digit_value[(uint8_t)e[-1 - (ptrdiff_t)i]];
+		if (value == NO_DIGIT) {
+			if (!b->quiet)
+				sr_err("Invalid value '%.*s' in column %u in line %zu.",
+					(int)len, s, inc->single_column,
+					b->line_number);
 			return SR_ERR;
 		}
+		acc |= (uint64_t)(value >> shift) << nbits;
+		nbits += inc->digit_bits - shift;
+		j += inc->digit_bits - shift;
+		shift = 0;
+		if (nbits >= 8) {
+			sample[pos++] = acc;
+			acc >>= 8;
+			nbits -= 8;
+		}
+	}
+	if (nbits && pos < inc->sample_unit_size)
+		sample[pos] = acc;
 
-		value = g_ascii_xdigit_value(c);
+	/* The last digit may have covered more than the channels. */
+	if (inc->num_channels % 8)
+		sample[inc->sample_unit_size - 1] &= (1 << (inc->num_channels % 8)) - 1;
 
-		k = (inc->first_channel + j) % 3;
+	return SR_OK;
+}
 
-		for (; j < inc->num_channels && k < 3; k++) {
-			if (value & (1 << k))
-				inc->sample_buffer[j / 8] |= (1 << (j % 8));
+/* Parse lines of the block, until its sample buffer is full. */
+static int parse_lines(const struct context *inc, struct text_block *b)
+{
+	const char *s, *e;
+	uint8_t *sample;
+	int ret;
 
-			j++;
-		}
+	while (b->num_samples < b->max_samples && next_line(inc, b, &s, &e)) {
+		sample = b->samples + b->num_samples * inc->sample_unit_size;
+		memset(sample, 0, inc->sample_unit_size);
+		if (inc->multi_column_mode)
+			ret = parse_multi_columns(inc, b, s, e, sample);
+		else
+			ret = parse_single_column(inc, b, s, e, sample);
+		if (ret != SR_OK)
+			return ret;
+		b->num_samples++;
 	}
 
 	return SR_OK;
@@ -346,74 +576,45 @@ static char **parse_line(char *buf, struct context *inc, int max_columns)
 	return columns;
 }
 
-static int parse_multi_columns(char **columns, struct context *inc)
+static int send_samples(const struct sr_input *in, const uint8_t *data,
+		size_t len)
 {
-	gsize i;
-	char *column;
-
-	/* Clear buffer in order to set bits only. */
-	memset(inc->sample_buffer, 0, inc->sample_unit_size);
-
-	for (i = 0; i < inc->num_channels; i++) {
-		column = columns[i];
-		if (column[0] == '1') {
-			inc->sample_buffer[i / 8] |= (1 << (i % 8));
-		} else if (!strlen(column)) {
-			sr_err("Column %zu in line %zu is empty.",
-				inc->first_channel + i, inc->line_number);
-			return SR_ERR;
-		} else if (column[0] != '0') {
-			sr_err("Invalid value '%s' in column %zu in line %zu.",
-				column, inc->first_channel + i,
-				inc->line_number);
-			return SR_ERR;
-		}
-	}
-
-	return SR_OK;
-}
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	int rc;
 
-static int parse_single_column(const char *column, struct context *inc)
-{
-	int res;
+	inc = in->priv;
 
-	res = SR_ERR;
+	memset(&packet, 0, sizeof(packet));
+	memset(&logic, 0, sizeof(logic));
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = inc->sample_unit_size;
 
-	switch (inc->format) {
-	case FORMAT_BIN:
-		res = parse_binstr(column, inc);
-		break;
-	case FORMAT_HEX:
-		res = parse_hexstr(column, inc);
-		break;
-	case FORMAT_OCT:
-		res = parse_octstr(column, inc);
-		break;
+	while (len) {
+		logic.length = MIN(len, inc->datafeed_buf_size);
+		logic.data = (uint8_t *)data;
+		rc = sr_session_send(in->sdi, &packet);
+		if (rc != SR_OK)
+			return rc;
+		data += logic.length;
+		len -= logic.length;
 	}
 
-	return res;
+	return SR_OK;
 }
 
 static int flush_samples(const struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	int rc;
 
 	inc = in->priv;
 	if (!inc->datafeed_buf_fill)
 		return SR_OK;
 
-	memset(&packet, 0, sizeof(packet));
-	memset(&logic, 0, sizeof(logic));
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->sample_unit_size;
-	logic.length = inc->datafeed_buf_fill;
-	logic.data = inc->datafeed_buffer;
-
-	rc = sr_session_send(in->sdi, &packet);
+	rc = send_samples(in, inc->datafeed_buffer, inc->datafeed_buf_fill);
 	if (rc != SR_OK)
 		return rc;
 
@@ -421,27 +622,155 @@ static int flush_samples(const struct sr_input *in)
 	return SR_OK;
 }
 
-static int queue_samples(const struct sr_input *in)
+/* Parse complete lines in the calling thread, queueing the samples. */
+static int parse_text(const struct sr_input *in, const char *start,
+		const char *end)
 {
 	struct context *inc;
-	int rc;
+	struct text_block b;
+	const char *s, *e;
+	int ret;
 
 	inc = in->priv;
 
-	inc->datafeed_buf_fill += inc->sample_unit_size;
-	if (inc->datafeed_buf_fill == inc->datafeed_buf_size) {
-		rc = flush_samples(in);
-		if (rc != SR_OK)
-			return rc;
+	memset(&b, 0, sizeof(b));
+	b.start = b.pos = start;
+	b.end = end;
+	b.line_number = inc->line_number;
+
+	/* Skip the header line, its content was used as the channel names. */
+	if (inc->skip_header && next_line(inc, &b, &s, &e)) {
+		sr_spew("Header line %zu skipped.", b.line_number);
+		inc->skip_header = FALSE;
 	}
-	inc->sample_buffer = &inc->datafeed_buffer[inc->datafeed_buf_fill];
-	return SR_OK;
+
+	ret = SR_OK;
+	while (ret == SR_OK && b.pos < b.end) {
+		if (inc->datafeed_buf_fill == inc->datafeed_buf_size) {
+			ret = flush_samples(in);
+			if (ret != SR_OK) {
+				sr_err("Sending samples failed.");
+				break;
+			}
+		}
+		b.samples = &inc->datafeed_buffer[inc->datafeed_buf_fill];
+		b.num_samples = 0;
+		b.max_samples = inc->datafeed_buf_size - inc->datafeed_buf_fill;
+		b.max_samples /= inc->sample_unit_size;
+		ret = parse_lines(inc, &b);
+		inc->datafeed_buf_fill += b.num_samples * inc->sample_unit_size;
+	}
+	inc->line_number = b.line_number;
+
+	return ret;
+}
+
+static void parse_job_run(gpointer data, gpointer user_data)
+{
+	struct text_block *b;
+	struct context *inc;
+	int ret;
+
+	b = data;
+	inc = user_data;
+
+	/* The buffer was sized for the shortest lines, but don't rely on it. */
+	while ((ret = parse_lines(inc, b)) == SR_OK && b->pos < b->end) {
+		b->max_samples *= 2;
+		b->samples = g_realloc(b->samples,
+			b->max_samples * inc->sample_unit_size);
+	}
+
+	g_mutex_lock(&inc->mutex);
+	b->ret = ret;
+	b->done = TRUE;
+	g_cond_broadcast(&inc->cond);
+	g_mutex_unlock(&inc->mutex);
+}
+
+/*
+ * Split the complete lines into one block per thread, parse the blocks
+ * in parallel, and send their samples in order.
+ */
+static int parse_text_threaded(const struct sr_input *in, const char *start,
+		const char *end)
+{
+	struct context *inc;
+	struct text_block *blocks, *b;
+	const char *pos, *split;
+	size_t min_line_len;
+	guint num_blocks, i;
+	int ret;
+
+	inc = in->priv;
+
+	/* Each line with a sample has at least one character per column. */
+	min_line_len = inc->first_column + 2;
+	if (inc->multi_column_mode)
+		min_line_len += 2 * (inc->num_channels - 1);
+
+	num_blocks = inc->num_threads + 1;
+	blocks = g_malloc0(num_blocks * sizeof(*blocks));
+	pos = start;
+	for (i = 0; i < num_blocks; i++) {
+		b = &blocks[i];
+		split = end;
+		if (i + 1 < num_blocks) {
+			split = MAX(pos, start + (end - start) / num_blocks * (i + 1));
+			split = find_eol(split, end);
+			if (split < end)
+				split++;
+		}
+		b->start = b->pos = pos;
+		b->end = split;
+		b->max_samples = (split - pos) / min_line_len + 1;
+		b->samples = g_malloc(b->max_samples * inc->sample_unit_size);
+		b->quiet = TRUE;
+		pos = split;
+		/* The last block is parsed in this thread. */
+		if (i + 1 < num_blocks)
+			g_thread_pool_push(inc->pool, b, NULL);
+		else
+			parse_job_run(b, inc);
+	}
+
+	g_mutex_lock(&inc->mutex);
+	for (i = 0; i < num_blocks; i++) {
+		while (!blocks[i].done)
+			g_cond_wait(&inc->cond, &inc->mutex);
+	}
+	g_mutex_unlock(&inc->mutex);
+
+	ret = SR_OK;
+	for (i = 0; i < num_blocks && ret == SR_OK; i++) {
+		b = &blocks[i];
+		if (b->ret != SR_OK) {
+			/* Parse the block again, to report the error properly. */
+			ret = parse_text(in, b->start, b->end);
+			continue;
+		}
+		ret = flush_samples(in);
+		if (ret == SR_OK)
+			ret = send_samples(in, b->samples,
+				b->num_samples * inc->sample_unit_size);
+		if (ret != SR_OK)
+			sr_err("Sending samples failed.");
+		inc->line_number += b->line_number;
+	}
+
+	for (i = 0; i < num_blocks; i++)
+		g_free(blocks[i].samples);
+	g_free(blocks);
+
+	return ret;
 }
 
 static int init(struct sr_input *in, GHashTable *options)
 {
 	struct context *inc;
 	const char *s;
+	GError *error;
+	unsigned int i;
 
 	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
 	in->priv = inc = g_malloc0(sizeof(struct context));
@@ -461,14 +790,23 @@ static int init(struct sr_input *in, GHashTable *options)
 	s = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
 	if (!g_ascii_strncasecmp(s, "bin", 3)) {
 		inc->format = FORMAT_BIN;
+		inc->digit_bits = 1;
 	} else if (!g_ascii_strncasecmp(s, "hex", 3)) {
 		inc->format = FORMAT_HEX;
+		inc->digit_bits = 4;
 	} else if (!g_ascii_strncasecmp(s, "oct", 3)) {
 		inc->format = FORMAT_OCT;
+		inc->digit_bits = 3;
 	} else {
 		sr_err("Invalid format: '%s'", s);
 		return SR_ERR_ARG;
 	}
+	memset(inc->digit_value, NO_DIGIT, sizeof(inc->digit_value));
+	for (i = 0; i < G_N_ELEMENTS(inc->digit_value); i++) {
+		if (g_ascii_isxdigit(i)
+				&& g_ascii_xdigit_value(i) < (1 << inc->digit_bits))
+			inc->digit_value[i] = g_ascii_xdigit_value(i);
+	}
 
 	inc->comment = g_string_new(g_variant_get_string(
 			g_hash_table_lookup(options, "comment"), NULL));
@@ -484,6 +822,7 @@ static int init(struct sr_input *in, GHashTable *options)
 	inc->first_channel = g_variant_get_int32(g_hash_table_lookup(options, "first-channel"));
 
 	inc->header = g_variant_get_boolean(g_hash_table_lookup(options, "header"));
+	inc->skip_header = inc->header;
 
 	inc->start_line = g_variant_get_int32(g_hash_table_lookup(options, "startline"));
 	if (inc->start_line < 1) {
@@ -501,11 +840,25 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR_ARG;
 	}
 
+	inc->num_threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
+	if (inc->num_threads > 0) {
+		g_mutex_init(&inc->mutex);
+		g_cond_init(&inc->cond);
+		error = NULL;
+		inc->pool = g_thread_pool_new(parse_job_run, inc,
+			inc->num_threads, TRUE, &error);
+		if (!inc->pool) {
+			sr_warn("Failed to start parser threads, parsing "
+				"inline: %s", error->message);
+			g_error_free(error);
+			g_mutex_clear(&inc->mutex);
+			g_cond_clear(&inc->cond);
+		}
+	}
+
 	return SR_OK;
 }
 
-static const char *delim_set = "\r\n";
-
 static const char *get_line_termination(GString *buf)
 {
 	const char *term;
@@ -521,46 +874,32 @@ static const char *get_line_termination(GString *buf)
 	return term;
 }
 
-static int initial_parse(const struct sr_input *in, GString *buf)
+static int initial_parse(const struct sr_input *in, const char *text,
+		size_t len)
 {
 	struct context *inc;
+	struct text_block b;
 	GString *channel_name;
 	unsigned int num_columns, i;
-	size_t line_number, l;
+	size_t line_number;
+	gboolean have_channels;
 	int ret;
-	char **lines, *line, **columns, *column;
+	const char *s, *e;
+	char *line, **columns, *column;
 
 	ret = SR_OK;
 	inc = in->priv;
 	columns = NULL;
 
-	line_number = 0;
-	lines = g_strsplit_set(buf->str, delim_set, 0);
-	for (l = 0; lines[l]; l++) {
-		line_number++;
-		line = lines[l];
-		if (inc->start_line > line_number) {
-			sr_spew("Line %zu skipped.", line_number);
-			continue;
-		}
-		if (line[0] == '\0') {
-			sr_spew("Blank line %zu skipped.", line_number);
-			continue;
-		}
-		strip_comment(line, inc->comment);
-		if (line[0] == '\0') {
-			sr_spew("Comment-only line %zu skipped.", line_number);
-			continue;
-		}
-
-		/* Reached first proper line. */
-		break;
-	}
-	if (!lines[l]) {
+	memset(&b, 0, sizeof(b));
+	b.pos = text;
+	b.end = text + len;
+	if (!next_line(inc, &b, &s, &e)) {
 		/* Not enough data for a proper line yet. */
-		ret = SR_ERR_NA;
-		goto out;
+		return SR_ERR_NA;
 	}
+	line_number = b.line_number;
+	line = g_strndup(s, e - s);
 
 	/*
 	 * In order to determine the number of columns parse the current line
@@ -605,10 +944,13 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 		}
 	}
 
+	/* After a reset the channels are there already. */
+	have_channels = in->sdi->channels != NULL;
 	channel_name = g_string_sized_new(64);
-	for (i = 0; i < inc->num_channels; i++) {
-		column = columns[i];
-		if (inc->header && inc->multi_column_mode && column[0] != '\0')
+	for (i = 0; i < inc->num_channels && !have_channels; i++) {
+		/* Single column mode has fewer columns than channels. */
+		column = inc->multi_column_mode ? columns[i] : NULL;
+		if (inc->header && column && column[0] != '\0')
 			g_string_assign(channel_name, column);
 		else
 			g_string_printf(channel_name, "%u", i);
@@ -620,20 +962,19 @@ static int initial_parse(const struct sr_input *in, GString *buf)
 	 * Calculate the minimum buffer size to store the set of samples
 	 * of all channels (unit size). Determine a larger buffer size
 	 * for datafeed submission that is a multiple of the unit size.
-	 * Allocate the larger buffer, and have the "sample buffer" point
-	 * to a location within that large buffer.
+	 * The lines are parsed straight into that larger buffer.
 	 */
 	inc->sample_unit_size = (inc->num_channels + 7) / 8;
 	inc->datafeed_buf_size = DATAFEED_MAX_SAMPLES;
 	inc->datafeed_buf_size *= inc->sample_unit_size;
+	g_free(inc->datafeed_buffer);
 	inc->datafeed_buffer = g_malloc(inc->datafeed_buf_size);
 	inc->datafeed_buf_fill = 0;
-	inc->sample_buffer = &inc->datafeed_buffer[inc->datafeed_buf_fill];
 
 out:
 	if (columns)
 		g_strfreev(columns);
-	g_strfreev(lines);
+	g_free(line);
 
 	return ret;
 }
@@ -662,8 +1003,7 @@ static void initial_bom_check(const struct sr_input *in)
 static int initial_receive(const struct sr_input *in)
 {
 	struct context *inc;
-	GString *new_buf;
-	int len, ret;
+	int ret;
 	char *p;
 	const char *termination;
 
@@ -680,18 +1020,13 @@ static int initial_receive(const struct sr_input *in)
 	if (!p)
 		/* Don't have a full line yet. */
 		return SR_ERR_NA;
-	len = p - in->buf->str - 1;
-	new_buf = g_string_new_len(in->buf->str, len);
-	g_string_append_c(new_buf, '\0');
-
-	inc->termination = g_strdup(termination);
 
 	if (in->buf->str[0] != '\0')
-		ret = initial_parse(in, new_buf);
+		ret = initial_parse(in, in->buf->str, p - in->buf->str);
 	else
 		ret = SR_OK;
-
-	g_string_free(new_buf, TRUE);
+	if (ret == SR_OK)
+		inc->termination = g_strdup(termination);
 
 	return ret;
 }
@@ -702,10 +1037,9 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	struct sr_datafeed_meta meta;
 	struct sr_config *src;
 	struct context *inc;
-	gsize num_columns;
 	uint64_t samplerate;
-	int max_columns, ret, l;
-	char *p, **lines, *line, **columns;
+	const char *text_end, *p;
+	int ret;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -725,12 +1059,6 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		inc->started = TRUE;
 	}
 
-	/* Limit the number of columns to parse. */
-	if (inc->multi_column_mode)
-		max_columns = inc->num_channels;
-	else
-		max_columns = 1;
-
 	/*
 	 * Consider empty input non-fatal. Keep accumulating input until
 	 * at least one full text line has become available. Grab the
@@ -747,91 +1075,28 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	if (!in->buf->len)
 		return SR_OK;
 	if (is_eof) {
-		p = in->buf->str + in->buf->len;
+		text_end = p = in->buf->str + in->buf->len;
 	} else {
-		p = g_strrstr_len(in->buf->str, in->buf->len, inc->termination);
-		if (!p)
-			return SR_ERR;
-		*p = '\0';
-		p += strlen(inc->termination);
+		text_end = g_strrstr_len(in->buf->str, in->buf->len, inc->termination);
+		if (!text_end)
+			return SR_OK;
+		p = text_end + strlen(inc->termination);
 	}
-	g_strstrip(in->buf->str);
-
-	ret = SR_OK;
-	lines = g_strsplit_set(in->buf->str, delim_set, 0);
-	for (l = 0; lines[l]; l++) {
-		inc->line_number++;
-		line = lines[l];
-		if (line[0] == '\0') {
-			sr_spew("Blank line %zu skipped.", inc->line_number);
-			continue;
-		}
-
-		/* Remove trailing comment. */
-		strip_comment(line, inc->comment);
-		if (line[0] == '\0') {
-			sr_spew("Comment-only line %zu skipped.", inc->line_number);
-			continue;
-		}
-
-		/* Skip the header line, its content was used as the channel names. */
-		if (inc->header) {
-			sr_spew("Header line %zu skipped.", inc->line_number);
-			inc->header = FALSE;
-			continue;
-		}
-
-		columns = parse_line(line, inc, max_columns);
-		if (!columns) {
-			sr_err("Error while parsing line %zu.", inc->line_number);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-		num_columns = g_strv_length(columns);
-		if (!num_columns) {
-			sr_err("Column %u in line %zu is out of bounds.",
-				inc->first_column, inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-		/*
-		 * Ensure that the number of channels does not exceed the number
-		 * of columns in multi column mode.
-		 */
-		if (inc->multi_column_mode && num_columns < inc->num_channels) {
-			sr_err("Not enough columns for desired number of channels in line %zu.",
-				inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-
-		if (inc->multi_column_mode)
-			ret = parse_multi_columns(columns, inc);
-		else
-			ret = parse_single_column(columns[0], inc);
-		if (ret != SR_OK) {
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
 
-		/* Send sample data to the session bus. */
-		ret = queue_samples(in);
-		if (ret != SR_OK) {
-			sr_err("Sending samples failed.");
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-
-		g_strfreev(columns);
-	}
-	g_strfreev(lines);
+	/*
+	 * Hand large amounts of text to the parser threads, once the lines
+	 * which need to be counted or looked at in order are behind.
+	 */
+	if (inc->pool && !inc->skip_header && inc->line_number + 1 >= inc->start_line
+			&& text_end - in->buf->str >= THREAD_MIN_TEXT)
+		ret = parse_text_threaded(in, in->buf->str, text_end);
+	else
+		ret = parse_text(in, in->buf->str, text_end);
+	if (ret != SR_OK)
+		return SR_ERR;
 	g_string_erase(in->buf, 0, p - in->buf->str);
 
-	return ret;
+	return SR_OK;
 }
 
 static int receive(struct sr_input *in, GString *buf)
@@ -897,13 +1162,28 @@ static void cleanup(struct sr_input *in)
 
 	g_free(inc->termination);
 	g_free(inc->datafeed_buffer);
+
+	if (inc->pool) {
+		g_thread_pool_free(inc->pool, FALSE, TRUE);
+		inc->pool = NULL;
+		g_mutex_clear(&inc->mutex);
+		g_cond_clear(&inc->cond);
+	}
 }
 
 static int reset(struct sr_input *in)
 {
 	struct context *inc = in->priv;
 
-	cleanup(in);
+	/*
+	 * Start over with the first line, which is looked at once more.
+	 * The options, channels and parser threads are kept.
+	 */
+	g_free(inc->termination);
+	inc->termination = NULL;
+	inc->skip_header = inc->header;
+	inc->line_number = 0;
+	inc->datafeed_buf_fill = 0;
 	inc->started = FALSE;
 	g_string_truncate(in->buf, 0);
 
@@ -920,6 +1200,7 @@ static struct sr_option options[] = {
 	{ "first-channel", "First channel", "Column number of first channel", NULL, NULL },
 	{ "header", "Header", "Treat first line as header with channel names", NULL, NULL },
 	{ "startline", "Start line", "Line number at which to start processing samples", NULL, NULL },
+	{ "threads", "Threads", "Number of additional parser threads (0: parse in the calling thread)", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -935,6 +1216,7 @@ static const struct sr_option *get_options(void)
 		options[6].def = g_variant_ref_sink(g_variant_new_int32(0));
 		options[7].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
 		options[8].def = g_variant_ref_sink(g_variant_new_int32(1));
+		options[9].def = g_variant_ref_sink(g_variant_new_uint32(0));
 	}
 
 	return options;
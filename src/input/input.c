@@ -545,6 +545,106 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
 	return in->module->receive((struct sr_input *)in, buf);
 }
 
+/**
+ * Map a file into memory, to feed it to the specified input instance
+ * without copying it.
+ *
+ * After this, the file is fed with sr_input_send_mapped() instead of
+ * sr_input_send(), followed by sr_input_end() as usual. Not all input
+ * modules support mapped input, the caller can fall back to reading the
+ * file and sr_input_send() when SR_ERR_NA is returned.
+ *
+ * @param in The input instance. Must not be NULL.
+ * @param filename The file to map. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The input module does not support mapped input.
+ * @retval SR_ERR The file could not be mapped.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_map_file(const struct sr_input *in, const char *filename)
+{
+	struct sr_input *input;
+	GError *error;
+
+	if (!in || !filename || !filename[0] || in->mapped)
+		return SR_ERR_ARG;
+	if (!in->module->receive_window)
+		return SR_ERR_NA;
+
+	error = NULL;
+	input = (struct sr_input *)in;
+	input->mapped = g_mapped_file_new(filename, FALSE, &error);
+	if (!input->mapped) {
+		sr_err("Failed to map %s: %s", filename, error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+	input->mapped_consumed = input->mapped_offered = 0;
+
+	return SR_OK;
+}
+
+/* Offer the module the mapped file up to the given offset. */
+static int send_window(struct sr_input *in, size_t end, gboolean is_final)
+{
+	const uint8_t *data;
+	size_t consumed;
+	int ret;
+
+	data = (const uint8_t *)g_mapped_file_get_contents(in->mapped);
+	in->mapped_offered = end;
+	consumed = 0;
+	ret = in->module->receive_window(in, data + in->mapped_consumed,
+			end - in->mapped_consumed, &consumed, is_final);
+	in->mapped_consumed += MIN(consumed, end - in->mapped_consumed);
+
+	return ret;
+}
+
+/**
+ * Send more of the mapped file to the specified input instance.
+ *
+ * This works like sr_input_send(), but the module gets the data in
+ * place, see sr_input_map_file().
+ *
+ * @param in The input instance. Must not be NULL.
+ * @param len The number of bytes to send, at most. Sending the file in
+ *            parts lets the caller pick up the device instance as soon
+ *            as it is ready.
+ * @param remaining If not NULL, the number of bytes which have not been
+ *                  sent yet is stored here.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no file mapped.
+ * @retval other Error code of the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_send_mapped(const struct sr_input *in, size_t len,
+		size_t *remaining)
+{
+	struct sr_input *input;
+	size_t size;
+	int ret;
+
+	if (!in || !in->mapped)
+		return SR_ERR_ARG;
+
+	input = (struct sr_input *)in;
+	size = g_mapped_file_get_length(in->mapped);
+	len = MIN(len, size - in->mapped_offered);
+	sr_spew("Sending %" G_GSIZE_FORMAT " mapped bytes to %s module.",
+		len, in->module->id);
+	ret = send_window(input, in->mapped_offered + len, FALSE);
+	if (remaining)
+		*remaining = size - in->mapped_offered;
+
+	return ret;
+}
+
 /**
  * Signal the input module no more data will come.
  *
@@ -555,6 +655,16 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
  */
 SR_API int sr_input_end(const struct sr_input *in)
 {
+	int ret;
+
+	/* The rest of a mapped file is part of the final data. */
+	if (in->mapped && in->sdi_ready) {
+		ret = send_window((struct sr_input *)in,
+			g_mapped_file_get_length(in->mapped), TRUE);
+		if (ret != SR_OK)
+			return ret;
+	}
+
 	sr_spew("Calling end() on %s module.", in->module->id);
 	return in->module->end((struct sr_input *)in);
 }
@@ -570,6 +680,12 @@ SR_API int sr_input_end(const struct sr_input *in)
  */
 SR_API int sr_input_reset(const struct sr_input *in)
 {
+	struct sr_input *input;
+
+	/* A mapped file is sent from the start again. */
+	input = (struct sr_input *)in;
+	input->mapped_consumed = input->mapped_offered = 0;
+
 	if (!in->module->reset) {
 		sr_spew("Tried to reset %s module but no reset handler found.",
 			in->module->id);
@@ -577,7 +693,7 @@ SR_API int sr_input_reset(const struct sr_input *in)
 	}
 
 	sr_spew("Resetting %s module.", in->module->id);
-	return in->module->reset((struct sr_input *)in);
+	return in->module->reset(input);
 }
 
 /**
@@ -593,6 +709,8 @@ SR_API void sr_input_free(const struct sr_input *in)
 	if (in->module->cleanup)
 		in->module->cleanup((struct sr_input *)in);
 	sr_dev_inst_free(in->sdi);
+	if (in->mapped)
+		g_mapped_file_unref(in->mapped);
 	if (in->buf->len > 64) {
 		/* That seems more than just some sub-unitsize leftover... */
 		sr_warn("Found %" G_GSIZE_FORMAT
@@ -30,16 +30,35 @@
 
 #define LOG_PREFIX "input/raw_analog"
 
-/* How many bytes at a time to process and send to the session bus. */
-#define CHUNK_SIZE		4096
+/* How many samples per channel to send to the session bus at a time. */
+#define DEFAULT_PACKET_SIZE	(64 * 1024)
 #define DEFAULT_NUM_CHANNELS	1
 #define DEFAULT_SAMPLERATE	0
 
+#define RL64FL(x) ((union { uint64_t u; double f; }) { .u = RL64(x) }.f)
+#define RB64FL(x) ((union { uint64_t u; double f; }) { .u = RB64(x) }.f)
+#define RS8(x) ((int8_t)R8(x))
+
+/*
+ * Converts num_samples samples of all channels to native floats, with
+ * each channel's own scale and offset.
+ */
+typedef void (*convert_func)(const uint8_t *in, float *out,
+		size_t num_samples, int num_channels,
+		const float *scale, const float *offset);
+
 struct context {
 	gboolean started;
 	int fmt_index;
 	uint64_t samplerate;
+	int num_channels;
 	int samplesize;
+	size_t packet_size;
+	/* Send normalised floats rather than the samples from the file. */
+	gboolean to_float;
+	float *scale;
+	float *offset;
+	float *float_buf;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
@@ -47,29 +66,62 @@ struct context {
 	struct sr_analog_spec spec;
 };
 
+/* One converter per sample format, with the reads resolved at build time. */
+#define CONVERTER(name, size, read) \
+static void convert_##name(const uint8_t *in, float *out, \
+		size_t num_samples, int num_channels, \
+		const float *scale, const float *offset) \
+{ \
+	size_t i; \
+	int ch; \
+\
+	for (i = 0; i < num_samples; i++) { \
+		for (ch = 0; ch < num_channels; ch++, in += size) \
+			*out++ = scale[ch] * (float)read(in) + offset[ch]; \
+	} \
+}
+
+CONVERTER(s8, 1, RS8)
+CONVERTER(u8, 1, R8)
+CONVERTER(s16le, 2, RL16S)
+CONVERTER(u16le, 2, RL16)
+CONVERTER(s16be, 2, RB16S)
+CONVERTER(u16be, 2, RB16)
+CONVERTER(s32le, 4, RL32S)
+CONVERTER(u32le, 4, RL32)
+CONVERTER(s32be, 4, RB32S)
+CONVERTER(u32be, 4, RB32)
+CONVERTER(f32le, 4, RLFL)
+CONVERTER(f32be, 4, RBFL)
+CONVERTER(f64le, 8, RL64FL)
+CONVERTER(f64be, 8, RB64FL)
+
 struct sample_format {
 	const char *fmt_name;
 	struct sr_analog_encoding encoding;
+	convert_func convert;
 };
 
 static const struct sample_format sample_formats[] =
 {
-	{ "S8",         { 1, TRUE,  FALSE, FALSE, 0, TRUE, { 1,                     128}, { 0, 1}}},
-	{ "U8",         { 1, FALSE, FALSE, FALSE, 0, TRUE, { 1,                     255}, {-1, 2}}},
-	{ "S16_LE",     { 2, TRUE,  FALSE, FALSE, 0, TRUE, { 1,           INT16_MAX + 1}, { 0, 1}}},
-	{ "U16_LE",     { 2, FALSE, FALSE, FALSE, 0, TRUE, { 1,              UINT16_MAX}, {-1, 2}}},
-	{ "S16_BE",     { 2, TRUE,  FALSE, TRUE,  0, TRUE, { 1,           INT16_MAX + 1}, { 0, 1}}},
-	{ "U16_BE",     { 2, FALSE, FALSE, TRUE,  0, TRUE, { 1,              UINT16_MAX}, {-1, 2}}},
-	{ "S32_LE",     { 4, TRUE,  FALSE, FALSE, 0, TRUE, { 1, (uint64_t)INT32_MAX + 1}, { 0, 1}}},
-	{ "U32_LE",     { 4, FALSE, FALSE, FALSE, 0, TRUE, { 1,              UINT32_MAX}, {-1, 2}}},
-	{ "S32_BE",     { 4, TRUE,  FALSE, TRUE,  0, TRUE, { 1, (uint64_t)INT32_MAX + 1}, { 0, 1}}},
-	{ "U32_BE",     { 4, FALSE, FALSE, TRUE,  0, TRUE, { 1,              UINT32_MAX}, {-1, 2}}},
-	{ "FLOAT_LE",   { 4, TRUE,  TRUE,  FALSE, 0, TRUE, { 1,                       1}, { 0, 1}}},
-	{ "FLOAT_BE",   { 4, TRUE,  TRUE,  TRUE,  0, TRUE, { 1,                       1}, { 0, 1}}},
-	{ "FLOAT64_LE", { 8, TRUE,  TRUE,  FALSE, 0, TRUE, { 1,                       1}, { 0, 1}}},
-	{ "FLOAT64_BE", { 8, TRUE,  TRUE,  TRUE,  0, TRUE, { 1,                       1}, { 0, 1}}},
+	{ "S8",         { 1, TRUE,  FALSE, FALSE, 0, TRUE, { 1,                     128}, { 0, 1}}, convert_s8    },
+	{ "U8",         { 1, FALSE, FALSE, FALSE, 0, TRUE, { 1,                     255}, {-1, 2}}, convert_u8    },
+	{ "S16_LE",     { 2, TRUE,  FALSE, FALSE, 0, TRUE, { 1,           INT16_MAX + 1}, { 0, 1}}, convert_s16le },
+	{ "U16_LE",     { 2, FALSE, FALSE, FALSE, 0, TRUE, { 1,              UINT16_MAX}, {-1, 2}}, convert_u16le },
+	{ "S16_BE",     { 2, TRUE,  FALSE, TRUE,  0, TRUE, { 1,           INT16_MAX + 1}, { 0, 1}}, convert_s16be },
+	{ "U16_BE",     { 2, FALSE, FALSE, TRUE,  0, TRUE, { 1,              UINT16_MAX}, {-1, 2}}, convert_u16be },
+	{ "S32_LE",     { 4, TRUE,  FALSE, FALSE, 0, TRUE, { 1, (uint64_t)INT32_MAX + 1}, { 0, 1}}, convert_s32le },
+	{ "U32_LE",     { 4, FALSE, FALSE, FALSE, 0, TRUE, { 1,              UINT32_MAX}, {-1, 2}}, convert_u32le },
+	{ "S32_BE",     { 4, TRUE,  FALSE, TRUE,  0, TRUE, { 1, (uint64_t)INT32_MAX + 1}, { 0, 1}}, convert_s32be },
+	{ "U32_BE",     { 4, FALSE, FALSE, TRUE,  0, TRUE, { 1,              UINT32_MAX}, {-1, 2}}, convert_u32be },
+	{ "FLOAT_LE",   { 4, TRUE,  TRUE,  FALSE, 0, TRUE, { 1,                       1}, { 0, 1}}, convert_f32le },
+	{ "FLOAT_BE",   { 4, TRUE,  TRUE,  TRUE,  0, TRUE, { 1,                       1}, { 0, 1}}, convert_f32be },
+	{ "FLOAT64_LE", { 8, TRUE,  TRUE,  FALSE, 0, TRUE, { 1,                       1}, { 0, 1}}, convert_f64le },
+	{ "FLOAT64_BE", { 8, TRUE,  TRUE,  TRUE,  0, TRUE, { 1,                       1}, { 0, 1}}, convert_f64be },
 };
 
+static const char *output_modes[] = { "raw", "float" };
+
 static int parse_format_string(const char *format)
 {
 	for (unsigned int i = 0; i < ARRAY_SIZE(sample_formats); i++) {
@@ -80,6 +132,36 @@ static int parse_format_string(const char *format)
 	return -1;
 }
 
+/*
+ * Parse a comma separated list with a value for each channel, or a
+ * single value for all of them.
+ */
+static int parse_channel_values(const char *str, const char *name,
+		int num_channels, float *values)
+{
+	char **tokens;
+	int num_tokens, i, ret;
+
+	tokens = g_strsplit(str, ",", 0);
+	num_tokens = g_strv_length(tokens);
+	ret = SR_OK;
+	if (num_tokens != 1 && num_tokens != num_channels) {
+		sr_err("Need one %s, or one for each of the %d channels.",
+			name, num_channels);
+		ret = SR_ERR_ARG;
+	}
+	for (i = 0; ret == SR_OK && i < num_channels; i++) {
+		if (sr_atof_ascii(g_strstrip(tokens[num_tokens == 1 ? 0 : i]),
+				&values[i]) != SR_OK) {
+			sr_err("Invalid %s '%s'.", name, tokens[i]);
+			ret = SR_ERR_ARG;
+		}
+	}
+	g_strfreev(tokens);
+
+	return ret;
+}
+
 static void init_context(struct context *inc, const struct sample_format *fmt, GSList *channels)
 {
 	inc->packet.type = SR_DF_ANALOG;
@@ -92,6 +174,21 @@ static void init_context(struct context *inc, const struct sample_format *fmt, G
 	inc->analog.spec = &inc->spec;
 
 	memcpy(&inc->encoding, &fmt->encoding, sizeof(inc->encoding));
+	if (inc->to_float) {
+		/* Converted samples are native floats, fully scaled. */
+		inc->encoding.unitsize = sizeof(float);
+		inc->encoding.is_signed = TRUE;
+		inc->encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+		inc->encoding.is_bigendian = TRUE;
+#else
+		inc->encoding.is_bigendian = FALSE;
+#endif
+		inc->encoding.scale.p = 1;
+		inc->encoding.scale.q = 1;
+		inc->encoding.offset.p = 0;
+		inc->encoding.offset.q = 1;
+	}
 
 	inc->meaning.mq = 0;
 	inc->meaning.unit = 0;
@@ -104,10 +201,14 @@ static void init_context(struct context *inc, const struct sample_format *fmt, G
 static int init(struct sr_input *in, GHashTable *options)
 {
 	struct context *inc;
-	int num_channels;
+	const struct sr_analog_encoding *encoding;
+	int num_channels, ch;
 	char channelname[16];
-	const char *format;
-	int fmt_index;
+	const char *format, *output;
+	int fmt_index, ret;
+	uint32_t packet_size;
+	float *scale, *offset, *float_buf;
+	gboolean scaled, to_float;
 
 	num_channels = g_variant_get_int32(g_hash_table_lookup(options, "numchannels"));
 	if (num_channels < 1) {
@@ -126,6 +227,59 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR_ARG;
 	}
 
+	packet_size = g_variant_get_uint32(g_hash_table_lookup(options, "packetsize"));
+	if (packet_size < 1) {
+		sr_err("Invalid value for packetsize: must be at least 1.");
+		return SR_ERR_ARG;
+	}
+	/* A packet's samples of all channels must fit the float buffer. */
+	if (packet_size > G_MAXSIZE / num_channels / sizeof(float)) {
+		sr_err("Invalid value for packetsize: too large for %d "
+		       "channels.", num_channels);
+		return SR_ERR_ARG;
+	}
+
+	output = g_variant_get_string(g_hash_table_lookup(options, "output"), NULL);
+	if (strcmp(output, "raw") && strcmp(output, "float")) {
+		sr_err("Invalid output '%s': must be raw or float.", output);
+		return SR_ERR_ARG;
+	}
+
+	scale = g_malloc(num_channels * sizeof(float));
+	offset = g_malloc(num_channels * sizeof(float));
+	ret = parse_channel_values(g_variant_get_string(g_hash_table_lookup(
+		options, "scale"), NULL), "scale", num_channels, scale);
+	if (ret == SR_OK)
+		ret = parse_channel_values(g_variant_get_string(g_hash_table_lookup(
+			options, "offset"), NULL), "offset", num_channels, offset);
+	if (ret != SR_OK) {
+		g_free(scale);
+		g_free(offset);
+		return ret;
+	}
+
+	scaled = FALSE;
+	for (ch = 0; ch < num_channels; ch++) {
+		if (scale[ch] != 1 || offset[ch] != 0)
+			scaled = TRUE;
+	}
+	to_float = !strcmp(output, "float");
+	if (scaled && !to_float) {
+		sr_info("Converting to float for the channel scale and offset.");
+		to_float = TRUE;
+	}
+	float_buf = NULL;
+	if (to_float) {
+		float_buf = g_try_malloc((size_t)packet_size * num_channels
+			* sizeof(float));
+		if (!float_buf) {
+			sr_err("Failed to allocate the float buffer.");
+			g_free(scale);
+			g_free(offset);
+			return SR_ERR_MALLOC;
+		}
+	}
+
 	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
 	in->priv = inc = g_malloc0(sizeof(struct context));
 
@@ -135,19 +289,58 @@ static int init(struct sr_input *in, GHashTable *options)
 	}
 
 	inc->samplerate = g_variant_get_uint64(g_hash_table_lookup(options, "samplerate"));
+	inc->num_channels = num_channels;
 	inc->samplesize = sample_formats[fmt_index].encoding.unitsize * num_channels;
+	inc->packet_size = packet_size;
+	inc->fmt_index = fmt_index;
+	inc->scale = scale;
+	inc->offset = offset;
+	inc->to_float = to_float;
+	inc->float_buf = float_buf;
+
+	/* Fold the format's own scale and offset into the channels'. */
+	encoding = &sample_formats[fmt_index].encoding;
+	for (ch = 0; ch < num_channels; ch++) {
+		inc->offset[ch] += inc->scale[ch]
+			* (encoding->offset.p / (double)encoding->offset.q);
+		inc->scale[ch] *= encoding->scale.p / (double)encoding->scale.q;
+	}
+
 	init_context(inc, &sample_formats[fmt_index], in->sdi->channels);
 
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+static void send_packet(struct sr_input *in, const uint8_t *data,
+		size_t num_samples)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	if (inc->to_float) {
+		sample_formats[inc->fmt_index].convert(data, inc->float_buf,
+			num_samples, inc->num_channels, inc->scale, inc->offset);
+		inc->analog.data = inc->float_buf;
+	} else {
+		inc->analog.data = (uint8_t *)data;
+	}
+	inc->analog.num_samples = num_samples;
+	sr_session_send(in->sdi, &inc->packet);
+}
+
+/*
+ * Send the samples of the data in packets of the configured size, and
+ * returns how many bytes they take. Only the final data may end with a
+ * smaller packet.
+ */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+		size_t len, gboolean is_final)
 {
 	struct context *inc;
 	struct sr_datafeed_meta meta;
 	struct sr_datafeed_packet packet;
 	struct sr_config *src;
-	unsigned int offset, chunk_size;
+	size_t offset, num_samples, packet_samples;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -167,41 +360,37 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	/* Round down to the last channels * unitsize boundary. */
-	inc->analog.num_samples = CHUNK_SIZE / inc->samplesize;
-	chunk_size = inc->analog.num_samples * inc->samplesize;
-	offset = 0;
+	num_samples = len / inc->samplesize;
+	if (!is_final)
+		num_samples -= num_samples % inc->packet_size;
 
-	while ((offset + chunk_size) < in->buf->len) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
-		offset += chunk_size;
+	offset = 0;
+	while (num_samples > 0) {
+		packet_samples = MIN(num_samples, inc->packet_size);
+		send_packet(in, data + offset, packet_samples);
+		offset += packet_samples * inc->samplesize;
+		num_samples -= packet_samples;
 	}
 
-	inc->analog.num_samples = (in->buf->len - offset) / inc->samplesize;
-	chunk_size = inc->analog.num_samples * inc->samplesize;
-	if (chunk_size > 0) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
-		offset += chunk_size;
-	}
+	return offset;
+}
 
-	if ((unsigned int)offset < in->buf->len) {
-		/*
-		 * The incoming buffer wasn't processed completely. Stash
-		 * the leftover data for next time.
-		 */
-		g_string_erase(in->buf, 0, offset);
-	} else {
-		g_string_truncate(in->buf, 0);
-	}
+static void process_buffer(struct sr_input *in, gboolean is_final)
+{
+	size_t len;
 
-	return SR_OK;
+	len = process_data(in, (const uint8_t *)in->buf->str, in->buf->len,
+		is_final);
+
+	/*
+	 * The incoming buffer may not have been processed completely.
+	 * Stash the leftover data for next time.
+	 */
+	g_string_erase(in->buf, 0, len);
 }
 
 static int receive(struct sr_input *in, GString *buf)
 {
-	int ret;
-
 	g_string_append_len(in->buf, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
@@ -210,32 +399,49 @@ static int receive(struct sr_input *in, GString *buf)
 		return SR_OK;
 	}
 
-	ret = process_buffer(in);
+	process_buffer(in, FALSE);
 
-	return ret;
+	return SR_OK;
+}
+
+static int receive_window(struct sr_input *in, const uint8_t *data,
+		size_t len, size_t *consumed, gboolean is_final)
+{
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		*consumed = 0;
+		return SR_OK;
+	}
+
+	/* The samples go out straight from the window. */
+	*consumed = process_data(in, data, len, is_final);
+
+	return SR_OK;
 }
 
 static int end(struct sr_input *in)
 {
 	struct context *inc;
-	int ret;
 
 	if (in->sdi_ready)
-		ret = process_buffer(in);
-	else
-		ret = SR_OK;
+		process_buffer(in, TRUE);
 
 	inc = in->priv;
 	if (inc->started)
 		std_session_send_df_end(in->sdi);
 
-	return ret;
+	return SR_OK;
 }
 
 static struct sr_option options[] = {
 	{ "numchannels", "Number of channels", "Number of channels", NULL, NULL },
 	{ "samplerate", "Sample rate", "Sample rate", NULL, NULL },
 	{ "format", "Format", "Numeric format", NULL, NULL },
+	{ "packetsize", "Packet size", "Samples per channel in each packet", NULL, NULL },
+	{ "output", "Output", "Send the samples as they are (raw), or as normalised floats (float)", NULL, NULL },
+	{ "scale", "Scale", "Scale factor, or comma separated scale factors for each channel", NULL, NULL },
+	{ "offset", "Offset", "Offset added after scaling, or comma separated offsets for each channel", NULL, NULL },
 	ALL_ZERO
 };
 
@@ -249,6 +455,14 @@ static const struct sr_option *get_options(void)
 			options[2].values = g_slist_append(options[2].values,
 				g_variant_ref_sink(g_variant_new_string(sample_formats[i].fmt_name)));
 		}
+		options[3].def = g_variant_ref_sink(g_variant_new_uint32(DEFAULT_PACKET_SIZE));
+		options[4].def = g_variant_ref_sink(g_variant_new_string(output_modes[0]));
+		for (unsigned int i = 0; i < ARRAY_SIZE(output_modes); i++) {
+			options[4].values = g_slist_append(options[4].values,
+				g_variant_ref_sink(g_variant_new_string(output_modes[i])));
+		}
+		options[5].def = g_variant_ref_sink(g_variant_new_string("1"));
+		options[6].def = g_variant_ref_sink(g_variant_new_string("0"));
 	}
 
 	return options;
@@ -259,19 +473,16 @@ static void cleanup(struct sr_input *in)
 	struct context *inc;
 
 	inc = in->priv;
-	g_variant_unref(options[0].def);
-	g_variant_unref(options[1].def);
-	g_variant_unref(options[2].def);
-	g_slist_free_full(options[2].values, (GDestroyNotify)g_variant_unref);
-	g_free(inc);
-	in->priv = NULL;
+	g_free(inc->scale);
+	g_free(inc->offset);
+	g_free(inc->float_buf);
+	inc->scale = inc->offset = inc->float_buf = NULL;
 }
 
 static int reset(struct sr_input *in)
 {
 	struct context *inc = in->priv;
 
-	cleanup(in);
 	inc->started = FALSE;
 	g_string_truncate(in->buf, 0);
 
@@ -286,6 +497,7 @@ SR_PRIV struct sr_input_module input_raw_analog = {
 	.options = get_options,
 	.init = init,
 	.receive = receive,
+	.receive_window = receive_window,
 	.end = end,
 	.cleanup = cleanup,
 	.reset = reset,
@@ -47,6 +47,7 @@
 
 #define MAX_CHUNK_SIZE    4096
 #define OUTBUF_FLUSH_SIZE 10240
+#define OUTBUF_MAX_SIZE   (4 * 1024 * 1024)
 #define MAX_POD_COUNT     12
 #define HEADER_SIZE       80
 
@@ -82,6 +83,13 @@ enum {
 	AD_COMPR_QCOMP = 6, /* File created with /COMPRESS or /QUICKCOMPRESS */
 };
 
+/* Where the data and clock of a pod are in a record. */
+struct pod_layout {
+	int data_offset;
+	int clk_offset;
+	int clk_bit;
+};
+
 struct context {
 	gboolean meta_sent;
 	gboolean header_read, records_read, trigger_sent;
@@ -93,6 +101,11 @@ struct context {
 	int32_t last_record;
 	uint64_t samplerate;
 	double timestamp_scale;
+	struct pod_layout pods[MAX_POD_COUNT];
+	int num_pods;
+	int unitsize;
+	/* The output buffer is flushed when it holds this many bytes. */
+	size_t out_size;
 	GString *out_buf;
 };
 
@@ -152,6 +165,8 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR;
 	}
 
+	inc->unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
+	inc->out_size = OUTBUF_FLUSH_SIZE;
 	inc->out_buf = g_string_sized_new(OUTBUF_FLUSH_SIZE);
 
 	return SR_OK;
@@ -324,41 +339,20 @@ static void send_metadata(struct sr_input *in)
 	inc->meta_sent = TRUE;
 }
 
-static void flush_output_buffer(struct sr_input *in)
-{
-	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
-
-	inc = in->priv;
-
-	if (inc->out_buf->len) {
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
-		logic.data = inc->out_buf->str;
-		logic.length = inc->out_buf->len;
-		sr_session_send(in->sdi, &packet);
-
-		g_string_truncate(inc->out_buf, 0);
-	}
-}
-
-static void process_record_pi(struct sr_input *in, gsize start)
+/*
+ * Work out where the samples of each selected pod are in a record. The
+ * iprobe's record looks like a PowerIntegrator record with only pod A.
+ */
+static int init_pod_layout(struct sr_input *in)
 {
-	struct sr_datafeed_packet packet;
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
-	uint32_t pod_data;
-	char single_payload[12 * 3];
-	GString *buf;
-	int i, pod_count, clk_offset, packet_count, pod;
-	int payload_bit, payload_len, value;
+	struct pod_layout *layout;
+	int pod, pod_count;
 
 	inc = in->priv;
-	buf = in->buf;
 
 	/*
+	 * PowerIntegrator:
 	 * 00-07 timestamp
 	 * 08-09 A15..0
 	 * 10-11 B15..0
@@ -379,184 +373,192 @@ static void process_record_pi(struct sr_input *in, gsize start)
 	 * 42/25    ??
 	 * 43/26    ??
 	 * 44/27    ??
+	 *
+	 * iprobe:
+	 * 00-07 timestamp
+	 * 08-09 IP15..0
+	 * 10    CLK
 	 */
 
-	timestamp = RL64(buf->str + start);
-
-	if (inc->record_mode == AD_MODE_500MHZ) {
+	if (inc->device == AD_DEVICE_IPROBE)
+		pod_count = 1;
+	else if (inc->record_mode == AD_MODE_500MHZ)
 		pod_count = 6;
-		clk_offset = 24;
-	} else {
-		pod_count = 12;
-		clk_offset = 40;
-	}
-
-	payload_bit = 0;
-	payload_len = 0;
-	single_payload[0] = 0;
+	else
+		pod_count = MAX_POD_COUNT;
 
-	for (pod = 0; pod < pod_count; pod++) {
+	inc->num_pods = 0;
+	for (pod = 0; pod < MAX_POD_COUNT; pod++) {
 		if (!inc->pod_status[pod])
 			continue;
-
-		switch (pod) {
-		case 0: /* A */
-			pod_data = RL16(buf->str + start + 8);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 1) << 16;
-			break;
-		case 1: /* B */
-			pod_data = RL16(buf->str + start + 10);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 2) << 15;
-			break;
-		case 2: /* C */
-			pod_data = RL16(buf->str + start + 12);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 4) << 14;
-			break;
-		case 3: /* D */
-			pod_data = RL16(buf->str + start + 14);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 8) << 13;
-			break;
-		case 4: /* E */
-			pod_data = RL16(buf->str + start + 16);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 16) << 12;
-			break;
-		case 5: /* F */
-			pod_data = RL16(buf->str + start + 18);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 32) << 11;
-			break;
-		case 6: /* J */
-			pod_data = RL16(buf->str + start + 24);
-			pod_data |= (RL16(buf->str + start + 41) & 1) << 16;
-			break;
-		case 7: /* K */
-			pod_data = RL16(buf->str + start + 26);
-			pod_data |= (RL16(buf->str + start + 41) & 2) << 15;
-			break;
-		case 8: /* L */
-			pod_data = RL16(buf->str + start + 28);
-			pod_data |= (RL16(buf->str + start + 41) & 4) << 14;
-			break;
-		case 9: /* M */
-			pod_data = RL16(buf->str + start + 30);
-			pod_data |= (RL16(buf->str + start + 41) & 8) << 13;
-			break;
-		case 10: /* N */
-			pod_data = RL16(buf->str + start + 32);
-			pod_data |= (RL16(buf->str + start + 41) & 16) << 12;
-			break;
-		case 11: /* O */
-			pod_data = RL16(buf->str + start + 34);
-			pod_data |= (RL16(buf->str + start + 41) & 32) << 11;
-			break;
-		default:
-			sr_err("Don't know how to obtain data for pod %d.", pod);
+		if (pod >= pod_count) {
+			sr_err("Pod %c is not present in this file.",
+				get_pod_name_from_id(pod));
+			return SR_ERR_DATA;
 		}
 
-		for (i = 0; i < 17; i++) {
-			value = (pod_data >> i) & 1;
-			single_payload[payload_len] |= value << payload_bit;
-
-			payload_bit++;
-			if (payload_bit > 7) {
-				payload_bit = 0;
-				payload_len++;
-				single_payload[payload_len] = 0;
-			}
+		layout = &inc->pods[inc->num_pods++];
+		if (inc->device == AD_DEVICE_IPROBE) {
+			layout->data_offset = 8;
+			layout->clk_offset = 10;
+			layout->clk_bit = 0;
+		} else if (pod < 6) {
+			layout->data_offset = 8 + 2 * pod;
+			layout->clk_offset = inc->record_mode == AD_MODE_500MHZ ? 24 : 40;
+			layout->clk_bit = pod;
+		} else {
+			layout->data_offset = 24 + 2 * (pod - 6);
+			layout->clk_offset = 41;
+			layout->clk_bit = pod - 6;
 		}
 	}
 
-	/* Make sure that payload_len accounts for any incomplete bytes used. */
-	if (payload_bit)
-		payload_len++;
+	return SR_OK;
+}
 
-	i = (g_slist_length(in->sdi->channels) + 7) / 8;
-	if (payload_len != i) {
-		sr_err("Payload unit size is %d but should be %d!", payload_len, i);
-		return;
-	}
+static void flush_output_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
 
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
+	inc = in->priv;
 
-		packet.type = SR_DF_TRIGGER;
-		packet.payload = NULL;
+	if (inc->out_buf->len) {
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.unitsize = inc->unitsize;
+		logic.data = inc->out_buf->str;
+		logic.length = inc->out_buf->len;
 		sr_session_send(in->sdi, &packet);
-		inc->trigger_sent = TRUE;
-	}
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
+		g_string_truncate(inc->out_buf, 0);
 
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
+		/* Long files get bigger packets as they go. */
+		if (inc->out_size < OUTBUF_MAX_SIZE)
+			inc->out_size *= 2;
+	}
+}
 
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
+/* Put the 16 channels and the clock of each selected pod in one sample. */
+static void decode_record(const struct context *inc, const uint8_t *record,
+		uint8_t *sample)
+{
+	const struct pod_layout *layout;
+	uint32_t acc, pod_data;
+	int i, bits;
+
+	acc = 0;
+	bits = 0;
+	for (i = 0; i < inc->num_pods; i++) {
+		layout = &inc->pods[i];
+		pod_data = RL16(record + layout->data_offset);
+		pod_data |= ((R8(record + layout->clk_offset) >> layout->clk_bit) & 1) << 16;
+		acc |= pod_data << bits;
+		bits += 17;
+		while (bits >= 8) {
+			*sample++ = acc & 0xff;
+			acc >>= 8;
+			bits -= 8;
+		}
 	}
+	if (bits)
+		*sample = acc;
+}
+
+/*
+ * Append count copies of the sample to the output buffer, flushing it
+ * whenever it is full. The copies are made by doubling what is already
+ * in the buffer, which takes few calls for long gaps between records.
+ */
+static void append_samples(struct sr_input *in, const uint8_t *sample,
+		uint64_t count)
+{
+	struct context *inc;
+	size_t room, num, len, filled, pos;
+	char *dst;
+
+	inc = in->priv;
 
-	if (inc->out_buf->len >= OUTBUF_FLUSH_SIZE)
-		flush_output_buffer(in);
+	while (count) {
+		room = (inc->out_size - inc->out_buf->len) / inc->unitsize;
+		if (!room) {
+			flush_output_buffer(in);
+			continue;
+		}
+		num = MIN(count, room);
+		len = num * inc->unitsize;
+		pos = inc->out_buf->len;
+		g_string_set_size(inc->out_buf, pos + len);
+		dst = inc->out_buf->str + pos;
+		memcpy(dst, sample, inc->unitsize);
+		for (filled = inc->unitsize; filled < len; filled *= 2)
+			memcpy(dst + filled, dst, MIN(filled, len - filled));
+		count -= num;
+	}
 }
 
-static void process_record_iprobe(struct sr_input *in, gsize start)
+/*
+ * Decode as many records as there are in the data, and return how many
+ * bytes were used. Every record but the last one in the file is held
+ * for as long as it takes to get to the next one's timestamp, so it
+ * needs the next record to be in the data as well.
+ */
+static size_t process_records(struct sr_input *in, const uint8_t *data,
+		size_t len)
 {
 	struct sr_datafeed_packet packet;
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
-	char single_payload[3];
-	int i, payload_len, packet_count;
+	uint8_t sample[(MAX_POD_COUNT * 17 + 7) / 8];
+	uint64_t timestamp, next_timestamp, count;
+	size_t num_records, i;
+	const uint8_t *record;
 
 	inc = in->priv;
 
-	/*
-	 * 00-07 timestamp
-	 * 08-09 IP15..0
-	 * 10    CLK
-	 */
-
-	timestamp = RL64(in->buf->str + start);
-	single_payload[0] = R8(in->buf->str + start + 8);
-	single_payload[1] = R8(in->buf->str + start + 9);
-	single_payload[2] = R8(in->buf->str + start + 10) & 1;
-	payload_len = 3;
+	num_records = len / inc->record_size;
+	for (i = 0; i < num_records && !inc->records_read; i++) {
+		record = data + i * inc->record_size;
+		if (inc->cur_record != inc->record_count - 1 && i + 1 == num_records)
+			break;
 
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
+		timestamp = RL64(record);
+		decode_record(inc, record, sample);
 
-		packet.type = SR_DF_TRIGGER;
-		packet.payload = NULL;
-		sr_session_send(in->sdi, &packet);
-		inc->trigger_sent = TRUE;
-	}
+		if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
+			sr_dbg("Trigger @%lf s, record #%d.",
+				timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(in->buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
+			/* The trigger goes after the samples before it. */
+			flush_output_buffer(in);
+			packet.type = SR_DF_TRIGGER;
+			packet.payload = NULL;
+			sr_session_send(in->sdi, &packet);
+			inc->trigger_sent = TRUE;
+		}
 
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
+		/* Is this the last record in the file? */
+		if (inc->cur_record == inc->record_count - 1) {
+			/* It is, so send the last sample data only once. */
+			count = 1;
+		} else {
+			/* It's not, so fill the time gap by sending lots of data. */
+			next_timestamp = RL64(record + inc->record_size);
+			count = 0;
+			if (next_timestamp > timestamp)
+				count = (next_timestamp - timestamp) / inc->timestamp_scale;
+			/* Make sure we send at least one data set. */
+			if (count == 0)
+				count = 1;
+		}
+		append_samples(in, sample, count);
 
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
+		inc->cur_record++;
+		if (inc->cur_record == inc->record_count)
+			inc->records_read = TRUE;
 	}
 
-	if (inc->out_buf->len >= OUTBUF_FLUSH_SIZE)
-		flush_output_buffer(in);
+	return i * inc->record_size;
 }
 
 static void process_practice_token(struct sr_input *in, char *cmd_token)
@@ -644,7 +646,7 @@ static void process_practice(struct sr_input *in)
 	int i;
 
 	/* Gather all input data until we see the end marker. */
-	if (in->buf->str[in->buf->len - 1] != 0x29)
+	if (!in->buf->len || in->buf->str[in->buf->len - 1] != 0x29)
 		return;
 
 	delimiter[0] = 0x0A;
@@ -671,15 +673,20 @@ static void process_practice(struct sr_input *in)
 static int process_buffer(struct sr_input *in)
 {
 	struct context *inc;
-	int i, chunk_size, res;
+	size_t len;
+	int res;
 
 	inc = in->priv;
 
 	if (!inc->header_read) {
+		if (in->buf->len < HEADER_SIZE)
+			return SR_OK;
 		res = process_header(in->buf, inc);
 		g_string_erase(in->buf, 0, HEADER_SIZE);
 		if (res != SR_OK)
 			return res;
+		if ((res = init_pod_layout(in)) != SR_OK)
+			return res;
 	}
 
 	if (!inc->meta_sent) {
@@ -688,31 +695,9 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	if (!inc->records_read) {
-		/* Cut off at a multiple of the record size. */
-		chunk_size = ((in->buf->len) / inc->record_size) * inc->record_size;
-
-		/* There needs to be at least one more record process_record() can peek into. */
-		chunk_size -= inc->record_size;
-
-		for (i = 0; (i < chunk_size) && (!inc->records_read); i += inc->record_size) {
-			switch (inc->device) {
-			case AD_DEVICE_PI:
-				process_record_pi(in, i);
-				break;
-			case AD_DEVICE_IPROBE:
-				process_record_iprobe(in, i);
-				break;
-			default:
-				sr_err("Trying to process records for unknown device!");
-				return SR_ERR;
-			}
-
-			inc->cur_record++;
-			if (inc->cur_record == inc->record_count)
-				inc->records_read = TRUE;
-		}
-
-		g_string_erase(in->buf, 0, i);
+		len = process_records(in, (const uint8_t *)in->buf->str,
+			in->buf->len);
+		g_string_erase(in->buf, 0, len);
 	}
 
 	if (inc->records_read) {
@@ -765,12 +750,22 @@ static int reset(struct sr_input *in)
 	inc->records_read = FALSE;
 	inc->trigger_sent = FALSE;
 	inc->cur_record = 0;
+	inc->out_size = OUTBUF_FLUSH_SIZE;
 
+	g_string_truncate(inc->out_buf, 0);
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc = in->priv;
+
+	g_string_free(inc->out_buf, TRUE);
+	inc->out_buf = NULL;
+}
+
 static struct sr_option options[] = {
 	{ "podA", "Import pod A / iprobe",
 		"Create channels and data for pod A / iprobe", NULL, NULL },
@@ -824,5 +819,6 @@ SR_PRIV struct sr_input_module input_trace32_ad = {
 	.init = init,
 	.receive = receive,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
@@ -22,7 +22,8 @@
  *
  * numchannels: Maximum number of channels to use. The channels are
  *              detected in the same order as they are listed
- *              in the $var sections of the VCD file.
+ *              in the $var sections of the VCD file. Every bit of
+ *              a vector counts as one channel.
  *
  * skip:        Allows skipping until given timestamp in the file.
  *              This can speed up analyzing of long captures.
@@ -45,16 +46,20 @@
  * Based on Verilog standard IEEE Std 1364-2001 Version C
  *
  * Supported features:
- * - $var with 'wire' and 'reg' types of scalar variables
+ * - $var with scalar and vector variables of all integer types (wire,
+ *   reg, integer, ...), every bit of a vector becomes a logic channel
+ * - $var with real variables, which become analog channels
  * - $timescale definition for samplerate
- * - multiple character variable identifiers
+ * - multiple character variable identifiers, and identifiers which
+ *   are shared by several variables
+ * - $dumpvars initial value declaration
+ * - files without real variables are sent as SR_DF_LOGIC_RLE runs, one
+ *   per value change, so long idle periods cost nothing
  *
  * Most important unsupported features:
- * - vector variables (bit vectors etc.)
- * - analog, integer and real number variables
- * - $dumpvars initial value declaration
- * - $scope namespaces
- * - more than 64 channels
+ * - event and string variables
+ * - $scope namespaces (channel names do not include the scope)
+ * - x and z states, which are taken as 0
  */
 
 #include <config.h>
@@ -69,6 +74,24 @@
 
 #define CHUNKSIZE (1024 * 1024)
 
+/* Number of runs which are collected before they are sent. */
+#define MAX_RUNS (64 * 1024)
+
+/*
+ * Identifiers of one or two printable characters, by far the most common
+ * ones, are looked up in a table. Longer ones go through a hash table.
+ */
+#define ID_FIRST '!'
+#define ID_CHARS ('~' - '!' + 1)
+#define ID_TABLE_SIZE (ID_CHARS + ID_CHARS * ID_CHARS)
+
+/* What the data section tokenizer expects next. */
+enum parse_state {
+	STATE_TOKEN,
+	STATE_IDENTIFIER,
+	STATE_SKIP_SECTION,
+};
+
 struct context {
 	gboolean started;
 	gboolean got_header;
@@ -77,36 +100,70 @@ struct context {
 	unsigned int channelcount;
 	int downsample;
 	unsigned compress;
+	int64_t skip_option;
 	int64_t skip;
-	gboolean skip_until_end;
-	GSList *channels;
+	uint64_t prev_timestamp;
+	GArray *vars;
+	unsigned int logic_count;
+	unsigned int analog_count;
+	/* Index + 1 of the first variable with an identifier, 0 if none. */
+	unsigned int *id_table;
+	GHashTable *long_ids;
+	GString *id_buf;
+	enum parse_state state;
+	char value_type;
+	const char *value;
+	size_t value_len;
+	GString *pending;
 	size_t bytes_per_sample;
+	size_t samples_per_chunk;
 	size_t samples_in_buffer;
+	/* The whole buffer holds copies of the current levels only. */
+	gboolean buffer_uniform;
 	uint8_t *buffer;
 	uint8_t *current_levels;
+	float *analog_buffer;
+	float *current_values;
+	GSList **analog_channels;
+	/* Logic only: buffer holds the values of runs of these lengths. */
+	gboolean rle;
+	uint64_t *run_lengths;
+	size_t num_runs;
 };
 
-struct vcd_channel {
+struct vcd_var {
 	gchar *name;
 	gchar *identifier;
+	gboolean is_real;
+	/* Number of bits, or 1 for real variables. */
+	unsigned int width;
+	/* Bit index range as declared, e.g. [7:0], if any. */
+	gboolean has_range;
+	int msb, lsb;
+	/* Logic channel of bit 0, or analog channel index of reals. */
+	unsigned int index;
+	/* Next variable with the same identifier, or -1. */
+	int next;
 };
 
 /*
  * Reads a single VCD section from input file and parses it to name/contents.
  * e.g. $timescale 1ps $end => "timescale" "1ps"
+ * Parsing starts at *offset, which is moved past the section on success.
  */
-static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
+static gboolean parse_section(GString *buf, size_t *offset,
+		gchar **name, gchar **contents)
 {
 	GString *sname, *scontent;
 	gboolean status;
-	unsigned int pos;
+	size_t pos;
 
 	*name = *contents = NULL;
 	status = FALSE;
-	pos = 0;
+	pos = *offset;
 
 	/* Skip UTF8 BOM */
-	if (buf->len >= 3 && !strncmp(buf->str, "\xef\xbb\xbf", 3))
+	if (pos == 0 && buf->len >= 3 && !strncmp(buf->str, "\xef\xbb\xbf", 3))
 		pos = 3;
 
 	/* Skip any initial white-space. */
@@ -114,7 +171,7 @@ static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
 		pos++;
 
 	/* Section tag should start with $. */
-	if (buf->str[pos++] != '$')
+	if (pos >= buf->len || buf->str[pos++] != '$')
 		return FALSE;
 
 	sname = g_string_sized_new(32);
@@ -129,15 +186,15 @@ static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
 		pos++;
 
 	/* Read the content. */
-	while (pos < buf->len - 4 && strncmp(buf->str + pos, "$end", 4))
+	while (pos + 4 <= buf->len && strncmp(buf->str + pos, "$end", 4))
 		g_string_append_c(scontent, buf->str[pos++]);
 
-	if (sname->len && pos < buf->len - 4 && !strncmp(buf->str + pos, "$end", 4)) {
+	if (sname->len && pos + 4 <= buf->len && !strncmp(buf->str + pos, "$end", 4)) {
 		status = TRUE;
 		pos += 4;
 		while (pos < buf->len && g_ascii_isspace(buf->str[pos]))
 			pos++;
-		g_string_erase(buf, 0, pos);
+		*offset = pos;
 	}
 
 	*name = g_string_free(sname, !status);
@@ -148,12 +205,12 @@ static gboolean parse_section(GString *buf, gchar **name, gchar **contents)
 	return status;
 }
 
-static void free_channel(void *data)
+static void clear_var(void *data)
 {
-	struct vcd_channel *vcd_ch = data;
-	g_free(vcd_ch->name);
-	g_free(vcd_ch->identifier);
-	g_free(vcd_ch);
+	struct vcd_var *var = data;
+
+	g_free(var->name);
+	g_free(var->identifier);
 }
 
 /* Remove empty parts from an array returned by g_strsplit. */
@@ -170,22 +227,215 @@ static void remove_empty_parts(gchar **parts)
 	*dest = NULL;
 }
 
+/* Table slot of a one or two character identifier, or -1. */
+static int id_slot(const char *id, size_t len)
+{
+	unsigned int c0, c1;
+
+	c0 = (unsigned char)id[0] - ID_FIRST;
+	if (c0 >= ID_CHARS)
+		return -1;
+	if (len == 1)
+		return c0;
+	c1 = (unsigned char)id[1] - ID_FIRST;
+	if (len != 2 || c1 >= ID_CHARS)
+		return -1;
+
+	return ID_CHARS + c0 * ID_CHARS + c1;
+}
+
+/* Index of the first variable with the given identifier, or -1. */
+static int lookup_var(struct context *inc, const char *id, size_t len)
+{
+	int slot;
+
+	if ((slot = id_slot(id, len)) >= 0)
+		return (int)inc->id_table[slot] - 1;
+
+	/* The hash table wants a terminated key, build it in place. */
+	g_string_truncate(inc->id_buf, 0);
+	g_string_append_len(inc->id_buf, id, len);
+
+	return GPOINTER_TO_INT(g_hash_table_lookup(inc->long_ids,
+		inc->id_buf->str)) - 1;
+}
+
+/* Make a variable findable by its identifier, after any aliases. */
+static void register_var(struct context *inc, int index)
+{
+	struct vcd_var *var;
+	int slot, first;
+
+	var = &g_array_index(inc->vars, struct vcd_var, index);
+	first = lookup_var(inc, var->identifier, strlen(var->identifier));
+	if (first < 0) {
+		slot = id_slot(var->identifier, strlen(var->identifier));
+		if (slot >= 0)
+			inc->id_table[slot] = index + 1;
+		else
+			g_hash_table_insert(inc->long_ids, var->identifier,
+				GINT_TO_POINTER(index + 1));
+		return;
+	}
+
+	while (g_array_index(inc->vars, struct vcd_var, first).next >= 0)
+		first = g_array_index(inc->vars, struct vcd_var, first).next;
+	g_array_index(inc->vars, struct vcd_var, first).next = index;
+}
+
+/*
+ * Parse a $var section.
+ * Format: $var type size identifier reference [opt. index] $end
+ */
+static void parse_var(struct context *inc, gchar *contents)
+{
+	struct vcd_var var;
+	gchar **parts, *range;
+	unsigned int length, needed;
+	unsigned long size;
+	int msb, lsb;
+
+	parts = g_strsplit_set(contents, " \r\n\t", 0);
+	remove_empty_parts(parts);
+	length = g_strv_length(parts);
+
+	memset(&var, 0, sizeof(var));
+	var.next = -1;
+	if (length == 4 || length == 5) {
+		var.is_real = !strcmp(parts[0], "real")
+			|| !strcmp(parts[0], "realtime")
+			|| !strcmp(parts[0], "shortreal");
+		size = strtoul(parts[1], NULL, 10);
+		var.width = var.is_real ? 1 : size;
+	}
+	needed = var.width;
+
+	if (length != 4 && length != 5) {
+		sr_warn("$var section should have 4 or 5 items");
+	} else if (!strcmp(parts[0], "event") || !strcmp(parts[0], "string")) {
+		sr_info("Unsupported signal type: '%s'", parts[0]);
+	} else if (!var.width || var.width > 1024 * 1024) {
+		sr_info("Unsupported signal size: '%s'", parts[1]);
+	} else if (inc->maxchannels && inc->channelcount + needed > inc->maxchannels) {
+		sr_warn("Skipping '%s%s' because only %d channels requested.",
+			parts[3], parts[4] ? : "", inc->maxchannels);
+	} else {
+		var.identifier = g_strdup(parts[2]);
+		var.name = g_strconcat(parts[3], parts[4], NULL);
+
+		/* The bit range is either separate, or part of the name. */
+		range = strchr(var.name, '[');
+		if (range && sscanf(range, "[%d:%d]", &msb, &lsb) == 2
+				&& (unsigned int)ABS(msb - lsb) + 1 == var.width) {
+			var.has_range = TRUE;
+			var.msb = msb;
+			var.lsb = lsb;
+			*range = '\0';
+		} else if (range && var.width > 1) {
+			*range = '\0';
+		}
+
+		sr_info("Variable '%s' of %u %s is identified by '%s'.",
+			var.name, var.width, var.is_real ? "real" : "bit(s)",
+			var.identifier);
+
+		inc->channelcount += needed;
+		g_array_append_val(inc->vars, var);
+		register_var(inc, inc->vars->len - 1);
+	}
+
+	g_strfreev(parts);
+}
+
+/*
+ * Create the channels of all variables: the logic channels first, so
+ * their indices are their bit positions in a sample, then the analog
+ * ones. Every bit of a vector gets a channel of its own, bit 0 first.
+ */
+static void create_channels(const struct sr_input *in)
+{
+	struct context *inc;
+	struct vcd_var *var;
+	struct sr_channel *ch;
+	unsigned int i, bit;
+	int index;
+	gchar *name;
+
+	inc = in->priv;
+	for (i = 0; i < inc->vars->len; i++) {
+		var = &g_array_index(inc->vars, struct vcd_var, i);
+		if (var->is_real)
+			continue;
+		var->index = inc->logic_count;
+		for (bit = 0; bit < var->width; bit++) {
+			if (var->has_range) {
+				index = var->msb >= var->lsb ?
+					var->lsb + (int)bit : var->lsb - (int)bit;
+				name = g_strdup_printf("%s[%d]", var->name, index);
+			} else if (var->width > 1) {
+				name = g_strdup_printf("%s[%u]", var->name, bit);
+			} else {
+				name = g_strdup(var->name);
+			}
+			sr_channel_new(in->sdi, inc->logic_count++,
+				SR_CHANNEL_LOGIC, TRUE, name);
+			g_free(name);
+		}
+	}
+
+	inc->analog_channels = g_malloc0_n(inc->channelcount,
+		sizeof(GSList *));
+	for (i = 0; i < inc->vars->len; i++) {
+		var = &g_array_index(inc->vars, struct vcd_var, i);
+		if (!var->is_real)
+			continue;
+		var->index = inc->analog_count;
+		ch = sr_channel_new(in->sdi, inc->logic_count + inc->analog_count,
+			SR_CHANNEL_ANALOG, TRUE, var->name);
+		inc->analog_channels[inc->analog_count++] =
+			g_slist_append(NULL, ch);
+	}
+
+	/*
+	 * Compute how many bytes each sample will have and initialize the
+	 * current levels. The current levels will be updated whenever VCD
+	 * has changes.
+	 */
+	inc->bytes_per_sample = (inc->logic_count + 7) / 8;
+	inc->current_levels = g_malloc0(inc->bytes_per_sample);
+	inc->current_values = g_malloc0_n(inc->analog_count, sizeof(float));
+	if (inc->logic_count && !inc->analog_count) {
+		inc->rle = TRUE;
+		inc->buffer = g_malloc(inc->bytes_per_sample * MAX_RUNS);
+		inc->run_lengths = g_malloc(MAX_RUNS * sizeof(uint64_t));
+		return;
+	}
+	inc->samples_per_chunk = CHUNKSIZE / (inc->bytes_per_sample
+		+ inc->analog_count * sizeof(float));
+	if (!inc->samples_per_chunk)
+		inc->samples_per_chunk = 1;
+	inc->buffer = g_malloc(inc->bytes_per_sample * inc->samples_per_chunk);
+	inc->analog_buffer = g_malloc_n(inc->analog_count
+		* inc->samples_per_chunk, sizeof(float));
+}
+
 /*
  * Parse VCD header to get values for context structure.
  * The context structure should be zeroed before calling this.
  */
 static gboolean parse_header(const struct sr_input *in, GString *buf)
 {
-	struct vcd_channel *vcd_ch;
 	uint64_t p, q;
 	struct context *inc;
 	gboolean status;
-	gchar *name, *contents, **parts;
+	gchar *name, *contents;
+	size_t pos;
 
 	inc = in->priv;
 	name = contents = NULL;
 	status = FALSE;
-	while (parse_section(buf, &name, &contents)) {
+	pos = 0;
+	while (parse_section(buf, &pos, &name, &contents)) {
 		sr_dbg("Section '%s', contents '%s'.", name, contents);
 
 		if (g_strcmp0(name, "enddefinitions") == 0) {
@@ -209,38 +459,7 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 				sr_err("Parsing timescale failed.");
 			}
 		} else if (g_strcmp0(name, "var") == 0) {
-			/* Format: $var type size identifier reference [opt. index] $end */
-			unsigned int length;
-
-			parts = g_strsplit_set(contents, " \r\n\t", 0);
-			remove_empty_parts(parts);
-			length = g_strv_length(parts);
-
-			if (length != 4 && length != 5)
-				sr_warn("$var section should have 4 or 5 items");
-			else if (g_strcmp0(parts[0], "reg") != 0 && g_strcmp0(parts[0], "wire") != 0)
-				sr_info("Unsupported signal type: '%s'", parts[0]);
-			else if (strtol(parts[1], NULL, 10) != 1)
-				sr_info("Unsupported signal size: '%s'", parts[1]);
-			else if (inc->maxchannels && inc->channelcount >= inc->maxchannels)
-				sr_warn("Skipping '%s%s' because only %d channels requested.",
-					parts[3], parts[4] ? : "", inc->maxchannels);
-			else {
-				vcd_ch = g_malloc(sizeof(struct vcd_channel));
-				vcd_ch->identifier = g_strdup(parts[2]);
-				if (length == 4)
-					vcd_ch->name = g_strdup(parts[3]);
-				else
-					vcd_ch->name = g_strconcat(parts[3], parts[4], NULL);
-
-				sr_info("Channel %d is '%s' identified by '%s'.",
-						inc->channelcount, vcd_ch->name, vcd_ch->identifier);
-
-				sr_channel_new(in->sdi, inc->channelcount++, SR_CHANNEL_LOGIC, TRUE, vcd_ch->name);
-				inc->channels = g_slist_append(inc->channels, vcd_ch);
-			}
-
-			g_strfreev(parts);
+			parse_var(inc, contents);
 		}
 
 		g_free(name);
@@ -250,14 +469,14 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 	}
 	g_free(name);
 	g_free(contents);
+	g_string_erase(buf, 0, pos);
 
-	/*
-	 * Compute how many bytes each sample will have and initialize the
-	 * current levels. The current levels will be updated whenever VCD
-	 * has changes.
-	 */
-	inc->bytes_per_sample = (inc->channelcount + 7) / 8;
-	inc->current_levels = g_malloc0(inc->bytes_per_sample);
+	if (status && !inc->vars->len) {
+		sr_err("No supported variables in the VCD file.");
+		status = FALSE;
+	}
+	if (status)
+		create_channels(in);
 
 	inc->got_header = status;
 
@@ -266,218 +485,381 @@ static gboolean parse_header(const struct sr_input *in, GString *buf)
 
 static int format_match(GHashTable *metadata)
 {
-	GString *buf, *tmpbuf;
+	GString *buf;
 	gboolean status;
 	gchar *name, *contents;
+	size_t pos;
 
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
-	tmpbuf = g_string_new_len(buf->str, buf->len);
 
 	/*
 	 * If we can parse the first section correctly,
 	 * then it is assumed to be a VCD file.
 	 */
-	status = parse_section(tmpbuf, &name, &contents);
-	g_string_free(tmpbuf, TRUE);
+	pos = 0;
+	status = parse_section(buf, &pos, &name, &contents);
 	g_free(name);
 	g_free(contents);
 
 	return status ? SR_OK : SR_ERR;
 }
 
-/* Send all accumulated bytes from inc->buffer. */
+/* Send all accumulated samples from inc->buffer and inc->analog_buffer. */
 static void send_buffer(const struct sr_input *in)
 {
 	struct context *inc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle rle;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	unsigned int i;
 
 	inc = in->priv;
 
+	if (inc->rle) {
+		if (inc->num_runs == 0)
+			return;
+		packet.type = SR_DF_LOGIC_RLE;
+		packet.payload = &rle;
+		rle.num_runs = inc->num_runs;
+		rle.unitsize = inc->bytes_per_sample;
+		rle.data = inc->buffer;
+		rle.lengths = inc->run_lengths;
+		sr_session_send(in->sdi, &packet);
+		inc->num_runs = 0;
+		return;
+	}
+
 	if (inc->samples_in_buffer == 0)
 		return;
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->bytes_per_sample;
-	logic.data = inc->buffer;
-	logic.length = inc->bytes_per_sample * inc->samples_in_buffer;
-	sr_session_send(in->sdi, &packet);
+	if (inc->logic_count) {
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.unitsize = inc->bytes_per_sample;
+		logic.data = inc->buffer;
+		logic.length = inc->bytes_per_sample * inc->samples_in_buffer;
+		sr_session_send(in->sdi, &packet);
+	}
+
+	for (i = 0; i < inc->analog_count; i++) {
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		sr_analog_init(&analog, &encoding, &meaning, &spec, 6);
+		analog.num_samples = inc->samples_in_buffer;
+		analog.data = inc->analog_buffer + i * inc->samples_per_chunk;
+		analog.meaning->channels = inc->analog_channels[i];
+		analog.meaning->mq = 0;
+		analog.meaning->mqflags = 0;
+		analog.meaning->unit = 0;
+		sr_session_send(in->sdi, &packet);
+	}
+
 	inc->samples_in_buffer = 0;
 }
 
+/* Fill count samples with copies of one sample, doubling the copies. */
+static void fill_samples(uint8_t *p, const uint8_t *sample,
+		size_t unitsize, size_t count)
+{
+	size_t done, n;
+
+	if (unitsize == 1) {
+		memset(p, sample[0], count);
+		return;
+	}
+
+	memcpy(p, sample, unitsize);
+	for (done = 1; done < count; done += n) {
+		n = MIN(done, count - done);
+		memcpy(p + done * unitsize, p, n * unitsize);
+	}
+}
+
+/* Extend the last run, or start a new one with the current levels. */
+static void add_run(const struct sr_input *in, uint64_t count)
+{
+	struct context *inc;
+	uint8_t *last;
+
+	inc = in->priv;
+
+	if (inc->num_runs) {
+		last = inc->buffer + (inc->num_runs - 1) * inc->bytes_per_sample;
+		if (!memcmp(last, inc->current_levels, inc->bytes_per_sample)) {
+			inc->run_lengths[inc->num_runs - 1] += count;
+			return;
+		}
+	}
+	if (inc->num_runs == MAX_RUNS)
+		send_buffer(in);
+	memcpy(inc->buffer + inc->num_runs * inc->bytes_per_sample,
+		inc->current_levels, inc->bytes_per_sample);
+	inc->run_lengths[inc->num_runs++] = count;
+}
+
 /*
  * Add N copies of the current sample to buffer.
  * When the buffer fills up, automatically send it.
  */
-static void add_samples(const struct sr_input *in, size_t count)
+static void add_samples(const struct sr_input *in, uint64_t count)
 {
 	struct context *inc;
-	size_t samples_per_chunk;
-	size_t space_left, i;
-	uint8_t *p;
+	size_t n, i, j;
+	float *values, value;
 
 	inc = in->priv;
-	samples_per_chunk = CHUNKSIZE / inc->bytes_per_sample;
 
-	while (count) {
-		space_left = samples_per_chunk - inc->samples_in_buffer;
+	if (inc->rle) {
+		add_run(in, count);
+		return;
+	}
 
-		if (space_left > count)
-			space_left = count;
+	while (count) {
+		/* Long idle runs: send the same full buffer again. */
+		if (inc->buffer_uniform && inc->samples_in_buffer == 0
+				&& count >= inc->samples_per_chunk) {
+			inc->samples_in_buffer = inc->samples_per_chunk;
+			count -= inc->samples_per_chunk;
+			send_buffer(in);
+			continue;
+		}
 
-		p = inc->buffer + inc->samples_in_buffer * inc->bytes_per_sample;
-		for (i = 0; i < space_left; i++) {
-			memcpy(p, inc->current_levels, inc->bytes_per_sample);
-			p += inc->bytes_per_sample;
-			inc->samples_in_buffer++;
-			count--;
+		n = MIN(count, inc->samples_per_chunk - inc->samples_in_buffer);
+		if (inc->bytes_per_sample)
+			fill_samples(inc->buffer + inc->samples_in_buffer
+				* inc->bytes_per_sample, inc->current_levels,
+				inc->bytes_per_sample, n);
+		for (i = 0; i < inc->analog_count; i++) {
+			values = inc->analog_buffer + i * inc->samples_per_chunk
+				+ inc->samples_in_buffer;
+			value = inc->current_values[i];
+			for (j = 0; j < n; j++)
+				values[j] = value;
 		}
+		inc->buffer_uniform = inc->samples_in_buffer == 0
+			&& n == inc->samples_per_chunk;
+		inc->samples_in_buffer += n;
+		count -= n;
 
-		if (inc->samples_in_buffer == samples_per_chunk)
+		if (inc->samples_in_buffer == inc->samples_per_chunk)
 			send_buffer(in);
 	}
 }
 
-/* Set the channel level depending on the identifier and parsed value. */
-static void process_bit(struct context *inc, char *identifier, unsigned int bit)
+/* Set the levels of a logic variable, from a value given MSB first. */
+static void set_bits(struct context *inc, const struct vcd_var *var,
+		const char *value, size_t len)
 {
-	GSList *l;
-	struct vcd_channel *vcd_ch;
-	unsigned int j;
-
-	for (j = 0, l = inc->channels; j < inc->channelcount && l; j++, l = l->next) {
-		vcd_ch = l->data;
-		if (g_strcmp0(identifier, vcd_ch->identifier) == 0) {
-			/* Found our channel. */
-			size_t byte_idx = (j / 8);
-			size_t bit_idx = j - 8 * byte_idx;
-			if (bit)
-				inc->current_levels[byte_idx] |= (uint8_t)1 << bit_idx;
-			else
-				inc->current_levels[byte_idx] &= ~((uint8_t)1 << bit_idx);
-			break;
-		}
+	unsigned int i, pos;
+	uint8_t mask;
+
+	for (i = 0; i < var->width; i++) {
+		pos = var->index + i;
+		mask = (uint8_t)1 << (pos % 8);
+		/* Missing leading bits are 0, x and z are taken as 0 too. */
+		if (i < len && value[len - 1 - i] == '1')
+			inc->current_levels[pos / 8] |= mask;
+		else
+			inc->current_levels[pos / 8] &= ~mask;
 	}
-	if (j == inc->channelcount)
-		sr_dbg("Did not find channel for identifier '%s'.", identifier);
 }
 
-/* Parse a set of lines from the data section. */
-static void parse_contents(const struct sr_input *in, char *data)
+/* Apply a value change to all variables with the given identifier. */
+static void process_value(struct context *inc, char type,
+		const char *value, size_t len, const char *id, size_t id_len)
+{
+	struct vcd_var *var;
+	char number[64];
+	float real;
+	int index;
+
+	if ((index = lookup_var(inc, id, id_len)) < 0) {
+		sr_dbg("Did not find channel for identifier '%.*s'.",
+			(int)id_len, id);
+		return;
+	}
+
+	real = 0;
+	if (type == 'r') {
+		len = MIN(len, sizeof(number) - 1);
+		memcpy(number, value, len);
+		number[len] = '\0';
+		real = g_ascii_strtod(number, NULL);
+	}
+
+	for (; index >= 0; index = var->next) {
+		var = &g_array_index(inc->vars, struct vcd_var, index);
+		if (type == 'r' && var->is_real)
+			inc->current_values[var->index] = real;
+		else if (type == 'b' && !var->is_real)
+			set_bits(inc, var, value, len);
+		else
+			sr_dbg("Value type does not match variable '%s'.",
+				var->name);
+	}
+	inc->buffer_uniform = FALSE;
+}
+
+static void process_timestamp(const struct sr_input *in, uint64_t timestamp)
 {
 	struct context *inc;
-	uint64_t timestamp, prev_timestamp;
-	unsigned int bit, i;
-	char **tokens;
 
 	inc = in->priv;
-	prev_timestamp = 0;
-
-	/* Read one space-delimited token at a time. */
-	tokens = g_strsplit_set(data, " \t\r\n", 0);
-	remove_empty_parts(tokens);
-	for (i = 0; tokens[i]; i++) {
-		if (inc->skip_until_end) {
-			if (!strcmp(tokens[i], "$end")) {
-				/* Done with unhandled/unknown section. */
-				inc->skip_until_end = FALSE;
-				break;
-			}
-		}
-		if (tokens[i][0] == '#' && g_ascii_isdigit(tokens[i][1])) {
-			/* Numeric value beginning with # is a new timestamp value */
-			timestamp = strtoull(tokens[i] + 1, NULL, 10);
 
-			if (inc->downsample > 1)
-				timestamp /= inc->downsample;
+	if (inc->downsample > 1)
+		timestamp /= inc->downsample;
 
-			/*
-			 * Skip < 0 => skip until first timestamp.
-			 * Skip = 0 => don't skip
-			 * Skip > 0 => skip until timestamp >= skip.
-			 */
-			if (inc->skip < 0) {
-				inc->skip = timestamp;
-				prev_timestamp = timestamp;
-			} else if (inc->skip > 0 && timestamp < (uint64_t)inc->skip) {
-				prev_timestamp = inc->skip;
-			} else if (timestamp == prev_timestamp) {
-				/* Ignore repeated timestamps (e.g. sigrok outputs these) */
-			} else {
-				if (inc->compress != 0 && timestamp - prev_timestamp > inc->compress) {
-					/* Compress long idle periods */
-					prev_timestamp = timestamp - inc->compress;
-				}
+	/*
+	 * Skip < 0 => skip until first timestamp.
+	 * Skip = 0 => don't skip
+	 * Skip > 0 => skip until timestamp >= skip.
+	 */
+	if (inc->skip < 0) {
+		inc->skip = timestamp;
+		inc->prev_timestamp = timestamp;
+	} else if (inc->skip > 0 && timestamp < (uint64_t)inc->skip) {
+		inc->prev_timestamp = inc->skip;
+	} else if (timestamp <= inc->prev_timestamp) {
+		/* Ignore repeated timestamps (e.g. sigrok outputs these) */
+		if (timestamp < inc->prev_timestamp)
+			sr_dbg("Ignoring timestamp %" PRIu64 " going back "
+				"in time.", timestamp);
+	} else {
+		if (inc->compress != 0 && timestamp - inc->prev_timestamp > inc->compress) {
+			/* Compress long idle periods */
+			inc->prev_timestamp = timestamp - inc->compress;
+		}
 
-				sr_dbg("New timestamp: %" PRIu64, timestamp);
+		sr_spew("New timestamp: %" PRIu64, timestamp);
 
-				/* Generate samples from prev_timestamp up to timestamp - 1. */
-				add_samples(in, timestamp - prev_timestamp);
-				prev_timestamp = timestamp;
-			}
-		} else if (tokens[i][0] == '$' && tokens[i][1] != '\0') {
-			/*
-			 * This is probably a $dumpvars, $comment or similar.
-			 * $dump* contain useful data.
-			 */
-			if (g_strcmp0(tokens[i], "$dumpvars") == 0
-					|| g_strcmp0(tokens[i], "$dumpon") == 0
-					|| g_strcmp0(tokens[i], "$dumpoff") == 0
-					|| g_strcmp0(tokens[i], "$end") == 0) {
-				/* Ignore, parse contents as normally. */
-			} else {
-				/* Ignore this and future lines until $end. */
-				inc->skip_until_end = TRUE;
-				break;
-			}
-		} else if (strchr("rR", tokens[i][0]) != NULL) {
-			sr_dbg("Real type vector values not supported yet!");
-			if (!tokens[++i])
-				/* No tokens left, bail out */
-				break;
-			else
-				/* Process next token */
-				continue;
-		} else if (strchr("bB", tokens[i][0]) != NULL) {
-			bit = (tokens[i][1] == '1');
+		/* Generate samples from prev_timestamp up to timestamp - 1. */
+		add_samples(in, timestamp - inc->prev_timestamp);
+		inc->prev_timestamp = timestamp;
+	}
+}
 
-			/*
-			 * Bail out if a) char after 'b' is NUL, or b) there is
-			 * a second character after 'b', or c) there is no
-			 * identifier.
-			 */
-			if (!tokens[i][1] || tokens[i][2] || !tokens[++i]) {
-				sr_dbg("Unexpected vector format!");
-				break;
-			}
+static gboolean token_is(const char *token, size_t len, const char *word)
+{
+	return len == strlen(word) && !strncmp(token, word, len);
+}
 
-			process_bit(inc, tokens[i], bit);
-		} else if (strchr("01xXzZ", tokens[i][0]) != NULL) {
-			char *identifier;
+static void process_token(const struct sr_input *in, const char *token,
+		size_t len)
+{
+	struct context *inc;
+	uint64_t timestamp;
+	size_t i;
 
-			/* A new 1-bit sample value */
-			bit = (tokens[i][0] == '1');
+	inc = in->priv;
 
-			/*
-			 * The identifier is either the next character, or, if
-			 * there was whitespace after the bit, the next token.
-			 */
-			if (tokens[i][1] == '\0') {
-				if (!tokens[++i]) {
-					sr_dbg("Identifier missing!");
-					break;
-				}
-				identifier = tokens[i];
-			} else {
-				identifier = tokens[i] + 1;
-			}
-			process_bit(inc, identifier, bit);
-		} else {
-			sr_warn("Skipping unknown token '%s'.", tokens[i]);
+	if (inc->state == STATE_SKIP_SECTION) {
+		if (token_is(token, len, "$end"))
+			inc->state = STATE_TOKEN;
+		return;
+	}
+	if (inc->state == STATE_IDENTIFIER) {
+		inc->state = STATE_TOKEN;
+		if (inc->value_type != 's')
+			process_value(inc, inc->value_type, inc->value,
+				inc->value_len, token, len);
+		return;
+	}
+
+	switch (token[0]) {
+	case '#':
+		/* Numeric value beginning with # is a new timestamp value */
+		timestamp = 0;
+		for (i = 1; i < len && g_ascii_isdigit(token[i]); i++)
+			timestamp = timestamp * 10 + token[i] - '0';
+		if (i == 1 || i != len) {
+			sr_warn("Skipping invalid timestamp '%.*s'.",
+				(int)len, token);
+			break;
+		}
+		process_timestamp(in, timestamp);
+		break;
+	case '$':
+		/*
+		 * The $dump* keywords and their $end are transparent,
+		 * they contain the data. Other sections like $comment
+		 * are ignored up to their $end.
+		 */
+		if (!token_is(token, len, "$dumpvars")
+				&& !token_is(token, len, "$dumpall")
+				&& !token_is(token, len, "$dumpon")
+				&& !token_is(token, len, "$dumpoff")
+				&& !token_is(token, len, "$end"))
+			inc->state = STATE_SKIP_SECTION;
+		break;
+	case '0': case '1':
+	case 'x': case 'X':
+	case 'z': case 'Z':
+		/*
+		 * A new 1-bit sample value. The identifier is either the
+		 * rest of the token, or, after whitespace, the next token.
+		 */
+		if (len > 1) {
+			process_value(inc, 'b', token, 1, token + 1, len - 1);
+			break;
 		}
+		inc->value_type = 'b';
+		inc->value = token;
+		inc->value_len = 1;
+		inc->state = STATE_IDENTIFIER;
+		break;
+	case 'b': case 'B':
+	case 'r': case 'R':
+	case 's': case 'S':
+		/* Vector, real or string value, then the identifier. */
+		inc->value_type = g_ascii_tolower(token[0]);
+		inc->value = token + 1;
+		inc->value_len = len - 1;
+		inc->state = STATE_IDENTIFIER;
+		break;
+	default:
+		sr_warn("Skipping unknown token '%.*s'.", (int)len, token);
+		break;
+	}
+}
+
+static inline gboolean is_space(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t'
+		|| c == '\v' || c == '\f';
+}
+
+/* Parse a set of lines from the data section, one token at a time. */
+static void parse_contents(const struct sr_input *in, const char *data,
+		size_t len)
+{
+	struct context *inc;
+	const char *p, *end, *token;
+
+	inc = in->priv;
+
+	p = data;
+	end = data + len;
+	while (TRUE) {
+		while (p < end && is_space(*p))
+			p++;
+		if (p == end)
+			break;
+		token = p;
+		while (p < end && !is_space(*p))
+			p++;
+		process_token(in, token, p - token);
+	}
+
+	/* A value whose identifier is still to come must survive the data. */
+	if (inc->state == STATE_IDENTIFIER && inc->value != inc->pending->str) {
+		g_string_truncate(inc->pending, 0);
+		g_string_append_len(inc->pending, inc->value, inc->value_len);
+		inc->value = inc->pending->str;
 	}
-	g_strfreev(tokens);
 }
 
 static int init(struct sr_input *in, GHashTable *options)
@@ -492,40 +874,50 @@ static int init(struct sr_input *in, GHashTable *options)
 		inc->downsample = 1;
 
 	inc->compress = g_variant_get_int32(g_hash_table_lookup(options, "compress"));
-	inc->skip = g_variant_get_int32(g_hash_table_lookup(options, "skip"));
-	inc->skip /= inc->downsample;
+	inc->skip_option = g_variant_get_int32(g_hash_table_lookup(options, "skip"));
+	if (inc->skip_option > 0)
+		inc->skip_option /= inc->downsample;
+	inc->skip = inc->skip_option;
+	if (inc->skip > 0)
+		inc->prev_timestamp = inc->skip;
 
 	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
 	in->priv = inc;
 
-	inc->buffer = g_malloc(CHUNKSIZE);
+	inc->vars = g_array_new(FALSE, FALSE, sizeof(struct vcd_var));
+	g_array_set_clear_func(inc->vars, clear_var);
+	inc->id_table = g_malloc0_n(ID_TABLE_SIZE, sizeof(unsigned int));
+	inc->long_ids = g_hash_table_new(g_str_hash, g_str_equal);
+	inc->id_buf = g_string_sized_new(32);
+	inc->pending = g_string_sized_new(64);
 
 	return SR_OK;
 }
 
 static gboolean have_header(GString *buf)
 {
-	unsigned int pos;
+	size_t pos;
 	char *p;
 
 	if (!(p = g_strstr_len(buf->str, buf->len, "$enddefinitions")))
 		return FALSE;
 	pos = p - buf->str + 15;
-	while (pos < buf->len - 4 && g_ascii_isspace(buf->str[pos]))
+	while (pos + 4 < buf->len && g_ascii_isspace(buf->str[pos]))
 		pos++;
-	if (!strncmp(buf->str + pos, "$end", 4))
+	if (pos + 4 <= buf->len && !strncmp(buf->str + pos, "$end", 4))
 		return TRUE;
 
 	return FALSE;
 }
 
-static int process_buffer(struct sr_input *in)
+static int process_buffer(struct sr_input *in, gboolean is_eof)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
 	struct sr_config *src;
 	struct context *inc;
 	uint64_t samplerate;
+	size_t len;
 	char *p;
 
 	inc = in->priv;
@@ -544,12 +936,17 @@ static int process_buffer(struct sr_input *in)
 		inc->started = TRUE;
 	}
 
-	while ((p = g_strrstr_len(in->buf->str, in->buf->len, "\n"))) {
-		*p = '\0';
-		g_strstrip(in->buf->str);
-		if (in->buf->str[0] != '\0')
-			parse_contents(in, in->buf->str);
-		g_string_erase(in->buf, 0, p - in->buf->str + 1);
+	/* Tokens never span lines, take all complete lines at once. */
+	if (is_eof)
+		len = in->buf->len;
+	else if ((p = g_strrstr_len(in->buf->str, in->buf->len, "\n")))
+		len = p - in->buf->str + 1;
+	else
+		len = 0;
+
+	if (len) {
+		parse_contents(in, in->buf->str, len);
+		g_string_erase(in->buf, 0, len);
 	}
 
 	return SR_OK;
@@ -575,7 +972,7 @@ static int receive(struct sr_input *in, GString *buf)
 		return SR_OK;
 	}
 
-	ret = process_buffer(in);
+	ret = process_buffer(in, FALSE);
 
 	return ret;
 }
@@ -588,7 +985,7 @@ static int end(struct sr_input *in)
 	inc = in->priv;
 
 	if (in->sdi_ready)
-		ret = process_buffer(in);
+		ret = process_buffer(in, TRUE);
 	else
 		ret = SR_OK;
 
@@ -604,21 +1001,66 @@ static int end(struct sr_input *in)
 static void cleanup(struct sr_input *in)
 {
 	struct context *inc;
+	unsigned int i;
 
 	inc = in->priv;
-	g_slist_free_full(inc->channels, free_channel);
+	if (inc->analog_channels) {
+		for (i = 0; i < inc->analog_count; i++)
+			g_slist_free(inc->analog_channels[i]);
+		g_free(inc->analog_channels);
+		inc->analog_channels = NULL;
+	}
+	if (inc->long_ids) {
+		g_hash_table_destroy(inc->long_ids);
+		inc->long_ids = NULL;
+	}
+	if (inc->vars) {
+		g_array_free(inc->vars, TRUE);
+		inc->vars = NULL;
+	}
+	if (inc->id_buf) {
+		g_string_free(inc->id_buf, TRUE);
+		inc->id_buf = NULL;
+	}
+	if (inc->pending) {
+		g_string_free(inc->pending, TRUE);
+		inc->pending = NULL;
+	}
+	g_free(inc->id_table);
+	inc->id_table = NULL;
 	g_free(inc->buffer);
 	inc->buffer = NULL;
+	g_free(inc->run_lengths);
+	inc->run_lengths = NULL;
+	g_free(inc->analog_buffer);
+	inc->analog_buffer = NULL;
 	g_free(inc->current_levels);
 	inc->current_levels = NULL;
+	g_free(inc->current_values);
+	inc->current_values = NULL;
 }
 
+/*
+ * Keep the variables and channels of the header, so the same file can
+ * be read again. Its header then passes the data tokenizer, which skips
+ * all the sections up to their $end.
+ */
 static int reset(struct sr_input *in)
 {
 	struct context *inc = in->priv;
 
-	cleanup(in);
 	inc->started = FALSE;
+	inc->state = STATE_TOKEN;
+	inc->skip = inc->skip_option;
+	inc->prev_timestamp = inc->skip > 0 ? inc->skip : 0;
+	inc->samples_in_buffer = 0;
+	inc->num_runs = 0;
+	inc->buffer_uniform = FALSE;
+	if (inc->current_levels)
+		memset(inc->current_levels, 0, inc->bytes_per_sample);
+	if (inc->current_values)
+		memset(inc->current_values, 0,
+			inc->analog_count * sizeof(float));
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
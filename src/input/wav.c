@@ -30,14 +30,17 @@
 
 #define LOG_PREFIX "input/wav"
 
-/* How many bytes at a time to process and send to the session bus. */
-#define CHUNK_SIZE               4096
+/* How many bytes of samples to send to the session bus at a time. */
+#define CHUNK_SIZE               (256 * 1024)
 
-/* Minimum size of header + 1 8-bit mono PCM sample. */
-#define MIN_DATA_CHUNK_OFFSET    45
+/* Minimum size of a RIFF header and a chunk header. */
+#define MIN_HEADER_SIZE          20
 
 /* Expect to find the "data" chunk within this offset from the start. */
-#define MAX_DATA_CHUNK_OFFSET    1024
+#define MAX_DATA_CHUNK_OFFSET    (1024 * 1024)
+
+/* Size of the fields of a ds64 chunk which are used. */
+#define DS64_MIN_SIZE            24
 
 #define WAVE_FORMAT_PCM_         0x0001
 #define WAVE_FORMAT_IEEE_FLOAT_  0x0003
@@ -51,63 +54,67 @@ struct context {
 	int num_channels;
 	int unitsize;
 	gboolean found_data;
+	/* Where the samples start in the file. */
+	size_t data_offset;
+	/* Size of the samples from the data chunk, or the ds64 chunk. */
+	uint64_t data_size;
+	uint64_t data_left;
+	/* 24-bit samples are widened to 32 bits before they are sent. */
+	int32_t *wide;
 };
 
-static int parse_wav_header(GString *buf, struct context *inc)
+/* Parse the body of a 'fmt ' chunk. */
+static int parse_fmt_chunk(const char *buf, size_t len, struct context *inc)
 {
 	uint64_t samplerate;
-	unsigned int fmt_code, samplesize, num_channels, unitsize;
-
-	if (buf->len < MIN_DATA_CHUNK_OFFSET)
-		return SR_ERR_NA;
+	unsigned int fmt_code, samplesize, num_channels, unitsize, bits;
 
-	fmt_code = RL16(buf->str + 20);
-	samplerate = RL32(buf->str + 24);
+	if (len < 16) {
+		sr_err("WAV format chunk is too short.");
+		return SR_ERR_DATA;
+	}
 
-	samplesize = RL16(buf->str + 32);
-	num_channels = RL16(buf->str + 22);
+	fmt_code = RL16(buf);
+	num_channels = RL16(buf + 2);
+	samplerate = RL32(buf + 4);
+	samplesize = RL16(buf + 12);
+	bits = RL16(buf + 14);
 	if (num_channels == 0)
 		return SR_ERR;
 	unitsize = samplesize / num_channels;
-	if (unitsize != 1 && unitsize != 2 && unitsize != 4) {
-		sr_err("Only 8, 16 or 32 bits per sample supported.");
+	if (unitsize < 1 || unitsize > 4 || bits > unitsize * 8) {
+		sr_err("Only 8, 16, 24 or 32 bits per sample supported.");
 		return SR_ERR_DATA;
 	}
 
-	if (fmt_code == WAVE_FORMAT_PCM_) {
-	} else if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_) {
-		if (unitsize != 4) {
-			sr_err("only 32-bit floats supported.");
-			return SR_ERR_DATA;
-		}
-	} else if (fmt_code == WAVE_FORMAT_EXTENSIBLE_) {
-		if (buf->len < 70)
-			/* Not enough for extensible header and next chunk. */
-			return SR_ERR_NA;
-
-		if (RL16(buf->str + 16) != 40) {
+	if (fmt_code == WAVE_FORMAT_EXTENSIBLE_) {
+		if (len < 40) {
 			sr_err("WAV extensible format chunk must be 40 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 36) != 22) {
+		if (RL16(buf + 16) != 22) {
 			sr_err("WAV extension must be 22 bytes.");
 			return SR_ERR;
 		}
-		if (RL16(buf->str + 34) != RL16(buf->str + 38)) {
-			sr_err("Reduced valid bits per sample not supported.");
-			return SR_ERR_DATA;
-		}
 		/* Real format code is the first two bytes of the GUID. */
-		fmt_code = RL16(buf->str + 44);
-		if (fmt_code != WAVE_FORMAT_PCM_ && fmt_code != WAVE_FORMAT_IEEE_FLOAT_) {
-			sr_err("Only PCM and floating point samples are supported.");
+		fmt_code = RL16(buf + 24);
+		/*
+		 * Fewer valid bits than the container holds are fine for
+		 * integer samples, they are aligned to the top.
+		 */
+		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_
+				&& RL16(buf + 18) != unitsize * 8) {
+			sr_err("Reduced valid bits per sample not supported.");
 			return SR_ERR_DATA;
 		}
-		if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_ && unitsize != 4) {
+	}
+
+	if (fmt_code == WAVE_FORMAT_IEEE_FLOAT_) {
+		if (unitsize != 4) {
 			sr_err("only 32-bit floats supported.");
 			return SR_ERR_DATA;
 		}
-	} else {
+	} else if (fmt_code != WAVE_FORMAT_PCM_) {
 		sr_err("Only PCM and floating point samples are supported.");
 		return SR_ERR_DATA;
 	}
@@ -118,29 +125,102 @@ static int parse_wav_header(GString *buf, struct context *inc)
 		inc->samplesize = samplesize;
 		inc->num_channels = num_channels;
 		inc->unitsize = unitsize;
-		inc->found_data = FALSE;
 	}
 
 	return SR_OK;
 }
 
+/*
+ * Walk the chunks of a RIFF, RF64 or BW64 file up to the start of the
+ * samples. The data chunk of the 64-bit variants has its real size in
+ * the ds64 chunk, which comes first. Returns SR_ERR_NA if more of the
+ * file is needed.
+ */
+static int parse_wav_header(const char *buf, size_t len, struct context *inc)
+{
+	uint64_t offset, size, ds64_data_size;
+	gboolean is_64bit, found_fmt;
+	unsigned int i;
+	int ret;
+
+	if (len < MIN_HEADER_SIZE)
+		return SR_ERR_NA;
+	if (strncmp(buf + 8, "WAVE", 4))
+		return SR_ERR;
+	if (!strncmp(buf, "RIFF", 4))
+		is_64bit = FALSE;
+	else if (!strncmp(buf, "RF64", 4) || !strncmp(buf, "BW64", 4))
+		is_64bit = TRUE;
+	else
+		return SR_ERR;
+
+	ds64_data_size = 0;
+	found_fmt = FALSE;
+	offset = 12;
+	while (offset + 8 <= len) {
+		size = RL32(buf + offset + 4);
+		if (!memcmp(buf + offset, "data", 4)) {
+			if (!found_fmt) {
+				sr_err("WAV data chunk before format chunk.");
+				return SR_ERR_DATA;
+			}
+			if (is_64bit && size == 0xffffffff)
+				size = ds64_data_size;
+			if (inc) {
+				inc->data_offset = offset + 8;
+				inc->data_size = size;
+			}
+			return SR_OK;
+		}
+		for (i = 0; i < 4; i++) {
+			if (!isalnum(buf[offset + i])
+					&& !isblank(buf[offset + i])) {
+				sr_err("Couldn't find data chunk.");
+				return SR_ERR;
+			}
+		}
+		if (!memcmp(buf + offset, "ds64", 4)) {
+			if (offset + 8 + DS64_MIN_SIZE > len)
+				return SR_ERR_NA;
+			ds64_data_size = RL64(buf + offset + 16);
+		} else if (!memcmp(buf + offset, "fmt ", 4)) {
+			if (offset + 8 + size > len)
+				return SR_ERR_NA;
+			if ((ret = parse_fmt_chunk(buf + offset + 8, size, inc)) != SR_OK)
+				return ret;
+			found_fmt = TRUE;
+		}
+		/* Skip past this chunk, and its pad byte. */
+		offset += 8 + size + (size & 1);
+		if (offset >= MAX_DATA_CHUNK_OFFSET) {
+			sr_err("Couldn't find data chunk.");
+			return SR_ERR;
+		}
+	}
+
+	return SR_ERR_NA;
+}
+
 static int format_match(GHashTable *metadata)
 {
 	GString *buf;
 	int ret;
 
 	buf = g_hash_table_lookup(metadata, GINT_TO_POINTER(SR_INPUT_META_HEADER));
-	if (strncmp(buf->str, "RIFF", 4))
+	if (buf->len < 12)
 		return SR_ERR;
-	if (strncmp(buf->str + 8, "WAVE", 4))
+	if (strncmp(buf->str, "RIFF", 4) && strncmp(buf->str, "RF64", 4)
+			&& strncmp(buf->str, "BW64", 4))
 		return SR_ERR;
-	if (strncmp(buf->str + 12, "fmt ", 4))
+	if (strncmp(buf->str + 8, "WAVE", 4))
 		return SR_ERR;
 	/*
 	 * Only gets called when we already know this is a WAV file, so
-	 * this parser can log error messages.
+	 * this parser can log error messages. Chunks before the format
+	 * chunk can be larger than the header we get to look at.
 	 */
-	if ((ret = parse_wav_header(buf, NULL)) != SR_OK)
+	ret = parse_wav_header(buf->str, buf->len, NULL);
+	if (ret != SR_OK && ret != SR_ERR_NA)
 		return ret;
 
 	return SR_OK;
@@ -156,32 +236,13 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int find_data_chunk(GString *buf, int initial_offset)
-{
-	unsigned int offset, i;
-
-	offset = initial_offset;
-	while (offset < MIN(MAX_DATA_CHUNK_OFFSET, buf->len)) {
-		if (!memcmp(buf->str + offset, "data", 4))
-			/* Skip into the samples. */
-			return offset + 8;
-		for (i = 0; i < 4; i++) {
-			if (!isalnum(buf->str[offset + i])
-					&& !isblank(buf->str[offset + i]))
-				/* Doesn't look like a chunk ID. */
-				return -1;
-		}
-		/* Skip past this chunk. */
-		offset += 8 + RL32(buf->str + offset + 4);
-	}
-
-	if (offset > MAX_DATA_CHUNK_OFFSET)
-		return -1;
-
-	return offset;
-}
-
-static void send_chunk(const struct sr_input *in, int offset, int num_samples)
+/*
+ * Send the samples as they are in the file, with an encoding which
+ * describes them. Only 24-bit samples, which the analog conversion
+ * doesn't handle, are widened to 32 bits first.
+ */
+static void send_chunk(const struct sr_input *in, const char *s,
+		int num_samples)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -189,50 +250,49 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
-	float fdata[CHUNK_SIZE];
-	int total_samples, samplenum;
-	char *s, *d;
+	int total_samples, i;
 
 	inc = in->priv;
 
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-	memset(fdata, 0, CHUNK_SIZE * sizeof(float));
-	total_samples = num_samples * inc->num_channels;
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
+	/* TODO: Use proper 'digits' value for this device (and its modes). */
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	encoding.is_bigendian = FALSE;
+	analog.data = (void *)s;
+	if (inc->fmt_code == WAVE_FORMAT_PCM_) {
+		encoding.is_float = FALSE;
+		encoding.unitsize = inc->unitsize;
+		encoding.is_signed = TRUE;
+		switch (inc->unitsize) {
+		case 1:
+			/* 8-bit PCM samples are unsigned. */
+			encoding.is_signed = FALSE;
+			encoding.scale.q = UINT8_MAX;
+			break;
+		case 2:
+			encoding.scale.q = INT16_MAX;
+			break;
+		case 3:
+			total_samples = num_samples * inc->num_channels;
+			for (i = 0; i < total_samples; i++, s += 3)
+				inc->wide[i] = (int32_t)((uint32_t)(uint8_t)s[0] << 8
+					| (uint32_t)(uint8_t)s[1] << 16
+					| (uint32_t)(uint8_t)s[2] << 24);
+			analog.data = inc->wide;
+			encoding.unitsize = sizeof(int32_t);
+			encoding.scale.q = (uint64_t)0x7fffff << 8;
 #ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
+			encoding.is_bigendian = TRUE;
 #endif
+			break;
+		case 4:
+			encoding.scale.q = INT32_MAX;
+			break;
 		}
-		s += inc->unitsize;
-		d += inc->unitsize;
 	}
 
-	/* TODO: Use proper 'digits' value for this device (and its modes). */
-	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
 	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
@@ -240,14 +300,17 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	sr_session_send(in->sdi, &packet);
 }
 
-static int process_buffer(struct sr_input *in)
+/* Send the complete samples of the data, *consumed is how many bytes. */
+static int process_data(struct sr_input *in, const char *data, size_t len,
+		size_t *consumed)
 {
 	struct context *inc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_meta meta;
 	struct sr_config *src;
-	int offset, chunk_samples, total_samples, processed, max_chunk_samples;
-	int num_samples, i;
+	size_t offset, chunk_samples, max_chunk_samples, num_samples;
+
+	*consumed = 0;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -265,56 +328,66 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	if (!inc->found_data) {
-		/* Skip past size of 'fmt ' chunk. */
-		i = 20 + RL32(in->buf->str + 16);
-		offset = find_data_chunk(in->buf, i);
-		if (offset < 0) {
-			if (in->buf->len > MAX_DATA_CHUNK_OFFSET) {
-				sr_err("Couldn't find data chunk.");
-				return SR_ERR;
-			}
-		}
+		/* Skip to the samples. */
+		if (len < inc->data_offset)
+			/* Not enough data yet. */
+			return SR_OK;
+		offset = inc->data_offset;
+		/* Streaming writers leave the size at 0 or maxed out. */
+		if (inc->data_size == 0 || inc->data_size == 0xffffffff)
+			inc->data_left = UINT64_MAX;
+		else
+			inc->data_left = inc->data_size;
 		inc->found_data = TRUE;
 	} else
 		offset = 0;
 
 	/* Round off up to the last channels * unitsize boundary. */
-	chunk_samples = (in->buf->len - offset) / inc->samplesize;
-	max_chunk_samples = CHUNK_SIZE / inc->samplesize;
-	processed = 0;
-	total_samples = chunk_samples;
-	while (processed < total_samples) {
-		if (chunk_samples > max_chunk_samples)
-			num_samples = max_chunk_samples;
-		else
-			num_samples = chunk_samples;
-		send_chunk(in, offset, num_samples);
+	chunk_samples = MIN(len - offset, inc->data_left) / inc->samplesize;
+	max_chunk_samples = MAX(1, CHUNK_SIZE / inc->samplesize);
+	if (inc->unitsize == 3 && !inc->wide)
+		inc->wide = g_malloc(max_chunk_samples * inc->num_channels
+			* sizeof(int32_t));
+	while (chunk_samples > 0) {
+		num_samples = MIN(chunk_samples, max_chunk_samples);
+		send_chunk(in, data + offset, num_samples);
 		offset += num_samples * inc->samplesize;
+		inc->data_left -= num_samples * inc->samplesize;
 		chunk_samples -= num_samples;
-		processed += num_samples;
 	}
 
-	if ((unsigned int)offset < in->buf->len) {
-		/*
-		 * The incoming buffer wasn't processed completely. Stash
-		 * the leftover data for next time.
-		 */
-		g_string_erase(in->buf, 0, offset);
-	} else
-		g_string_truncate(in->buf, 0);
+	/* Chunks after the samples are of no interest. */
+	if (inc->data_left < (uint64_t)inc->samplesize)
+		offset = len;
+	*consumed = offset;
 
 	return SR_OK;
 }
 
-static int receive(struct sr_input *in, GString *buf)
+static int process_buffer(struct sr_input *in)
+{
+	size_t len;
+	int ret;
+
+	ret = process_data(in, in->buf->str, in->buf->len, &len);
+
+	/*
+	 * The incoming buffer may not have been processed completely.
+	 * Stash the leftover data for next time.
+	 */
+	g_string_erase(in->buf, 0, len);
+
+	return ret;
+}
+
+/* Create the channels once the header is complete. */
+static int check_header(struct sr_input *in, const char *data, size_t len)
 {
 	struct context *inc;
 	int ret;
 	char channelname[8];
 
-	g_string_append_len(in->buf, buf->str, buf->len);
-
-	if (in->buf->len < MIN_DATA_CHUNK_OFFSET) {
+	if (len < MIN_HEADER_SIZE) {
 		/*
 		 * Don't even try until there's enough room
 		 * for the data segment to start.
@@ -323,26 +396,43 @@ static int receive(struct sr_input *in, GString *buf)
 	}
 
 	inc = in->priv;
-	if (!in->sdi_ready) {
-		if ((ret = parse_wav_header(in->buf, inc)) == SR_ERR_NA)
-			/* Not enough data yet. */
-			return SR_OK;
-		else if (ret != SR_OK)
-			return ret;
-
-		for (int i = 0; i < inc->num_channels; i++) {
-			snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
-			sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
-		}
-
-		/* sdi is ready, notify frontend. */
-		in->sdi_ready = TRUE;
+	if ((ret = parse_wav_header(data, len, inc)) == SR_ERR_NA)
+		/* Not enough data yet. */
 		return SR_OK;
+	else if (ret != SR_OK)
+		return ret;
+
+	for (int i = 0; i < inc->num_channels; i++) {
+		snprintf(channelname, sizeof(channelname), "CH%d", i + 1);
+		sr_channel_new(in->sdi, i, SR_CHANNEL_ANALOG, TRUE, channelname);
 	}
 
-	ret = process_buffer(in);
+	/* sdi is ready, notify frontend. */
+	in->sdi_ready = TRUE;
 
-	return ret;
+	return SR_OK;
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
+	g_string_append_len(in->buf, buf->str, buf->len);
+
+	if (!in->sdi_ready)
+		return check_header(in, in->buf->str, in->buf->len);
+
+	return process_buffer(in);
+}
+
+static int receive_window(struct sr_input *in, const uint8_t *data,
+		size_t len, size_t *consumed, gboolean is_final)
+{
+	(void)is_final;
+
+	*consumed = 0;
+	if (!in->sdi_ready)
+		return check_header(in, (const char *)data, len);
+
+	return process_data(in, (const char *)data, len, consumed);
 }
 
 static int end(struct sr_input *in)
@@ -362,11 +452,20 @@ static int end(struct sr_input *in)
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc = in->priv;
+
+	g_free(inc->wide);
+	inc->wide = NULL;
+}
+
 static int reset(struct sr_input *in)
 {
 	struct context *inc = in->priv;
 
 	inc->started = FALSE;
+	inc->found_data = FALSE;
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
@@ -381,6 +480,8 @@ SR_PRIV struct sr_input_module input_wav = {
 	.format_match = format_match,
 	.init = init,
 	.receive = receive,
+	.receive_window = receive_window,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
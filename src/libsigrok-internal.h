@@ -28,6 +28,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #ifdef HAVE_LIBUSB_1_0
 #include <libusb.h>
@@ -252,6 +253,45 @@ struct zip_stat;
  */
 #define WLFL(p, x)  WL32(p, (union { uint32_t u; float f; }) { .f = x }.u)
 
+/**
+ * Read up to 8 bytes from unaligned memory into a 64 bits word, in
+ * host byte order. Missing upper bytes are zero.
+ * @param p a pointer to the input memory
+ * @param len the number of bytes to read (at most 8)
+ * @return the word
+ */
+static inline uint64_t sr_load_word(const uint8_t *p, unsigned int len)
+{
+	uint64_t word;
+
+	word = 0;
+	if (len == 8)
+		memcpy(&word, p, 8);
+	else
+		memcpy(&word, p, len);
+
+	return word;
+}
+
+/**
+ * Find the lowest set bit of a word.
+ * @param word the input word, must not be zero
+ * @return the position of the lowest set bit
+ */
+static inline int sr_lowest_bit(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int pos;
+
+	for (pos = 0; !(word & 1); pos++)
+		word >>= 1;
+
+	return pos;
+#endif
+}
+
 /* Portability fixes for FreeBSD. */
 #ifdef __FreeBSD__
 #define LIBUSB_CLASS_APPLICATION 0xfe
@@ -367,6 +407,12 @@ struct sr_input {
 	 */
 	const struct sr_input_module *module;
 	GString *buf;
+	/** The file mapped by sr_input_map_file(), or NULL. */
+	GMappedFile *mapped;
+	/** Offset in the mapped file up to which the module consumed it. */
+	size_t mapped_consumed;
+	/** Offset in the mapped file up to which it was offered. */
+	size_t mapped_offered;
 	struct sr_dev_inst *sdi;
 	gboolean sdi_ready;
 	void *priv;
@@ -462,6 +508,39 @@ struct sr_input_module {
 	 */
 	int (*receive) (struct sr_input *in, GString *buf);
 
+	/**
+	 * Send a window into a memory-mapped file to the specified input
+	 * instance, without copying it.
+	 *
+	 * The window starts where the module stopped consuming data in the
+	 * previous call, so data the module cannot process yet (e.g. a
+	 * partial sample) is offered again, together with more data. The
+	 * data stays valid until the input instance is freed.
+	 *
+	 * Like receive(), this returns without consuming anything the
+	 * moment the device instance is ready.
+	 *
+	 * sr_input_end() offers the rest of the file as the final window,
+	 * before it calls end(). The module must process all of it then,
+	 * e.g. send a last packet which is shorter than the others.
+	 *
+	 * This function is optional. Modules which provide it can be fed
+	 * with sr_input_map_file() and sr_input_send_mapped().
+	 *
+	 * @param in The input instance.
+	 * @param data The start of the window.
+	 * @param len The length of the window.
+	 * @param consumed Where to store the number of bytes the module is
+	 *                 done with, counting from the start of the window.
+	 * @param is_final TRUE if this is the final window, which reaches
+	 *                 the end of the file.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_window) (struct sr_input *in, const uint8_t *data,
+			size_t len, size_t *consumed, gboolean is_final);
+
 	/**
 	 * Signal the input module no more data will come.
 	 *
@@ -869,6 +948,19 @@ struct sr_session {
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+
+	/** Pool of reusable packet buffers, created on first use. */
+	struct sr_packet_pool *packet_pool;
+
+	/** Whether datafeed callbacks run on threads of their own. */
+	gboolean threaded_dispatch;
+	/** Queue size per datafeed callback in threaded mode. */
+	unsigned int dispatch_queue_size;
+	/** What to do when a queue is full, enum sr_dispatch_policy. */
+	int dispatch_policy;
+
+	/** Whether USB streams handle their transfers on a thread. */
+	gboolean usb_thread;
 };
 
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
@@ -897,6 +989,12 @@ SR_PRIV int sr_session_source_remove_channel(struct sr_session *session,
 
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV struct sr_datafeed_packet *sr_session_logic_packet_new(
+		struct sr_session *session, uint16_t unitsize, size_t size);
+SR_PRIV struct sr_datafeed_packet *sr_session_analog_packet_new(
+		struct sr_session *session, size_t size);
+SR_PRIV int sr_session_send_owned(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
@@ -922,6 +1020,8 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_meaning *meaning,
                            struct sr_analog_spec *spec,
                            int digits);
+SR_PRIV int sr_analog_to_float_range(const struct sr_datafeed_analog *analog,
+		size_t start, size_t count, float *outbuf);
 
 /*--- std.c -----------------------------------------------------------------*/
 
@@ -1014,12 +1114,31 @@ SR_PRIV int sr_atof_ascii(const char *str, float *ret);
 
 /*--- soft-trigger.c --------------------------------------------------------*/
 
+/**
+ * A trigger stage compiled into per-word bit masks. Bit n of word w
+ * corresponds to bit (n % 8) of byte (8 * w + n / 8) of a sample.
+ */
+struct soft_trigger_stage {
+	gboolean has_matches;
+	gboolean has_edges;
+	uint64_t *zero;
+	uint64_t *one;
+	uint64_t *rising;
+	uint64_t *falling;
+	uint64_t *edge;
+	/* Masks replicated over 32 bytes, only for unitsize 1, 2 and 4. */
+	uint8_t *lanes;
+};
+
 struct soft_trigger_logic {
 	const struct sr_dev_inst *sdi;
 	const struct sr_trigger *trigger;
-	int count;
 	int unitsize;
+	int num_words;
+	int num_stages;
+	struct soft_trigger_stage *stages;
 	int cur_stage;
+	gboolean have_prev;
 	uint8_t *prev_sample;
 	uint8_t *pre_trigger_buffer;
 	uint8_t *pre_trigger_head;
@@ -1034,6 +1153,58 @@ SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
 
+/*--- transpose.c -----------------------------------------------------------*/
+
+SR_PRIV uint64_t sr_transpose_8x8(uint64_t m);
+SR_PRIV void sr_transpose_16x16(uint16_t *m);
+SR_PRIV void sr_transpose_64x64(uint64_t *m);
+SR_PRIV void sr_transpose_planes16(const uint64_t *planes, uint16_t *samples,
+		unsigned int num_samples, gboolean msb_first);
+
+/*--- ols_decode.c ----------------------------------------------------------*/
+
+/** Runs handed out per sr_ols_decoder_read() call. */
+#define SR_OLS_DECODER_MAX_RUNS 1024
+
+/** A run of identical samples received from an OLS-family device. */
+struct sr_ols_run {
+	uint32_t value;
+	uint32_t length;
+};
+
+struct sr_ols_decoder {
+	/* Capture parameters, from the flag register. */
+	gboolean rle;
+	gboolean demux;
+	unsigned int group_mask;
+	unsigned int sample_bytes;
+	unsigned int unit_size;
+	uint64_t limit_samples;
+	/* The unit being received. */
+	uint8_t unit[8];
+	unsigned int unit_bytes;
+	uint32_t rle_count;
+	/* The runs so far, newest first as the device sends them. */
+	GArray *runs;
+	/* Bytes received, samples received (counts included), samples. */
+	uint64_t num_bytes;
+	uint64_t num_received;
+	uint64_t num_samples;
+	/* Read position, runs counted from the oldest. */
+	unsigned int read_run;
+	uint64_t read_offset;
+	uint8_t values[SR_OLS_DECODER_MAX_RUNS * 4];
+	uint64_t lengths[SR_OLS_DECODER_MAX_RUNS];
+};
+
+SR_PRIV void sr_ols_decoder_init(struct sr_ols_decoder *dec,
+		uint16_t flag_reg, uint64_t limit_samples);
+SR_PRIV void sr_ols_decoder_clear(struct sr_ols_decoder *dec);
+SR_PRIV size_t sr_ols_decoder_feed(struct sr_ols_decoder *dec,
+		const uint8_t *buf, size_t len);
+SR_PRIV uint64_t sr_ols_decoder_read(struct sr_ols_decoder *dec,
+		struct sr_datafeed_logic_rle *rle, uint64_t max_samples);
+
 /*--- hardware/serial.c -----------------------------------------------------*/
 
 #ifdef HAVE_LIBSERIALPORT
@@ -1102,6 +1273,254 @@ SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
 		const char *manufacturer, const char *product);
 #endif
 
+/*--- usb_stream.c ----------------------------------------------------------*/
+
+#ifdef HAVE_LIBUSB_1_0
+#define USB_STREAM_MAX_TRANSFERS 32
+
+struct sr_usb_stream_config {
+	/* The bulk IN endpoint, with LIBUSB_ENDPOINT_IN. */
+	unsigned char endpoint;
+	/* The data rate of the device. */
+	uint64_t bytes_per_ms;
+	/* Transfer sizes are a multiple of this, 512 by default. */
+	size_t block_size;
+	/* The data a transfer holds at first, 10 ms by default. */
+	unsigned int transfer_ms;
+	/* The data in flight at first, 500 ms by default. */
+	unsigned int total_ms;
+	/* Limits for adapting; 32 transfers, 4 times the first size. */
+	unsigned int max_transfers;
+	size_t max_transfer_size;
+	/* Empty transfers in a row after which the stream ends. */
+	unsigned int max_empty_transfers;
+	/*
+	 * The session the data goes to. When it asks for a USB thread,
+	 * transfers are handled on a thread of their own. May be NULL.
+	 */
+	struct sr_session *session;
+};
+
+/* Numbers about a stream, times in us. */
+struct sr_usb_stream_stats {
+	uint64_t transfers;
+	uint64_t bytes;
+	uint64_t empty_transfers;
+	/* Transfers reaped so late that the device likely overran. */
+	uint64_t starved;
+	/* How late a transfer was reaped, at most. */
+	uint64_t max_backlog_us;
+	unsigned int max_in_flight;
+	/* Time spent in the receive callback. */
+	uint64_t callback_us;
+	uint64_t max_callback_us;
+	/* From completion to resubmission. */
+	uint64_t resubmit_us;
+	uint64_t max_resubmit_us;
+	/* From submission to completion. */
+	uint64_t latency_us;
+	uint64_t max_latency_us;
+	unsigned int grown;
+	unsigned int shrunk;
+	/* With a USB thread: the most transfers waiting for the session. */
+	unsigned int max_queued;
+	/* With a USB thread: completions with no transfer to replace them. */
+	uint64_t missed_resubmits;
+};
+
+typedef gboolean (*sr_usb_stream_receive_callback)(uint8_t *data,
+		size_t length, void *cb_data);
+typedef void (*sr_usb_stream_finished_callback)(void *cb_data);
+
+struct usb_stream_slot;
+struct usb_stream_thread;
+
+struct sr_usb_stream {
+	struct sr_usb_dev_inst *usb;
+	struct sr_usb_stream_config config;
+	sr_usb_stream_receive_callback receive;
+	sr_usb_stream_finished_callback finished;
+	void *cb_data;
+	struct usb_stream_slot *slots;
+	unsigned int num_slots;
+	/* Set while transfers are handled on a thread of their own. */
+	struct usb_stream_thread *thread;
+	gboolean threaded;
+	unsigned int submitted;
+	/* The transfers to keep in flight, their size and limits. */
+	unsigned int target;
+	unsigned int min_target;
+	size_t size;
+	size_t min_size;
+	/* The transfer timeout for the current pool, in ms. */
+	unsigned int timeout;
+	gboolean aborted;
+	unsigned int empty_count;
+	/* When the last transfer was reaped, and how late. */
+	int64_t last_reaped_us;
+	int64_t backlog_us;
+	/* The round of completions looked at for adapting. */
+	unsigned int window_count;
+	unsigned int quiet_windows;
+	int64_t window_max_backlog_us;
+	uint64_t window_callback_us;
+	uint64_t window_fill_us;
+	struct sr_usb_stream_stats stats;
+};
+
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(struct sr_usb_dev_inst *usb,
+		const struct sr_usb_stream_config *config,
+		sr_usb_stream_receive_callback receive,
+		sr_usb_stream_finished_callback finished, void *cb_data);
+SR_PRIV int sr_usb_stream_start(struct sr_usb_stream *stream);
+SR_PRIV void sr_usb_stream_abort(struct sr_usb_stream *stream);
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *stream);
+
+/*--- usb_stream_pool.c -----------------------------------------------------*/
+
+/*
+ * A ring of slots with a single producer and a single consumer, which
+ * needs no lock. Like the datafeed workers in session.c.
+ */
+struct sr_usb_stream_ring {
+	struct usb_stream_slot **items;
+	/* Ring size, one more than the slots of the stream. */
+	int capacity;
+	/* Next item to take, only written by the consumer. */
+	int head;
+	/* Next free place, only written by the producer. */
+	int tail;
+};
+
+SR_PRIV void sr_usb_stream_size_pool(struct sr_usb_stream *stream);
+SR_PRIV int64_t sr_usb_stream_fill_time(const struct sr_usb_stream *stream,
+		uint64_t bytes);
+SR_PRIV int64_t sr_usb_stream_update_backlog(struct sr_usb_stream *stream,
+		int64_t reaped_us, size_t length);
+SR_PRIV void sr_usb_stream_adapt(struct sr_usb_stream *stream,
+		int64_t backlog_us, uint64_t callback_us, size_t length);
+SR_PRIV void sr_usb_stream_ring_init(struct sr_usb_stream_ring *ring,
+		unsigned int size);
+SR_PRIV unsigned int sr_usb_stream_ring_depth(struct sr_usb_stream_ring *ring);
+SR_PRIV void sr_usb_stream_ring_push(struct sr_usb_stream_ring *ring,
+		struct usb_stream_slot *slot);
+SR_PRIV gboolean sr_usb_stream_ring_pop(struct sr_usb_stream_ring *ring,
+		struct usb_stream_slot **slot);
+#endif
+
+/*--- usb_trace.c -----------------------------------------------------------*/
+
+#ifdef HAVE_LIBUSB_1_0
+SR_PRIV void sr_usb_trace_init(void);
+SR_PRIV void sr_usb_trace_exit(void);
+SR_PRIV gboolean sr_usb_trace_active(void);
+SR_PRIV int sr_usb_trace_timeout(void);
+SR_PRIV ssize_t sr_usb_trace_get_device_list(libusb_context *ctx,
+		libusb_device ***list);
+SR_PRIV void sr_usb_trace_free_device_list(libusb_device **list,
+		int unref_devices);
+SR_PRIV int sr_usb_trace_get_device_descriptor(libusb_device *dev,
+		struct libusb_device_descriptor *desc);
+SR_PRIV uint8_t sr_usb_trace_get_bus_number(libusb_device *dev);
+SR_PRIV uint8_t sr_usb_trace_get_device_address(libusb_device *dev);
+SR_PRIV int sr_usb_trace_get_port_numbers(libusb_device *dev,
+		uint8_t *port_numbers, int port_numbers_len);
+SR_PRIV int sr_usb_trace_open(libusb_device *dev,
+		libusb_device_handle **dev_handle);
+SR_PRIV void sr_usb_trace_close(libusb_device_handle *dev_handle);
+SR_PRIV libusb_device *sr_usb_trace_get_device(libusb_device_handle *dev_handle);
+SR_PRIV int sr_usb_trace_get_string_descriptor_ascii(
+		libusb_device_handle *dev_handle, uint8_t desc_index,
+		unsigned char *data, int length);
+SR_PRIV int sr_usb_trace_claim_interface(libusb_device_handle *dev_handle,
+		int interface_number);
+SR_PRIV int sr_usb_trace_release_interface(libusb_device_handle *dev_handle,
+		int interface_number);
+SR_PRIV int sr_usb_trace_kernel_driver_active(libusb_device_handle *dev_handle,
+		int interface_number);
+SR_PRIV int sr_usb_trace_detach_kernel_driver(libusb_device_handle *dev_handle,
+		int interface_number);
+SR_PRIV int sr_usb_trace_attach_kernel_driver(libusb_device_handle *dev_handle,
+		int interface_number);
+SR_PRIV int sr_usb_trace_set_configuration(libusb_device_handle *dev_handle,
+		int configuration);
+SR_PRIV int sr_usb_trace_get_configuration(libusb_device_handle *dev_handle,
+		int *config);
+SR_PRIV int sr_usb_trace_reset_device(libusb_device_handle *dev_handle);
+SR_PRIV int sr_usb_trace_get_config_descriptor(libusb_device *dev,
+		uint8_t config_index, struct libusb_config_descriptor **config);
+SR_PRIV int sr_usb_trace_control_transfer(libusb_device_handle *dev_handle,
+		uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+		uint16_t wIndex, unsigned char *data, uint16_t wLength,
+		unsigned int timeout);
+SR_PRIV int sr_usb_trace_bulk_transfer(libusb_device_handle *dev_handle,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout);
+SR_PRIV int sr_usb_trace_interrupt_transfer(libusb_device_handle *dev_handle,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout);
+SR_PRIV int sr_usb_trace_submit_transfer(struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_trace_cancel_transfer(struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_trace_handle_events_timeout(libusb_context *ctx,
+		struct timeval *tv);
+
+/*
+ * Route the libusb calls of the drivers through usb_trace.c, which can
+ * record them, or answer them from a recording.
+ */
+#define libusb_get_device_list(ctx, list) \
+	sr_usb_trace_get_device_list(ctx, list)
+#define libusb_free_device_list(list, unref) \
+	sr_usb_trace_free_device_list(list, unref)
+#define libusb_get_device_descriptor(dev, desc) \
+	sr_usb_trace_get_device_descriptor(dev, desc)
+#define libusb_get_bus_number(dev) sr_usb_trace_get_bus_number(dev)
+#define libusb_get_device_address(dev) sr_usb_trace_get_device_address(dev)
+#define libusb_get_port_numbers(dev, ports, len) \
+	sr_usb_trace_get_port_numbers(dev, ports, len)
+#define libusb_open(dev, hdl) sr_usb_trace_open(dev, hdl)
+#define libusb_close(hdl) sr_usb_trace_close(hdl)
+#define libusb_get_device(hdl) sr_usb_trace_get_device(hdl)
+#define libusb_get_string_descriptor_ascii(hdl, index, data, len) \
+	sr_usb_trace_get_string_descriptor_ascii(hdl, index, data, len)
+#define libusb_claim_interface(hdl, iface) \
+	sr_usb_trace_claim_interface(hdl, iface)
+#define libusb_release_interface(hdl, iface) \
+	sr_usb_trace_release_interface(hdl, iface)
+#define libusb_kernel_driver_active(hdl, iface) \
+	sr_usb_trace_kernel_driver_active(hdl, iface)
+#define libusb_detach_kernel_driver(hdl, iface) \
+	sr_usb_trace_detach_kernel_driver(hdl, iface)
+#define libusb_attach_kernel_driver(hdl, iface) \
+	sr_usb_trace_attach_kernel_driver(hdl, iface)
+#define libusb_set_configuration(hdl, config) \
+	sr_usb_trace_set_configuration(hdl, config)
+#define libusb_get_configuration(hdl, config) \
+	sr_usb_trace_get_configuration(hdl, config)
+#define libusb_reset_device(hdl) sr_usb_trace_reset_device(hdl)
+#define libusb_get_config_descriptor(dev, index, config) \
+	sr_usb_trace_get_config_descriptor(dev, index, config)
+#define libusb_control_transfer(hdl, type, req, val, idx, data, len, tmo) \
+	sr_usb_trace_control_transfer(hdl, type, req, val, idx, data, len, tmo)
+#define libusb_bulk_transfer(hdl, ep, data, len, done, tmo) \
+	sr_usb_trace_bulk_transfer(hdl, ep, data, len, done, tmo)
+#define libusb_interrupt_transfer(hdl, ep, data, len, done, tmo) \
+	sr_usb_trace_interrupt_transfer(hdl, ep, data, len, done, tmo)
+#define libusb_submit_transfer(transfer) \
+	sr_usb_trace_submit_transfer(transfer)
+#define libusb_cancel_transfer(transfer) \
+	sr_usb_trace_cancel_transfer(transfer)
+#define libusb_handle_events_timeout(ctx, tv) \
+	sr_usb_trace_handle_events_timeout(ctx, tv)
+/* On FreeBSD, this is mapped to libusb_handle_events_timeout() above. */
+#ifndef __FreeBSD__
+SR_PRIV int sr_usb_trace_handle_events_timeout_completed(libusb_context *ctx,
+		struct timeval *tv, int *completed);
+#define libusb_handle_events_timeout_completed(ctx, tv, completed) \
+	sr_usb_trace_handle_events_timeout_completed(ctx, tv, completed)
+#endif
+#endif
+
 
 /*--- modbus/modbus.c -------------------------------------------------------*/
 
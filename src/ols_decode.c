@@ -0,0 +1,263 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ *
+ * Decoder for the sample stream of OLS-family devices.
+ *
+ * The Openbench Logic Sniffer and its descendants send their sample memory
+ * newest sample first, one unit of up to four bytes (one per enabled
+ * channel group) at a time. With RLE enabled, a unit with its top bit set
+ * is the repeat count of the value that follows it. In demux mode the
+ * units are sample pairs, and the counts apply to pairs.
+ *
+ * The decoder keeps the capture as runs of identical samples, so that
+ * it is never expanded in memory, and hands them out oldest first.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "ols-decode"
+/** @endcond */
+
+/* Bits of the flag register the decoder cares about. */
+#define FLAG_RLE          (1 << 8)
+#define FLAG_DEMUX        (1 << 0)
+#define FLAG_GROUPS_SHIFT 2
+
+/**
+ * Start decoding a new capture.
+ *
+ * @param dec The decoder. Must be zeroed or cleared before the first use.
+ * @param flag_reg The value of the device's flag register for the
+ *                 capture. Only the RLE, demux and channel group bits
+ *                 are used.
+ * @param limit_samples Stop after this many (decoded) samples.
+ *
+ * @private
+ */
+SR_PRIV void sr_ols_decoder_init(struct sr_ols_decoder *dec,
+		uint16_t flag_reg, uint64_t limit_samples)
+{
+	unsigned int i;
+
+	dec->rle = (flag_reg & FLAG_RLE) != 0;
+	dec->demux = dec->rle && (flag_reg & FLAG_DEMUX);
+	dec->group_mask = ~(flag_reg >> FLAG_GROUPS_SHIFT) & 0x0f;
+	/* Sample pairs only have the lower two channel groups. */
+	if (dec->demux)
+		dec->group_mask &= 0x03;
+	dec->sample_bytes = 0;
+	for (i = 0; i < 4; i++)
+		if (dec->group_mask & (1 << i))
+			dec->sample_bytes++;
+	dec->unit_size = dec->demux ? 2 * dec->sample_bytes : dec->sample_bytes;
+	dec->limit_samples = limit_samples;
+
+	dec->unit_bytes = 0;
+	dec->rle_count = 0;
+	dec->num_bytes = dec->num_received = dec->num_samples = 0;
+	dec->read_run = dec->read_offset = 0;
+
+	if (dec->runs)
+		g_array_set_size(dec->runs, 0);
+	else
+		dec->runs = g_array_new(FALSE, FALSE, sizeof(struct sr_ols_run));
+}
+
+/**
+ * Free the runs of the last capture.
+ *
+ * @param dec The decoder.
+ *
+ * @private
+ */
+SR_PRIV void sr_ols_decoder_clear(struct sr_ols_decoder *dec)
+{
+	if (dec->runs)
+		g_array_free(dec->runs, TRUE);
+	dec->runs = NULL;
+}
+
+/* Spread the bytes of a sample out to the enabled channel groups. */
+static uint32_t expand_sample(const struct sr_ols_decoder *dec,
+		const uint8_t *bytes)
+{
+	uint32_t sample;
+	unsigned int i;
+
+	sample = 0;
+	for (i = 0; i < 4; i++)
+		if (dec->group_mask & (1 << i))
+			sample |= (uint32_t)*bytes++ << (8 * i);
+
+	return sample;
+}
+
+/* Add a run older than all previous ones. */
+static void add_run(struct sr_ols_decoder *dec, uint32_t value,
+		uint64_t length)
+{
+	struct sr_ols_run run, *last;
+	uint64_t n;
+
+	if (dec->runs->len > 0) {
+		last = &g_array_index(dec->runs, struct sr_ols_run,
+			dec->runs->len - 1);
+		if (last->value == value) {
+			n = MIN(length, UINT32_MAX - last->length);
+			last->length += n;
+			length -= n;
+		}
+	}
+
+	run.value = value;
+	while (length > 0) {
+		run.length = MIN(length, UINT32_MAX);
+		g_array_append_val(dec->runs, run);
+		length -= run.length;
+	}
+}
+
+static void decode_unit(struct sr_ols_decoder *dec)
+{
+	const uint8_t *unit;
+	uint32_t s1, s2;
+	uint64_t n, i;
+	unsigned int b;
+
+	unit = dec->unit;
+	dec->num_received += dec->demux ? 2 : 1;
+
+	if (dec->rle && (unit[dec->unit_size - 1] & 0x80)) {
+		/* The number of times the next value repeats. */
+		dec->rle_count = 0;
+		for (b = 0; b < dec->unit_size; b++)
+			dec->rle_count |= (uint32_t)unit[b] << (8 * b);
+		dec->rle_count &= ~(0x80U << (8 * (dec->unit_size - 1)));
+		return;
+	}
+
+	s1 = expand_sample(dec, unit);
+	if (!dec->demux) {
+		n = MIN((uint64_t)dec->rle_count + 1,
+			dec->limit_samples - dec->num_samples);
+		add_run(dec, s1, n);
+	} else {
+		/* In time order a pair is the second sample, then the first. */
+		s2 = expand_sample(dec, unit + dec->sample_bytes);
+		n = MIN(2 * ((uint64_t)dec->rle_count + 1),
+			dec->limit_samples - dec->num_samples);
+		if (s1 == s2) {
+			add_run(dec, s1, n);
+		} else {
+			for (i = 0; i < n; i++)
+				add_run(dec, i & 1 ? s2 : s1, 1);
+		}
+	}
+	dec->num_samples += n;
+	dec->rle_count = 0;
+}
+
+/**
+ * Decode a block of the sample stream.
+ *
+ * Units may be split across blocks.
+ *
+ * @param dec The decoder.
+ * @param buf The bytes received from the device.
+ * @param len The number of bytes in buf.
+ *
+ * @return The number of bytes used. This is less than len only when the
+ *         sample limit was reached, the remaining bytes are not needed.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_ols_decoder_feed(struct sr_ols_decoder *dec,
+		const uint8_t *buf, size_t len)
+{
+	size_t pos, n;
+
+	pos = 0;
+	while (pos < len && dec->num_samples < dec->limit_samples) {
+		n = MIN(dec->unit_size - dec->unit_bytes, len - pos);
+		memcpy(dec->unit + dec->unit_bytes, buf + pos, n);
+		dec->unit_bytes += n;
+		pos += n;
+		if (dec->unit_bytes == dec->unit_size) {
+			decode_unit(dec);
+			dec->unit_bytes = 0;
+		}
+	}
+	dec->num_bytes += pos;
+
+	return pos;
+}
+
+/**
+ * Get the next decoded samples, oldest first.
+ *
+ * The runs go into buffers of the decoder, which are reused by the next
+ * call. A run which does not fit into max_samples is split.
+ *
+ * @param dec The decoder.
+ * @param rle The payload to fill in, with 32-bit samples.
+ * @param max_samples The maximum number of samples to return.
+ *
+ * @return The number of samples in rle, 0 after the last one.
+ *
+ * @private
+ */
+SR_PRIV uint64_t sr_ols_decoder_read(struct sr_ols_decoder *dec,
+		struct sr_datafeed_logic_rle *rle, uint64_t max_samples)
+{
+	const struct sr_ols_run *run;
+	uint64_t count, n;
+	unsigned int num_runs;
+
+	count = 0;
+	num_runs = 0;
+	while (num_runs < SR_OLS_DECODER_MAX_RUNS && count < max_samples
+			&& dec->read_run < dec->runs->len) {
+		run = &g_array_index(dec->runs, struct sr_ols_run,
+			dec->runs->len - 1 - dec->read_run);
+		n = MIN(run->length - dec->read_offset, max_samples - count);
+		WL32(&dec->values[num_runs * 4], run->value);
+		dec->lengths[num_runs++] = n;
+		count += n;
+		dec->read_offset += n;
+		if (dec->read_offset == run->length) {
+			dec->read_run++;
+			dec->read_offset = 0;
+		}
+	}
+
+	rle->num_runs = num_runs;
+	rle->unitsize = 4;
+	rle->data = dec->values;
+	rle->lengths = dec->lengths;
+
+	return count;
+}
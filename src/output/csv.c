@@ -63,10 +63,31 @@
 
 #define LOG_PREFIX "output/csv"
 
+/* Longest float from format_float(), like "-1.17549e-38". */
+#define FLOAT_MAX_LEN 16
+
+/* Longest decimal uint64_t. */
+#define UINT64_MAX_LEN 20
+
 struct ctx_channel {
 	struct sr_channel *ch;
 	char *label;
 	float min, max;
+	/* Position among the enabled channels of the same type. */
+	unsigned int slot;
+};
+
+/*
+ * A cell of a record, or a group of logic cells which all come from the
+ * same byte of the sample, and which are copied from a table holding
+ * their text for each value of that byte.
+ */
+struct row_cell {
+	struct ctx_channel *channel;
+	gboolean is_logic;
+	unsigned int byte;
+	char *strings;
+	size_t len;
 };
 
 struct context {
@@ -98,8 +119,21 @@ struct context {
 	uint8_t *previous_sample;
 	float *analog_samples;
 	uint8_t *logic_samples;
+	size_t analog_samples_size;
+	size_t logic_samples_size;
+	gboolean analog_seen, logic_seen;
+	float *fdata;
+	size_t fdata_size;
 	const char *xlabel;	/* Don't free: will point to a static string. */
 	const char *title;	/* Don't free: will point into the driver struct. */
+
+	/* Record layout, from the enabled channels. */
+	struct row_cell *cells;
+	unsigned int num_cells;
+	uint8_t *logic_mask;
+	size_t logic_unitsize;
+	size_t value_len, record_len;
+	size_t max_row_len;
 };
 
 /*
@@ -108,6 +142,66 @@ struct context {
  *    channel LAs) as ASCII/hex etc. etc.
  */
 
+/*
+ * Work out the cells of a record from the enabled channels. Consecutive
+ * logic channels which live in the same byte of a sample share a cell,
+ * whose text for each of the 256 values of that byte is prepared here,
+ * separators included. Also size the longest possible record, so that a
+ * whole packet can be formatted without growing the output buffer.
+ */
+static void init_row_layout(struct context *ctx)
+{
+	struct row_cell *cell;
+	struct ctx_channel *channel;
+	unsigned int i, j, k, num_channels, value;
+	char *text;
+
+	ctx->value_len = strlen(ctx->value);
+	ctx->record_len = strlen(ctx->record);
+	num_channels = ctx->num_analog_channels + ctx->num_logic_channels;
+	ctx->cells = g_malloc0(sizeof(struct row_cell) * (num_channels + 1));
+	ctx->logic_mask = g_malloc0(ctx->logic_unitsize + 1);
+
+	ctx->max_row_len = ctx->record_len;
+	if (ctx->time)
+		ctx->max_row_len += UINT64_MAX_LEN + ctx->value_len;
+	if (ctx->do_trigger)
+		ctx->max_row_len += 1 + ctx->value_len;
+
+	for (i = 0; i < num_channels; i = j) {
+		channel = &ctx->channels[i];
+		cell = &ctx->cells[ctx->num_cells++];
+		cell->channel = channel;
+		j = i + 1;
+		if (channel->ch->type == SR_CHANNEL_ANALOG) {
+			ctx->max_row_len += FLOAT_MAX_LEN + ctx->value_len;
+			continue;
+		}
+
+		cell->is_logic = TRUE;
+		cell->byte = channel->ch->index / 8;
+		while (j < num_channels &&
+				ctx->channels[j].ch->type == SR_CHANNEL_LOGIC &&
+				ctx->channels[j].ch->index / 8 == (int)cell->byte)
+			j++;
+		cell->len = (j - i) * (1 + ctx->value_len);
+		cell->strings = g_malloc(256 * cell->len);
+		text = cell->strings;
+		for (value = 0; value < 256; value++) {
+			for (k = i; k < j; k++) {
+				*text++ = value & (1 << (ctx->channels[k].ch->index % 8))
+					? '1' : '0';
+				memcpy(text, ctx->value, ctx->value_len);
+				text += ctx->value_len;
+			}
+		}
+		for (k = i; k < j; k++)
+			ctx->logic_mask[cell->byte] |=
+				1 << (ctx->channels[k].ch->index % 8);
+		ctx->max_row_len += cell->len;
+	}
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	unsigned int i, analog_channels, logic_channels;
@@ -183,24 +277,34 @@ static int init(struct sr_output *o, GHashTable *options)
 
 	/* Once more to map the enabled channels. */
 	ctx->channel_count = g_slist_length(o->sdi->channels);
+	analog_channels = logic_channels = 0;
 	for (i = 0, l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
-		if (ch->enabled) {
-			if (ch->type == SR_CHANNEL_ANALOG) {
-				ctx->channels[i].min = FLT_MAX;
-				ctx->channels[i].max = FLT_MIN;
-			} else if (ch->type == SR_CHANNEL_LOGIC) {
-				ctx->channels[i].min = 0;
-				ctx->channels[i].max = 1;
-			} else {
-				sr_warn("Unknown channel type %d.", ch->type);
-			}
-			if (ctx->label_do && ctx->label_names)
-				ctx->channels[i].label = ch->name;
-			ctx->channels[i++].ch = ch;
+		if (!ch->enabled)
+			continue;
+		if (ch->type == SR_CHANNEL_ANALOG) {
+			ctx->channels[i].min = FLT_MAX;
+			ctx->channels[i].max = FLT_MIN;
+			ctx->channels[i].slot = analog_channels++;
+			ctx->channels[i].label = NULL;
+		} else if (ch->type == SR_CHANNEL_LOGIC) {
+			ctx->channels[i].min = 0;
+			ctx->channels[i].max = 1;
+			ctx->channels[i].slot = logic_channels++;
+			ctx->channels[i].label = "logic";
+			if (ch->index / 8 >= (int)ctx->logic_unitsize)
+				ctx->logic_unitsize = ch->index / 8 + 1;
+		} else {
+			sr_warn("Unknown channel type %d.", ch->type);
+			continue;
 		}
+		if (ctx->label_do && ctx->label_names)
+			ctx->channels[i].label = ch->name;
+		ctx->channels[i++].ch = ch;
 	}
 
+	init_row_layout(ctx);
+
 	return SR_OK;
 }
 
@@ -308,97 +412,254 @@ static void process_analog(struct context *ctx,
 			   const struct sr_datafeed_analog *analog)
 {
 	int ret;
-	unsigned int i, j, c, num_channels;
+	unsigned int i, j, c, num_channels, num_samples, stride;
 	struct sr_analog_meaning *meaning;
+	struct ctx_channel *channel;
+	size_t size;
 	GSList *l;
-	float *fdata = NULL;
 
-	if (!ctx->analog_samples) {
-		ctx->analog_samples = g_malloc(analog->num_samples
-			* sizeof(float) * ctx->num_analog_channels);
-		if (!ctx->num_samples)
-			ctx->num_samples = analog->num_samples;
-	}
+	if (!ctx->num_samples)
+		ctx->num_samples = analog->num_samples;
 	if (ctx->num_samples != analog->num_samples)
 		sr_warn("Expecting %u analog samples, got %u.",
 			ctx->num_samples, analog->num_samples);
+	if (!ctx->analog_seen) {
+		size = ctx->num_samples * ctx->num_analog_channels;
+		if (size > ctx->analog_samples_size) {
+			g_free(ctx->analog_samples);
+			ctx->analog_samples = g_malloc0(size * sizeof(float));
+			ctx->analog_samples_size = size;
+		}
+		ctx->analog_seen = TRUE;
+	}
 
 	meaning = analog->meaning;
 	num_channels = g_slist_length(meaning->channels);
 	ctx->channels_seen += num_channels;
 	sr_dbg("Processing packet of %u analog channels", num_channels);
-	fdata = g_malloc(analog->num_samples * num_channels * sizeof(float));
-	if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
+	size = analog->num_samples * num_channels;
+	if (size > ctx->fdata_size) {
+		g_free(ctx->fdata);
+		ctx->fdata = g_malloc(size * sizeof(float));
+		ctx->fdata_size = size;
+	}
+	if ((ret = sr_analog_to_float(analog, ctx->fdata)) != SR_OK)
 		sr_warn("Problems converting data to floating point values.");
 
+	num_samples = MIN(analog->num_samples, ctx->num_samples);
+	stride = ctx->num_analog_channels;
 	for (i = 0; i < ctx->num_analog_channels + ctx->num_logic_channels; i++) {
-		if (ctx->channels[i].ch->type == SR_CHANNEL_ANALOG) {
-			sr_dbg("Looking for channel %s",
-			       ctx->channels[i].ch->name);
-			for (l = meaning->channels, c = 0; l; l = l->next, c++) {
-				struct sr_channel *ch = l->data;
-				sr_dbg("Checking %s", ch->name);
-				if (ctx->channels[i].ch == l->data) {
-					if (ctx->label_do && !ctx->label_names) {
-						sr_analog_unit_to_string(analog,
-							&ctx->channels[i].label);
-					}
-					for (j = 0; j < analog->num_samples; j++)
-						ctx->analog_samples[j * ctx->num_analog_channels + i] = fdata[j * num_channels + c];
-					break;
-				}
+		channel = &ctx->channels[i];
+		if (channel->ch->type != SR_CHANNEL_ANALOG)
+			continue;
+		for (l = meaning->channels, c = 0; l; l = l->next, c++) {
+			if (channel->ch != l->data)
+				continue;
+			if (ctx->label_do && !ctx->label_names) {
+				g_free(channel->label);
+				sr_analog_unit_to_string(analog, &channel->label);
 			}
+			for (j = 0; j < num_samples; j++)
+				ctx->analog_samples[j * stride + channel->slot] =
+					ctx->fdata[j * num_channels + c];
+			break;
 		}
 	}
-	g_free(fdata);
 }
 
 /*
  * We treat logic packets the same as analog packets, though it's not
  * strictly required. This allows us to process mixed signals properly.
+ * Only the bits of the enabled channels are kept, and the sample bytes
+ * are looked up as they are when the values are formatted.
  */
 static void process_logic(struct context *ctx,
 			  const struct sr_datafeed_logic *logic)
 {
-	unsigned int i, j, ch, num_samples;
-	int idx;
-	uint8_t *sample;
+	unsigned int i, b, num_samples, copy;
+	const uint8_t *sample;
+	uint8_t *saved;
+	size_t size;
 
 	num_samples = logic->length / logic->unitsize;
 	ctx->channels_seen += ctx->logic_channel_count;
 	sr_dbg("Logic packet had %d channels", logic->unitsize * 8);
-	if (!ctx->logic_samples) {
-		ctx->logic_samples = g_malloc(num_samples * ctx->num_logic_channels);
-		if (!ctx->num_samples)
-			ctx->num_samples = num_samples;
-	}
+	if (!ctx->num_samples)
+		ctx->num_samples = num_samples;
 	if (ctx->num_samples != num_samples)
 		sr_warn("Expecting %u samples, got %u",
 			ctx->num_samples, num_samples);
+	if (!ctx->logic_seen) {
+		size = ctx->num_samples * ctx->logic_unitsize;
+		if (size > ctx->logic_samples_size) {
+			g_free(ctx->logic_samples);
+			ctx->logic_samples = g_malloc0(size);
+			ctx->logic_samples_size = size;
+		}
+		ctx->logic_seen = TRUE;
+	}
 
-	for (j = ch = 0; ch < ctx->num_logic_channels; j++) {
-		if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-			for (i = 0; i < num_samples; i++) {
-				sample = logic->data + i * logic->unitsize;
-				idx = ctx->channels[j].ch->index;
-				if (ctx->label_do && !ctx->label_names)
-					ctx->channels[j].label = "logic";
-				ctx->logic_samples[i * ctx->num_logic_channels + ch] = sample[idx / 8] & (1 << (idx % 8));
-			}
-			ch++;
+	num_samples = MIN(num_samples, ctx->num_samples);
+	copy = MIN(logic->unitsize, ctx->logic_unitsize);
+	sample = logic->data;
+	saved = ctx->logic_samples;
+	if (copy == 1 && ctx->logic_unitsize == 1) {
+		for (i = 0; i < num_samples; i++, sample += logic->unitsize)
+			saved[i] = sample[0] & ctx->logic_mask[0];
+		return;
+	}
+	for (i = 0; i < num_samples; i++, sample += logic->unitsize) {
+		for (b = 0; b < copy; b++)
+			*saved++ = sample[b] & ctx->logic_mask[b];
+		for (; b < ctx->logic_unitsize; b++)
+			*saved++ = 0;
+	}
+}
+
+/* Print an unsigned number in decimal, return the number of characters. */
+static size_t format_uint64(char *buf, uint64_t value)
+{
+	char digits[UINT64_MAX_LEN];
+	size_t len;
+
+	len = 0;
+	do {
+		digits[UINT64_MAX_LEN - ++len] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	memcpy(buf, digits + UINT64_MAX_LEN - len, len);
+
+	return len;
+}
+
+/* Exact powers of ten, for scaling a float to six significant digits. */
+static const double scale_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+};
+
+/*
+ * Print a float like "%g" does, return the number of characters. A float
+ * times a power of ten up to 1e12 is exact in a double, so rounding that
+ * to an integer gives the same six digits as printf. Values outside the
+ * range this covers, and NaN and infinity, go through the slow path. The
+ * buffer must hold FLOAT_MAX_LEN characters, including the terminating
+ * NUL the slow path writes.
+ */
+static size_t format_float(char *buf, float value)
+{
+	char digits[6], *p;
+	double a, m;
+	unsigned int u;
+	int e, i, last;
+
+	a = fabs(value);
+	p = buf;
+	if (a == 0) {
+		if (signbit(value))
+			*p++ = '-';
+		*p++ = '0';
+		return p - buf;
+	}
+	if (!(a >= 1e-7 && a < 1e6))
+		goto slow;
+
+	/* Estimate the decimal exponent, then correct it after rounding. */
+	for (e = 5; e > -7 && a < scale_pow10[e + 7] / 1e7; e--)
+		;
+	for (;;) {
+		if (e > 5 || e < -7)
+			goto slow;
+		m = rint(a * scale_pow10[5 - e]);
+		if (m >= 1e6)
+			e++;
+		else if (m < 1e5)
+			e--;
+		else
+			break;
+	}
+
+	u = m;
+	for (i = 5; i >= 0; i--) {
+		digits[i] = '0' + u % 10;
+		u /= 10;
+	}
+	for (last = 5; last > 0 && digits[last] == '0'; last--)
+		;
+
+	if (value < 0)
+		*p++ = '-';
+	if (e >= 0) {
+		memcpy(p, digits, e + 1);
+		p += e + 1;
+		if (last > e) {
+			*p++ = '.';
+			memcpy(p, digits + e + 1, last - e);
+			p += last - e;
+		}
+	} else if (e >= -4) {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = -1; i > e; i--)
+			*p++ = '0';
+		memcpy(p, digits, last + 1);
+		p += last + 1;
+	} else {
+		*p++ = digits[0];
+		if (last > 0) {
+			*p++ = '.';
+			memcpy(p, digits + 1, last);
+			p += last;
 		}
+		*p++ = 'e';
+		*p++ = '-';
+		*p++ = '0';
+		*p++ = '0' - e;
 	}
+
+	return p - buf;
+
+slow:
+	g_ascii_formatd(buf, FLOAT_MAX_LEN, "%g", value);
+	return strlen(buf);
+}
+
+/* Skip rows which repeat the previous one, except the first and last. */
+static gboolean is_duplicate(struct context *ctx, unsigned int i,
+		const uint8_t *logic_sample, const float *analog_sample)
+{
+	size_t analog_size;
+	gboolean same;
+
+	analog_size = ctx->num_analog_channels * sizeof(float);
+	same = (!ctx->logic_unitsize || !memcmp(logic_sample,
+			ctx->previous_sample, ctx->logic_unitsize)) &&
+		(!analog_size || !memcmp(analog_sample,
+			ctx->previous_sample + ctx->logic_unitsize, analog_size));
+	if (same && i > 0 && i < ctx->num_samples - 1)
+		return TRUE;
+	if (ctx->logic_unitsize)
+		memcpy(ctx->previous_sample, logic_sample, ctx->logic_unitsize);
+	if (analog_size)
+		memcpy(ctx->previous_sample + ctx->logic_unitsize,
+		       analog_sample, analog_size);
+
+	return FALSE;
 }
 
 static void dump_saved_values(struct context *ctx, GString **out)
 {
-	unsigned int i, j, analog_size, num_channels;
-	float *analog_sample, value;
-	uint8_t *logic_sample;
+	unsigned int i, j, num_channels;
+	const struct row_cell *cell;
+	struct ctx_channel *channel;
+	const float *analog_sample;
+	const uint8_t *logic_sample;
+	char *p, *row;
+	size_t start;
+	float value;
 
 	/* If we haven't seen samples we're expecting, skip them. */
-	if ((ctx->num_analog_channels && !ctx->analog_samples) ||
-	    (ctx->num_logic_channels && !ctx->logic_samples)) {
+	if ((ctx->num_analog_channels && !ctx->analog_seen) ||
+	    (ctx->num_logic_channels && !ctx->logic_seen)) {
 		sr_warn("Discarding partial packet");
 	} else {
 		sr_info("Dumping %u samples", ctx->num_samples);
@@ -412,91 +673,89 @@ static void dump_saved_values(struct context *ctx, GString **out)
 				g_string_append_printf(*out, "%s%s",
 					ctx->label_names ? "Time" :
 					ctx->xlabel, ctx->value);
-			for (i = 0; i < num_channels; i++) {
+			for (i = 0; i < num_channels; i++)
 				g_string_append_printf(*out, "%s%s",
-					ctx->channels[i].label, ctx->value);
-				if (ctx->channels[i].ch->type == SR_CHANNEL_ANALOG
-						&& ctx->label_names)
-					g_free(ctx->channels[i].label);
-			}
+					ctx->channels[i].label ?
+					ctx->channels[i].label : "",
+					ctx->value);
 			if (ctx->do_trigger)
 				g_string_append_printf(*out, "Trigger%s",
 						       ctx->value);
 			/* Drop last separator. */
-			g_string_truncate(*out, (*out)->len - 1);
+			if ((*out)->len >= ctx->value_len)
+				g_string_truncate(*out,
+					(*out)->len - ctx->value_len);
 			g_string_append(*out, ctx->record);
 
 			ctx->label_do = FALSE;
 		}
 
-		analog_size = ctx->num_analog_channels * sizeof(float);
 		if (ctx->dedup && !ctx->previous_sample)
-			ctx->previous_sample = g_malloc0(analog_size + ctx->num_logic_channels);
+			ctx->previous_sample = g_malloc0(ctx->logic_unitsize
+				+ ctx->num_analog_channels * sizeof(float));
+
+		/* Format straight into the buffer, sized for the longest rows. */
+		start = (*out)->len;
+		g_string_set_size(*out,
+			start + ctx->num_samples * ctx->max_row_len);
+		p = (*out)->str + start;
 
 		for (i = 0; i < ctx->num_samples; i++) {
 			ctx->sample_time += ctx->period;
-			analog_sample =
-			    &ctx->analog_samples[i * ctx->num_analog_channels];
-			logic_sample =
-			    &ctx->logic_samples[i * ctx->num_logic_channels];
-
-			if (ctx->dedup) {
-				if (i > 0 && i < ctx->num_samples - 1 &&
-				    !memcmp(logic_sample, ctx->previous_sample,
-					    ctx->num_logic_channels) &&
-				    !memcmp(analog_sample,
-					    ctx->previous_sample +
-					    ctx->num_logic_channels,
-					    analog_size))
-					continue;
-				memcpy(ctx->previous_sample, logic_sample,
-				       ctx->num_logic_channels);
-				memcpy(ctx->previous_sample
-				       + ctx->num_logic_channels,
-				       analog_sample, analog_size);
+			analog_sample = ctx->analog_samples +
+				i * ctx->num_analog_channels;
+			logic_sample = ctx->logic_samples +
+				i * ctx->logic_unitsize;
+
+			if (ctx->dedup && is_duplicate(ctx, i, logic_sample,
+					analog_sample))
+				continue;
+
+			row = p;
+			if (ctx->time) {
+				p += format_uint64(p, ctx->sample_time);
+				memcpy(p, ctx->value, ctx->value_len);
+				p += ctx->value_len;
 			}
 
-			if (ctx->time)
-				g_string_append_printf(*out, "%" PRIu64 "%s",
-					ctx->sample_time, ctx->value);
-
-			for (j = 0; j < num_channels; j++) {
-				if (ctx->channels[j].ch->type == SR_CHANNEL_ANALOG) {
-					value = ctx->analog_samples[i * ctx->num_analog_channels + j];
-					ctx->channels[j].max =
-					    fmax(value, ctx->channels[j].max);
-					ctx->channels[j].min =
-					    fmin(value, ctx->channels[j].min);
-					g_string_append_printf(*out, "%g%s",
-						value, ctx->value);
-				} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-					g_string_append_printf(*out, "%c%s",
-							       ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0', ctx->value);
-				} else {
-					sr_warn("Unexpected channel type: %d",
-						ctx->channels[i].ch->type);
+			for (j = 0; j < ctx->num_cells; j++) {
+				cell = &ctx->cells[j];
+				if (cell->is_logic) {
+					memcpy(p, cell->strings + cell->len
+						* logic_sample[cell->byte],
+						cell->len);
+					p += cell->len;
+					continue;
 				}
+				channel = cell->channel;
+				value = analog_sample[channel->slot];
+				channel->max = fmax(value, channel->max);
+				channel->min = fmin(value, channel->min);
+				p += format_float(p, value);
+				memcpy(p, ctx->value, ctx->value_len);
+				p += ctx->value_len;
 			}
 
 			if (ctx->do_trigger) {
-				g_string_append_printf(*out, "%d%s",
-					ctx->trigger, ctx->value);
+				*p++ = ctx->trigger ? '1' : '0';
+				memcpy(p, ctx->value, ctx->value_len);
+				p += ctx->value_len;
 				ctx->trigger = FALSE;
 			}
-			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+			/* Drop last separator. */
+			if ((size_t)(p - row) >= ctx->value_len)
+				p -= ctx->value_len;
+			memcpy(p, ctx->record, ctx->record_len);
+			p += ctx->record_len;
 		}
+		g_string_truncate(*out, p - (*out)->str);
 	}
 
-	/* Discard all of the working space. */
-	g_free(ctx->previous_sample);
-	g_free(ctx->analog_samples);
-	g_free(ctx->logic_samples);
+	/* Keep the working space for the next packet. */
 	ctx->channels_seen = 0;
 	ctx->num_samples = 0;
-	ctx->previous_sample = NULL;
-	ctx->analog_samples = NULL;
-	ctx->logic_samples = NULL;
+	ctx->analog_seen = FALSE;
+	ctx->logic_seen = FALSE;
 }
 
 static void save_gnuplot(struct context *ctx)
@@ -598,18 +857,32 @@ static int receive(const struct sr_output *o,
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
+	unsigned int i, num_channels;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 
 	if (o->priv) {
 		ctx = o->priv;
+		num_channels = ctx->num_analog_channels + ctx->num_logic_channels;
 		g_free((gpointer)ctx->record);
 		g_free((gpointer)ctx->frame);
 		g_free((gpointer)ctx->comment);
 		g_free((gpointer)ctx->gnuplot);
 		g_free((gpointer)ctx->value);
+		for (i = 0; i < ctx->num_cells; i++)
+			g_free(ctx->cells[i].strings);
+		g_free(ctx->cells);
+		g_free(ctx->logic_mask);
+		if (!ctx->label_names) {
+			for (i = 0; i < num_channels; i++)
+				if (ctx->channels[i].ch->type == SR_CHANNEL_ANALOG)
+					g_free(ctx->channels[i].label);
+		}
 		g_free(ctx->previous_sample);
+		g_free(ctx->analog_samples);
+		g_free(ctx->logic_samples);
+		g_free(ctx->fdata);
 		g_free(ctx->channels);
 		g_free(o->priv);
 		o->priv = NULL;
@@ -26,6 +26,9 @@
 #define LOG_PREFIX "output"
 /** @endcond */
 
+/* Size of the pieces in which runs are expanded for output modules. */
+#define RLE_EXPAND_SIZE (1024 * 1024)
+
 /**
  * @file
  *
@@ -321,17 +324,65 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	return op;
 }
 
+/* Feed the runs to a module in pieces, as SR_DF_LOGIC packets. */
+static int send_expanded(const struct sr_output *o,
+		const struct sr_datafeed_logic_rle *rle, GString **out)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_logic_rle_pos pos;
+	GString *piece;
+	uint64_t max_samples, count;
+	int ret;
+
+	*out = NULL;
+	if (!rle->unitsize)
+		return SR_ERR_ARG;
+
+	max_samples = MAX(RLE_EXPAND_SIZE / rle->unitsize, 1);
+	logic.unitsize = rle->unitsize;
+	logic.data = g_malloc(max_samples * rle->unitsize);
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	memset(&pos, 0, sizeof(pos));
+
+	ret = SR_OK;
+	while ((count = sr_logic_rle_expand(rle, &pos, logic.data, max_samples))) {
+		logic.length = count * rle->unitsize;
+		piece = NULL;
+		ret = o->module->receive(o, &packet, &piece);
+		if (piece && *out) {
+			g_string_append_len(*out, piece->str, piece->len);
+			g_string_free(piece, TRUE);
+		} else if (piece) {
+			*out = piece;
+		}
+		if (ret != SR_OK)
+			break;
+	}
+	g_free(logic.data);
+
+	return ret;
+}
+
 /**
  * Send a packet to the specified output instance.
  *
  * The instance's output is returned as a newly allocated GString,
  * which must be freed by the caller.
  *
+ * SR_DF_LOGIC_RLE packets are expanded for modules which do not handle
+ * them, see SR_OUTPUT_LOGIC_RLE.
+ *
  * @since 0.4.0
  */
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
+	if (packet->type == SR_DF_LOGIC_RLE
+			&& !(o->module->flags & SR_OUTPUT_LOGIC_RLE))
+		return send_expanded(o, packet->payload, out);
+
 	return o->module->receive(o, packet, out);
 }
 
@@ -17,56 +17,515 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * The archive is written as a stream: the file is opened once, logic and
+ * analog data are collected into fixed-size chunks which are compressed
+ * and appended as soon as they fill up, and the central directory is
+ * only written when the acquisition ends. Nothing that was written is
+ * ever read back or rewritten, so the cost per chunk stays constant no
+ * matter how long the capture runs. libzip can't do this (it keeps all
+ * added data around until zip_close()), hence the small ZIP writer here.
+ * The files are still read with libzip, see session_file.c.
+ *
+ * Chunks are independent of each other, so with the "threads" option
+ * they are compressed on a thread pool. They still go into the file in
+ * the order they were produced.
+ */
+
 #include <config.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <glib.h>
 #include <glib/gstdio.h>
-#include <zip.h>
+#include <zlib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "output/srzip"
 
+/* Same as the chunk size the session file reader uses. */
+#define CHUNK_SIZE (4 * 1024 * 1024)
+
+#define ZIP_VERSION		20
+#define ZIP64_VERSION		45
+#define ZIP_METHOD_STORE	0
+#define ZIP_METHOD_DEFLATE	8
+#define ZIP_LOCAL_HEADER_SIG	0x04034b50
+#define ZIP_CENTRAL_HEADER_SIG	0x02014b50
+#define ZIP_EOCD_SIG		0x06054b50
+#define ZIP64_EOCD_SIG		0x06064b50
+#define ZIP64_LOCATOR_SIG	0x07064b50
+#define ZIP64_EXTRA_ID		0x0001
+#define ZIP_MAX16		0xffff
+#define ZIP_MAX32		0xffffffffULL
+
+/* One archive member on its way into the file. */
+struct zip_job {
+	char *name;
+	uint8_t *data;
+	size_t len;
+	uint8_t *comp;
+	size_t comp_size;
+	uint32_t crc;
+	uint16_t method;
+	int level;
+	gboolean done;
+};
+
+struct zip_entry {
+	char *name;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t comp_size;
+	uint32_t crc;
+	uint16_t method;
+};
+
+struct analog_stream {
+	float *buf;
+	size_t count;
+	unsigned int next_chunk;
+};
+
 struct out_context {
 	gboolean zip_created;
+	gboolean zip_finished;
 	uint64_t samplerate;
 	char *filename;
 	gint first_analog_index;
 	gint *analog_index_map;
+
+	/* Archive being written. */
+	FILE *file;
+	uint64_t offset;
+	GArray *entries;
+	uint16_t dos_time;
+	uint16_t dos_date;
+	GKeyFile *meta;
+
+	/* Chunk compression, possibly on a thread pool. */
+	int level;
+	guint num_threads;
+	GThreadPool *pool;
+	GQueue jobs;
+	GMutex mutex;
+	GCond cond;
+	GSList *free_bufs;
+	GSList *free_comp_bufs;
+	size_t comp_buf_size;
+
+	/* Logic data waiting for a full chunk. */
+	int unitsize;
+	uint8_t *logic_buf;
+	size_t logic_len;
+	size_t logic_chunk_size;
+	unsigned int next_logic_chunk;
+
+	/* Analog data waiting for a full chunk, one per enabled channel. */
+	struct analog_stream *analog;
+	guint num_analog;
+	float *analog_tmp;
+	size_t analog_tmp_count;
+};
+
+static const struct {
+	const char *name;
+	int level;
+} compression_levels[] = {
+	{ "store", 0 },
+	{ "fast", Z_BEST_SPEED },
+	{ "default", Z_DEFAULT_COMPRESSION },
+	{ "best", Z_BEST_COMPRESSION },
 };
 
+static void zip_job_run(gpointer data, gpointer user_data);
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
-
-	(void)options;
+	const char *compression;
+	GError *error;
+	unsigned int i;
 
 	if (!o->filename || o->filename[0] == '\0') {
 		sr_info("srzip output module requires a file name, cannot save.");
 		return SR_ERR_ARG;
 	}
 
+	compression = g_variant_get_string(g_hash_table_lookup(options,
+		"compression"), NULL);
+	for (i = 0; i < G_N_ELEMENTS(compression_levels); i++) {
+		if (!g_ascii_strcasecmp(compression, compression_levels[i].name))
+			break;
+	}
+	if (i == G_N_ELEMENTS(compression_levels)) {
+		sr_err("Unknown compression '%s'.", compression);
+		return SR_ERR_ARG;
+	}
+
 	outc = g_malloc0(sizeof(struct out_context));
 	outc->filename = g_strdup(o->filename);
+	outc->level = compression_levels[i].level;
+	outc->num_threads = g_variant_get_uint32(g_hash_table_lookup(options,
+		"threads"));
+	outc->comp_buf_size = compressBound(CHUNK_SIZE);
+	g_queue_init(&outc->jobs);
+	g_mutex_init(&outc->mutex);
+	g_cond_init(&outc->cond);
 	o->priv = outc;
 
+	/* Storing is just a copy, threads would not help there. */
+	if (outc->num_threads > 0 && outc->level != 0) {
+		error = NULL;
+		outc->pool = g_thread_pool_new(zip_job_run, outc,
+			outc->num_threads, TRUE, &error);
+		if (!outc->pool) {
+			sr_warn("Failed to start compression threads, "
+				"compressing inline: %s", error->message);
+			g_error_free(error);
+		}
+	}
+	if (!outc->pool)
+		outc->num_threads = 0;
+
 	return SR_OK;
 }
 
+static void put16(GByteArray *b, uint16_t v)
+{
+	uint8_t buf[2];
+
+	WL16(buf, v);
+	g_byte_array_append(b, buf, sizeof(buf));
+}
+
+static void put32(GByteArray *b, uint32_t v)
+{
+	uint8_t buf[4];
+
+	WL32(buf, v);
+	g_byte_array_append(b, buf, sizeof(buf));
+}
+
+static void put64(GByteArray *b, uint64_t v)
+{
+	put32(b, v & ZIP_MAX32);
+	put32(b, v >> 32);
+}
+
+static int zip_write(struct out_context *outc, const void *data, size_t len)
+{
+	if (len && fwrite(data, 1, len, outc->file) != len) {
+		sr_err("Failed to write to '%s': %s", outc->filename,
+			g_strerror(errno));
+		return SR_ERR;
+	}
+	outc->offset += len;
+
+	return SR_OK;
+}
+
+/* Chunk buffers are recycled instead of allocated per chunk. */
+static void *zip_buf_get(GSList **list, size_t size)
+{
+	void *buf;
+
+	if (!*list)
+		return g_malloc(size);
+	buf = (*list)->data;
+	*list = g_slist_delete_link(*list, *list);
+
+	return buf;
+}
+
+static void zip_buf_put(GSList **list, void *buf)
+{
+	if (buf)
+		*list = g_slist_prepend(*list, buf);
+}
+
+/*
+ * Checksum and compress a member. This doesn't touch the output context,
+ * so it can run on any thread. Incompressible data is kept as is.
+ */
+static void zip_job_compress(struct zip_job *job)
+{
+	z_stream zstrm;
+
+	job->crc = crc32(0, job->data, job->len);
+	job->method = ZIP_METHOD_STORE;
+	if (job->level == 0 || job->len == 0 || !job->comp) {
+		job->comp_size = job->len;
+		return;
+	}
+
+	memset(&zstrm, 0, sizeof(zstrm));
+	if (deflateInit2(&zstrm, job->level, Z_DEFLATED, -MAX_WBITS, 8,
+			Z_DEFAULT_STRATEGY) != Z_OK) {
+		job->comp_size = job->len;
+		return;
+	}
+	zstrm.next_in = job->data;
+	zstrm.avail_in = job->len;
+	zstrm.next_out = job->comp;
+	zstrm.avail_out = job->comp_size;
+	if (deflate(&zstrm, Z_FINISH) == Z_STREAM_END && zstrm.total_out < job->len) {
+		job->method = ZIP_METHOD_DEFLATE;
+		job->comp_size = zstrm.total_out;
+	} else {
+		job->comp_size = job->len;
+	}
+	deflateEnd(&zstrm);
+}
+
+static void zip_job_run(gpointer data, gpointer user_data)
+{
+	struct zip_job *job;
+	struct out_context *outc;
+
+	job = data;
+	outc = user_data;
+
+	zip_job_compress(job);
+
+	g_mutex_lock(&outc->mutex);
+	job->done = TRUE;
+	g_cond_broadcast(&outc->cond);
+	g_mutex_unlock(&outc->mutex);
+}
+
+/*
+ * Append a compressed member to the file. Sizes and CRC are known by
+ * now, so they go straight into the local header.
+ */
+static int zip_job_write(struct out_context *outc, struct zip_job *job)
+{
+	struct zip_entry entry;
+	GByteArray *hdr;
+	int ret;
+
+	entry.offset = outc->offset;
+	entry.size = job->len;
+	entry.comp_size = job->comp_size;
+	entry.crc = job->crc;
+	entry.method = job->method;
+
+	hdr = g_byte_array_sized_new(30 + strlen(job->name));
+	put32(hdr, ZIP_LOCAL_HEADER_SIG);
+	put16(hdr, ZIP_VERSION);
+	put16(hdr, 0);
+	put16(hdr, entry.method);
+	put16(hdr, outc->dos_time);
+	put16(hdr, outc->dos_date);
+	put32(hdr, entry.crc);
+	put32(hdr, entry.comp_size);
+	put32(hdr, entry.size);
+	put16(hdr, strlen(job->name));
+	put16(hdr, 0);
+	g_byte_array_append(hdr, (const guint8 *)job->name, strlen(job->name));
+
+	ret = zip_write(outc, hdr->data, hdr->len);
+	g_byte_array_free(hdr, TRUE);
+	if (ret == SR_OK)
+		ret = zip_write(outc, job->method == ZIP_METHOD_DEFLATE
+			? job->comp : job->data, job->comp_size);
+	if (ret != SR_OK)
+		return ret;
+
+	entry.name = job->name;
+	job->name = NULL;
+	g_array_append_val(outc->entries, entry);
+
+	return SR_OK;
+}
+
+static void zip_job_free(struct out_context *outc, struct zip_job *job)
+{
+	zip_buf_put(&outc->free_bufs, job->data);
+	zip_buf_put(&outc->free_comp_bufs, job->comp);
+	g_free(job->name);
+	g_free(job);
+}
+
+/*
+ * Write out finished jobs from the head of the queue, in order. Waits
+ * for the head job as long as more than max_pending jobs are queued,
+ * which bounds the memory held by chunks in flight.
+ */
+static int zip_commit_jobs(struct out_context *outc, guint max_pending)
+{
+	struct zip_job *job;
+	int ret;
+
+	while ((job = g_queue_peek_head(&outc->jobs))) {
+		g_mutex_lock(&outc->mutex);
+		if (!job->done && g_queue_get_length(&outc->jobs) <= max_pending) {
+			g_mutex_unlock(&outc->mutex);
+			break;
+		}
+		while (!job->done)
+			g_cond_wait(&outc->cond, &outc->mutex);
+		g_mutex_unlock(&outc->mutex);
+
+		g_queue_pop_head(&outc->jobs);
+		ret = zip_job_write(outc, job);
+		zip_job_free(outc, job);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Queue a full chunk for compression. Takes ownership of the name and
+ * of the chunk buffer, which must come from zip_buf_get().
+ */
+static int zip_add_chunk(struct out_context *outc, char *name,
+		void *data, size_t len)
+{
+	struct zip_job *job;
+
+	job = g_malloc0(sizeof(struct zip_job));
+	job->name = name;
+	job->data = data;
+	job->len = len;
+	job->level = outc->level;
+	if (job->level != 0) {
+		job->comp = zip_buf_get(&outc->free_comp_bufs, outc->comp_buf_size);
+		job->comp_size = outc->comp_buf_size;
+	}
+	g_queue_push_tail(&outc->jobs, job);
+
+	if (outc->pool) {
+		g_thread_pool_push(outc->pool, job, NULL);
+	} else {
+		zip_job_compress(job);
+		job->done = TRUE;
+	}
+
+	return zip_commit_jobs(outc, 2 * outc->num_threads);
+}
+
+/* Write a small member right away, after all chunks queued so far. */
+static int zip_add_entry(struct out_context *outc, const char *name,
+		const void *data, size_t len)
+{
+	struct zip_job job;
+	int ret;
+
+	if ((ret = zip_commit_jobs(outc, 0)) != SR_OK)
+		return ret;
+
+	memset(&job, 0, sizeof(job));
+	job.name = g_strdup(name);
+	job.data = (uint8_t *)data;
+	job.len = len;
+	job.level = outc->level;
+	job.comp_size = compressBound(len);
+	job.comp = g_malloc(job.comp_size);
+	zip_job_compress(&job);
+	ret = zip_job_write(outc, &job);
+	g_free(job.comp);
+	g_free(job.name);
+
+	return ret;
+}
+
+/*
+ * The central directory and end records. ZIP64 fields are only used
+ * where the classic ones overflow, i.e. for members beyond 4 GiB into
+ * the file, or if there are more than 65535 of them.
+ */
+static int zip_write_directory(struct out_context *outc)
+{
+	struct zip_entry *entry;
+	GByteArray *dir;
+	uint64_t dir_offset, dir_size, num_entries;
+	gboolean zip64;
+	guint i;
+	int ret;
+
+	dir_offset = outc->offset;
+	num_entries = outc->entries->len;
+	dir = g_byte_array_new();
+	for (i = 0; i < outc->entries->len; i++) {
+		entry = &g_array_index(outc->entries, struct zip_entry, i);
+		zip64 = entry->offset >= ZIP_MAX32;
+		put32(dir, ZIP_CENTRAL_HEADER_SIG);
+		put16(dir, zip64 ? ZIP64_VERSION : ZIP_VERSION);
+		put16(dir, zip64 ? ZIP64_VERSION : ZIP_VERSION);
+		put16(dir, 0);
+		put16(dir, entry->method);
+		put16(dir, outc->dos_time);
+		put16(dir, outc->dos_date);
+		put32(dir, entry->crc);
+		put32(dir, entry->comp_size);
+		put32(dir, entry->size);
+		put16(dir, strlen(entry->name));
+		put16(dir, zip64 ? 12 : 0);
+		put16(dir, 0);
+		put16(dir, 0);
+		put16(dir, 0);
+		put32(dir, 0);
+		put32(dir, zip64 ? ZIP_MAX32 : entry->offset);
+		g_byte_array_append(dir, (const guint8 *)entry->name,
+			strlen(entry->name));
+		if (zip64) {
+			put16(dir, ZIP64_EXTRA_ID);
+			put16(dir, 8);
+			put64(dir, entry->offset);
+		}
+	}
+	dir_size = dir->len;
+
+	zip64 = num_entries >= ZIP_MAX16 || dir_offset >= ZIP_MAX32
+		|| dir_size >= ZIP_MAX32;
+	if (zip64) {
+		put32(dir, ZIP64_EOCD_SIG);
+		put64(dir, 44);
+		put16(dir, ZIP64_VERSION);
+		put16(dir, ZIP64_VERSION);
+		put32(dir, 0);
+		put32(dir, 0);
+		put64(dir, num_entries);
+		put64(dir, num_entries);
+		put64(dir, dir_size);
+		put64(dir, dir_offset);
+
+		put32(dir, ZIP64_LOCATOR_SIG);
+		put32(dir, 0);
+		put64(dir, dir_offset + dir_size);
+		put32(dir, 1);
+	}
+
+	put32(dir, ZIP_EOCD_SIG);
+	put16(dir, 0);
+	put16(dir, 0);
+	put16(dir, MIN(num_entries, ZIP_MAX16));
+	put16(dir, MIN(num_entries, ZIP_MAX16));
+	put32(dir, MIN(dir_size, ZIP_MAX32));
+	put32(dir, MIN(dir_offset, ZIP_MAX32));
+	put16(dir, 0);
+
+	ret = zip_write(outc, dir->data, dir->len);
+	g_byte_array_free(dir, TRUE);
+
+	return ret;
+}
+
 static int zip_create(const struct sr_output *o)
 {
 	struct out_context *outc;
-	struct zip *zipfile;
-	struct zip_source *versrc, *metasrc;
 	struct sr_channel *ch;
 	GVariant *gvar;
 	GKeyFile *meta;
+	GDateTime *now;
 	GSList *l;
 	const char *devgroup;
-	char *s, *metabuf;
-	gsize metalen;
+	char *s;
 	guint logic_channels = 0, enabled_logic_channels = 0;
 	guint enabled_analog_channels = 0;
 	guint index;
@@ -79,23 +538,28 @@ static int zip_create(const struct sr_output *o)
 		g_variant_unref(gvar);
 	}
 
-	/* Quietly delete it first, libzip wants replace ops otherwise. */
-	g_unlink(outc->filename);
-	zipfile = zip_open(outc->filename, ZIP_CREATE, NULL);
-	if (!zipfile)
+	if (!(outc->file = g_fopen(outc->filename, "wb"))) {
+		sr_err("Failed to create '%s': %s", outc->filename,
+			g_strerror(errno));
 		return SR_ERR;
+	}
+
+	outc->entries = g_array_new(FALSE, FALSE, sizeof(struct zip_entry));
+
+	now = g_date_time_new_now_local();
+	outc->dos_time = (g_date_time_get_hour(now) << 11)
+		| (g_date_time_get_minute(now) << 5)
+		| (g_date_time_get_second(now) / 2);
+	outc->dos_date = ((MAX(g_date_time_get_year(now), 1980) - 1980) << 9)
+		| (g_date_time_get_month(now) << 5)
+		| g_date_time_get_day_of_month(now);
+	g_date_time_unref(now);
 
 	/* "version" */
-	versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
-	if (zip_add(zipfile, "version", versrc) < 0) {
-		sr_err("Error saving version into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(versrc);
-		zip_discard(zipfile);
-		return SR_ERR;
-	}
+	if (zip_add_entry(outc, "version", "2", 1) != SR_OK)
+		goto err_close;
 
-	/* init "metadata" */
+	/* init "metadata", it's written out when the acquisition ends. */
 	meta = g_key_file_new();
 
 	g_key_file_set_string(meta, "global", "sigrok version",
@@ -143,6 +607,8 @@ static int zip_create(const struct sr_output *o)
 	 * entry as terminator, which is set to -1. */
 	outc->analog_index_map = g_malloc0(sizeof(gint) * (enabled_analog_channels + 1));
 	outc->analog_index_map[enabled_analog_channels] = -1;
+	outc->num_analog = enabled_analog_channels;
+	outc->analog = g_malloc0(sizeof(struct analog_stream) * enabled_analog_channels);
 
 	index = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
@@ -156,6 +622,7 @@ static int zip_create(const struct sr_output *o)
 			break;
 		case SR_CHANNEL_ANALOG:
 			outc->analog_index_map[index] = ch->index;
+			outc->analog[index].next_chunk = 1;
 			s = g_strdup_printf("analog%d", outc->first_analog_index + index);
 			index++;
 			break;
@@ -163,27 +630,53 @@ static int zip_create(const struct sr_output *o)
 		g_key_file_set_string(meta, devgroup, s, ch->name);
 		g_free(s);
 	}
+	outc->meta = meta;
+	outc->next_logic_chunk = 1;
 
-	metabuf = g_key_file_to_data(meta, &metalen, NULL);
-	g_key_file_free(meta);
+	return SR_OK;
 
-	metasrc = zip_source_buffer(zipfile, metabuf, metalen, FALSE);
-	if (zip_add(zipfile, "metadata", metasrc) < 0) {
-		sr_err("Error saving metadata into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(metasrc);
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+err_close:
+	/* Nothing else gets written without an open file. */
+	fclose(outc->file);
+	outc->file = NULL;
+
+	return SR_ERR;
+}
+
+static int zip_flush_logic(struct out_context *outc)
+{
+	char *chunkname;
+	int ret;
+
+	if (outc->logic_len == 0)
+		return SR_OK;
+
+	chunkname = g_strdup_printf("logic-1-%u", outc->next_logic_chunk);
+	ret = zip_add_chunk(outc, chunkname, outc->logic_buf, outc->logic_len);
+	if (ret != SR_OK)
+		sr_err("Failed to add logic chunk %u.", outc->next_logic_chunk);
+	outc->logic_buf = NULL;
+	outc->next_logic_chunk++;
+	outc->logic_len = 0;
+
+	return ret;
+}
+
+static int zip_set_unitsize(struct out_context *outc, int unitsize)
+{
+	if (unitsize <= 0) {
+		sr_err("Invalid unit size %d.", unitsize);
+		return SR_ERR_DATA;
 	}
 
-	if (zip_close(zipfile) < 0) {
-		sr_err("Error saving zipfile: %s", zip_strerror(zipfile));
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	if (!outc->unitsize) {
+		outc->unitsize = unitsize;
+		outc->logic_chunk_size = CHUNK_SIZE - CHUNK_SIZE % unitsize;
+	} else if (unitsize != outc->unitsize) {
+		sr_err("Unit size changed from %d to %d during acquisition.",
+			outc->unitsize, unitsize);
+		return SR_ERR_DATA;
 	}
-	g_free(metabuf);
 
 	return SR_OK;
 }
@@ -192,139 +685,105 @@ static int zip_append(const struct sr_output *o, unsigned char *buf,
 		int unitsize, int length)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *logicsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	struct zip_source *metasrc;
-	GKeyFile *kf;
-	GError *error;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *metabuf;
-	gsize metalen;
-	char *chunkname;
-	unsigned int next_chunk_num;
+	size_t len;
+	int ret;
 
 	outc = o->priv;
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	if (!kf) {
-		zip_discard(archive);
-		return SR_ERR_DATA;
-	}
-	/*
-	 * If the file was only initialized but doesn't yet have any
-	 * data it in, it won't have a unitsize field in metadata yet.
-	 */
-	error = NULL;
-	metabuf = NULL;
-	if (!g_key_file_has_key(kf, "device 1", "unitsize", &error)) {
-		if (error && error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
-			sr_err("Failed to check unitsize key: %s", error->message);
-			g_error_free(error);
-			g_key_file_free(kf);
-			zip_discard(archive);
-			return SR_ERR;
-		}
-		g_clear_error(&error);
-
-		/* Add unitsize field. */
-		g_key_file_set_integer(kf, "device 1", "unitsize", unitsize);
-		metabuf = g_key_file_to_data(kf, &metalen, NULL);
-		metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
-
-		if (zip_replace(archive, zs.index, metasrc) < 0) {
-			sr_err("Failed to replace metadata: %s",
-				zip_strerror(archive));
-			g_key_file_free(kf);
-			zip_source_free(metasrc);
-			zip_discard(archive);
-			g_free(metabuf);
-			return SR_ERR;
-		}
-	}
-	g_key_file_free(kf);
-
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, "logic-1", 7) != 0)
-			continue;
-		if (entry_name[7] == '\0') {
-			/*
-			 * This file has no extra chunks, just a single
-			 * "logic-1". Rename it to "logic-1-1" and continue
-			 * with chunk 2.
-			 */
-			if (zip_rename(archive, i, "logic-1-1") < 0) {
-				sr_err("Failed to rename 'logic-1' to 'logic-1-1': %s",
-					zip_strerror(archive));
-				zip_discard(archive);
-				g_free(metabuf);
-				return SR_ERR;
-			}
-			next_chunk_num = 2;
-			break;
-		} else if (entry_name[7] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + 8, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
+	if ((ret = zip_set_unitsize(outc, unitsize)) != SR_OK)
+		return ret;
 
 	if (length % unitsize != 0) {
 		sr_warn("Chunk size %d not a multiple of the"
 			" unit size %d.", length, unitsize);
 	}
-	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
-	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
-		zip_source_free(logicsrc);
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
+
+	while (length > 0) {
+		if (!outc->logic_buf)
+			outc->logic_buf = zip_buf_get(&outc->free_bufs, CHUNK_SIZE);
+		len = MIN((size_t)length,
+			outc->logic_chunk_size - outc->logic_len);
+		memcpy(outc->logic_buf + outc->logic_len, buf, len);
+		outc->logic_len += len;
+		buf += len;
+		length -= len;
+		if (outc->logic_len == outc->logic_chunk_size) {
+			if ((ret = zip_flush_logic(outc)) != SR_OK)
+				return ret;
+		}
 	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
+
+	return SR_OK;
+}
+
+/* Expand the runs straight into the chunk buffers. */
+static int zip_append_rle(const struct sr_output *o,
+		const struct sr_datafeed_logic_rle *rle)
+{
+	struct out_context *outc;
+	struct sr_logic_rle_pos pos;
+	uint64_t count;
+	int ret;
+
+	outc = o->priv;
+
+	if ((ret = zip_set_unitsize(outc, rle->unitsize)) != SR_OK)
+		return ret;
+
+	memset(&pos, 0, sizeof(pos));
+	while (pos.run < rle->num_runs) {
+		if (!outc->logic_buf)
+			outc->logic_buf = zip_buf_get(&outc->free_bufs, CHUNK_SIZE);
+		count = sr_logic_rle_expand(rle, &pos,
+			outc->logic_buf + outc->logic_len,
+			(outc->logic_chunk_size - outc->logic_len) / rle->unitsize);
+		outc->logic_len += count * rle->unitsize;
+		if (outc->logic_chunk_size - outc->logic_len < rle->unitsize) {
+			if ((ret = zip_flush_logic(outc)) != SR_OK)
+				return ret;
+		} else if (!count) {
+			/* Only empty runs were left. */
+			break;
+		}
 	}
-	g_free(metabuf);
 
 	return SR_OK;
 }
 
+static int zip_flush_analog(struct out_context *outc, guint index)
+{
+	struct analog_stream *as;
+	char *chunkname;
+	int ret;
+
+	as = &outc->analog[index];
+	if (as->count == 0)
+		return SR_OK;
+
+	chunkname = g_strdup_printf("analog-1-%u-%u",
+		outc->first_analog_index + index, as->next_chunk);
+	ret = zip_add_chunk(outc, chunkname, as->buf,
+		as->count * sizeof(float));
+	if (ret != SR_OK)
+		sr_err("Failed to add analog chunk %u-%u.",
+			outc->first_analog_index + index, as->next_chunk);
+	as->buf = NULL;
+	as->next_chunk++;
+	as->count = 0;
+
+	return ret;
+}
+
 static int zip_append_analog(const struct sr_output *o,
 		const struct sr_datafeed_analog *analog)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *analogsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *basename;
-	gsize baselen;
+	struct analog_stream *as;
 	struct sr_channel *channel;
-	float *chunkbuf;
-	gsize chunksize;
-	char *chunkname;
-	unsigned int next_chunk_num, index;
+	const float *src;
+	size_t chunk_count, remaining, count;
+	unsigned int index;
+	int ret;
 
 	outc = o->priv;
 
@@ -344,65 +803,93 @@ static int zip_append_analog(const struct sr_output *o,
 	if (outc->analog_index_map[index] == -1)
 		return SR_ERR_ARG; /* Channel index was not in the list */
 
-	index += outc->first_analog_index;
-
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
-
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		goto err_zip_discard;
+	as = &outc->analog[index];
+	chunk_count = CHUNK_SIZE / sizeof(float);
+	/* The common case: convert straight into the pending chunk. */
+	if (as->count + analog->num_samples <= chunk_count) {
+		if (!as->buf)
+			as->buf = zip_buf_get(&outc->free_bufs, CHUNK_SIZE);
+		ret = sr_analog_to_float(analog, as->buf + as->count);
+		if (ret != SR_OK)
+			return ret;
+		as->count += analog->num_samples;
+		if (as->count == chunk_count)
+			return zip_flush_analog(outc, index);
+		return SR_OK;
 	}
 
-	basename = g_strdup_printf("analog-1-%u", index);
-	baselen = strlen(basename);
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, basename, baselen) != 0) {
-			continue;
-		} else if (entry_name[baselen] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + baselen + 1, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
+	/* The packet straddles chunks, so it goes through a bounce buffer. */
+	if (outc->analog_tmp_count < analog->num_samples) {
+		g_free(outc->analog_tmp);
+		outc->analog_tmp = g_try_malloc(sizeof(float) * analog->num_samples);
+		outc->analog_tmp_count = outc->analog_tmp ? analog->num_samples : 0;
+		if (!outc->analog_tmp)
+			return SR_ERR_MALLOC;
+	}
+	if ((ret = sr_analog_to_float(analog, outc->analog_tmp)) != SR_OK)
+		return ret;
+
+	src = outc->analog_tmp;
+	remaining = analog->num_samples;
+	while (remaining > 0) {
+		if (!as->buf)
+			as->buf = zip_buf_get(&outc->free_bufs, CHUNK_SIZE);
+		count = MIN(remaining, chunk_count - as->count);
+		memcpy(as->buf + as->count, src, count * sizeof(float));
+		as->count += count;
+		src += count;
+		remaining -= count;
+		if (as->count == chunk_count) {
+			if ((ret = zip_flush_analog(outc, index)) != SR_OK)
+				return ret;
 		}
 	}
 
-	chunksize = sizeof(float) * analog->num_samples;
-	if (!(chunkbuf = g_try_malloc(chunksize)))
-		goto err_free_basename;
+	return SR_OK;
+}
 
-	if (sr_analog_to_float(analog, chunkbuf) != SR_OK)
-		goto err_free_chunkbuf;
+/*
+ * Flush whatever is still pending, then write the metadata and the
+ * central directory. Only after this is the file a valid archive.
+ */
+static int zip_finish(struct out_context *outc)
+{
+	char *metabuf;
+	gsize metalen;
+	guint i;
+	int ret;
 
-	analogsrc = zip_source_buffer(archive, chunkbuf, chunksize, FALSE);
-	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
-	i = zip_add(archive, chunkname, analogsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
-		zip_source_free(analogsrc);
-		goto err_free_chunkbuf;
-	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		goto err_free_chunkbuf;
+	outc->zip_finished = TRUE;
+
+	if ((ret = zip_flush_logic(outc)) != SR_OK)
+		return ret;
+	for (i = 0; i < outc->num_analog; i++) {
+		if ((ret = zip_flush_analog(outc, i)) != SR_OK)
+			return ret;
 	}
 
-	g_free(basename);
-	g_free(chunkbuf);
+	if (outc->unitsize)
+		g_key_file_set_integer(outc->meta, "device 1", "unitsize",
+			outc->unitsize);
+	metabuf = g_key_file_to_data(outc->meta, &metalen, NULL);
+	ret = zip_add_entry(outc, "metadata", metabuf, metalen);
+	g_free(metabuf);
+	if (ret != SR_OK) {
+		sr_err("Error saving metadata into zipfile.");
+		return ret;
+	}
 
-	return SR_OK;
+	if ((ret = zip_write_directory(outc)) != SR_OK)
+		return ret;
 
-err_free_chunkbuf:
-	g_free(chunkbuf);
-err_free_basename:
-	g_free(basename);
-err_zip_discard:
-	zip_discard(archive);
+	ret = fclose(outc->file);
+	outc->file = NULL;
+	if (ret != 0) {
+		sr_err("Error saving session file: %s", g_strerror(errno));
+		return SR_ERR;
+	}
 
-	return SR_ERR;
+	return SR_OK;
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -432,40 +919,64 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		}
 		break;
 	case SR_DF_LOGIC:
+	case SR_DF_LOGIC_RLE:
 		if (!outc->zip_created) {
+			outc->zip_created = TRUE;
 			if ((ret = zip_create(o)) != SR_OK)
 				return ret;
-			outc->zip_created = TRUE;
 		}
-		logic = packet->payload;
-		ret = zip_append(o, logic->data, logic->unitsize, logic->length);
+		if (!outc->file)
+			return SR_ERR;
+		if (packet->type == SR_DF_LOGIC_RLE) {
+			ret = zip_append_rle(o, packet->payload);
+		} else {
+			logic = packet->payload;
+			ret = zip_append(o, logic->data, logic->unitsize,
+				logic->length);
+		}
 		if (ret != SR_OK)
 			return ret;
 		break;
 	case SR_DF_ANALOG:
 		if (!outc->zip_created) {
+			outc->zip_created = TRUE;
 			if ((ret = zip_create(o)) != SR_OK)
 				return ret;
-			outc->zip_created = TRUE;
 		}
+		if (!outc->file)
+			return SR_ERR;
 		analog = packet->payload;
 		ret = zip_append_analog(o, analog);
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_END:
+		if (outc->file && !outc->zip_finished)
+			return zip_finish(outc);
+		break;
 	}
 
 	return SR_OK;
 }
 
 static struct sr_option options[] = {
+	{"compression", "Compression", "Chunk compression: store, fast, default or best", NULL, NULL},
+	{"threads", "Threads", "Number of compression threads (0: compress in the datafeed callback)", NULL, NULL},
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
-		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string("default"));
+		for (i = 0; i < G_N_ELEMENTS(compression_levels); i++)
+			options[0].values = g_slist_append(options[0].values,
+				g_variant_ref_sink(g_variant_new_string(
+				compression_levels[i].name)));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint32(0));
+	}
 
 	return options;
 }
@@ -473,9 +984,39 @@ static const struct sr_option *get_options(void)
 static int cleanup(struct sr_output *o)
 {
 	struct out_context *outc;
+	struct zip_job *job;
+	guint i;
 
 	outc = o->priv;
-	g_variant_unref(options[0].def);
+
+	/* Don't leave a truncated archive behind if SR_DF_END never came. */
+	if (outc->file && !outc->zip_finished)
+		zip_finish(outc);
+	if (outc->file)
+		fclose(outc->file);
+
+	/* Wait for chunks still being compressed before freeing them. */
+	if (outc->pool)
+		g_thread_pool_free(outc->pool, FALSE, TRUE);
+	while ((job = g_queue_pop_head(&outc->jobs)))
+		zip_job_free(outc, job);
+	g_slist_free_full(outc->free_bufs, g_free);
+	g_slist_free_full(outc->free_comp_bufs, g_free);
+	g_mutex_clear(&outc->mutex);
+	g_cond_clear(&outc->cond);
+
+	if (outc->entries) {
+		for (i = 0; i < outc->entries->len; i++)
+			g_free(g_array_index(outc->entries, struct zip_entry, i).name);
+		g_array_free(outc->entries, TRUE);
+	}
+	for (i = 0; i < outc->num_analog; i++)
+		g_free(outc->analog[i].buf);
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+	g_free(outc->analog);
+	g_free(outc->analog_tmp);
+	g_free(outc->logic_buf);
 	g_free(outc->analog_index_map);
 	g_free(outc->filename);
 	g_free(outc);
@@ -489,7 +1030,7 @@ SR_PRIV struct sr_output_module output_srzip = {
 	.name = "srzip",
 	.desc = "srzip session file",
 	.exts = (const char*[]){"sr", NULL},
-	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING | SR_OUTPUT_LOGIC_RLE,
 	.options = get_options,
 	.init = init,
 	.receive = receive,
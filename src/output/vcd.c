@@ -19,6 +19,7 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <glib.h>
@@ -27,26 +28,64 @@
 
 #define LOG_PREFIX "output/vcd"
 
+/* Identifiers are made of the 94 printable characters '!' to '~'. */
+#define ID_FIRST '!'
+#define ID_CHARS ('~' - '!' + 1)
+#define ID_MAXLEN 8
+
 struct context {
 	int num_enabled_channels;
-	uint8_t *prevsample;
 	gboolean header_done;
 	int period;
 	int *channel_index;
 	uint64_t samplerate;
 	uint64_t samplecount;
+	/* Timestamps are samplecount * ts_mul / ts_div, see set_timescale(). */
+	uint64_t ts_mul;
+	uint64_t ts_div;
+	/* Identifier of every enabled channel, in header order. */
+	char (*identifiers)[ID_MAXLEN];
+	/* Header position of each channel index, -1 if not enabled. */
+	int *channel_pos;
+	/*
+	 * The previous sample and the mask of the enabled channels, as
+	 * words of up to 8 sample bytes. Only masked bits are compared.
+	 */
+	unsigned int unitsize;
+	unsigned int num_words;
+	uint64_t *prevsample;
+	uint64_t *mask;
 };
 
+/*
+ * Write the identifier of the n-th channel: one character for the first
+ * 94 channels, two for the next 94 * 94, and so on.
+ */
+static void make_identifier(char *id, unsigned int n)
+{
+	int len;
+
+	len = 0;
+	while (TRUE) {
+		id[len++] = ID_FIRST + n % ID_CHARS;
+		if (n < ID_CHARS)
+			break;
+		n = n / ID_CHARS - 1;
+	}
+	id[len] = '\0';
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct context *ctx;
 	struct sr_channel *ch;
 	GSList *l;
-	int num_enabled_channels, i;
+	int num_enabled_channels, max_index, i;
 
 	(void)options;
 
 	num_enabled_channels = 0;
+	max_index = -1;
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_LOGIC)
@@ -54,16 +93,17 @@ static int init(struct sr_output *o, GHashTable *options)
 		if (!ch->enabled)
 			continue;
 		num_enabled_channels++;
-	}
-	if (num_enabled_channels > 94) {
-		sr_err("VCD only supports 94 channels.");
-		return SR_ERR;
+		max_index = MAX(max_index, ch->index);
 	}
 
 	ctx = g_malloc0(sizeof(struct context));
 	o->priv = ctx;
 	ctx->num_enabled_channels = num_enabled_channels;
 	ctx->channel_index = g_malloc(sizeof(int) * ctx->num_enabled_channels);
+	ctx->identifiers = g_malloc(ID_MAXLEN * ctx->num_enabled_channels);
+	ctx->channel_pos = g_malloc(sizeof(int) * (max_index + 1));
+	for (i = 0; i <= max_index; i++)
+		ctx->channel_pos[i] = -1;
 
 	/* Once more to map the enabled channels. */
 	for (i = 0, l = o->sdi->channels; l; l = l->next) {
@@ -72,12 +112,74 @@ static int init(struct sr_output *o, GHashTable *options)
 			continue;
 		if (!ch->enabled)
 			continue;
+		make_identifier(ctx->identifiers[i], i);
+		ctx->channel_pos[ch->index] = i;
 		ctx->channel_index[i++] = ch->index;
 	}
 
 	return SR_OK;
 }
 
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	uint64_t t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/*
+ * A timestamp is samplecount / samplerate * period. Reduce the fraction
+ * once, so it can be computed with integers for every timestamp. Without
+ * a samplerate, the timestamps are sample numbers.
+ */
+static void set_timescale(struct context *ctx)
+{
+	uint64_t div;
+
+	if (ctx->samplerate == 0) {
+		ctx->ts_mul = ctx->ts_div = 1;
+		return;
+	}
+	div = gcd(ctx->period, ctx->samplerate);
+	ctx->ts_mul = ctx->period / div;
+	ctx->ts_div = ctx->samplerate / div;
+}
+
+/* Append "#<timestamp>" for the current sample, rounded half to even. */
+static void append_timestamp(struct context *ctx, GString *out)
+{
+	uint64_t q, r, ts, frac;
+	char buf[24];
+	int pos;
+
+	q = ctx->samplecount / ctx->ts_div;
+	r = ctx->samplecount % ctx->ts_div;
+	if (ctx->ts_mul <= UINT64_MAX / ctx->ts_div) {
+		ts = q * ctx->ts_mul + r * ctx->ts_mul / ctx->ts_div;
+		frac = r * ctx->ts_mul % ctx->ts_div;
+		if (2 * frac > ctx->ts_div
+				|| (2 * frac == ctx->ts_div && (ts & 1)))
+			ts++;
+	} else {
+		ts = llround((double)ctx->samplecount * ctx->ts_mul
+			/ ctx->ts_div);
+	}
+
+	pos = sizeof(buf);
+	do {
+		buf[--pos] = '0' + ts % 10;
+		ts /= 10;
+	} while (ts);
+	buf[--pos] = '#';
+	g_string_append_len(out, buf + pos, sizeof(buf) - pos);
+}
+
 static GString *gen_header(const struct sr_output *o)
 {
 	struct context *ctx;
@@ -131,19 +233,20 @@ static GString *gen_header(const struct sr_output *o)
 	frequency_s = sr_period_string(1, ctx->period);
 	g_string_append_printf(header, "$timescale %s $end\n", frequency_s);
 	g_free(frequency_s);
+	set_timescale(ctx);
 
 	/* scope */
 	g_string_append_printf(header, "$scope module %s $end\n", PACKAGE_NAME);
 
 	/* Wires / channels */
-	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
+	for (i = 0, l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->type != SR_CHANNEL_LOGIC)
 			continue;
 		if (!ch->enabled)
 			continue;
-		g_string_append_printf(header, "$var wire 1 %c %s $end\n",
-				(char)('!' + i), ch->name);
+		g_string_append_printf(header, "$var wire 1 %s %s $end\n",
+				ctx->identifiers[i++], ch->name);
 	}
 
 	g_string_append(header, "$upscope $end\n$enddefinitions $end\n");
@@ -151,18 +254,147 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/* Can't allocate these until we know the stream's unitsize. */
+static void init_sample_state(struct context *ctx, unsigned int unitsize)
+{
+	uint8_t *mask;
+	int p, index;
+
+	g_free(ctx->prevsample);
+	g_free(ctx->mask);
+	ctx->unitsize = unitsize;
+	ctx->num_words = (unitsize + 7) / 8;
+	ctx->prevsample = g_malloc0_n(ctx->num_words, sizeof(uint64_t));
+	ctx->mask = g_malloc0_n(ctx->num_words, sizeof(uint64_t));
+
+	/* The mask has the memory layout of a sample, like prevsample. */
+	mask = (uint8_t *)ctx->mask;
+	for (p = 0; p < ctx->num_enabled_channels; p++) {
+		index = ctx->channel_index[p];
+		if ((unsigned int)index / 8 < unitsize)
+			mask[index / 8] |= 1 << (index % 8);
+	}
+}
+
+/*
+ * Returns the first sample from i on in which an enabled channel differs
+ * from the previous sample, or num_samples if there is none.
+ */
+static size_t skip_unchanged(const struct context *ctx, const uint8_t *data,
+		size_t i, size_t num_samples)
+{
+	const uint8_t *sample;
+	uint32_t prev32, mask32, word32;
+	uint16_t prev16, mask16, word16;
+	uint8_t prev8, mask8;
+	unsigned int w, len;
+
+	switch (ctx->unitsize) {
+	case 1:
+		prev8 = *(const uint8_t *)ctx->prevsample;
+		mask8 = *(const uint8_t *)ctx->mask;
+		while (i < num_samples && !((data[i] ^ prev8) & mask8))
+			i++;
+		return i;
+	case 2:
+		memcpy(&prev16, ctx->prevsample, 2);
+		memcpy(&mask16, ctx->mask, 2);
+		for (; i < num_samples; i++) {
+			memcpy(&word16, data + 2 * i, 2);
+			if ((word16 ^ prev16) & mask16)
+				break;
+		}
+		return i;
+	case 4:
+		memcpy(&prev32, ctx->prevsample, 4);
+		memcpy(&mask32, ctx->mask, 4);
+		for (; i < num_samples; i++) {
+			memcpy(&word32, data + 4 * i, 4);
+			if ((word32 ^ prev32) & mask32)
+				break;
+		}
+		return i;
+	}
+
+	for (; i < num_samples; i++) {
+		sample = data + i * ctx->unitsize;
+		for (w = 0; w < ctx->num_words; w++) {
+			len = MIN(8, ctx->unitsize - 8 * w);
+			if ((sr_load_word(sample + 8 * w, len) ^ ctx->prevsample[w])
+					& ctx->mask[w])
+				return i;
+		}
+	}
+
+	return num_samples;
+}
+
+/*
+ * Output the timestamp and the changed channels of a sample. The first
+ * sample of the stream lists all channels.
+ */
+static void append_changes(struct context *ctx, GString *out,
+		const uint8_t *sample)
+{
+	const uint8_t *mask;
+	uint8_t *prev;
+	unsigned int b, diff;
+	int bit, pos;
+
+	prev = (uint8_t *)ctx->prevsample;
+	mask = (const uint8_t *)ctx->mask;
+
+	append_timestamp(ctx, out);
+	for (b = 0; b < ctx->unitsize; b++) {
+		diff = mask[b];
+		if (ctx->samplecount > 0)
+			diff &= sample[b] ^ prev[b];
+		for (; diff; diff &= diff - 1) {
+			bit = sr_lowest_bit(diff);
+			pos = ctx->channel_pos[8 * b + bit];
+			/* Output which signal changed to which value. */
+			g_string_append_c(out, ' ');
+			g_string_append_c(out, '0' + ((sample[b] >> bit) & 1));
+			g_string_append(out, ctx->identifiers[pos]);
+		}
+	}
+	g_string_append_c(out, '\n');
+
+	memcpy(prev, sample, ctx->unitsize);
+}
+
+/* The output for a logic packet, which starts with the header. */
+static GString *start_logic(const struct sr_output *o, unsigned int unitsize)
+{
+	struct context *ctx;
+	GString *out;
+
+	ctx = o->priv;
+	if (!ctx->header_done) {
+		out = gen_header(o);
+		ctx->header_done = TRUE;
+	} else {
+		out = g_string_sized_new(512);
+	}
+
+	if (unitsize != ctx->unitsize)
+		init_sample_state(ctx, unitsize);
+
+	return out;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_config *src;
+	const uint8_t *value;
 	GSList *l;
 	struct context *ctx;
-	unsigned int i;
-	int p, curbit, prevbit, index;
-	uint8_t *sample;
-	gboolean timestamp_written;
+	size_t i, next, num_samples;
+	uint64_t run;
 
 	*out = NULL;
 	if (!o || !o->priv)
@@ -177,65 +409,51 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			if (src->key != SR_CONF_SAMPLERATE)
 				continue;
 			ctx->samplerate = g_variant_get_uint64(src->data);
+			if (ctx->header_done)
+				set_timescale(ctx);
 		}
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-
-		if (!ctx->header_done) {
-			*out = gen_header(o);
-			ctx->header_done = TRUE;
-		} else {
-			*out = g_string_sized_new(512);
-		}
-
-		if (!ctx->prevsample) {
-			/* Can't allocate this until we know the stream's unitsize. */
-			ctx->prevsample = g_malloc0(logic->unitsize);
-		}
-
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			sample = logic->data + i;
-			timestamp_written = FALSE;
-
-			for (p = 0; p < ctx->num_enabled_channels; p++) {
-				index = ctx->channel_index[p];
-
-				curbit = ((unsigned)sample[index / 8]
-						>> (index % 8)) & 1;
-				prevbit = ((unsigned)ctx->prevsample[index / 8]
-						>> (index % 8)) & 1;
-
-				/* VCD only contains deltas/changes of signals. */
-				if (prevbit == curbit && ctx->samplecount > 0)
-					continue;
-
-				/* Output timestamp of subsequent signal changes. */
-				if (!timestamp_written)
-					g_string_append_printf(*out, "#%.0f",
-						(double)ctx->samplecount /
-							ctx->samplerate * ctx->period);
-
-				/* Output which signal changed to which value. */
-				g_string_append_c(*out, ' ');
-				g_string_append_c(*out, '0' + curbit);
-				g_string_append_c(*out, '!' + p);
-
-				timestamp_written = TRUE;
+		*out = start_logic(o, logic->unitsize);
+
+		/* VCD only contains deltas/changes of signals. */
+		num_samples = logic->length / logic->unitsize;
+		for (i = 0; i < num_samples; i++) {
+			if (ctx->samplecount > 0) {
+				next = skip_unchanged(ctx, logic->data,
+					i, num_samples);
+				ctx->samplecount += next - i;
+				if ((i = next) == num_samples)
+					break;
 			}
-
-			if (timestamp_written)
-				g_string_append_c(*out, '\n');
-
+			append_changes(ctx, *out, (const uint8_t *)logic->data
+				+ i * logic->unitsize);
 			ctx->samplecount++;
-			memcpy(ctx->prevsample, sample, logic->unitsize);
+		}
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		*out = start_logic(o, rle->unitsize);
+
+		/* A run has at most one change, at its first sample. */
+		for (run = 0; run < rle->num_runs; run++) {
+			if (!rle->lengths[run])
+				continue;
+			value = (const uint8_t *)rle->data + run * rle->unitsize;
+			if (ctx->samplecount == 0
+					|| skip_unchanged(ctx, value, 0, 1) == 0)
+				append_changes(ctx, *out, value);
+			ctx->samplecount += rle->lengths[run];
 		}
 		break;
 	case SR_DF_END:
 		/* Write final timestamp as length indicator. */
 		*out = g_string_sized_new(512);
-		g_string_printf(*out, "#%.0f\n",
-				(double)ctx->samplecount / ctx->samplerate * ctx->period);
+		if (!ctx->ts_div)
+			set_timescale(ctx);
+		append_timestamp(ctx, *out);
+		g_string_append_c(*out, '\n');
 		break;
 	}
 
@@ -251,7 +469,10 @@ static int cleanup(struct sr_output *o)
 
 	ctx = o->priv;
 	g_free(ctx->prevsample);
+	g_free(ctx->mask);
 	g_free(ctx->channel_index);
+	g_free(ctx->channel_pos);
+	g_free(ctx->identifiers);
 	g_free(ctx);
 
 	return SR_OK;
@@ -262,7 +483,7 @@ struct sr_output_module output_vcd = {
 	.name = "VCD",
 	.desc = "Value Change Dump",
 	.exts = (const char*[]){"vcd", NULL},
-	.flags = 0,
+	.flags = SR_OUTPUT_LOGIC_RLE,
 	.options = NULL,
 	.init = init,
 	.receive = receive,
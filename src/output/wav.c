@@ -17,6 +17,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Options and their values:
+ *
+ * scale:  Divide the values by this factor before they are written. The
+ *         default of 0 leaves them as they are.
+ *
+ * format: The sample format, "float" for 32-bit IEEE float (the default),
+ *         or "int16" or "int24" for integer PCM. Integer samples map the
+ *         range -1 to 1 onto the full scale, and clip values outside it.
+ *
+ * The output is a stream, so the header is written before the size of
+ * the data is known. When the device has a sample limit which makes the
+ * file larger than a RIFF file can be, an RF64 header is written, with
+ * the sizes from that limit in its ds64 chunk. Otherwise the RIFF and
+ * data chunk sizes are maxed out, which most readers take to mean the
+ * data runs to the end of the file, and a JUNK chunk reserves the space
+ * for a ds64 chunk so that the file can be turned into RF64 in place.
+ */
+
 #include <config.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
@@ -24,79 +43,79 @@
 
 #define LOG_PREFIX "output/wav"
 
-/* Minimum/maximum number of samples per channel to put in a data chunk */
-#define MIN_DATA_CHUNK_SAMPLES 10
+/* Number of values to convert to float at a time, to stay in the cache. */
+#define CONVERT_BLOCK_VALUES 4096
+
+/* Size of the ds64 chunk body, and the JUNK chunk which reserves it. */
+#define DS64_CHUNK_SIZE 28
+
+/* Size of the fmt chunk body. */
+#define FMT_CHUNK_SIZE 18
+
+enum sample_format {
+	FORMAT_FLOAT,
+	FORMAT_INT16,
+	FORMAT_INT24,
+};
+
+static const struct {
+	const char *name;
+	uint16_t format_code;
+	unsigned int bytes;
+} sample_formats[] = {
+	[FORMAT_FLOAT] = { "float", 0x0003, 4 },
+	[FORMAT_INT16] = { "int16", 0x0001, 2 },
+	[FORMAT_INT24] = { "int24", 0x0001, 3 },
+};
 
 struct out_context {
 	double scale;
+	enum sample_format format;
+	unsigned int sample_size;
+	unsigned int frame_size;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
-	int chanbuf_size;
-	int *chanbuf_used;
-	uint8_t **chanbuf;
+	/* Output position in a frame of each channel of the current packet. */
+	int *chan_idx;
+	uint8_t **chan_out;
+	/*
+	 * Frames which some channels have been written to, and others not
+	 * yet, in the output format. Only used when a packet doesn't have
+	 * all of the enabled channels.
+	 */
+	uint8_t *pending;
+	size_t pending_size;
+	size_t *pending_used;
 	float *fdata;
+	size_t fdata_size;
 };
 
-static int realloc_chanbufs(const struct sr_output *o, int size)
-{
-	struct out_context *outc;
-	int i;
-
-	outc = o->priv;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (!(outc->chanbuf[i] = g_try_realloc(outc->chanbuf[i], sizeof(float) * size))) {
-			sr_err("Unable to allocate enough output buffer memory.");
-			return SR_ERR;
-		}
-		outc->chanbuf_used[i] = 0;
-	}
-	outc->chanbuf_size = size;
-
-	return SR_OK;
-}
-
-static int flush_chanbufs(const struct sr_output *o, GString *out)
-{
-	struct out_context *outc;
-	int num_samples, i, j;
-	char *buf, *bufp;
-
-	outc = o->priv;
-
-	/* Any one of them will do. */
-	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
-	}
-
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
-		}
-	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
-
-	for (i = 0; i < outc->num_channels; i++)
-		outc->chanbuf_used[i] = 0;
-
-	return SR_OK;
-}
-
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
 	struct sr_channel *ch;
+	const char *format;
 	GSList *l;
+	unsigned int i;
 
 	outc = g_malloc0(sizeof(struct out_context));
 	o->priv = outc;
 	outc->scale = g_variant_get_double(g_hash_table_lookup(options, "scale"));
+	format = g_variant_get_string(g_hash_table_lookup(options, "format"), NULL);
+	for (i = 0; i < ARRAY_SIZE(sample_formats); i++) {
+		if (!g_ascii_strcasecmp(format, sample_formats[i].name))
+			break;
+	}
+	if (i == ARRAY_SIZE(sample_formats)) {
+		sr_err("Unsupported sample format '%s'.", format);
+		g_free(outc);
+		o->priv = NULL;
+		return SR_ERR_ARG;
+	}
+	outc->format = i;
+	outc->sample_size = sample_formats[i].bytes;
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -107,51 +126,64 @@ static int init(struct sr_output *o, GHashTable *options)
 		outc->channels = g_slist_append(outc->channels, ch);
 		outc->num_channels++;
 	}
+	outc->frame_size = outc->sample_size * outc->num_channels;
 
-	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
-	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
-
-	/* Start off the interleaved buffer with 100 samples/channel. */
-	realloc_chanbufs(o, 100);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->chan_out = g_malloc0(sizeof(uint8_t *) * outc->num_channels);
+	outc->pending_used = g_malloc0(sizeof(size_t) * outc->num_channels);
 
 	return SR_OK;
 }
 
+static void append_le16(GString *gs, uint16_t value)
+{
+	char tmp[2];
+
+	WL16(tmp, value);
+	g_string_append_len(gs, tmp, 2);
+}
+
+static void append_le32(GString *gs, uint32_t value)
+{
+	char tmp[4];
+
+	WL32(tmp, value);
+	g_string_append_len(gs, tmp, 4);
+}
+
+static void append_le64(GString *gs, uint64_t value)
+{
+	append_le32(gs, value & 0xffffffff);
+	append_le32(gs, value >> 32);
+}
+
 static void add_data_chunk(const struct sr_output *o, GString *gs)
 {
 	struct out_context *outc;
-	char tmp[4];
+	uint64_t byterate;
 
 	outc = o->priv;
 	g_string_append(gs, "fmt ");
 	/* Remaining chunk size */
-	WL32(tmp, 0x12);
-	g_string_append_len(gs, tmp, 4);
-	/* Format code 3 = IEEE float */
-	WL16(tmp, 0x0003);
-	g_string_append_len(gs, tmp, 2);
+	append_le32(gs, FMT_CHUNK_SIZE);
+	/* Format code, 1 = integer PCM, 3 = IEEE float */
+	append_le16(gs, sample_formats[outc->format].format_code);
 	/* Number of channels */
-	WL16(tmp, outc->num_channels);
-	g_string_append_len(gs, tmp, 2);
+	append_le16(gs, outc->num_channels);
 	/* Samplerate */
-	WL32(tmp, outc->samplerate);
-	g_string_append_len(gs, tmp, 4);
-	/* Byterate, using 32-bit floats. */
-	WL32(tmp, outc->samplerate * outc->num_channels * 4);
-	g_string_append_len(gs, tmp, 4);
+	append_le32(gs, outc->samplerate);
+	/* Byterate */
+	byterate = outc->samplerate * outc->frame_size;
+	append_le32(gs, MIN(byterate, 0xffffffff));
 	/* Blockalign */
-	WL16(tmp, outc->num_channels * 4);
-	g_string_append_len(gs, tmp, 2);
+	append_le16(gs, outc->frame_size);
 	/* Bits per sample */
-	WL16(tmp, 32);
-	g_string_append_len(gs, tmp, 2);
-	WL16(tmp, 0);
-	g_string_append_len(gs, tmp, 2);
+	append_le16(gs, outc->sample_size * 8);
+	append_le16(gs, 0);
 
 	g_string_append(gs, "data");
 	/* Data chunk size, max it out. */
-	WL32(tmp, 0xffffffff);
-	g_string_append_len(gs, tmp, 4);
+	append_le32(gs, 0xffffffff);
 }
 
 static GString *gen_header(const struct sr_output *o)
@@ -159,7 +191,7 @@ static GString *gen_header(const struct sr_output *o)
 	struct out_context *outc;
 	GVariant *gvar;
 	GString *header;
-	char tmp[4];
+	uint64_t limit, data_size, riff_size;
 
 	outc = o->priv;
 	if (outc->samplerate == 0) {
@@ -169,13 +201,40 @@ static GString *gen_header(const struct sr_output *o)
 			g_variant_unref(gvar);
 		}
 	}
+	limit = 0;
+	if (sr_config_get(o->sdi->driver, o->sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+			&gvar) == SR_OK) {
+		limit = g_variant_get_uint64(gvar);
+		g_variant_unref(gvar);
+	}
+
+	/* WAVE, the ds64 or JUNK chunk, the fmt chunk, and the data. */
+	data_size = limit * outc->frame_size;
+	riff_size = 4 + 8 + DS64_CHUNK_SIZE + 8 + FMT_CHUNK_SIZE + 8 + data_size;
 
 	header = g_string_sized_new(512);
-	g_string_append(header, "RIFF");
-	/* Total size. Max out the field. */
-	WL32(tmp, 0xffffffff);
-	g_string_append_len(header, tmp, 4);
-	g_string_append(header, "WAVE");
+	if (riff_size > 0xffffffff) {
+		sr_dbg("Writing RF64 header for %" PRIu64 " samples.", limit);
+		g_string_append(header, "RF64");
+		append_le32(header, 0xffffffff);
+		g_string_append(header, "WAVE");
+		g_string_append(header, "ds64");
+		append_le32(header, DS64_CHUNK_SIZE);
+		append_le64(header, riff_size);
+		append_le64(header, data_size);
+		append_le64(header, limit);
+		/* No table of other chunk sizes. */
+		append_le32(header, 0);
+	} else {
+		g_string_append(header, "RIFF");
+		/* Total size. Max out the field. */
+		append_le32(header, 0xffffffff);
+		g_string_append(header, "WAVE");
+		g_string_append(header, "JUNK");
+		append_le32(header, DS64_CHUNK_SIZE);
+		g_string_append_len(header, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+			"\0\0\0\0\0\0\0\0\0\0\0\0\0\0", DS64_CHUNK_SIZE);
+	}
 	add_data_chunk(o, header);
 
 	return header;
@@ -202,34 +261,196 @@ static void float_to_le(uint8_t *buf, float value)
 #endif
 }
 
+/* Scale -1..1 to a signed integer of the given maximum, with clipping. */
+static inline int32_t float_to_pcm(float value, float max)
+{
+	value *= max;
+	if (value >= max)
+		return max;
+	if (value <= -max)
+		return -max;
+	if (value != value)
+		return 0;
+
+	return value + (value < 0 ? -0.5f : 0.5f);
+}
+
 /*
- * Returns the number of samples used in the current channel buffers,
- * or -1 if they're not all the same.
+ * Write one channel's values of a block, taken every stride floats from
+ * values, to every frame_size bytes of buf. Returns the position after
+ * the last sample written.
  */
-static int check_chanbuf_size(const struct sr_output *o)
+static uint8_t *write_samples(const struct out_context *outc, uint8_t *buf,
+		const float *values, size_t count, size_t stride)
 {
-	struct out_context *outc;
-	int size, i;
+	size_t i, step;
+	float f, scale;
+	int32_t v;
+
+	step = outc->frame_size;
+	scale = outc->scale != 0.0 ? outc->scale : 1;
+	switch (outc->format) {
+	case FORMAT_FLOAT:
+		for (i = 0; i < count; i++, values += stride, buf += step) {
+			f = *values;
+			if (outc->scale != 0.0)
+				f /= outc->scale;
+			float_to_le(buf, f);
+		}
+		break;
+	case FORMAT_INT16:
+		for (i = 0; i < count; i++, values += stride, buf += step) {
+			v = float_to_pcm(*values / scale, 32767);
+			WL16(buf, v);
+		}
+		break;
+	case FORMAT_INT24:
+		for (i = 0; i < count; i++, values += stride, buf += step) {
+			v = float_to_pcm(*values / scale, 8388607);
+			buf[0] = v;
+			buf[1] = v >> 8;
+			buf[2] = v >> 16;
+		}
+		break;
+	}
 
-	outc = o->priv;
-	size = 0;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (size == 0) {
-			if (outc->chanbuf_used[i] == 0) {
-				/* Nothing in all the buffers yet. */
-				size = -1;
-				break;
-			} else
-				/* New high water mark. */
-				size = outc->chanbuf_used[i];
-		} else if (outc->chanbuf_used[i] != size) {
-			/* All channel buffers are not equally full yet. */
-			size = -1;
-			break;
+	return buf;
+}
+
+/*
+ * Convert the packet's values and write them straight to their place in
+ * the output frames, through a small buffer of floats which stays in the
+ * cache. The values of channel i go to outc->chan_out[i], which is left
+ * pointing after them.
+ */
+static int write_packet(struct out_context *outc,
+		const struct sr_datafeed_analog *analog, int num_channels)
+{
+	size_t block, start, count, size;
+	int i, ret;
+	float *data;
+
+	block = MAX(1, CONVERT_BLOCK_VALUES / num_channels);
+	size = block * num_channels;
+	if (size > outc->fdata_size) {
+		if (!(data = g_try_realloc(outc->fdata, sizeof(float) * size)))
+			return SR_ERR_MALLOC;
+		outc->fdata = data;
+		outc->fdata_size = size;
+	}
+
+	for (start = 0; start < analog->num_samples; start += count) {
+		count = MIN(block, analog->num_samples - start);
+		ret = sr_analog_to_float_range(analog, start * num_channels,
+				count * num_channels, outc->fdata);
+		if (ret != SR_OK)
+			return ret;
+		for (i = 0; i < num_channels; i++) {
+			if (!outc->chan_out[i])
+				continue;
+			outc->chan_out[i] = write_samples(outc, outc->chan_out[i],
+				outc->fdata + i, count, num_channels);
+		}
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Write the frames which all channels have reached to the output, and
+ * keep the rest.
+ */
+static void flush_pending(struct out_context *outc, GString *out)
+{
+	size_t complete, used;
+	int i;
+
+	complete = used = outc->pending_used[0];
+	for (i = 1; i < outc->num_channels; i++) {
+		complete = MIN(complete, outc->pending_used[i]);
+		used = MAX(used, outc->pending_used[i]);
+	}
+	if (!complete)
+		return;
+
+	g_string_append_len(out, (const char *)outc->pending,
+		complete * outc->frame_size);
+	memmove(outc->pending, outc->pending + complete * outc->frame_size,
+		(used - complete) * outc->frame_size);
+	for (i = 0; i < outc->num_channels; i++)
+		outc->pending_used[i] -= complete;
+}
+
+static int process_analog(struct out_context *outc,
+		const struct sr_datafeed_analog *analog, GString *out)
+{
+	const GSList *l;
+	int num_channels, i, idx, ret;
+	gboolean direct;
+	size_t start, used, size;
+	uint8_t *buf;
+
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (analog->num_samples == 0)
+		return SR_OK;
+
+	if (num_channels > outc->num_channels) {
+		sr_err("Packet has %d channels, but only %d were enabled.",
+				num_channels, outc->num_channels);
+		return SR_ERR;
+	}
+
+	/* Index the channels in this packet, so we can interleave quicker. */
+	direct = num_channels == outc->num_channels;
+	used = 0;
+	for (i = 0, l = analog->meaning->channels; l; l = l->next, i++) {
+		idx = g_slist_index(outc->channels, l->data);
+		outc->chan_idx[i] = idx;
+		if (idx < 0) {
+			direct = FALSE;
+			continue;
 		}
+		if (outc->pending_used[idx])
+			direct = FALSE;
+		used = MAX(used, outc->pending_used[idx]);
+	}
+
+	if (direct) {
+		/* The packet has whole frames: write them to the output. */
+		start = out->len;
+		g_string_set_size(out,
+			start + analog->num_samples * outc->frame_size);
+		for (i = 0; i < num_channels; i++)
+			outc->chan_out[i] = (uint8_t *)out->str + start
+				+ outc->chan_idx[i] * outc->sample_size;
+		return write_packet(outc, analog, num_channels);
+	}
+
+	/* Fill in this packet's channels of the pending frames. */
+	size = (used + analog->num_samples) * outc->frame_size;
+	if (size > outc->pending_size) {
+		if (!(buf = g_try_realloc(outc->pending, size))) {
+			sr_err("Unable to allocate enough output buffer memory.");
+			return SR_ERR_MALLOC;
+		}
+		outc->pending = buf;
+		outc->pending_size = size;
+	}
+	for (i = 0; i < num_channels; i++) {
+		idx = outc->chan_idx[i];
+		outc->chan_out[i] = idx < 0 ? NULL : outc->pending
+			+ outc->pending_used[idx] * outc->frame_size
+			+ idx * outc->sample_size;
+	}
+	if ((ret = write_packet(outc, analog, num_channels)) != SR_OK)
+		return ret;
+	for (i = 0; i < num_channels; i++) {
+		if ((idx = outc->chan_idx[i]) >= 0)
+			outc->pending_used[idx] += analog->num_samples;
 	}
+	flush_pending(outc, out);
 
-	return size;
+	return SR_OK;
 }
 
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
@@ -237,15 +458,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 {
 	struct out_context *outc;
 	const struct sr_datafeed_meta *meta;
-	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
-	struct sr_channel *ch;
 	GSList *l;
-	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
-	float *data;
-	uint8_t *buf;
+	int i;
 
 	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
@@ -268,61 +483,13 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		} else
 			*out = g_string_sized_new(512);
 
-		analog = packet->payload;
-		num_samples = analog->num_samples;
-		channels = analog->meaning->channels;
-		num_channels = g_slist_length(analog->meaning->channels);
-		if (!(data = g_try_realloc(outc->fdata, sizeof(float) * num_samples * num_channels)))
-			return SR_ERR_MALLOC;
-		outc->fdata = data;
-		ret = sr_analog_to_float(analog, data);
-		if (ret != SR_OK)
-			return ret;
-
-		if (num_samples == 0)
-			return SR_OK;
-
-		if (num_channels > outc->num_channels) {
-			sr_err("Packet has %d channels, but only %d were enabled.",
-					num_channels, outc->num_channels);
-			return SR_ERR;
-		}
-
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
-				return SR_ERR_MALLOC;
-		}
-
-		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
-		for (i = 0; i < num_channels; i++) {
-			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
-		}
-
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 0.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
-			}
-		}
-		g_free(chan_idx);
-
-		size = check_chanbuf_size(o);
-		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
-		break;
+		return process_analog(outc, packet->payload, *out);
 	case SR_DF_END:
-		size = check_chanbuf_size(o);
-		if (size > 0) {
-			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
-				return SR_ERR;
+		for (i = 0; i < outc->num_channels; i++) {
+			if (outc->pending_used[i]) {
+				sr_warn("Dropping samples of incomplete frames.");
+				break;
+			}
 		}
 		break;
 	}
@@ -332,13 +499,23 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "format", "Sample format", "Float, or 16 or 24 bit integer PCM", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
+	unsigned int i;
+
+	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_double(0.0));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(
+			sample_formats[FORMAT_FLOAT].name));
+		for (i = 0; i < ARRAY_SIZE(sample_formats); i++)
+			options[1].values = g_slist_append(options[1].values,
+				g_variant_ref_sink(g_variant_new_string(
+					sample_formats[i].name)));
+	}
 
 	return options;
 }
@@ -346,15 +523,14 @@ static const struct sr_option *get_options(void)
 static int cleanup(struct sr_output *o)
 {
 	struct out_context *outc;
-	int i;
 
-	outc = o->priv;
+	if (!(outc = o->priv))
+		return SR_ERR_ARG;
 	g_slist_free(outc->channels);
-	g_variant_unref(options[0].def);
-	for (i = 0; i < outc->num_channels; i++)
-		g_free(outc->chanbuf[i]);
-	g_free(outc->chanbuf_used);
-	g_free(outc->chanbuf);
+	g_free(outc->chan_idx);
+	g_free(outc->chan_out);
+	g_free(outc->pending);
+	g_free(outc->pending_used);
 	g_free(outc->fdata);
 	g_free(outc);
 	o->priv = NULL;
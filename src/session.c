@@ -46,11 +46,103 @@
  * @{
  */
 
+/* Default queue size per datafeed callback in threaded mode. */
+#define DEFAULT_DISPATCH_QUEUE_SIZE 64
+
+struct dispatch_item {
+	const struct sr_dev_inst *sdi;
+	/* Reference counted packet, NULL tells the worker to quit. */
+	struct sr_datafeed_packet *packet;
+};
+
+/** Thread running a datafeed callback in threaded dispatch mode.
+ * Packets are passed through a single producer (the session thread),
+ * single consumer (the worker) ring buffer. The mutex and condition
+ * are only used to sleep on an empty or full ring.
+ * @internal
+ */
+struct datafeed_worker {
+	GThread *thread;
+	struct dispatch_item *ring;
+	/* Ring size, one more than the queue size. */
+	int capacity;
+	/* Next item to take, only written by the worker. */
+	int head;
+	/* Next free slot, only written by the session thread. */
+	int tail;
+	int policy;
+	GMutex mutex;
+	GCond cond;
+	int consumer_waiting;
+	int producer_waiting;
+};
+
 struct datafeed_callback {
 	sr_datafeed_callback cb;
 	void *cb_data;
+	/* Only set while a session in threaded dispatch mode is running. */
+	struct datafeed_worker *worker;
+	struct sr_datafeed_stats stats;
+	/* Takes SR_DF_LOGIC_RLE packets, instead of expanded samples. */
+	gboolean rle;
+};
+
+/* Which datafeed callbacks a packet is delivered to. */
+enum deliver_to {
+	DELIVER_ALL,
+	DELIVER_RLE,
+	DELIVER_PLAIN,
+};
+
+/* Default size of pooled packet buffers, in bytes. */
+#define DEFAULT_POOL_BUFSIZE (1024 * 1024)
+/* Default number of unused buffers of each kind kept in a pool. */
+#define DEFAULT_POOL_MAX_FREE 8
+
+/** Pool of reusable packet buffers, one per session.
+ * The session holds a reference, and so does every packet handed out,
+ * so packets can outlive the session.
+ * @internal
+ */
+struct sr_packet_pool {
+	GMutex mutex;
+	int refcount;
+	size_t logic_size;
+	size_t analog_size;
+	unsigned int max_free;
+	GSList *free_logic;
+	GSList *free_analog;
+	unsigned int num_free_logic;
+	unsigned int num_free_analog;
+};
+
+/** A reference counted datafeed packet.
+ * The packet is the first member, so that a packet_ref can be handed
+ * out as a struct sr_datafeed_packet.
+ * @internal
+ */
+struct packet_ref {
+	struct sr_datafeed_packet packet;
+	int refcount;
+	/* Pool which owns the buffer, NULL for copies. */
+	struct sr_packet_pool *pool;
+	/* Deep copy of a borrowed packet, see sr_packet_retain(). */
+	struct sr_datafeed_packet *copy;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint8_t *buf;
+	size_t bufsize;
 };
 
+/* The reference counted packet being sent on this thread, if any. */
+static GPrivate dispatched_packet;
+
+static void packet_pool_unref(struct sr_packet_pool *pool);
+static struct sr_packet_pool *session_packet_pool(struct sr_session *session);
+
 /** Custom GLib event source for generic descriptor I/O.
  * @see https://developer.gnome.org/glib/stable/glib-The-Main-Event-Loop.html
  * @internal
@@ -198,6 +290,185 @@ static GSource *fd_source_new(struct sr_session *session, void *key,
 	return source;
 }
 
+static gboolean ring_has_items(struct datafeed_worker *worker)
+{
+	return g_atomic_int_get(&worker->head) != g_atomic_int_get(&worker->tail);
+}
+
+static gboolean ring_has_space(struct datafeed_worker *worker)
+{
+	return (g_atomic_int_get(&worker->tail) + 1) % worker->capacity
+		!= g_atomic_int_get(&worker->head);
+}
+
+/* Called from the session thread only. */
+static gboolean ring_push(struct datafeed_worker *worker,
+		const struct dispatch_item *item)
+{
+	int tail;
+
+	if (!ring_has_space(worker))
+		return FALSE;
+	tail = g_atomic_int_get(&worker->tail);
+	worker->ring[tail] = *item;
+	/* Publish the item only after it has been written. */
+	g_atomic_int_set(&worker->tail, (tail + 1) % worker->capacity);
+
+	return TRUE;
+}
+
+/* Called from the worker thread only. */
+static gboolean ring_pop(struct datafeed_worker *worker,
+		struct dispatch_item *item)
+{
+	int head;
+
+	if (!ring_has_items(worker))
+		return FALSE;
+	head = g_atomic_int_get(&worker->head);
+	*item = worker->ring[head];
+	g_atomic_int_set(&worker->head, (head + 1) % worker->capacity);
+
+	return TRUE;
+}
+
+/*
+ * Sleep until the condition holds. Setting the waiting flag before
+ * re-checking the condition, and the other side checking the flag after
+ * updating the ring, guarantees that no wakeup gets lost.
+ */
+static void worker_wait(struct datafeed_worker *worker, int *waiting,
+		gboolean (*condition)(struct datafeed_worker *))
+{
+	g_mutex_lock(&worker->mutex);
+	g_atomic_int_set(waiting, 1);
+	while (!condition(worker))
+		g_cond_wait(&worker->cond, &worker->mutex);
+	g_atomic_int_set(waiting, 0);
+	g_mutex_unlock(&worker->mutex);
+}
+
+static void worker_wake(struct datafeed_worker *worker, int *waiting)
+{
+	if (!g_atomic_int_get(waiting))
+		return;
+	g_mutex_lock(&worker->mutex);
+	g_cond_broadcast(&worker->cond);
+	g_mutex_unlock(&worker->mutex);
+}
+
+static gpointer datafeed_worker_thread(gpointer data)
+{
+	struct datafeed_callback *cb_struct;
+	struct datafeed_worker *worker;
+	struct dispatch_item item;
+
+	cb_struct = data;
+	worker = cb_struct->worker;
+	for (;;) {
+		if (!ring_pop(worker, &item)) {
+			worker_wait(worker, &worker->consumer_waiting,
+				ring_has_items);
+			continue;
+		}
+		worker_wake(worker, &worker->producer_waiting);
+		if (!item.packet)
+			break;
+		/* Lets the callback keep the packet without a copy. */
+		g_private_set(&dispatched_packet, item.packet);
+		cb_struct->cb(item.sdi, item.packet, cb_struct->cb_data);
+		g_private_set(&dispatched_packet, NULL);
+		sr_packet_unref(item.packet);
+	}
+
+	return NULL;
+}
+
+/* Queue a packet reference for a threaded callback, or drop it. */
+static void datafeed_worker_push(struct datafeed_callback *cb_struct,
+		const struct sr_dev_inst *sdi, struct sr_datafeed_packet *packet)
+{
+	struct datafeed_worker *worker;
+	struct dispatch_item item;
+	unsigned int depth;
+	gboolean droppable;
+
+	worker = cb_struct->worker;
+	item.sdi = sdi;
+	item.packet = packet;
+
+	if (!ring_push(worker, &item)) {
+		droppable = packet && (packet->type == SR_DF_LOGIC
+			|| packet->type == SR_DF_LOGIC_RLE
+			|| packet->type == SR_DF_ANALOG);
+		if (droppable && worker->policy == SR_DISPATCH_DROP) {
+			cb_struct->stats.dropped++;
+			sr_packet_unref(packet);
+			return;
+		}
+		cb_struct->stats.stalls++;
+		while (!ring_push(worker, &item))
+			worker_wait(worker, &worker->producer_waiting,
+				ring_has_space);
+	}
+	worker_wake(worker, &worker->consumer_waiting);
+
+	if (!packet)
+		return;
+	cb_struct->stats.packets++;
+	depth = (g_atomic_int_get(&worker->tail) - g_atomic_int_get(&worker->head)
+		+ worker->capacity) % worker->capacity;
+	cb_struct->stats.max_queue_depth = MAX(cb_struct->stats.max_queue_depth,
+		depth);
+}
+
+static void datafeed_workers_start(struct sr_session *session)
+{
+	struct datafeed_callback *cb_struct;
+	struct datafeed_worker *worker;
+	GSList *l;
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		memset(&cb_struct->stats, 0, sizeof(cb_struct->stats));
+		worker = g_malloc0(sizeof(struct datafeed_worker));
+		worker->capacity = session->dispatch_queue_size + 1;
+		worker->ring = g_malloc0_n(worker->capacity,
+			sizeof(struct dispatch_item));
+		worker->policy = session->dispatch_policy;
+		g_mutex_init(&worker->mutex);
+		g_cond_init(&worker->cond);
+		cb_struct->worker = worker;
+		worker->thread = g_thread_new("sr-datafeed",
+			datafeed_worker_thread, cb_struct);
+	}
+}
+
+/* Wait until the workers are done with all queued packets, then end them. */
+static void datafeed_workers_stop(struct sr_session *session)
+{
+	struct datafeed_callback *cb_struct;
+	struct datafeed_worker *worker;
+	GSList *l;
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->worker)
+			datafeed_worker_push(cb_struct, NULL, NULL);
+	}
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (!(worker = cb_struct->worker))
+			continue;
+		g_thread_join(worker->thread);
+		cb_struct->worker = NULL;
+		g_cond_clear(&worker->cond);
+		g_mutex_clear(&worker->mutex);
+		g_free(worker->ring);
+		g_free(worker);
+	}
+}
+
 /**
  * Create a new session.
  *
@@ -230,6 +501,9 @@ SR_API int sr_session_new(struct sr_context *ctx,
 	 */
 	session->event_sources = g_hash_table_new(NULL, NULL);
 
+	session->dispatch_queue_size = DEFAULT_DISPATCH_QUEUE_SIZE;
+	session->dispatch_policy = SR_DISPATCH_BLOCK;
+
 	*new_session = session;
 
 	return SR_OK;
@@ -258,6 +532,9 @@ SR_API int sr_session_destroy(struct sr_session *session)
 
 	sr_session_datafeed_callback_remove_all(session);
 
+	if (session->packet_pool)
+		packet_pool_unref(session->packet_pool);
+
 	g_hash_table_unref(session->event_sources);
 
 	g_mutex_clear(&session->main_mutex);
@@ -460,15 +737,45 @@ SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
 		return SR_ERR_ARG;
 	}
 
+	datafeed_workers_stop(session);
 	g_slist_free_full(session->datafeed_callbacks, g_free);
 	session->datafeed_callbacks = NULL;
 
 	return SR_OK;
 }
 
+static int datafeed_callback_add(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data, gboolean rle)
+{
+	struct datafeed_callback *cb_struct;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	if (!cb) {
+		sr_err("%s: cb was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
+	cb_struct->cb = cb;
+	cb_struct->cb_data = cb_data;
+	cb_struct->rle = rle;
+
+	session->datafeed_callbacks =
+	    g_slist_append(session->datafeed_callbacks, cb_struct);
+
+	return SR_OK;
+}
+
 /**
  * Add a datafeed callback to a session.
  *
+ * Run-length encoded logic data is passed to the callback as
+ * SR_DF_LOGIC packets.
+ *
  * @param session The session to use. Must not be NULL.
  * @param cb Function to call when a chunk of data is received.
  *           Must not be NULL.
@@ -482,28 +789,178 @@ SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data)
 {
-	struct datafeed_callback *cb_struct;
+	return datafeed_callback_add(session, cb, cb_data, FALSE);
+}
 
+/**
+ * Add a datafeed callback which handles run-length encoded logic data.
+ *
+ * Unlike with sr_session_datafeed_callback_add(), SR_DF_LOGIC_RLE
+ * packets are passed to the callback as they are, so the runs need not
+ * be expanded. See struct sr_datafeed_logic_rle and
+ * sr_logic_rle_expand().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb Function to call when a chunk of data is received.
+ *           Must not be NULL.
+ * @param cb_data Opaque pointer passed in by the caller.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_BUG No session exists.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_rle_callback_add(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
+{
+	return datafeed_callback_add(session, cb, cb_data, TRUE);
+}
+
+/**
+ * Set how datafeed callbacks are run.
+ *
+ * By default, all datafeed callbacks run synchronously on the thread
+ * which runs the session, so a slow callback delays the drivers. In
+ * threaded mode every datafeed callback which is registered when the
+ * session starts runs on a thread of its own, which is fed through a
+ * bounded queue. The callbacks see the packets in the same order as in
+ * synchronous mode, and the session does not report that it stopped
+ * before all callbacks have seen the SR_DF_END packets.
+ *
+ * Packets which do not come from the session's packet pool are copied
+ * once before they are queued.
+ *
+ * This must not be called while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param threaded TRUE to run the datafeed callbacks on threads.
+ * @param queue_size Number of packets each callback's queue can hold,
+ *                   or 0 for the default.
+ * @param policy What to do when a queue is full, see
+ *               enum sr_dispatch_policy.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_dispatch_set(struct sr_session *session,
+		gboolean threaded, unsigned int queue_size, int policy)
+{
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
+		return SR_ERR_ARG;
 	}
 
-	if (!cb) {
-		sr_err("%s: cb was NULL", __func__);
+	if (policy != SR_DISPATCH_BLOCK && policy != SR_DISPATCH_DROP) {
+		sr_err("%s: invalid dispatch policy %d", __func__, policy);
 		return SR_ERR_ARG;
 	}
 
-	cb_struct = g_malloc0(sizeof(struct datafeed_callback));
-	cb_struct->cb = cb;
-	cb_struct->cb_data = cb_data;
+	if (queue_size > G_MAXINT / 2)
+		return SR_ERR_ARG;
 
-	session->datafeed_callbacks =
-	    g_slist_append(session->datafeed_callbacks, cb_struct);
+	if (session->running) {
+		sr_err("Cannot change dispatch mode while the session is running.");
+		return SR_ERR;
+	}
+
+	session->threaded_dispatch = threaded;
+	session->dispatch_queue_size = queue_size ? queue_size
+		: DEFAULT_DISPATCH_QUEUE_SIZE;
+	session->dispatch_policy = policy;
+
+	return SR_OK;
+}
+
+/**
+ * Set whether USB transfers are handled on a thread of their own.
+ *
+ * By default, USB transfers complete on the thread which runs the
+ * session, so datafeed callbacks and other event sources delay them. With
+ * a USB thread, drivers which stream their samples over USB bulk
+ * transfers submit the transfers again on a dedicated thread as soon as
+ * they complete, and the data gets to the session thread through a queue.
+ * The session thread may then fall behind for a while without the device
+ * running out of transfers.
+ *
+ * Only some drivers support this, the others ignore it. This must not be
+ * called while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param enable TRUE to handle USB transfers on a thread.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_usb_thread_set(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (session->running) {
+		sr_err("Cannot change the USB thread while the session is running.");
+		return SR_ERR;
+	}
+
+	session->usb_thread = enable;
 
 	return SR_OK;
 }
 
+/**
+ * Get the statistics of a datafeed callback in threaded dispatch mode.
+ *
+ * The statistics are reset when the session starts. While the session
+ * is running, the values are updated concurrently and only approximate.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb The callback, as passed to sr_session_datafeed_callback_add().
+ * @param cb_data The callback data, as passed to
+ *                sr_session_datafeed_callback_add().
+ * @param stats Where to store the statistics. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no such callback.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_stats_get(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data,
+		struct sr_datafeed_stats *stats)
+{
+	struct datafeed_callback *cb_struct;
+	struct datafeed_worker *worker;
+	GSList *l;
+
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->cb != cb || cb_struct->cb_data != cb_data)
+			continue;
+		*stats = cb_struct->stats;
+		stats->queue_depth = 0;
+		worker = cb_struct->worker;
+		if (worker)
+			stats->queue_depth = (g_atomic_int_get(&worker->tail)
+				- g_atomic_int_get(&worker->head)
+				+ worker->capacity) % worker->capacity;
+		return SR_OK;
+	}
+
+	return SR_ERR_ARG;
+}
+
 /**
  * Get the trigger assigned to this session.
  *
@@ -688,6 +1145,9 @@ static gboolean delayed_stop_check(void *data)
 	if (g_hash_table_size(session->event_sources) != 0)
 		return G_SOURCE_REMOVE;
 
+	/* Let threaded datafeed callbacks finish with the data. */
+	datafeed_workers_stop(session);
+
 	session->running = FALSE;
 	unset_main_context(session);
 
@@ -805,6 +1265,9 @@ SR_API int sr_session_start(struct sr_session *session)
 	if (ret != SR_OK)
 		return ret;
 
+	if (session->threaded_dispatch)
+		datafeed_workers_start(session);
+
 	sr_info("Starting.");
 
 	session->running = TRUE;
@@ -836,6 +1299,7 @@ SR_API int sr_session_start(struct sr_session *session)
 		 * sources... */
 		session->running = FALSE;
 
+		datafeed_workers_stop(session);
 		unset_main_context(session);
 		return ret;
 	}
@@ -1033,6 +1497,7 @@ SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 static void datafeed_dump(const struct sr_datafeed_packet *packet)
 {
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_datafeed_analog *analog;
 
 	/* Please use the same order as in libsigrok.h. */
@@ -1065,12 +1530,101 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
 		       analog->num_samples);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_RLE packet (%" PRIu64 " runs, "
+		       "unitsize = %d).", rle->num_runs, rle->unitsize);
+		break;
 	default:
 		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
 		break;
 	}
 }
 
+/*
+ * Pass a packet to the datafeed callbacks. Threaded callbacks share one
+ * reference counted packet.
+ */
+static void datafeed_deliver(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, enum deliver_to to)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	struct sr_datafeed_packet *retained;
+
+	retained = NULL;
+	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if ((to == DELIVER_RLE && !cb_struct->rle)
+				|| (to == DELIVER_PLAIN && cb_struct->rle))
+			continue;
+		if (sr_log_loglevel_get() >= SR_LOG_DBG)
+			datafeed_dump(packet);
+		if (!cb_struct->worker) {
+			cb_struct->cb(sdi, packet, cb_struct->cb_data);
+			continue;
+		}
+		if (!retained)
+			retained = sr_packet_retain(packet, TRUE);
+		if (retained)
+			datafeed_worker_push(cb_struct, sdi,
+				sr_packet_ref(retained));
+	}
+	sr_packet_unref(retained);
+}
+
+/*
+ * Send run-length encoded samples as pooled SR_DF_LOGIC packets, either
+ * through the transforms or straight to the callbacks which do not take
+ * runs.
+ */
+static int send_rle_expanded(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_logic_rle *rle, gboolean transform)
+{
+	struct sr_packet_pool *pool;
+	struct sr_datafeed_packet *packet, *prev;
+	struct sr_datafeed_logic *logic;
+	struct sr_logic_rle_pos pos;
+	uint64_t max_samples;
+	int ret;
+
+	if (!rle->unitsize) {
+		sr_err("%s: unitsize was 0", __func__);
+		return SR_ERR_ARG;
+	}
+
+	pool = session_packet_pool(sdi->session);
+	g_mutex_lock(&pool->mutex);
+	max_samples = MAX(pool->logic_size / rle->unitsize, 1);
+	g_mutex_unlock(&pool->mutex);
+
+	memset(&pos, 0, sizeof(pos));
+	ret = SR_OK;
+	while (ret == SR_OK && pos.run < rle->num_runs) {
+		packet = sr_session_logic_packet_new(sdi->session, rle->unitsize,
+			max_samples * rle->unitsize);
+		logic = (struct sr_datafeed_logic *)packet->payload;
+		logic->length = rle->unitsize
+			* sr_logic_rle_expand(rle, &pos, logic->data, max_samples);
+		if (!logic->length) {
+			/* Only empty runs were left. */
+			sr_packet_unref(packet);
+			break;
+		}
+		if (transform) {
+			ret = sr_session_send_owned(sdi, packet);
+			continue;
+		}
+		prev = g_private_get(&dispatched_packet);
+		g_private_set(&dispatched_packet, packet);
+		datafeed_deliver(sdi, packet, DELIVER_PLAIN);
+		g_private_set(&dispatched_packet, prev);
+		sr_packet_unref(packet);
+	}
+
+	return ret;
+}
+
 /**
  * Send a packet to whatever is listening on the datafeed bus.
  *
@@ -1108,6 +1662,10 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		return SR_ERR_BUG;
 	}
 
+	/* Transform modules only handle expanded logic samples. */
+	if (packet->type == SR_DF_LOGIC_RLE && sdi->session->transforms)
+		return send_rle_expanded(sdi, packet->payload, TRUE);
+
 	/*
 	 * Pass the packet to the first transform module. If that returns
 	 * another packet (instead of NULL), pass that packet to the next
@@ -1143,11 +1701,17 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 	 * If the last transform did output a packet, pass it to all datafeed
 	 * callbacks.
 	 */
+	if (packet->type != SR_DF_LOGIC_RLE) {
+		datafeed_deliver(sdi, packet, DELIVER_ALL);
+		return SR_OK;
+	}
+
+	/* Runs are only expanded if some callback cannot take them. */
+	datafeed_deliver(sdi, packet, DELIVER_RLE);
 	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
 		cb_struct = l->data;
-		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		if (!cb_struct->rle)
+			return send_rle_expanded(sdi, packet->payload, FALSE);
 	}
 
 	return SR_OK;
@@ -1458,6 +2022,8 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	struct sr_datafeed_meta *meta_copy;
 	const struct sr_datafeed_logic *logic;
 	struct sr_datafeed_logic *logic_copy;
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_logic_rle *rle_copy;
 	const struct sr_datafeed_analog *analog;
 	struct sr_datafeed_analog *analog_copy;
 	uint8_t *payload;
@@ -1468,6 +2034,8 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1478,7 +2046,7 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	case SR_DF_META:
 		meta = packet->payload;
 		meta_copy = g_malloc0(sizeof(struct sr_datafeed_meta));
-		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy->config);
+		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy);
 		(*copy)->payload = meta_copy;
 		break;
 	case SR_DF_LOGIC:
@@ -1486,7 +2054,7 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		logic_copy = g_malloc(sizeof(*logic_copy));
 		logic_copy->length = logic->length;
 		logic_copy->unitsize = logic->unitsize;
-		memcpy(logic_copy->data, logic->data, logic->length * logic->unitsize);
+		logic_copy->data = g_memdup(logic->data, logic->length);
 		(*copy)->payload = logic_copy;
 		break;
 	case SR_DF_ANALOG:
@@ -1507,6 +2075,17 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 				sizeof(struct sr_analog_spec));
 		(*copy)->payload = analog_copy;
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		rle_copy = g_malloc(sizeof(*rle_copy));
+		rle_copy->num_runs = rle->num_runs;
+		rle_copy->unitsize = rle->unitsize;
+		rle_copy->data = g_memdup(rle->data,
+				rle->num_runs * rle->unitsize);
+		rle_copy->lengths = g_memdup(rle->lengths,
+				rle->num_runs * sizeof(uint64_t));
+		(*copy)->payload = rle_copy;
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 		return SR_ERR;
@@ -1515,10 +2094,12 @@ SR_PRIV int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	return SR_OK;
 }
 
-void sr_packet_free(struct sr_datafeed_packet *packet)
+/** @private */
+SR_PRIV void sr_packet_free(struct sr_datafeed_packet *packet)
 {
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_datafeed_analog *analog;
 	struct sr_config *src;
 	GSList *l;
@@ -1526,6 +2107,8 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1556,6 +2139,12 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 		g_free(analog->spec);
 		g_free((void *)packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		g_free(rle->data);
+		g_free(rle->lengths);
+		g_free((void *)packet->payload);
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 	}
@@ -1563,4 +2152,360 @@ void sr_packet_free(struct sr_datafeed_packet *packet)
 
 }
 
+static struct sr_packet_pool *packet_pool_new(void)
+{
+	struct sr_packet_pool *pool;
+
+	pool = g_malloc0(sizeof(struct sr_packet_pool));
+	g_mutex_init(&pool->mutex);
+	pool->refcount = 1;
+	pool->logic_size = DEFAULT_POOL_BUFSIZE;
+	pool->analog_size = DEFAULT_POOL_BUFSIZE;
+	pool->max_free = DEFAULT_POOL_MAX_FREE;
+
+	return pool;
+}
+
+static void packet_ref_free(struct packet_ref *ref)
+{
+	g_free(ref->buf);
+	g_free(ref);
+}
+
+static void packet_pool_flush(struct sr_packet_pool *pool)
+{
+	g_slist_free_full(pool->free_logic, (GDestroyNotify)packet_ref_free);
+	g_slist_free_full(pool->free_analog, (GDestroyNotify)packet_ref_free);
+	pool->free_logic = pool->free_analog = NULL;
+	pool->num_free_logic = pool->num_free_analog = 0;
+}
+
+static void packet_pool_unref(struct sr_packet_pool *pool)
+{
+	if (!g_atomic_int_dec_and_test(&pool->refcount))
+		return;
+
+	packet_pool_flush(pool);
+	g_mutex_clear(&pool->mutex);
+	g_free(pool);
+}
+
+static struct packet_ref *packet_pool_get(struct sr_packet_pool *pool,
+		int type, size_t size)
+{
+	struct packet_ref *ref;
+	GSList **free_list;
+	unsigned int *num_free;
+	size_t bufsize;
+
+	if (type == SR_DF_LOGIC) {
+		free_list = &pool->free_logic;
+		num_free = &pool->num_free_logic;
+		bufsize = pool->logic_size;
+	} else {
+		free_list = &pool->free_analog;
+		num_free = &pool->num_free_analog;
+		bufsize = pool->analog_size;
+	}
+
+	ref = NULL;
+	g_mutex_lock(&pool->mutex);
+	if (size <= bufsize && *free_list) {
+		ref = (*free_list)->data;
+		*free_list = g_slist_delete_link(*free_list, *free_list);
+		(*num_free)--;
+	}
+	g_mutex_unlock(&pool->mutex);
+
+	if (!ref) {
+		/* Oversized requests get a buffer of their own. */
+		ref = g_malloc0(sizeof(struct packet_ref));
+		ref->bufsize = MAX(size, bufsize);
+		ref->buf = g_malloc(ref->bufsize);
+	}
+	g_atomic_int_inc(&pool->refcount);
+	ref->pool = pool;
+	ref->refcount = 1;
+	ref->packet.type = type;
+
+	return ref;
+}
+
+static void packet_pool_put(struct sr_packet_pool *pool,
+		struct packet_ref *ref)
+{
+	GSList **free_list;
+	unsigned int *num_free;
+	size_t bufsize;
+
+	g_slist_free(ref->meaning.channels);
+	ref->meaning.channels = NULL;
+
+	g_mutex_lock(&pool->mutex);
+	if (ref->packet.type == SR_DF_LOGIC) {
+		free_list = &pool->free_logic;
+		num_free = &pool->num_free_logic;
+		bufsize = pool->logic_size;
+	} else {
+		free_list = &pool->free_analog;
+		num_free = &pool->num_free_analog;
+		bufsize = pool->analog_size;
+	}
+	if (ref->bufsize == bufsize && *num_free < pool->max_free) {
+		*free_list = g_slist_prepend(*free_list, ref);
+		(*num_free)++;
+		ref = NULL;
+	}
+	g_mutex_unlock(&pool->mutex);
+
+	if (ref)
+		packet_ref_free(ref);
+	packet_pool_unref(pool);
+}
+
+static struct sr_packet_pool *session_packet_pool(struct sr_session *session)
+{
+	g_mutex_lock(&session->main_mutex);
+	if (!session->packet_pool)
+		session->packet_pool = packet_pool_new();
+	g_mutex_unlock(&session->main_mutex);
+
+	return session->packet_pool;
+}
+
+/**
+ * Configure the packet buffer pool of a session.
+ *
+ * Drivers which support it send their logic and analog data in buffers
+ * taken from this pool. The buffers are recycled once the last
+ * reference to a packet is dropped, see sr_packet_retain().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param logic_size Size of the logic packet buffers in bytes.
+ * @param analog_size Size of the analog packet buffers in bytes.
+ * @param num_buffers Number of buffers of each kind which are allocated
+ *                    up front and kept around for reuse.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_packet_pool_set(struct sr_session *session,
+		size_t logic_size, size_t analog_size, unsigned int num_buffers)
+{
+	struct sr_packet_pool *pool;
+	struct packet_ref *ref;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!logic_size || !analog_size)
+		return SR_ERR_ARG;
+
+	pool = session_packet_pool(session);
+	g_mutex_lock(&pool->mutex);
+	if (logic_size != pool->logic_size || analog_size != pool->analog_size)
+		packet_pool_flush(pool);
+	pool->logic_size = logic_size;
+	pool->analog_size = analog_size;
+	pool->max_free = num_buffers;
+	while (pool->num_free_logic < num_buffers) {
+		ref = g_malloc0(sizeof(struct packet_ref));
+		ref->bufsize = logic_size;
+		ref->buf = g_malloc(logic_size);
+		pool->free_logic = g_slist_prepend(pool->free_logic, ref);
+		pool->num_free_logic++;
+	}
+	while (pool->num_free_analog < num_buffers) {
+		ref = g_malloc0(sizeof(struct packet_ref));
+		ref->bufsize = analog_size;
+		ref->buf = g_malloc(analog_size);
+		pool->free_analog = g_slist_prepend(pool->free_analog, ref);
+		pool->num_free_analog++;
+	}
+	g_mutex_unlock(&pool->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get a logic packet with a buffer from the session's packet pool.
+ *
+ * The packet's logic payload points to a buffer of at least @a size
+ * bytes, its length is set to @a size and can be reduced by the caller.
+ * Send it with sr_session_send_owned(), which takes over the caller's
+ * reference.
+ *
+ * @private
+ */
+SR_PRIV struct sr_datafeed_packet *sr_session_logic_packet_new(
+		struct sr_session *session, uint16_t unitsize, size_t size)
+{
+	struct packet_ref *ref;
+
+	ref = packet_pool_get(session_packet_pool(session), SR_DF_LOGIC, size);
+	ref->logic.length = size;
+	ref->logic.unitsize = unitsize;
+	ref->logic.data = ref->buf;
+	ref->packet.payload = &ref->logic;
+
+	return &ref->packet;
+}
+
+/**
+ * Get an analog packet with a buffer from the session's packet pool.
+ *
+ * The packet's analog payload points to a buffer of at least @a size
+ * bytes, and to encoding, meaning and spec structures which are part of
+ * the packet. The caller fills these in, e.g. with sr_analog_init().
+ * Send it with sr_session_send_owned(), which takes over the caller's
+ * reference.
+ *
+ * @private
+ */
+SR_PRIV struct sr_datafeed_packet *sr_session_analog_packet_new(
+		struct sr_session *session, size_t size)
+{
+	struct packet_ref *ref;
+
+	ref = packet_pool_get(session_packet_pool(session), SR_DF_ANALOG, size);
+	memset(&ref->encoding, 0, sizeof(ref->encoding));
+	memset(&ref->meaning, 0, sizeof(ref->meaning));
+	memset(&ref->spec, 0, sizeof(ref->spec));
+	ref->analog.data = ref->buf;
+	ref->analog.num_samples = 0;
+	ref->analog.encoding = &ref->encoding;
+	ref->analog.meaning = &ref->meaning;
+	ref->analog.spec = &ref->spec;
+	ref->packet.payload = &ref->analog;
+
+	return &ref->packet;
+}
+
+/**
+ * Send a reference counted packet to the session bus and drop the
+ * caller's reference to it.
+ *
+ * Datafeed callbacks can keep the packet without copying it, by taking
+ * their own reference with sr_packet_retain().
+ *
+ * @param sdi Device instance from which the packet comes. Must not be NULL.
+ * @param packet A packet from sr_session_logic_packet_new() or
+ *               sr_session_analog_packet_new(). Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_owned(const struct sr_dev_inst *sdi,
+		struct sr_datafeed_packet *packet)
+{
+	struct packet_ref *prev;
+	int ret;
+
+	prev = g_private_get(&dispatched_packet);
+	g_private_set(&dispatched_packet, packet);
+	ret = sr_session_send(sdi, packet);
+	g_private_set(&dispatched_packet, prev);
+	sr_packet_unref(packet);
+
+	return ret;
+}
+
+/**
+ * Take a reference to a datafeed packet.
+ *
+ * Packets handed to datafeed callbacks are only valid for the duration
+ * of the callback. Use this to keep a packet beyond that.
+ *
+ * If the packet comes straight from a driver which sends pooled buffers,
+ * this only takes a reference and no data is copied. Otherwise the
+ * packet is copied if @a copy is TRUE, or NULL is returned.
+ *
+ * @param packet The packet which is passed to the datafeed callback.
+ *               Must not be NULL.
+ * @param copy Whether to fall back to copying the packet.
+ *
+ * @return A packet which must be released with sr_packet_unref(), or NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_datafeed_packet *sr_packet_retain(
+		const struct sr_datafeed_packet *packet, gboolean copy)
+{
+	struct packet_ref *ref;
+
+	if (!packet)
+		return NULL;
+
+	ref = g_private_get(&dispatched_packet);
+	if (ref && &ref->packet == packet)
+		return sr_packet_ref(&ref->packet);
+
+	if (!copy)
+		return NULL;
+
+	ref = g_malloc0(sizeof(struct packet_ref));
+	if (sr_packet_copy(packet, &ref->copy) != SR_OK) {
+		g_free(ref->copy);
+		g_free(ref);
+		return NULL;
+	}
+	ref->refcount = 1;
+	ref->packet = *ref->copy;
+
+	return &ref->packet;
+}
+
+/**
+ * Take another reference to a packet obtained from sr_packet_retain().
+ *
+ * @param packet The packet. Must not be NULL.
+ *
+ * @return The packet.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_datafeed_packet *sr_packet_ref(
+		struct sr_datafeed_packet *packet)
+{
+	struct packet_ref *ref;
+
+	ref = (struct packet_ref *)packet;
+	g_atomic_int_inc(&ref->refcount);
+
+	return packet;
+}
+
+/**
+ * Drop a reference to a packet obtained from sr_packet_retain() or
+ * sr_packet_ref().
+ *
+ * Once the last reference is dropped, the packet's buffer is returned
+ * to its pool, or freed.
+ *
+ * @param packet The packet. May be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_packet_unref(struct sr_datafeed_packet *packet)
+{
+	struct packet_ref *ref;
+
+	if (!packet)
+		return;
+
+	ref = (struct packet_ref *)packet;
+	if (!g_atomic_int_dec_and_test(&ref->refcount))
+		return;
+
+	if (ref->pool) {
+		packet_pool_put(ref->pool, ref);
+	} else {
+		sr_packet_free(ref->copy);
+		g_free(ref);
+	}
+}
+
 /** @} */
@@ -50,6 +50,7 @@ struct session_vdev {
 	GArray *analog_channels;
 	int cur_chunk;
 	gboolean finished;
+	void *buf;
 };
 
 static const uint32_t devopts[] = {
@@ -70,10 +71,8 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
-	struct zip_stat zs;
 	int ret, got_data;
 	char capturefile[16];
-	void *buf;
 
 	got_data = FALSE;
 	vdev = sdi->priv;
@@ -83,21 +82,17 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 		 * chunked one. */
 		if (vdev->capturefile && (vdev->cur_chunk == 0)) {
 			/* capturefile is always the unchunked base name. */
-			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
+			if ((vdev->capfile = zip_fopen(vdev->archive,
+					vdev->capturefile, 0))) {
 				/* No chunks, just a single capture file. */
 				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
-					return FALSE;
 				sr_dbg("Opened %s.", vdev->capturefile);
 			} else {
 				/* Try as first chunk filename. */
 				snprintf(capturefile, sizeof(capturefile) - 1, "%s-1", vdev->capturefile);
-				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
+				if ((vdev->capfile = zip_fopen(vdev->archive,
+						capturefile, 0))) {
 					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
-						return FALSE;
 					sr_dbg("Opened %s.", capturefile);
 				} else {
 					sr_err("No capture file '%s' in " "session file '%s'.",
@@ -110,10 +105,8 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			vdev->cur_chunk++;
 			snprintf(capturefile, sizeof(capturefile) - 1, "%s-%d", vdev->capturefile,
 					vdev->cur_chunk);
-			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
-					return FALSE;
+			if ((vdev->capfile = zip_fopen(vdev->archive,
+					capturefile, 0))) {
 				sr_dbg("Opened %s.", capturefile);
 			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
 				vdev->capturefile = g_strdup_printf("analog-1-%d",
@@ -140,14 +133,12 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 		}
 	}
 
-	buf = g_malloc(CHUNKSIZE);
-
 	/* unitsize is not defined for purely analog session files. */
-	if (vdev->unitsize)
-		ret = zip_fread(vdev->capfile, buf,
+	if (vdev->cur_analog_channel == 0 && vdev->unitsize)
+		ret = zip_fread(vdev->capfile, vdev->buf,
 				CHUNKSIZE / vdev->unitsize * vdev->unitsize);
 	else
-		ret = zip_fread(vdev->capfile, buf, CHUNKSIZE);
+		ret = zip_fread(vdev->capfile, vdev->buf, CHUNKSIZE);
 
 	if (ret > 0) {
 		got_data = TRUE;
@@ -163,7 +154,7 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			analog.meaning->mq = SR_MQ_VOLTAGE;
 			analog.meaning->unit = SR_UNIT_VOLT;
 			analog.meaning->mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
+			analog.data = vdev->buf;
 		} else {
 			if (ret % vdev->unitsize != 0)
 				sr_warn("Read size %d not a multiple of the"
@@ -172,10 +163,12 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			packet.payload = &logic;
 			logic.length = ret;
 			logic.unitsize = vdev->unitsize;
-			logic.data = buf;
+			logic.data = vdev->buf;
 		}
 		vdev->bytes_read += ret;
 		sr_session_send(sdi, &packet);
+		if (packet.type == SR_DF_ANALOG)
+			g_slist_free(analog.meaning->channels);
 	} else {
 		/* done with this capture file */
 		zip_fclose(vdev->capfile);
@@ -186,7 +179,6 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 			got_data = TRUE;
 		}
 	}
-	g_free(buf);
 
 	return got_data;
 }
@@ -215,6 +207,8 @@ static int receive_data(int fd, int revents, void *cb_data)
 		zip_discard(vdev->archive);
 		vdev->archive = NULL;
 	}
+	g_free(vdev->buf);
+	vdev->buf = NULL;
 
 	std_session_send_df_end(sdi);
 
@@ -341,6 +335,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	}
 	vdev->cur_chunk = 0;
 	vdev->finished = FALSE;
+	/* One read buffer for the whole acquisition. */
+	vdev->buf = g_malloc(CHUNKSIZE);
 
 	sr_info("Opening archive %s file %s", vdev->sessionfile,
 		vdev->capturefile);
@@ -348,6 +344,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if (!(vdev->archive = zip_open(vdev->sessionfile, 0, &ret))) {
 		sr_err("Failed to open session file '%s': "
 		       "zip error %d.", vdev->sessionfile, ret);
+		g_free(vdev->buf);
+		vdev->buf = NULL;
 		return SR_ERR;
 	}
 
@@ -391,4 +391,707 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	return ret;
 }
 
+
+/** @cond PRIVATE */
+/* One archive member holding part of a stream. */
+struct sessionfile_chunk {
+	zip_uint64_t index;
+	uint64_t chunk_num;
+	uint64_t first_sample;
+	uint64_t num_samples;
+	uint64_t size;
+};
+
+/* The logic data, or the data of one analog channel. */
+struct sessionfile_stream {
+	char *name;
+	unsigned int unitsize;
+	uint64_t num_samples;
+	GArray *chunks;
+	/* The most recently decompressed chunk. */
+	gboolean cached;
+	guint cached_chunk;
+	uint8_t *cache;
+	size_t cache_size;
+};
+
+struct sr_session_file {
+	struct zip *archive;
+	uint64_t samplerate;
+	struct sessionfile_stream *logic;
+	GPtrArray *analog;
+};
+/** @endcond */
+
+static struct sessionfile_stream *sessionfile_stream_new(const char *name,
+		unsigned int unitsize)
+{
+	struct sessionfile_stream *st;
+
+	st = g_malloc0(sizeof(struct sessionfile_stream));
+	st->name = g_strdup(name);
+	st->unitsize = unitsize;
+	st->chunks = g_array_new(FALSE, FALSE, sizeof(struct sessionfile_chunk));
+
+	return st;
+}
+
+static void sessionfile_stream_free(struct sessionfile_stream *st)
+{
+	if (!st)
+		return;
+	g_array_free(st->chunks, TRUE);
+	g_free(st->cache);
+	g_free(st->name);
+	g_free(st);
+}
+
+static gint sessionfile_chunk_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct sessionfile_chunk *ca, *cb;
+
+	ca = a;
+	cb = b;
+	if (ca->chunk_num == cb->chunk_num)
+		return 0;
+
+	return ca->chunk_num < cb->chunk_num ? -1 : 1;
+}
+
+/*
+ * Put the chunks of a stream in order and assign them their sample
+ * ranges. Chunks must be numbered without gaps, otherwise the sample
+ * positions after the gap would be wrong.
+ */
+static int sessionfile_stream_index(struct sessionfile_stream *st)
+{
+	struct sessionfile_chunk *chunk;
+	uint64_t first_num;
+	guint i;
+
+	g_array_sort(st->chunks, sessionfile_chunk_cmp);
+	first_num = 0;
+	st->num_samples = 0;
+	for (i = 0; i < st->chunks->len; i++) {
+		chunk = &g_array_index(st->chunks, struct sessionfile_chunk, i);
+		if (i == 0)
+			first_num = chunk->chunk_num;
+		if (chunk->chunk_num != first_num + i) {
+			sr_err("Chunk %" PRIu64 " of '%s' is missing.",
+				first_num + i, st->name);
+			return SR_ERR_DATA;
+		}
+		if (chunk->size % st->unitsize != 0)
+			sr_warn("Size of '%s' chunk %" PRIu64 " is not a "
+				"multiple of the unit size %u.", st->name,
+				chunk->chunk_num, st->unitsize);
+		chunk->first_sample = st->num_samples;
+		chunk->num_samples = chunk->size / st->unitsize;
+		st->num_samples += chunk->num_samples;
+	}
+
+	return SR_OK;
+}
+
+/* Parse "<base>" or "<base>-<chunk>" member names. */
+static gboolean sessionfile_parse_chunk_name(const char *name,
+		const char *base, uint64_t *chunk_num)
+{
+	size_t len;
+	char *end;
+
+	len = strlen(base);
+	if (strncmp(name, base, len) != 0)
+		return FALSE;
+	if (name[len] == '\0') {
+		*chunk_num = 0;
+		return TRUE;
+	}
+	if (name[len] != '-' || !g_ascii_isdigit(name[len + 1]))
+		return FALSE;
+	*chunk_num = g_ascii_strtoull(name + len + 1, &end, 10);
+
+	return *end == '\0';
+}
+
+static gint sessionfile_analog_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct sessionfile_stream *sa, *sb;
+	uint64_t na, nb;
+
+	sa = *(struct sessionfile_stream * const *)a;
+	sb = *(struct sessionfile_stream * const *)b;
+	na = g_ascii_strtoull(sa->name + strlen("analog-1-"), NULL, 10);
+	nb = g_ascii_strtoull(sb->name + strlen("analog-1-"), NULL, 10);
+	if (na == nb)
+		return 0;
+
+	return na < nb ? -1 : 1;
+}
+
+/* Walk the member list once and sort every data member into its stream. */
+static int sessionfile_build_index(struct sr_session_file *sf)
+{
+	struct sessionfile_stream *st;
+	struct sessionfile_chunk chunk;
+	struct zip_stat zs;
+	zip_int64_t i, num_entries;
+	uint64_t chunk_num;
+	guint j;
+	char *base;
+	int ret;
+
+	num_entries = zip_get_num_entries(sf->archive, 0);
+	for (i = 0; i < num_entries; i++) {
+		if (zip_stat_index(sf->archive, i, 0, &zs) < 0 || !zs.name)
+			continue;
+		st = NULL;
+		if (sf->logic && sessionfile_parse_chunk_name(zs.name,
+				sf->logic->name, &chunk_num)) {
+			st = sf->logic;
+		} else if (!strncmp(zs.name, "analog-1-", 9)) {
+			/* The channel number ends at the chunk number, if any. */
+			base = g_strndup(zs.name, strcspn(zs.name + 9, "-") + 9);
+			for (j = 0; j < sf->analog->len; j++) {
+				st = g_ptr_array_index(sf->analog, j);
+				if (!strcmp(st->name, base))
+					break;
+				st = NULL;
+			}
+			if (!st) {
+				st = sessionfile_stream_new(base, sizeof(float));
+				g_ptr_array_add(sf->analog, st);
+			}
+			if (!sessionfile_parse_chunk_name(zs.name, base, &chunk_num))
+				st = NULL;
+			g_free(base);
+		}
+		if (!st)
+			continue;
+		chunk.index = zs.index;
+		chunk.chunk_num = chunk_num;
+		chunk.size = zs.size;
+		g_array_append_val(st->chunks, chunk);
+	}
+
+	if (sf->logic && (ret = sessionfile_stream_index(sf->logic)) != SR_OK)
+		return ret;
+	g_ptr_array_sort(sf->analog, sessionfile_analog_cmp);
+	for (j = 0; j < sf->analog->len; j++) {
+		st = g_ptr_array_index(sf->analog, j);
+		if ((ret = sessionfile_stream_index(st)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Open a session file for random access.
+ *
+ * Unlike sr_session_load(), which replays the file from the start
+ * through a session, this reads the archive's member list once and
+ * indexes the chunks of the logic data and of every analog channel by
+ * sample position. Arbitrary sample ranges can then be read, only
+ * decompressing the chunks they cover.
+ *
+ * The returned handle is not thread-safe.
+ *
+ * @param filename The name of the session file to open.
+ * @param sf Will be set to the new session file handle. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file.
+ * @retval SR_ERR This is not a session file.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_open(const char *filename,
+		struct sr_session_file **sf)
+{
+	struct sr_session_file *f;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	char *val;
+	int unitsize, ret;
+
+	if (!filename || !sf)
+		return SR_ERR_ARG;
+	*sf = NULL;
+
+	if ((ret = sr_sessionfile_check(filename)) != SR_OK)
+		return ret;
+
+	f = g_malloc0(sizeof(struct sr_session_file));
+	f->analog = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)sessionfile_stream_free);
+	if (!(f->archive = zip_open(filename, 0, NULL))) {
+		sr_session_file_close(f);
+		return SR_ERR;
+	}
+
+	kf = NULL;
+	if (zip_stat(f->archive, "metadata", 0, &zs) < 0
+			|| !(kf = sr_sessionfile_read_metadata(f->archive, &zs))) {
+		sr_session_file_close(f);
+		return SR_ERR_DATA;
+	}
+
+	ret = SR_OK;
+	val = g_key_file_get_string(kf, "device 1", "samplerate", NULL);
+	if (val && sr_parse_sizestring(val, &f->samplerate) != SR_OK)
+		ret = SR_ERR_DATA;
+	g_free(val);
+
+	/*
+	 * Logic data is only there if a capturefile is set, which names its
+	 * members like for the session driver.
+	 */
+	val = g_key_file_get_string(kf, "device 1", "capturefile", NULL);
+	if (val) {
+		unitsize = g_key_file_get_integer(kf, "device 1", "unitsize", NULL);
+		if (unitsize > 0)
+			f->logic = sessionfile_stream_new(val, unitsize);
+		g_free(val);
+	}
+	g_key_file_free(kf);
+
+	if (ret == SR_OK)
+		ret = sessionfile_build_index(f);
+	if (ret != SR_OK) {
+		sr_session_file_close(f);
+		return ret;
+	}
+	*sf = f;
+
+	return SR_OK;
+}
+
+/**
+ * Close a session file opened with sr_session_file_open().
+ *
+ * @param sf The session file to close. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_close(struct sr_session_file *sf)
+{
+	if (!sf)
+		return SR_ERR_ARG;
+
+	sessionfile_stream_free(sf->logic);
+	g_ptr_array_free(sf->analog, TRUE);
+	if (sf->archive)
+		zip_discard(sf->archive);
+	g_free(sf);
+
+	return SR_OK;
+}
+
+/**
+ * Get the basic properties of an opened session file.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param samplerate Will be set to the samplerate, 0 if unknown. May be NULL.
+ * @param unitsize Will be set to the number of bytes per logic sample,
+ *                 0 if the file has no logic data. May be NULL.
+ * @param num_logic_samples Will be set to the number of logic samples.
+ *                          May be NULL.
+ * @param num_analog_channels Will be set to the number of analog
+ *                            channels with data. May be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_info_get(struct sr_session_file *sf,
+		uint64_t *samplerate, unsigned int *unitsize,
+		uint64_t *num_logic_samples, unsigned int *num_analog_channels)
+{
+	if (!sf)
+		return SR_ERR_ARG;
+
+	if (samplerate)
+		*samplerate = sf->samplerate;
+	if (unitsize)
+		*unitsize = sf->logic ? sf->logic->unitsize : 0;
+	if (num_logic_samples)
+		*num_logic_samples = sf->logic ? sf->logic->num_samples : 0;
+	if (num_analog_channels)
+		*num_analog_channels = sf->analog->len;
+
+	return SR_OK;
+}
+
+/**
+ * Get the number of samples of an analog channel in a session file.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param channel The analog channel, counting from 0 in file order.
+ * @param num_samples Will be set to the number of samples. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_analog_samples_get(struct sr_session_file *sf,
+		unsigned int channel, uint64_t *num_samples)
+{
+	struct sessionfile_stream *st;
+
+	if (!sf || !num_samples || channel >= sf->analog->len)
+		return SR_ERR_ARG;
+
+	st = g_ptr_array_index(sf->analog, channel);
+	*num_samples = st->num_samples;
+
+	return SR_OK;
+}
+
+/* Find the chunk holding a sample by bisecting the index. */
+static guint sessionfile_find_chunk(struct sessionfile_stream *st,
+		uint64_t sample)
+{
+	struct sessionfile_chunk *chunk;
+	guint lo, hi, mid;
+
+	lo = 0;
+	hi = st->chunks->len;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		chunk = &g_array_index(st->chunks, struct sessionfile_chunk, mid);
+		if (chunk->first_sample <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Make a chunk's data available in the stream's cache. */
+static int sessionfile_load_chunk(struct sr_session_file *sf,
+		struct sessionfile_stream *st, guint i)
+{
+	struct sessionfile_chunk *chunk;
+	struct zip_file *zf;
+	zip_int64_t len;
+
+	if (st->cached && st->cached_chunk == i)
+		return SR_OK;
+
+	chunk = &g_array_index(st->chunks, struct sessionfile_chunk, i);
+	if (st->cache_size < chunk->size) {
+		g_free(st->cache);
+		st->cache_size = 0;
+		if (!(st->cache = g_try_malloc(chunk->size)))
+			return SR_ERR_MALLOC;
+		st->cache_size = chunk->size;
+	}
+
+	st->cached = FALSE;
+	if (!(zf = zip_fopen_index(sf->archive, chunk->index, 0))) {
+		sr_err("Failed to open '%s' chunk %" PRIu64 ": %s", st->name,
+			chunk->chunk_num, zip_strerror(sf->archive));
+		return SR_ERR;
+	}
+	len = zip_fread(zf, st->cache, chunk->size);
+	if (len < 0 || (uint64_t)len != chunk->size) {
+		sr_err("Failed to read '%s' chunk %" PRIu64 ": %s", st->name,
+			chunk->chunk_num, zip_file_strerror(zf));
+		zip_fclose(zf);
+		return SR_ERR;
+	}
+	zip_fclose(zf);
+	st->cached = TRUE;
+	st->cached_chunk = i;
+
+	return SR_OK;
+}
+
+typedef void (*sessionfile_range_cb)(const uint8_t *data, uint64_t count,
+		void *cb_data);
+
+/*
+ * Hand the samples [start, start + count) of a stream to a callback,
+ * in pieces that each lie within one chunk.
+ */
+static int sessionfile_walk(struct sr_session_file *sf,
+		struct sessionfile_stream *st, uint64_t start, uint64_t count,
+		sessionfile_range_cb cb, void *cb_data)
+{
+	struct sessionfile_chunk *chunk;
+	uint64_t offset, n;
+	guint i;
+	int ret;
+
+	if (start > st->num_samples || count > st->num_samples - start)
+		return SR_ERR_ARG;
+
+	i = sessionfile_find_chunk(st, start);
+	while (count > 0) {
+		chunk = &g_array_index(st->chunks, struct sessionfile_chunk, i);
+		if ((ret = sessionfile_load_chunk(sf, st, i)) != SR_OK)
+			return ret;
+		offset = start - chunk->first_sample;
+		n = MIN(count, chunk->num_samples - offset);
+		cb(st->cache + offset * st->unitsize, n, cb_data);
+		start += n;
+		count -= n;
+		i++;
+	}
+
+	return SR_OK;
+}
+
+struct sessionfile_copy {
+	uint8_t *dst;
+	unsigned int unitsize;
+};
+
+static void sessionfile_copy_cb(const uint8_t *data, uint64_t count,
+		void *cb_data)
+{
+	struct sessionfile_copy *copy;
+
+	copy = cb_data;
+	memcpy(copy->dst, data, count * copy->unitsize);
+	copy->dst += count * copy->unitsize;
+}
+
+/**
+ * Read a range of logic samples from a session file.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param start The first sample to read.
+ * @param count The number of samples to read.
+ * @param buf Buffer for the samples, count times the unit size bytes
+ *            large. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the range extends beyond the
+ *                    end of the data.
+ * @retval SR_ERR Reading the file failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_read(struct sr_session_file *sf,
+		uint64_t start, uint64_t count, uint8_t *buf)
+{
+	struct sessionfile_copy copy;
+
+	if (!sf || !sf->logic || !buf)
+		return SR_ERR_ARG;
+
+	copy.dst = buf;
+	copy.unitsize = sf->logic->unitsize;
+
+	return sessionfile_walk(sf, sf->logic, start, count,
+			sessionfile_copy_cb, &copy);
+}
+
+/**
+ * Read a range of samples of one analog channel from a session file.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param channel The analog channel, counting from 0 in file order.
+ * @param start The first sample to read.
+ * @param count The number of samples to read.
+ * @param buf Buffer for count samples. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the range extends beyond the
+ *                    end of the data.
+ * @retval SR_ERR Reading the file failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_analog_read(struct sr_session_file *sf,
+		unsigned int channel, uint64_t start, uint64_t count, float *buf)
+{
+	struct sessionfile_copy copy;
+
+	if (!sf || !buf || channel >= sf->analog->len)
+		return SR_ERR_ARG;
+
+	copy.dst = (uint8_t *)buf;
+	copy.unitsize = sizeof(float);
+
+	return sessionfile_walk(sf, g_ptr_array_index(sf->analog, channel),
+			start, count, sessionfile_copy_cb, &copy);
+}
+
+struct sessionfile_logic_bin {
+	uint8_t *min;
+	uint8_t *max;
+	unsigned int unitsize;
+};
+
+static void sessionfile_logic_bin_cb(const uint8_t *data, uint64_t count,
+		void *cb_data)
+{
+	struct sessionfile_logic_bin *bin;
+	uint64_t i;
+	unsigned int j;
+
+	bin = cb_data;
+	for (i = 0; i < count; i++, data += bin->unitsize) {
+		for (j = 0; j < bin->unitsize; j++) {
+			bin->min[j] &= data[j];
+			bin->max[j] |= data[j];
+		}
+	}
+}
+
+/*
+ * Number of samples in bin i, or 0 if it's beyond the end. The last bin
+ * may be cut short.
+ */
+static uint64_t sessionfile_bin_samples(struct sessionfile_stream *st,
+		uint64_t start, uint64_t step, uint64_t i)
+{
+	uint64_t first;
+
+	if (i > (st->num_samples - start) / step)
+		return 0;
+	first = start + i * step;
+	if (first >= st->num_samples)
+		return 0;
+
+	return MIN(step, st->num_samples - first);
+}
+
+/**
+ * Read a decimated overview of the logic data in a session file.
+ *
+ * The samples starting at start are split into bins of step samples
+ * each. For every bin, min receives the bitwise AND and max the bitwise
+ * OR of all samples in it: a channel that is low in min and high in
+ * max toggled within the bin. The last bin may hold fewer samples if
+ * the data ends within it.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param start The first sample of the first bin.
+ * @param step The number of samples per bin. Must not be 0.
+ * @param num_bins The number of bins.
+ * @param min Buffer of num_bins times the unit size bytes. Must not be NULL.
+ * @param max Buffer of num_bins times the unit size bytes. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or a bin lies entirely beyond the
+ *                    end of the data.
+ * @retval SR_ERR Reading the file failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_decimate(struct sr_session_file *sf,
+		uint64_t start, uint64_t step, uint64_t num_bins,
+		uint8_t *min, uint8_t *max)
+{
+	struct sessionfile_logic_bin bin;
+	uint64_t i, n;
+	int ret;
+
+	if (!sf || !sf->logic || !step || !min || !max
+			|| start >= sf->logic->num_samples)
+		return SR_ERR_ARG;
+
+	bin.unitsize = sf->logic->unitsize;
+	for (i = 0; i < num_bins; i++) {
+		if (!(n = sessionfile_bin_samples(sf->logic, start, step, i)))
+			return SR_ERR_ARG;
+		bin.min = min + i * bin.unitsize;
+		bin.max = max + i * bin.unitsize;
+		memset(bin.min, 0xff, bin.unitsize);
+		memset(bin.max, 0x00, bin.unitsize);
+		ret = sessionfile_walk(sf, sf->logic, start + i * step, n,
+				sessionfile_logic_bin_cb, &bin);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+struct sessionfile_analog_bin {
+	float min;
+	float max;
+};
+
+static void sessionfile_analog_bin_cb(const uint8_t *data, uint64_t count,
+		void *cb_data)
+{
+	struct sessionfile_analog_bin *bin;
+	uint64_t i;
+	float v;
+
+	bin = cb_data;
+	for (i = 0; i < count; i++, data += sizeof(float)) {
+		memcpy(&v, data, sizeof(float));
+		if (v < bin->min)
+			bin->min = v;
+		if (v > bin->max)
+			bin->max = v;
+	}
+}
+
+/**
+ * Read a decimated overview of one analog channel in a session file.
+ *
+ * The samples starting at start are split into bins of step samples
+ * each, and the smallest and largest value of every bin are returned.
+ * The last bin may hold fewer samples if the data ends within it.
+ *
+ * @param sf The session file. Must not be NULL.
+ * @param channel The analog channel, counting from 0 in file order.
+ * @param start The first sample of the first bin.
+ * @param step The number of samples per bin. Must not be 0.
+ * @param num_bins The number of bins.
+ * @param min Buffer for num_bins minimum values. Must not be NULL.
+ * @param max Buffer for num_bins maximum values. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or a bin lies entirely beyond the
+ *                    end of the data.
+ * @retval SR_ERR Reading the file failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_analog_decimate(struct sr_session_file *sf,
+		unsigned int channel, uint64_t start, uint64_t step,
+		uint64_t num_bins, float *min, float *max)
+{
+	struct sessionfile_stream *st;
+	struct sessionfile_analog_bin bin;
+	uint64_t i, n;
+	int ret;
+
+	if (!sf || channel >= sf->analog->len || !step || !min || !max)
+		return SR_ERR_ARG;
+	st = g_ptr_array_index(sf->analog, channel);
+	if (start >= st->num_samples)
+		return SR_ERR_ARG;
+
+	for (i = 0; i < num_bins; i++) {
+		if (!(n = sessionfile_bin_samples(st, start, step, i)))
+			return SR_ERR_ARG;
+		bin.min = G_MAXFLOAT;
+		bin.max = -G_MAXFLOAT;
+		ret = sessionfile_walk(sf, st, start + i * step, n,
+				sessionfile_analog_bin_cb, &bin);
+		if (ret != SR_OK)
+			return ret;
+		min[i] = bin.min;
+		max[i] = bin.max;
+	}
+
+	return SR_OK;
+}
+
 /** @} */
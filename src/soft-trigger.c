@@ -19,6 +19,12 @@
 
 #include <config.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -26,16 +32,113 @@
 #define LOG_PREFIX "soft-trigger"
 /* @endcond */
 
+/* Number of mask kinds per compiled stage (zero, one and edges). */
+#define NUM_MASKS 5
+
+/* Size of the replicated per-lane masks, enough for one AVX2 vector. */
+#define LANE_BYTES 32
+
+/* Number of sample bytes evaluated per iteration of the vector scan. */
+#define SCAN_BLOCK 64
+
+static void compile_stage(struct soft_trigger_logic *stl,
+		const struct sr_trigger_stage *stage,
+		struct soft_trigger_stage *st)
+{
+	const struct sr_trigger_match *match;
+	uint8_t *bytes, *mask, *lanes;
+	uint64_t *words;
+	const GSList *l;
+	int index, kind, w, i, len;
+
+	st->has_matches = stage->matches != NULL;
+
+	/* Build the byte-wise masks first, then pack them into words. */
+	bytes = g_malloc0(NUM_MASKS * stl->unitsize);
+	for (l = stage->matches; l; l = l->next) {
+		match = l->data;
+		if (!match->channel->enabled)
+			/* Ignore disabled channels with a trigger. */
+			continue;
+		index = match->channel->index;
+		if (index / 8 >= stl->unitsize)
+			continue;
+		switch (match->match) {
+		case SR_TRIGGER_ZERO:
+			kind = 0;
+			break;
+		case SR_TRIGGER_ONE:
+			kind = 1;
+			break;
+		case SR_TRIGGER_RISING:
+			kind = 2;
+			break;
+		case SR_TRIGGER_FALLING:
+			kind = 3;
+			break;
+		case SR_TRIGGER_EDGE:
+			kind = 4;
+			break;
+		default:
+			sr_err("Unsupported trigger match %d on logic channel %s.",
+				match->match, match->channel->name);
+			continue;
+		}
+		bytes[kind * stl->unitsize + index / 8] |= 1 << (index % 8);
+	}
+
+	words = g_malloc0(NUM_MASKS * stl->num_words * sizeof(uint64_t));
+	for (kind = 0; kind < NUM_MASKS; kind++) {
+		mask = bytes + kind * stl->unitsize;
+		for (w = 0; w < stl->num_words; w++) {
+			len = MIN(8, stl->unitsize - 8 * w);
+			words[kind * stl->num_words + w] =
+				sr_load_word(mask + 8 * w, len);
+			if (kind >= 2 && words[kind * stl->num_words + w])
+				st->has_edges = TRUE;
+		}
+	}
+	st->zero = words;
+	st->one = words + stl->num_words;
+	st->rising = words + 2 * stl->num_words;
+	st->falling = words + 3 * stl->num_words;
+	st->edge = words + 4 * stl->num_words;
+
+	/*
+	 * For unit sizes which fit a SIMD/SWAR lane, replicate the masks
+	 * so that a whole vector of samples can be checked at once.
+	 */
+	if (stl->unitsize == 1 || stl->unitsize == 2 || stl->unitsize == 4) {
+		lanes = g_malloc(NUM_MASKS * LANE_BYTES);
+		for (kind = 0; kind < NUM_MASKS; kind++) {
+			mask = bytes + kind * stl->unitsize;
+			for (i = 0; i < LANE_BYTES; i += stl->unitsize)
+				memcpy(lanes + kind * LANE_BYTES + i, mask,
+					stl->unitsize);
+		}
+		st->lanes = lanes;
+	}
+
+	g_free(bytes);
+}
+
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples)
 {
 	struct soft_trigger_logic *stl;
+	const GSList *l;
+	int i;
 
 	stl = g_malloc0(sizeof(struct soft_trigger_logic));
 	stl->sdi = sdi;
 	stl->trigger = trigger;
 	stl->unitsize = (g_slist_length(sdi->channels) + 7) / 8;
+	stl->num_words = (stl->unitsize + 7) / 8;
+	stl->num_stages = g_slist_length(trigger->stages);
+	stl->stages = g_malloc0(stl->num_stages * sizeof(struct soft_trigger_stage));
+	for (l = trigger->stages, i = 0; l; l = l->next, i++)
+		compile_stage(stl, l->data, &stl->stages[i]);
 	stl->prev_sample = g_malloc0(stl->unitsize);
 	stl->pre_trigger_size = stl->unitsize * pre_trigger_samples;
 	stl->pre_trigger_buffer = g_malloc(stl->pre_trigger_size);
@@ -51,6 +154,13 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
+	int i;
+
+	for (i = 0; i < stl->num_stages; i++) {
+		g_free(stl->stages[i].zero);
+		g_free(stl->stages[i].lanes);
+	}
+	g_free(stl->stages);
 	g_free(stl->pre_trigger_buffer);
 	g_free(stl->prev_sample);
 	g_free(stl);
@@ -114,36 +224,209 @@ static void pre_trigger_send(struct soft_trigger_logic *stl,
 	}
 }
 
-static gboolean logic_check_match(struct soft_trigger_logic *stl,
-		uint8_t *sample, struct sr_trigger_match *match)
+/*
+ * Check a single sample against a compiled stage. Each term of the
+ * mismatch word has a bit set for every channel that fails its match:
+ *  - zero:    cur & zero
+ *  - one:     ~cur & one
+ *  - rising:  (prev | ~cur) & rising
+ *  - falling: (~prev | cur) & falling
+ *  - edge:    ~(prev ^ cur) & edge
+ * If there is no previous sample yet, edge matches cannot succeed.
+ */
+static gboolean sample_match(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *st, const uint8_t *cur,
+		const uint8_t *prev)
 {
-	int bit, prev_bit;
-	gboolean result;
-
-	stl->count++;
-	result = FALSE;
-	bit = *(sample + match->channel->index / 8)
-			& (1 << (match->channel->index % 8));
-	if (match->match == SR_TRIGGER_ZERO)
-		result = bit == 0;
-	else if (match->match == SR_TRIGGER_ONE)
-		result = bit != 0;
-	else {
-		/* Edge matches. */
-		if (stl->count == 1)
-			/* First sample, don't have enough for an edge match yet. */
+	uint64_t c, p, miss;
+	int w, len;
+
+	if (!prev && st->has_edges)
+		/* First sample, don't have enough for an edge match yet. */
+		return FALSE;
+
+	for (w = 0; w < stl->num_words; w++) {
+		len = MIN(8, stl->unitsize - 8 * w);
+		c = sr_load_word(cur + 8 * w, len);
+		miss = (c & st->zero[w]) | (~c & st->one[w]);
+		if (st->has_edges) {
+			p = sr_load_word(prev + 8 * w, len);
+			miss |= (p | ~c) & st->rising[w];
+			miss |= (~p | c) & st->falling[w];
+			miss |= ~(p ^ c) & st->edge[w];
+		}
+		if (miss)
 			return FALSE;
-		prev_bit = *(stl->prev_sample + match->channel->index / 8)
-				& (1 << (match->channel->index % 8));
-		if (match->match == SR_TRIGGER_RISING)
-			result = prev_bit == 0 && bit != 0;
-		else if (match->match == SR_TRIGGER_FALLING)
-			result = prev_bit != 0 && bit == 0;
-		else if (match->match == SR_TRIGGER_EDGE)
-			result = prev_bit != bit;
 	}
 
-	return result;
+	return TRUE;
+}
+
+#if defined(__AVX2__)
+static int scan_block(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *st, const uint8_t *buf)
+{
+	__m256i z, o, r, f, e, c, p, miss, zero;
+	uint64_t found;
+	int k;
+
+	z = _mm256_loadu_si256((const __m256i *)(st->lanes + 0 * LANE_BYTES));
+	o = _mm256_loadu_si256((const __m256i *)(st->lanes + 1 * LANE_BYTES));
+	r = _mm256_loadu_si256((const __m256i *)(st->lanes + 2 * LANE_BYTES));
+	f = _mm256_loadu_si256((const __m256i *)(st->lanes + 3 * LANE_BYTES));
+	e = _mm256_loadu_si256((const __m256i *)(st->lanes + 4 * LANE_BYTES));
+	zero = _mm256_setzero_si256();
+
+	found = 0;
+	for (k = 0; k < SCAN_BLOCK; k += 32) {
+		c = _mm256_loadu_si256((const __m256i *)(buf + k));
+		p = _mm256_loadu_si256((const __m256i *)(buf + k - stl->unitsize));
+		miss = _mm256_and_si256(c, z);
+		miss = _mm256_or_si256(miss, _mm256_andnot_si256(c, o));
+		miss = _mm256_or_si256(miss, _mm256_and_si256(p, r));
+		miss = _mm256_or_si256(miss, _mm256_andnot_si256(c, r));
+		miss = _mm256_or_si256(miss, _mm256_andnot_si256(p, f));
+		miss = _mm256_or_si256(miss, _mm256_and_si256(c, f));
+		miss = _mm256_or_si256(miss,
+			_mm256_andnot_si256(_mm256_xor_si256(p, c), e));
+		if (stl->unitsize == 1)
+			miss = _mm256_cmpeq_epi8(miss, zero);
+		else if (stl->unitsize == 2)
+			miss = _mm256_cmpeq_epi16(miss, zero);
+		else
+			miss = _mm256_cmpeq_epi32(miss, zero);
+		found |= (uint64_t)(uint32_t)_mm256_movemask_epi8(miss) << k;
+	}
+
+	return found ? sr_lowest_bit(found) / stl->unitsize : -1;
+}
+#elif defined(__SSE2__)
+static int scan_block(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *st, const uint8_t *buf)
+{
+	__m128i z, o, r, f, e, c, p, miss, zero;
+	uint64_t found;
+	int k;
+
+	z = _mm_loadu_si128((const __m128i *)(st->lanes + 0 * LANE_BYTES));
+	o = _mm_loadu_si128((const __m128i *)(st->lanes + 1 * LANE_BYTES));
+	r = _mm_loadu_si128((const __m128i *)(st->lanes + 2 * LANE_BYTES));
+	f = _mm_loadu_si128((const __m128i *)(st->lanes + 3 * LANE_BYTES));
+	e = _mm_loadu_si128((const __m128i *)(st->lanes + 4 * LANE_BYTES));
+	zero = _mm_setzero_si128();
+
+	found = 0;
+	for (k = 0; k < SCAN_BLOCK; k += 16) {
+		c = _mm_loadu_si128((const __m128i *)(buf + k));
+		p = _mm_loadu_si128((const __m128i *)(buf + k - stl->unitsize));
+		miss = _mm_and_si128(c, z);
+		miss = _mm_or_si128(miss, _mm_andnot_si128(c, o));
+		miss = _mm_or_si128(miss, _mm_and_si128(p, r));
+		miss = _mm_or_si128(miss, _mm_andnot_si128(c, r));
+		miss = _mm_or_si128(miss, _mm_andnot_si128(p, f));
+		miss = _mm_or_si128(miss, _mm_and_si128(c, f));
+		miss = _mm_or_si128(miss,
+			_mm_andnot_si128(_mm_xor_si128(p, c), e));
+		if (stl->unitsize == 1)
+			miss = _mm_cmpeq_epi8(miss, zero);
+		else if (stl->unitsize == 2)
+			miss = _mm_cmpeq_epi16(miss, zero);
+		else
+			miss = _mm_cmpeq_epi32(miss, zero);
+		found |= (uint64_t)(uint16_t)_mm_movemask_epi8(miss) << k;
+	}
+
+	return found ? sr_lowest_bit(found) / stl->unitsize : -1;
+}
+#else
+/*
+ * Portable SWAR variant: 8 bytes per word, one lane per sample. A lane
+ * is flagged (top bit set) in the result if and only if it is zero.
+ */
+static inline uint64_t zero_lanes(uint64_t x, int unitsize)
+{
+	uint64_t low;
+
+	if (unitsize == 1)
+		low = 0x7f7f7f7f7f7f7f7fULL;
+	else if (unitsize == 2)
+		low = 0x7fff7fff7fff7fffULL;
+	else
+		low = 0x7fffffff7fffffffULL;
+
+	return ~(((x & low) + low) | x | low);
+}
+
+static int scan_block(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *st, const uint8_t *buf)
+{
+	uint64_t z, o, r, f, e, c, p, miss, found;
+	int k, bit;
+
+	z = sr_load_word(st->lanes + 0 * LANE_BYTES, 8);
+	o = sr_load_word(st->lanes + 1 * LANE_BYTES, 8);
+	r = sr_load_word(st->lanes + 2 * LANE_BYTES, 8);
+	f = sr_load_word(st->lanes + 3 * LANE_BYTES, 8);
+	e = sr_load_word(st->lanes + 4 * LANE_BYTES, 8);
+
+	for (k = 0; k < SCAN_BLOCK; k += 8) {
+		c = sr_load_word(buf + k, 8);
+		p = sr_load_word(buf + k - stl->unitsize, 8);
+		miss = (c & z) | (~c & o);
+		miss |= (p | ~c) & r;
+		miss |= (~p | c) & f;
+		miss |= ~(p ^ c) & e;
+		found = zero_lanes(miss, stl->unitsize);
+		if (!found)
+			continue;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+		bit = sr_lowest_bit(found);
+#else
+		/* The first sample in memory is in the most significant lane. */
+		bit = __builtin_clzll(found);
+#endif
+		return (k + bit / 8) / stl->unitsize;
+	}
+
+	return -1;
+}
+#endif
+
+/*
+ * Returns the index of the first sample in [start, num) which matches
+ * the given stage, or num if there is none.
+ */
+static int stage_scan(struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *st, const uint8_t *buf,
+		int start, int num)
+{
+	int i, block, ret;
+
+	i = start;
+	if (i == 0 && num > 0) {
+		if (sample_match(stl, st, buf,
+				stl->have_prev ? stl->prev_sample : NULL))
+			return 0;
+		i = 1;
+	}
+
+	if (st->lanes) {
+		/* Vector scan; sample i - 1 is always in buf here. */
+		block = SCAN_BLOCK / stl->unitsize;
+		for (; i + block <= num; i += block) {
+			ret = scan_block(stl, st, buf + i * stl->unitsize);
+			if (ret >= 0)
+				return i + ret;
+		}
+	}
+
+	for (; i < num; i++) {
+		if (sample_match(stl, st, buf + i * stl->unitsize,
+				buf + (i - 1) * stl->unitsize))
+			return i;
+	}
+
+	return num;
 }
 
 /* Returns the offset (in samples) within buf of where the trigger
@@ -152,67 +435,74 @@ SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		uint8_t *buf, int len, int *pre_trigger_samples)
 {
 	struct sr_datafeed_packet packet;
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *l_stage;
-	int offset;
-	int i;
-	gboolean match_found;
+	struct soft_trigger_stage *st;
+	const uint8_t *prev;
+	int offset, num, i;
+
+	if (stl->num_stages == 0)
+		/* No stages supplied, client error. */
+		return SR_ERR_ARG;
 
 	offset = -1;
-	for (i = 0; i < len; i += stl->unitsize) {
-		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
-		stage = l_stage->data;
-		if (!stage->matches)
+	num = len / stl->unitsize;
+	i = 0;
+	while (i < num) {
+		st = &stl->stages[stl->cur_stage];
+		if (!st->has_matches)
 			/* No matches supplied, client error. */
 			return SR_ERR_ARG;
 
-		match_found = TRUE;
-		for (l = stage->matches; l; l = l->next) {
-			match = l->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			if (!logic_check_match(stl, buf + i, match)) {
-				match_found = FALSE;
+		if (stl->cur_stage == 0) {
+			/* Fast scan for the first stage. */
+			i = stage_scan(stl, st, buf, i, num);
+			if (i >= num)
 				break;
+		} else {
+			if (i > 0)
+				prev = buf + (i - 1) * stl->unitsize;
+			else
+				prev = stl->have_prev ? stl->prev_sample : NULL;
+			if (!sample_match(stl, st, buf + i * stl->unitsize, prev)) {
+				/*
+				 * We had a match at an earlier stage, but failed
+				 * on the current stage. However, we may have a
+				 * match on this stage in the next bit -- trigger
+				 * on 0001 will fail on seeing 00001, so we need to
+				 * go back to stage 0 -- but at the next sample
+				 * from the one that matched originally.
+				 */
+				i = MAX(i - stl->cur_stage + 1, 0);
+				/* Reset trigger stage. */
+				stl->cur_stage = 0;
+				continue;
 			}
 		}
-		memcpy(stl->prev_sample, buf + i, stl->unitsize);
-		if (match_found) {
-			/* Matched on the current stage. */
-			if (l_stage->next) {
-				/* Advance to next stage. */
-				stl->cur_stage++;
-			} else {
-				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
-				pre_trigger_send(stl, pre_trigger_samples);
-
-				/* Fire trigger. */
-				offset = i / stl->unitsize;
-
-				packet.type = SR_DF_TRIGGER;
-				packet.payload = NULL;
-				sr_session_send(stl->sdi, &packet);
-				break;
-			}
-		} else if (stl->cur_stage > 0) {
-			/*
-			 * We had a match at an earlier stage, but failed on the
-			 * current stage. However, we may have a match on this
-			 * stage in the next bit -- trigger on 0001 will fail on
-			 * seeing 00001, so we need to go back to stage 0 -- but
-			 * at the next sample from the one that matched originally,
-			 * which the counter increment at the end of the loop
-			 * takes care of.
-			 */
-			i -= stl->cur_stage * stl->unitsize;
-			if (i < -1)
-				i = -1; /* Oops, went back past this buffer. */
-			/* Reset trigger stage. */
-			stl->cur_stage = 0;
+
+		/* Matched on the current stage. */
+		if (stl->cur_stage + 1 < stl->num_stages) {
+			/* Advance to next stage. */
+			stl->cur_stage++;
+			i++;
+			continue;
 		}
+
+		/* Matched on last stage, send pre-trigger data. */
+		pre_trigger_append(stl, buf, i * stl->unitsize);
+		pre_trigger_send(stl, pre_trigger_samples);
+
+		/* Fire trigger. */
+		offset = i;
+
+		packet.type = SR_DF_TRIGGER;
+		packet.payload = NULL;
+		sr_session_send(stl->sdi, &packet);
+		break;
+	}
+
+	if (num > 0) {
+		memcpy(stl->prev_sample, buf + (num - 1) * stl->unitsize,
+			stl->unitsize);
+		stl->have_prev = TRUE;
 	}
 
 	if (offset == -1)
@@ -0,0 +1,247 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ *
+ * Bit-matrix transposes.
+ *
+ * Many logic analyzers send their samples as bit-planes: a run of samples
+ * of one channel, followed by a run of samples of the next channel, and
+ * so on. Turning these into per-sample words is a bit-matrix transpose.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__) && !defined(WORDS_BIGENDIAN)
+#include <immintrin.h>
+#endif
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "transpose"
+/** @endcond */
+
+/**
+ * Transpose an 8x8 bit matrix.
+ *
+ * Row r of the matrix is byte r of the value (bits 8r to 8r+7), column c
+ * is bit c of every byte.
+ *
+ * @param m The matrix to transpose.
+ *
+ * @return The transposed matrix: bit c of byte r becomes bit r of byte c.
+ */
+SR_PRIV uint64_t sr_transpose_8x8(uint64_t m)
+{
+	uint64_t t;
+
+	t = (m ^ (m >> 7)) & 0x00aa00aa00aa00aaULL;
+	m ^= t ^ (t << 7);
+	t = (m ^ (m >> 14)) & 0x0000cccc0000ccccULL;
+	m ^= t ^ (t << 14);
+	t = (m ^ (m >> 28)) & 0x00000000f0f0f0f0ULL;
+	m ^= t ^ (t << 28);
+
+	return m;
+}
+
+/**
+ * Transpose a 16x16 bit matrix in place.
+ *
+ * @param m The matrix, 16 rows of 16 bits. Bit c of m[r] becomes
+ *          bit r of m[c].
+ */
+SR_PRIV void sr_transpose_16x16(uint16_t *m)
+{
+	unsigned int j, k;
+	uint16_t mask, t;
+
+	/* Swap the off-diagonal blocks of ever smaller block sizes. */
+	for (j = 8, mask = 0x00ff; j; j >>= 1, mask ^= mask << j) {
+		for (k = 0; k < 16; k = (k + j + 1) & ~j) {
+			t = ((m[k] >> j) ^ m[k + j]) & mask;
+			m[k] ^= t << j;
+			m[k + j] ^= t;
+		}
+	}
+}
+
+/**
+ * Transpose a 64x64 bit matrix in place.
+ *
+ * @param m The matrix, 64 rows of 64 bits. Bit c of m[r] becomes
+ *          bit r of m[c].
+ */
+SR_PRIV void sr_transpose_64x64(uint64_t *m)
+{
+	unsigned int j, k;
+	uint64_t mask, t;
+
+	j = 32;
+	mask = 0x00000000ffffffffULL;
+
+#if defined(__AVX2__) && !defined(WORDS_BIGENDIAN)
+	/* Four rows at a time while the rows to swap are 4 or more apart. */
+	for (; j >= 4; j >>= 1, mask ^= mask << j) {
+		__m256i vmask = _mm256_set1_epi64x(mask);
+		__m128i shift = _mm_cvtsi32_si128(j);
+		for (k = 0; k < 64; k = (k + j + 4) & ~j) {
+			__m256i a = _mm256_loadu_si256((const __m256i *)&m[k]);
+			__m256i b = _mm256_loadu_si256((const __m256i *)&m[k + j]);
+			__m256i x = _mm256_and_si256(_mm256_xor_si256(
+				_mm256_srl_epi64(a, shift), b), vmask);
+			_mm256_storeu_si256((__m256i *)&m[k],
+				_mm256_xor_si256(a, _mm256_sll_epi64(x, shift)));
+			_mm256_storeu_si256((__m256i *)&m[k + j],
+				_mm256_xor_si256(b, x));
+		}
+	}
+#elif defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+	/* Two rows at a time while the rows to swap are 2 or more apart. */
+	for (; j >= 2; j >>= 1, mask ^= mask << j) {
+		__m128i vmask = _mm_set1_epi64x(mask);
+		__m128i shift = _mm_cvtsi32_si128(j);
+		for (k = 0; k < 64; k = (k + j + 2) & ~j) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&m[k]);
+			__m128i b = _mm_loadu_si128((const __m128i *)&m[k + j]);
+			__m128i x = _mm_and_si128(_mm_xor_si128(
+				_mm_srl_epi64(a, shift), b), vmask);
+			_mm_storeu_si128((__m128i *)&m[k],
+				_mm_xor_si128(a, _mm_sll_epi64(x, shift)));
+			_mm_storeu_si128((__m128i *)&m[k + j],
+				_mm_xor_si128(b, x));
+		}
+	}
+#endif
+
+	for (; j; j >>= 1, mask ^= mask << j) {
+		for (k = 0; k < 64; k = (k + j + 1) & ~j) {
+			t = ((m[k] >> j) ^ m[k + j]) & mask;
+			m[k] ^= t << j;
+			m[k + j] ^= t;
+		}
+	}
+}
+
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+
+/*
+ * Transpose the 16x8 byte matrix of the planes, so that vector s holds
+ * byte s of all 16 planes.
+ */
+static inline void transpose_plane_bytes(const uint64_t *planes,
+		__m128i *v)
+{
+	__m128i a[8], b[8], c[8];
+	unsigned int i;
+
+	for (i = 0; i < 8; i++)
+		a[i] = _mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)&planes[2 * i]),
+			_mm_loadl_epi64((const __m128i *)&planes[2 * i + 1]));
+	for (i = 0; i < 4; i++) {
+		b[i] = _mm_unpacklo_epi16(a[2 * i], a[2 * i + 1]);
+		b[i + 4] = _mm_unpackhi_epi16(a[2 * i], a[2 * i + 1]);
+	}
+	for (i = 0; i < 2; i++) {
+		c[2 * i] = _mm_unpacklo_epi32(b[4 * i], b[4 * i + 1]);
+		c[2 * i + 1] = _mm_unpackhi_epi32(b[4 * i], b[4 * i + 1]);
+		c[2 * i + 4] = _mm_unpacklo_epi32(b[4 * i + 2], b[4 * i + 3]);
+		c[2 * i + 5] = _mm_unpackhi_epi32(b[4 * i + 2], b[4 * i + 3]);
+	}
+	for (i = 0; i < 4; i++) {
+		v[2 * i] = _mm_unpacklo_epi64(c[i], c[i + 4]);
+		v[2 * i + 1] = _mm_unpackhi_epi64(c[i], c[i + 4]);
+	}
+}
+
+#endif
+
+/**
+ * Turn 16 bit-planes into samples of 16 bits.
+ *
+ * Byte s of every plane (bits 8s to 8s+7 of its value) holds samples 8s
+ * to 8s+7 of one channel, in ascending bit order or, with msb_first,
+ * starting at the most significant bit. Channels which are not present
+ * must have all-zero planes.
+ *
+ * @param planes The 16 planes, one per channel (output bit).
+ * @param samples Where to store num_samples samples, in host byte order.
+ * @param num_samples The number of samples, a multiple of 8 up to 64.
+ * @param msb_first Whether the first sample of each byte is its MSB.
+ */
+SR_PRIV void sr_transpose_planes16(const uint64_t *planes, uint16_t *samples,
+		unsigned int num_samples, gboolean msb_first)
+{
+	unsigned int s, b, r;
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+	__m128i v[8];
+
+	transpose_plane_bytes(planes, v);
+	s = 0;
+#if defined(__AVX2__)
+	/* Two bytes at a time: one movemask yields two samples. */
+	for (; 8 * s + 16 <= num_samples; s += 2) {
+		__m256i x = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(v[s]), v[s + 1], 1);
+		for (b = 0; b < 8; b++) {
+			uint32_t m = _mm256_movemask_epi8(x);
+			r = msb_first ? b : 7 - b;
+			samples[8 * s + r] = m;
+			samples[8 * s + 8 + r] = m >> 16;
+			x = _mm256_slli_epi64(x, 1);
+		}
+	}
+#endif
+	/* The movemask picks bit 7 of every byte, i.e. of every channel. */
+	for (; 8 * s < num_samples; s++) {
+		__m128i x = v[s];
+		for (b = 0; b < 8; b++) {
+			r = msb_first ? b : 7 - b;
+			samples[8 * s + r] = _mm_movemask_epi8(x);
+			x = _mm_slli_epi64(x, 1);
+		}
+	}
+#else
+	unsigned int g;
+	uint64_t m;
+
+	memset(samples, 0, num_samples * sizeof(uint16_t));
+	for (g = 0; g < 2; g++) {
+		for (s = 0; 8 * s < num_samples; s++) {
+			/* Byte s of eight planes, as the rows of a matrix. */
+			m = 0;
+			for (r = 0; r < 8; r++)
+				m |= ((planes[8 * g + r] >> (8 * s)) & 0xff) << (8 * r);
+			m = sr_transpose_8x8(m);
+			for (b = 0; b < 8; b++) {
+				r = msb_first ? 7 - b : b;
+				samples[8 * s + r] |= ((m >> (8 * b)) & 0xff) << (8 * g);
+			}
+		}
+	}
+#endif
+}
@@ -60,7 +60,7 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 	int64_t now_us, usb_due_us;
 	struct usb_source *usource;
 	struct timeval usb_timeout;
-	int remaining_ms;
+	int remaining_ms, trace_ms;
 	int ret;
 
 	usource = (struct usb_source *)source;
@@ -82,6 +82,13 @@ static gboolean usb_source_prepare(GSource *source, int *timeout)
 		if (usb_due_us < usource->due_us)
 			usource->due_us = usb_due_us;
 	}
+	/* Transfers replayed from a USB trace complete without any I/O. */
+	trace_ms = sr_usb_trace_timeout();
+	if (trace_ms >= 0) {
+		usb_due_us = now_us + 1000 * (int64_t)trace_ms;
+		if (usb_due_us < usource->due_us)
+			usource->due_us = usb_due_us;
+	}
 	if (usource->due_us != INT64_MAX)
 		remaining_ms = (MAX(0, usource->due_us - now_us) + 999) / 1000;
 	else
@@ -0,0 +1,694 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Streaming of sample data from a bulk IN endpoint.
+ *
+ * A stream keeps a pool of bulk transfers in flight, hands the data of
+ * every completed transfer to the driver and resubmits the transfer. It
+ * starts with transfers holding transfer_ms worth of data, and enough of
+ * them for total_ms. While running, it looks at one round of completions
+ * at a time:
+ *
+ *  - When transfers were reaped so late that the device had used up half
+ *    of the pool meanwhile, the host fell behind and the device came close
+ *    to an overrun. More transfers are added.
+ *  - When the driver callbacks took more than half of the time the device
+ *    needed to fill the transfers, the transfers are made larger, which
+ *    saves per-transfer overhead.
+ *  - When transfers were reaped in time for a few rounds in a row and the
+ *    callbacks took little time, the transfers are made smaller again, and
+ *    then fewer.
+ *
+ * The numbers collected along the way are logged when the stream ends.
+ *
+ * When the session asks for it, the transfers are handled on a thread of
+ * its own, which holds the libusb event lock while the stream runs. The
+ * pool then has as many spare transfers as it has transfers in flight.
+ * On every completion, the thread submits a spare transfer right away
+ * and queues the completed one for the session thread, which passes the
+ * data to the driver and hands the transfer back as a spare. Both queues
+ * are rings without locks, so neither side waits for the other, and the
+ * session thread may fall behind by a whole pool before the device
+ * notices.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libusb.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "usb-stream"
+
+/* How often the USB thread looks whether it should end. */
+#define USB_THREAD_POLL_US 10000
+
+struct usb_stream_slot {
+	struct sr_usb_stream *stream;
+	struct libusb_transfer *transfer;
+	/* The size of the buffer, which may be larger than the transfer. */
+	size_t capacity;
+	int64_t submit_us;
+	/* Set by the USB thread: when this completed, and how long it took
+	 * to submit a spare transfer, or -1 if there was none. */
+	int64_t complete_us;
+	int64_t resubmit_us;
+};
+
+/*
+ * The USB thread of a stream. This is also the event source through
+ * which the session thread picks up completed transfers.
+ */
+struct usb_stream_thread {
+	GSource base;
+	GThread *thread;
+	/* Cleared when the stream ends, which may free it. */
+	struct sr_usb_stream *stream;
+	struct sr_session *session;
+	libusb_context *libusb_ctx;
+	GMainContext *main_context;
+	/* Completed transfers, for the session thread. */
+	struct sr_usb_stream_ring done;
+	/* Transfers for the USB thread to submit on the next completion. */
+	struct sr_usb_stream_ring spare;
+	/* Shared by both threads, only accessed atomically. */
+	int in_flight;
+	int aborted;
+	int stop;
+	int missed;
+};
+
+/* The slots to keep: the transfers in flight, and as many spares. */
+static unsigned int pool_slots(const struct sr_usb_stream *stream)
+{
+	return stream->threaded ? 2 * stream->target : stream->target;
+}
+
+static unsigned int in_flight(const struct sr_usb_stream *stream)
+{
+	if (!stream->thread)
+		return stream->submitted;
+
+	return g_atomic_int_get(&stream->thread->in_flight);
+}
+
+static void log_stats(const struct sr_usb_stream *stream)
+{
+	const struct sr_usb_stream_stats *stats;
+	uint64_t n, all;
+
+	stats = &stream->stats;
+	n = MAX(stats->transfers, 1);
+	all = MAX(stats->transfers + stats->empty_transfers, 1);
+
+	sr_info("%" PRIu64 " transfers with %" PRIu64 " bytes, %" PRIu64
+		" empty, %" PRIu64 " with the pool run dry, up to %" PRIu64
+		" us late.", stats->transfers, stats->bytes,
+		stats->empty_transfers, stats->starved, stats->max_backlog_us);
+	sr_info("Up to %u transfers in flight, %u of %zu bytes at the end "
+		"(%u times more, %u times less).", stats->max_in_flight,
+		stream->target, stream->size, stats->grown, stats->shrunk);
+	sr_info("Callback %" PRIu64 "/%" PRIu64 " us, resubmit %" PRIu64
+		"/%" PRIu64 " us, completion %" PRIu64 "/%" PRIu64
+		" us (average/max).",
+		stats->callback_us / n, stats->max_callback_us,
+		stats->resubmit_us / all, stats->max_resubmit_us,
+		stats->latency_us / all, stats->max_latency_us);
+	if (stream->threaded)
+		sr_info("USB thread: up to %u transfers waiting for the "
+			"session, %" PRIu64 " completions without a spare.",
+			stats->max_queued, stats->missed_resubmits);
+}
+
+static void thread_stop(struct sr_usb_stream *stream);
+
+static void free_slot(struct usb_stream_slot *slot)
+{
+	struct sr_usb_stream *stream;
+
+	stream = slot->stream;
+
+	g_free(slot->transfer->buffer);
+	slot->transfer->buffer = NULL;
+	libusb_free_transfer(slot->transfer);
+	slot->transfer = NULL;
+
+	/* The stream may be freed by the callback. */
+	if (--stream->submitted == 0) {
+		if (stream->thread)
+			thread_stop(stream);
+		log_stats(stream);
+		stream->finished(stream->cb_data);
+	}
+}
+
+/*
+ * Submit a transfer. With a USB thread, only if too few are in flight,
+ * otherwise it becomes a spare for the thread to submit.
+ */
+static int submit_slot(struct usb_stream_slot *slot)
+{
+	struct sr_usb_stream *stream;
+	struct usb_stream_thread *thread;
+	int ret;
+
+	stream = slot->stream;
+	thread = stream->thread;
+
+	if (thread && in_flight(stream) >= stream->target) {
+		sr_usb_stream_ring_push(&thread->spare, slot);
+		return LIBUSB_SUCCESS;
+	}
+
+	if (thread)
+		g_atomic_int_inc(&thread->in_flight);
+	slot->submit_us = g_get_monotonic_time();
+	if ((ret = libusb_submit_transfer(slot->transfer)) != LIBUSB_SUCCESS) {
+		if (thread)
+			g_atomic_int_add(&thread->in_flight, -1);
+		return ret;
+	}
+	stream->stats.max_in_flight = MAX(stream->stats.max_in_flight,
+		in_flight(stream));
+
+	return LIBUSB_SUCCESS;
+}
+
+static void resubmit(struct usb_stream_slot *slot, int64_t completed_us)
+{
+	struct sr_usb_stream *stream;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	int64_t now_us;
+	int ret;
+
+	stream = slot->stream;
+	transfer = slot->transfer;
+
+	/* Take up the current size. */
+	if (stream->size > slot->capacity
+			&& (buf = g_try_realloc(transfer->buffer, stream->size))) {
+		transfer->buffer = buf;
+		slot->capacity = stream->size;
+	}
+	transfer->length = MIN(stream->size, slot->capacity);
+	transfer->timeout = stream->timeout;
+
+	if ((ret = submit_slot(slot)) != LIBUSB_SUCCESS) {
+		sr_err("%s: %s", __func__, libusb_error_name(ret));
+		free_slot(slot);
+		return;
+	}
+
+	/* The USB thread measures this itself. */
+	if (stream->thread)
+		return;
+	now_us = g_get_monotonic_time();
+	stream->stats.resubmit_us += now_us - completed_us;
+	stream->stats.max_resubmit_us = MAX(stream->stats.max_resubmit_us,
+		(uint64_t)(now_us - completed_us));
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer);
+static void LIBUSB_CALL thread_receive_transfer(
+		struct libusb_transfer *transfer);
+
+static int submit_new(struct sr_usb_stream *stream)
+{
+	struct usb_stream_slot *slot;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; stream->slots[i].transfer; i++)
+		;
+	slot = &stream->slots[i];
+
+	if (!(buf = g_try_malloc(stream->size))) {
+		sr_err("USB transfer buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	transfer = libusb_alloc_transfer(0);
+	libusb_fill_bulk_transfer(transfer, stream->usb->devhdl,
+			stream->config.endpoint, buf, stream->size,
+			stream->thread ? thread_receive_transfer : receive_transfer,
+			slot, stream->timeout);
+	slot->transfer = transfer;
+	slot->capacity = stream->size;
+	sr_dbg("Submitting transfer %u.", i);
+	if ((ret = submit_slot(slot)) != LIBUSB_SUCCESS) {
+		sr_err("Failed to submit transfer: %s.",
+		       libusb_error_name(ret));
+		slot->transfer = NULL;
+		libusb_free_transfer(transfer);
+		g_free(buf);
+		return SR_ERR;
+	}
+	stream->submitted++;
+
+	return SR_OK;
+}
+
+/* Pass the data of a completed transfer on, and keep the pool going. */
+static void handle_transfer(struct usb_stream_slot *slot, int64_t completed_us)
+{
+	struct libusb_transfer *transfer;
+	struct sr_usb_stream *stream;
+	gboolean packet_has_error, keep;
+	int64_t start_us, callback_us, backlog_us;
+
+	transfer = slot->transfer;
+	stream = slot->stream;
+
+	/*
+	 * If acquisition has already ended, just free any queued up
+	 * transfer that come in.
+	 */
+	if (stream->aborted) {
+		free_slot(slot);
+		return;
+	}
+
+	sr_dbg("receive_transfer(): status %s received %d bytes.",
+		libusb_error_name(transfer->status), transfer->actual_length);
+
+	stream->stats.latency_us += completed_us - slot->submit_us;
+	stream->stats.max_latency_us = MAX(stream->stats.max_latency_us,
+		(uint64_t)(completed_us - slot->submit_us));
+	if (stream->thread && slot->resubmit_us >= 0) {
+		stream->stats.resubmit_us += slot->resubmit_us;
+		stream->stats.max_resubmit_us = MAX(
+			stream->stats.max_resubmit_us, (uint64_t)slot->resubmit_us);
+	}
+
+	packet_has_error = FALSE;
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		sr_usb_stream_abort(stream);
+		free_slot(slot);
+		return;
+	case LIBUSB_TRANSFER_COMPLETED:
+	case LIBUSB_TRANSFER_TIMED_OUT: /* We may have received some data though. */
+		break;
+	default:
+		packet_has_error = TRUE;
+		break;
+	}
+
+	if (transfer->actual_length == 0 || packet_has_error) {
+		stream->stats.empty_transfers++;
+		if (++stream->empty_count > stream->config.max_empty_transfers) {
+			/*
+			 * The device gave up. End the acquisition, the frontend
+			 * will work out that the samplecount is short.
+			 */
+			sr_usb_stream_abort(stream);
+			free_slot(slot);
+		} else {
+			resubmit(slot, completed_us);
+		}
+		return;
+	}
+	stream->empty_count = 0;
+
+	/* Later than the rest of the pool lasts means an overrun. */
+	backlog_us = sr_usb_stream_update_backlog(stream, completed_us,
+		transfer->actual_length);
+	stream->stats.max_backlog_us = MAX(stream->stats.max_backlog_us,
+		(uint64_t)backlog_us);
+	if (backlog_us >= sr_usb_stream_fill_time(stream,
+			(uint64_t)(stream->target - 1) * stream->size))
+		stream->stats.starved++;
+	stream->stats.transfers++;
+	stream->stats.bytes += transfer->actual_length;
+
+	start_us = g_get_monotonic_time();
+	keep = stream->receive(transfer->buffer, transfer->actual_length,
+		stream->cb_data);
+
+	callback_us = g_get_monotonic_time() - start_us;
+	stream->stats.callback_us += callback_us;
+	stream->stats.max_callback_us = MAX(stream->stats.max_callback_us,
+		(uint64_t)callback_us);
+
+	if (!keep || stream->aborted) {
+		sr_usb_stream_abort(stream);
+		free_slot(slot);
+		return;
+	}
+
+	/*
+	 * With a USB thread, the spares run out when the session thread
+	 * falls behind, so the time the data waited for it counts as well.
+	 */
+	if (stream->thread)
+		backlog_us = MAX(backlog_us, start_us - completed_us);
+	sr_usb_stream_adapt(stream, backlog_us, callback_us,
+		transfer->actual_length);
+
+	/* Retire transfers the pool does not need anymore. */
+	if (stream->submitted > pool_slots(stream)) {
+		free_slot(slot);
+		return;
+	}
+	resubmit(slot, completed_us);
+	while (!stream->aborted && stream->submitted < pool_slots(stream))
+		if (submit_new(stream) != SR_OK)
+			break;
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	handle_transfer(transfer->user_data, g_get_monotonic_time());
+}
+
+/* Queue a transfer for the session thread. Called on the USB thread. */
+static void thread_done(struct usb_stream_thread *thread,
+		struct usb_stream_slot *slot)
+{
+	sr_usb_stream_ring_push(&thread->done, slot);
+	g_main_context_wakeup(thread->main_context);
+}
+
+/* Called on the USB thread. */
+static gboolean thread_submit(struct usb_stream_thread *thread,
+		struct usb_stream_slot *slot)
+{
+	struct libusb_transfer *transfer;
+	int ret;
+
+	transfer = slot->transfer;
+
+	g_atomic_int_inc(&thread->in_flight);
+	slot->submit_us = g_get_monotonic_time();
+	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS) {
+		g_atomic_int_add(&thread->in_flight, -1);
+		/* The session thread tries again, and ends the stream if
+		 * that fails as well. */
+		transfer->status = LIBUSB_TRANSFER_ERROR;
+		transfer->actual_length = 0;
+		slot->complete_us = slot->submit_us;
+		slot->resubmit_us = -1;
+		thread_done(thread, slot);
+		return FALSE;
+	}
+	/* The stream may have been aborted in the meantime. */
+	if (g_atomic_int_get(&thread->aborted))
+		libusb_cancel_transfer(transfer);
+
+	return TRUE;
+}
+
+static void LIBUSB_CALL thread_receive_transfer(
+		struct libusb_transfer *transfer)
+{
+	struct usb_stream_slot *slot, *spare;
+	struct usb_stream_thread *thread;
+
+	slot = transfer->user_data;
+	thread = slot->stream->thread;
+
+	slot->complete_us = g_get_monotonic_time();
+	slot->resubmit_us = -1;
+	g_atomic_int_add(&thread->in_flight, -1);
+
+	/* Keep the device busy first, the data can wait. */
+	if (transfer->status != LIBUSB_TRANSFER_CANCELLED
+			&& transfer->status != LIBUSB_TRANSFER_NO_DEVICE
+			&& !g_atomic_int_get(&thread->aborted)) {
+		if (!sr_usb_stream_ring_pop(&thread->spare, &spare))
+			g_atomic_int_inc(&thread->missed);
+		else if (thread_submit(thread, spare))
+			slot->resubmit_us = spare->submit_us - slot->complete_us;
+	}
+
+	thread_done(thread, slot);
+}
+
+static gpointer usb_thread(gpointer data)
+{
+	struct usb_stream_thread *thread;
+	struct usb_stream_slot *slot;
+	struct timeval tv;
+
+	thread = data;
+
+	while (!g_atomic_int_get(&thread->stop)) {
+		/* Holding the lock keeps the session thread out. */
+		libusb_lock_events(thread->libusb_ctx);
+		while (!g_atomic_int_get(&thread->stop)
+				&& libusb_event_handling_ok(thread->libusb_ctx)) {
+			tv.tv_sec = 0;
+			tv.tv_usec = USB_THREAD_POLL_US;
+			libusb_handle_events_locked(thread->libusb_ctx, &tv);
+			/* Once the stream ends, the spares go back. */
+			if (g_atomic_int_get(&thread->aborted))
+				while (sr_usb_stream_ring_pop(&thread->spare,
+						&slot))
+					thread_done(thread, slot);
+		}
+		libusb_unlock_events(thread->libusb_ctx);
+	}
+
+	return NULL;
+}
+
+static gboolean thread_source_prepare(GSource *source, int *timeout)
+{
+	struct usb_stream_thread *thread;
+
+	thread = (struct usb_stream_thread *)source;
+	*timeout = -1;
+
+	return sr_usb_stream_ring_depth(&thread->done) > 0;
+}
+
+static gboolean thread_source_check(GSource *source)
+{
+	struct usb_stream_thread *thread;
+
+	thread = (struct usb_stream_thread *)source;
+
+	return sr_usb_stream_ring_depth(&thread->done) > 0;
+}
+
+static gboolean thread_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	struct usb_stream_thread *thread;
+	struct usb_stream_slot *slot;
+	struct sr_usb_stream *stream;
+
+	(void)callback;
+	(void)user_data;
+
+	thread = (struct usb_stream_thread *)source;
+	if ((stream = thread->stream))
+		stream->stats.max_queued = MAX(stream->stats.max_queued,
+			sr_usb_stream_ring_depth(&thread->done));
+
+	/* The stream ends with its last transfer, and may be freed. */
+	while (thread->stream && sr_usb_stream_ring_pop(&thread->done, &slot))
+		handle_transfer(slot, slot->complete_us);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void thread_source_finalize(GSource *source)
+{
+	struct usb_stream_thread *thread;
+
+	thread = (struct usb_stream_thread *)source;
+
+	g_free(thread->done.items);
+	g_free(thread->spare.items);
+	sr_session_source_destroyed(thread->session, thread, source);
+}
+
+static int thread_start(struct sr_usb_stream *stream)
+{
+	static GSourceFuncs thread_source_funcs = {
+		.prepare  = &thread_source_prepare,
+		.check    = &thread_source_check,
+		.dispatch = &thread_source_dispatch,
+		.finalize = &thread_source_finalize
+	};
+	struct usb_stream_thread *thread;
+	struct sr_session *session;
+	int ret;
+
+	session = stream->config.session;
+
+	thread = (struct usb_stream_thread *)g_source_new(&thread_source_funcs,
+		sizeof(struct usb_stream_thread));
+	g_source_set_name(&thread->base, "usb-stream");
+	thread->stream = stream;
+	thread->session = session;
+	thread->libusb_ctx = session->ctx->libusb_ctx;
+	sr_usb_stream_ring_init(&thread->done, stream->num_slots);
+	sr_usb_stream_ring_init(&thread->spare, stream->num_slots);
+
+	if ((ret = sr_session_source_add_internal(session, thread,
+			&thread->base)) != SR_OK) {
+		g_source_unref(&thread->base);
+		return ret;
+	}
+	thread->main_context = g_source_get_context(&thread->base);
+
+	stream->thread = thread;
+	thread->thread = g_thread_new("sr-usb", usb_thread, thread);
+	sr_dbg("Handling transfers on a thread of their own.");
+
+	return SR_OK;
+}
+
+/* Called once no transfers are left. */
+static void thread_stop(struct sr_usb_stream *stream)
+{
+	struct usb_stream_thread *thread;
+
+	thread = stream->thread;
+
+	g_atomic_int_set(&thread->stop, 1);
+	g_thread_join(thread->thread);
+	stream->stats.missed_resubmits = g_atomic_int_get(&thread->missed);
+
+	thread->stream = NULL;
+	stream->thread = NULL;
+	sr_session_source_remove_internal(thread->session, thread);
+	g_source_unref(&thread->base);
+}
+
+/**
+ * Create a stream of bulk transfers, without starting it.
+ *
+ * @param usb The device to stream from, which must be open.
+ * @param config The endpoint, data rate and sizing. Fields left at 0 take
+ *               the defaults.
+ * @param receive Called with the data of every transfer. Returns FALSE
+ *                when no more data is needed, which ends the stream.
+ * @param finished Called when the last transfer has come back after the
+ *                 stream ended. It may free the stream.
+ * @param cb_data Passed to the callbacks.
+ *
+ * @return The new stream.
+ *
+ * @private
+ */
+SR_PRIV struct sr_usb_stream *sr_usb_stream_new(struct sr_usb_dev_inst *usb,
+		const struct sr_usb_stream_config *config,
+		sr_usb_stream_receive_callback receive,
+		sr_usb_stream_finished_callback finished, void *cb_data)
+{
+	struct sr_usb_stream *stream;
+	unsigned int i;
+
+	stream = g_malloc0(sizeof(*stream));
+	stream->usb = usb;
+	stream->receive = receive;
+	stream->finished = finished;
+	stream->cb_data = cb_data;
+
+	stream->config = *config;
+	sr_usb_stream_size_pool(stream);
+
+	/* A USB trace is recorded and replayed on the session thread. */
+	if (config->session && config->session->usb_thread) {
+		if (sr_usb_trace_active())
+			sr_warn("No USB thread while a USB trace is in use.");
+		else
+			stream->threaded = TRUE;
+	}
+
+	stream->num_slots = stream->config.max_transfers
+		* (stream->threaded ? 2 : 1);
+	stream->slots = g_malloc0(stream->num_slots * sizeof(*stream->slots));
+	for (i = 0; i < stream->num_slots; i++)
+		stream->slots[i].stream = stream;
+
+	return stream;
+}
+
+/**
+ * Submit the first transfers of a stream.
+ *
+ * If this fails after some transfers went out, the stream ends, and the
+ * finished callback is called once they come back. Otherwise, the caller
+ * has to free the stream.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_stream_start(struct sr_usb_stream *stream)
+{
+	unsigned int i;
+	int ret;
+
+	if (stream->threaded && (ret = thread_start(stream)) != SR_OK)
+		return ret;
+
+	for (i = 0; i < pool_slots(stream); i++) {
+		if ((ret = submit_new(stream)) != SR_OK) {
+			if (stream->submitted)
+				sr_usb_stream_abort(stream);
+			else if (stream->thread)
+				thread_stop(stream);
+			return ret;
+		}
+	}
+	stream->last_reaped_us = g_get_monotonic_time();
+
+	return SR_OK;
+}
+
+/**
+ * End a stream. The transfers in flight are cancelled, and the finished
+ * callback is called when the last one has come back.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_abort(struct sr_usb_stream *stream)
+{
+	int i;
+
+	stream->aborted = TRUE;
+	if (stream->thread)
+		g_atomic_int_set(&stream->thread->aborted, 1);
+
+	for (i = stream->num_slots - 1; i >= 0; i--) {
+		if (stream->slots[i].transfer)
+			libusb_cancel_transfer(stream->slots[i].transfer);
+	}
+}
+
+/**
+ * Free a stream which has no transfers in flight.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_free(struct sr_usb_stream *stream)
+{
+	if (!stream)
+		return;
+
+	g_free(stream->slots);
+	g_free(stream);
+}
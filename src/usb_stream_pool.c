@@ -0,0 +1,257 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sizing of the transfer pool of a USB stream, and the rings which pass
+ * its transfers between the USB thread and the session thread, as
+ * described in usb_stream.c. These have no device access, so that they
+ * can be tested without hardware.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "usb-stream"
+
+/* Rounds without trouble before the pool is made smaller. */
+#define USB_STREAM_QUIET_WINDOWS 4
+
+static size_t round_size(const struct sr_usb_stream *stream, uint64_t size)
+{
+	size_t block_size;
+
+	block_size = stream->config.block_size;
+	size = (size + block_size - 1) / block_size * block_size;
+
+	return MAX(size, block_size);
+}
+
+static void update_timeout(struct sr_usb_stream *stream)
+{
+	unsigned int timeout;
+
+	timeout = (uint64_t)stream->target * stream->size
+		/ stream->config.bytes_per_ms;
+	/* Leave a headroom of 25%. */
+	stream->timeout = timeout + timeout / 4;
+}
+
+/**
+ * Fill in the defaults of the stream's config, and size the pool the
+ * stream starts with.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_size_pool(struct sr_usb_stream *stream)
+{
+	struct sr_usb_stream_config *cfg;
+	unsigned int n;
+
+	cfg = &stream->config;
+	if (!cfg->block_size)
+		cfg->block_size = 512;
+	if (!cfg->bytes_per_ms)
+		cfg->bytes_per_ms = 1;
+	if (!cfg->transfer_ms)
+		cfg->transfer_ms = 10;
+	if (!cfg->total_ms)
+		cfg->total_ms = 500;
+	if (!cfg->max_transfers)
+		cfg->max_transfers = USB_STREAM_MAX_TRANSFERS;
+	if (!cfg->max_empty_transfers)
+		cfg->max_empty_transfers = cfg->max_transfers * 2;
+
+	stream->size = round_size(stream,
+		(uint64_t)cfg->transfer_ms * cfg->bytes_per_ms);
+	stream->min_size = stream->size;
+	if (!cfg->max_transfer_size)
+		cfg->max_transfer_size = 4 * stream->size;
+	cfg->max_transfer_size = MAX(round_size(stream,
+		cfg->max_transfer_size), stream->size);
+
+	n = ((uint64_t)cfg->total_ms * cfg->bytes_per_ms + stream->size - 1)
+		/ stream->size;
+	stream->target = CLAMP(n, 1, cfg->max_transfers);
+	stream->min_target = MAX(stream->target / 2, MIN(stream->target, 2));
+	update_timeout(stream);
+}
+
+/**
+ * The time in us the device needs to fill a number of bytes.
+ *
+ * @private
+ */
+SR_PRIV int64_t sr_usb_stream_fill_time(const struct sr_usb_stream *stream,
+		uint64_t bytes)
+{
+	return bytes * 1000 / stream->config.bytes_per_ms;
+}
+
+/**
+ * Track how late transfers are reaped. The device fills one transfer
+ * after the other, so when the host keeps up, transfers are reaped one
+ * fill time apart. Reaped sooner, they had been waiting. This cannot be
+ * negative; when it comes out so, the device was slower than its
+ * nominal rate.
+ *
+ * @return How late the transfer was reaped, in us.
+ *
+ * @private
+ */
+SR_PRIV int64_t sr_usb_stream_update_backlog(struct sr_usb_stream *stream,
+		int64_t reaped_us, size_t length)
+{
+	stream->backlog_us += reaped_us - stream->last_reaped_us;
+	stream->backlog_us -= sr_usb_stream_fill_time(stream, length);
+	stream->backlog_us = MAX(stream->backlog_us, 0);
+	stream->last_reaped_us = reaped_us;
+
+	return stream->backlog_us;
+}
+
+/**
+ * Take a completion into the current round, and at the end of the round
+ * change the pool if needed.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_adapt(struct sr_usb_stream *stream,
+		int64_t backlog_us, uint64_t callback_us, size_t length)
+{
+	const struct sr_usb_stream_config *config;
+	unsigned int target;
+	int64_t pool_us;
+	size_t size;
+
+	config = &stream->config;
+
+	stream->window_max_backlog_us = MAX(stream->window_max_backlog_us,
+		backlog_us);
+	stream->window_callback_us += callback_us;
+	stream->window_fill_us += sr_usb_stream_fill_time(stream, length);
+	if (++stream->window_count < stream->target)
+		return;
+
+	target = stream->target;
+	size = stream->size;
+	pool_us = sr_usb_stream_fill_time(stream, (uint64_t)target * size);
+	if (stream->window_max_backlog_us * 2 > pool_us
+			&& target < config->max_transfers) {
+		target = MIN(target + MAX(target / 4, 1), config->max_transfers);
+	} else if (stream->window_callback_us * 2 > stream->window_fill_us
+			&& size < config->max_transfer_size) {
+		size = MIN(size * 2, config->max_transfer_size);
+	} else if (stream->window_max_backlog_us * 4 >= pool_us
+			|| stream->window_callback_us * 10 >= stream->window_fill_us) {
+		stream->quiet_windows = 0;
+	} else if (++stream->quiet_windows >= USB_STREAM_QUIET_WINDOWS) {
+		stream->quiet_windows = 0;
+		if (size > stream->min_size)
+			size = MAX(round_size(stream, size / 2), stream->min_size);
+		else if (target > stream->min_target)
+			target--;
+	}
+
+	if (target > stream->target || size > stream->size) {
+		stream->quiet_windows = 0;
+		stream->stats.grown++;
+	} else if (target < stream->target || size < stream->size) {
+		stream->stats.shrunk++;
+	}
+	if (target != stream->target || size != stream->size) {
+		sr_dbg("Now %u transfers of %zu bytes (up to %" PRIi64
+			" of %" PRIi64 " us late, callbacks took %" PRIu64
+			" of %" PRIu64 " us).", target, size,
+			stream->window_max_backlog_us, pool_us,
+			stream->window_callback_us, stream->window_fill_us);
+		stream->target = target;
+		stream->size = size;
+		update_timeout(stream);
+	}
+
+	stream->window_count = 0;
+	stream->window_max_backlog_us = 0;
+	stream->window_callback_us = 0;
+	stream->window_fill_us = 0;
+}
+
+/**
+ * Set up an empty ring for the given number of slots.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_ring_init(struct sr_usb_stream_ring *ring,
+		unsigned int size)
+{
+	ring->capacity = size + 1;
+	ring->items = g_malloc0_n(ring->capacity, sizeof(*ring->items));
+	ring->head = ring->tail = 0;
+}
+
+/**
+ * The number of slots in the ring. Exact for either side, only the other
+ * side may change it meanwhile.
+ *
+ * @private
+ */
+SR_PRIV unsigned int sr_usb_stream_ring_depth(struct sr_usb_stream_ring *ring)
+{
+	return (g_atomic_int_get(&ring->tail) - g_atomic_int_get(&ring->head)
+		+ ring->capacity) % ring->capacity;
+}
+
+/**
+ * Add a slot, on the producer side. Every slot of the stream fits, so
+ * this cannot fail.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_stream_ring_push(struct sr_usb_stream_ring *ring,
+		struct usb_stream_slot *slot)
+{
+	int tail;
+
+	tail = g_atomic_int_get(&ring->tail);
+	ring->items[tail] = slot;
+	/* Publish the item only after it has been written. */
+	g_atomic_int_set(&ring->tail, (tail + 1) % ring->capacity);
+}
+
+/**
+ * Take the oldest slot, on the consumer side.
+ *
+ * @return TRUE if there was one.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_usb_stream_ring_pop(struct sr_usb_stream_ring *ring,
+		struct usb_stream_slot **slot)
+{
+	int head;
+
+	head = g_atomic_int_get(&ring->head);
+	if (head == g_atomic_int_get(&ring->tail))
+		return FALSE;
+	*slot = ring->items[head];
+	g_atomic_int_set(&ring->head, (head + 1) % ring->capacity);
+
+	return TRUE;
+}
@@ -0,0 +1,1139 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Record and replay of USB traffic.
+ *
+ * The libusb calls of the drivers are routed through the wrappers in this
+ * file (see the macros in libsigrok-internal.h). Normally the wrappers just
+ * call libusb. When the SIGROK_USB_RECORD environment variable names a file,
+ * the devices, string descriptors and transfers seen by the drivers are
+ * written to it. When SIGROK_USB_REPLAY names such a file instead, libusb is
+ * not used at all: the devices of the trace are presented to the drivers,
+ * and their transfers are answered from the trace. This allows driver and
+ * session throughput to be measured, and problems seen in the field to be
+ * reproduced, without the hardware.
+ *
+ * By default, replayed transfers complete as fast as the driver submits
+ * them. With SIGROK_USB_REPLAY_TIMING=recorded, completions are delivered
+ * at the pace at which they were recorded.
+ *
+ * Replay follows the order of the trace: synchronous transfers are answered
+ * with the next recorded transfer of the same kind, and each recorded
+ * completion goes to the oldest transfer submitted on its endpoint. Replay
+ * only works as long as the driver does what it did during recording.
+ * Configuration descriptors are not recorded; on replay, asking for one
+ * fails with LIBUSB_ERROR_NOT_SUPPORTED.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libusb.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "usb-trace"
+
+#define TRACE_MAGIC "SRUSBTRC"
+#define TRACE_VERSION 1
+#define HEADER_SIZE 29
+
+/* The maximum number of records read ahead while searching the trace. */
+#define MAX_LOOKAHEAD 4096
+
+/* The number of port numbers stored with a device. */
+#define MAX_PORTS 8
+
+enum record_type {
+	/* A device, its descriptor and its port numbers. */
+	RECORD_DEVICE = 1,
+	/* A string descriptor, read with the ASCII helper. */
+	RECORD_STRING,
+	/* A synchronous control transfer. */
+	RECORD_CONTROL,
+	/* A synchronous bulk or interrupt transfer. */
+	RECORD_BULK,
+	/* The completion of an asynchronous transfer. */
+	RECORD_COMPLETE,
+};
+
+/*
+ * On disk, every record is a little endian header of HEADER_SIZE bytes,
+ * laid out as the fields below, followed by data_len bytes of data.
+ */
+struct trace_record {
+	uint8_t type;
+	uint8_t bus;
+	uint8_t address;
+	/* The endpoint, or bmRequestType of a control transfer. */
+	uint8_t endpoint;
+	uint8_t request;
+	uint16_t value;
+	/* wIndex of a control transfer, or the string descriptor index. */
+	uint16_t index;
+	/* The return value, or the status of a completed transfer. */
+	int32_t result;
+	/* The number of bytes transferred. */
+	uint32_t length;
+	/* Microseconds since the start of the recording. */
+	uint64_t time_us;
+	uint32_t data_len;
+	uint8_t *data;
+};
+
+/* A device of the trace, handed to the drivers as a libusb_device. */
+struct trace_device {
+	uint8_t bus;
+	uint8_t address;
+	struct libusb_device_descriptor des;
+	uint8_t ports[MAX_PORTS];
+	int num_ports;
+	/* Its string descriptors, as struct trace_record. */
+	GSList *strings;
+};
+
+/* Handed to the drivers as a libusb_device_handle. */
+struct trace_handle {
+	struct trace_device *dev;
+};
+
+struct usb_trace {
+	int refcount;
+	FILE *file;
+	gboolean replay;
+	int64_t start_us;
+
+	/* Recording. */
+	GMutex mutex;
+	gboolean failed;
+	/* The devices written so far, keyed by bus and address. */
+	GHashTable *recorded;
+	/* The original callbacks of the transfers in flight. */
+	GHashTable *callbacks;
+
+	/* Replay. */
+	gboolean timing;
+	gboolean eof;
+	GSList *devices;
+	/* Records read from the trace but not used yet. */
+	GQueue *lookahead;
+	/* Transfers submitted by the drivers, oldest first. */
+	GQueue *pending;
+	GQueue *cancelled;
+	/* The time of the first completion, in the trace and in replay. */
+	gboolean timing_started;
+	uint64_t first_time_us;
+	int64_t replay_start_us;
+};
+
+static struct usb_trace *trace;
+
+static gboolean recording(void)
+{
+	return trace && !trace->replay;
+}
+
+static gboolean replaying(void)
+{
+	return trace && trace->replay;
+}
+
+static void record_free(struct trace_record *rec)
+{
+	g_free(rec->data);
+	g_free(rec);
+}
+
+static void device_free(struct trace_device *tdev)
+{
+	g_slist_free_full(tdev->strings, (GDestroyNotify)record_free);
+	g_free(tdev);
+}
+
+static void record_write(struct trace_record *rec, const void *data)
+{
+	uint8_t header[HEADER_SIZE];
+
+	rec->time_us = g_get_monotonic_time() - trace->start_us;
+
+	W8(header + 0, rec->type);
+	W8(header + 1, rec->bus);
+	W8(header + 2, rec->address);
+	W8(header + 3, rec->endpoint);
+	W8(header + 4, rec->request);
+	WL16(header + 5, rec->value);
+	WL16(header + 7, rec->index);
+	WL32(header + 9, rec->result);
+	WL32(header + 13, rec->length);
+	WL32(header + 17, rec->time_us & 0xffffffff);
+	WL32(header + 21, rec->time_us >> 32);
+	WL32(header + 25, rec->data_len);
+
+	g_mutex_lock(&trace->mutex);
+	if (!trace->failed && (fwrite(header, HEADER_SIZE, 1, trace->file) != 1
+			|| (rec->data_len && fwrite(data, rec->data_len, 1,
+			trace->file) != 1))) {
+		sr_err("Failed to write the USB trace, recording stopped.");
+		trace->failed = TRUE;
+	}
+	g_mutex_unlock(&trace->mutex);
+}
+
+/* Read the next record, or return NULL at the end of the trace. */
+static struct trace_record *record_read(void)
+{
+	struct trace_record *rec;
+	uint8_t header[HEADER_SIZE];
+
+	if (fread(header, HEADER_SIZE, 1, trace->file) != 1)
+		return NULL;
+
+	rec = g_malloc0(sizeof(*rec));
+	rec->type = R8(header + 0);
+	rec->bus = R8(header + 1);
+	rec->address = R8(header + 2);
+	rec->endpoint = R8(header + 3);
+	rec->request = R8(header + 4);
+	rec->value = RL16(header + 5);
+	rec->index = RL16(header + 7);
+	rec->result = (int32_t)RL32(header + 9);
+	rec->length = RL32(header + 13);
+	rec->time_us = RL64(header + 17);
+	rec->data_len = RL32(header + 25);
+	if (rec->data_len) {
+		rec->data = g_try_malloc(rec->data_len);
+		if (!rec->data || fread(rec->data, rec->data_len, 1,
+				trace->file) != 1) {
+			sr_err("Truncated record in the USB trace.");
+			record_free(rec);
+			return NULL;
+		}
+	}
+
+	return rec;
+}
+
+static void bus_address(libusb_device_handle *hdl, uint8_t *bus,
+		uint8_t *address)
+{
+	libusb_device *dev;
+
+	dev = (libusb_get_device)(hdl);
+	*bus = (libusb_get_bus_number)(dev);
+	*address = (libusb_get_device_address)(dev);
+}
+
+static void record_device(libusb_device *dev,
+		const struct libusb_device_descriptor *des)
+{
+	struct trace_record rec;
+	uint8_t data[LIBUSB_DT_DEVICE_SIZE + MAX_PORTS];
+	uint8_t ports[MAX_PORTS];
+	unsigned int key;
+	gboolean known;
+	int num_ports;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = RECORD_DEVICE;
+	rec.bus = (libusb_get_bus_number)(dev);
+	rec.address = (libusb_get_device_address)(dev);
+
+	key = rec.bus << 8 | rec.address;
+	g_mutex_lock(&trace->mutex);
+	known = g_hash_table_contains(trace->recorded, GUINT_TO_POINTER(key));
+	if (!known)
+		g_hash_table_add(trace->recorded, GUINT_TO_POINTER(key));
+	g_mutex_unlock(&trace->mutex);
+	if (known)
+		return;
+
+	/* The descriptor as it goes over the wire. */
+	W8(data + 0, des->bLength);
+	W8(data + 1, des->bDescriptorType);
+	WL16(data + 2, des->bcdUSB);
+	W8(data + 4, des->bDeviceClass);
+	W8(data + 5, des->bDeviceSubClass);
+	W8(data + 6, des->bDeviceProtocol);
+	W8(data + 7, des->bMaxPacketSize0);
+	WL16(data + 8, des->idVendor);
+	WL16(data + 10, des->idProduct);
+	WL16(data + 12, des->bcdDevice);
+	W8(data + 14, des->iManufacturer);
+	W8(data + 15, des->iProduct);
+	W8(data + 16, des->iSerialNumber);
+	W8(data + 17, des->bNumConfigurations);
+
+	num_ports = (libusb_get_port_numbers)(dev, ports, sizeof(ports));
+	if (num_ports < 0)
+		num_ports = 0;
+	memcpy(data + LIBUSB_DT_DEVICE_SIZE, ports, num_ports);
+
+	rec.result = num_ports;
+	rec.data_len = LIBUSB_DT_DEVICE_SIZE + num_ports;
+	record_write(&rec, data);
+}
+
+static void LIBUSB_CALL record_completion(struct libusb_transfer *transfer)
+{
+	struct trace_record rec;
+	libusb_transfer_cb_fn callback;
+	unsigned int offset;
+	gboolean in;
+
+	g_mutex_lock(&trace->mutex);
+	callback = g_hash_table_lookup(trace->callbacks, transfer);
+	g_hash_table_remove(trace->callbacks, transfer);
+	g_mutex_unlock(&trace->mutex);
+	transfer->callback = callback;
+
+	offset = 0;
+	in = (transfer->endpoint & LIBUSB_ENDPOINT_IN) != 0;
+	if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL) {
+		/* The direction is in bmRequestType of the setup packet. */
+		offset = LIBUSB_CONTROL_SETUP_SIZE;
+		in = (transfer->buffer[0] & LIBUSB_ENDPOINT_IN) != 0;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = RECORD_COMPLETE;
+	bus_address(transfer->dev_handle, &rec.bus, &rec.address);
+	rec.endpoint = transfer->endpoint;
+	rec.result = transfer->status;
+	rec.length = MAX(transfer->actual_length, 0);
+	if (in)
+		rec.data_len = rec.length;
+	record_write(&rec, transfer->buffer + offset);
+
+	if (callback)
+		callback(transfer);
+}
+
+static struct trace_device *replay_device(uint8_t bus, uint8_t address)
+{
+	struct trace_device *tdev;
+	GSList *l;
+
+	for (l = trace->devices; l; l = l->next) {
+		tdev = l->data;
+		if (tdev->bus == bus && tdev->address == address)
+			return tdev;
+	}
+
+	return NULL;
+}
+
+/* Take the devices and strings of the trace into the replay state. */
+static void replay_absorb(struct trace_record *rec)
+{
+	struct trace_device *tdev;
+	const uint8_t *data;
+
+	tdev = replay_device(rec->bus, rec->address);
+
+	if (rec->type == RECORD_STRING) {
+		if (tdev)
+			tdev->strings = g_slist_prepend(tdev->strings, rec);
+		else
+			record_free(rec);
+		return;
+	}
+
+	if (tdev || rec->data_len < LIBUSB_DT_DEVICE_SIZE) {
+		record_free(rec);
+		return;
+	}
+
+	data = rec->data;
+	tdev = g_malloc0(sizeof(*tdev));
+	tdev->bus = rec->bus;
+	tdev->address = rec->address;
+	tdev->des.bLength = R8(data + 0);
+	tdev->des.bDescriptorType = R8(data + 1);
+	tdev->des.bcdUSB = RL16(data + 2);
+	tdev->des.bDeviceClass = R8(data + 4);
+	tdev->des.bDeviceSubClass = R8(data + 5);
+	tdev->des.bDeviceProtocol = R8(data + 6);
+	tdev->des.bMaxPacketSize0 = R8(data + 7);
+	tdev->des.idVendor = RL16(data + 8);
+	tdev->des.idProduct = RL16(data + 10);
+	tdev->des.bcdDevice = RL16(data + 12);
+	tdev->des.iManufacturer = R8(data + 14);
+	tdev->des.iProduct = R8(data + 15);
+	tdev->des.iSerialNumber = R8(data + 16);
+	tdev->des.bNumConfigurations = R8(data + 17);
+	tdev->num_ports = MIN(MIN(rec->result, MAX_PORTS),
+		(int)rec->data_len - LIBUSB_DT_DEVICE_SIZE);
+	tdev->num_ports = MAX(tdev->num_ports, 0);
+	memcpy(tdev->ports, data + LIBUSB_DT_DEVICE_SIZE, tdev->num_ports);
+	trace->devices = g_slist_append(trace->devices, tdev);
+	record_free(rec);
+}
+
+/* Read up to the next transfer record, which goes into the lookahead. */
+static gboolean replay_read_more(void)
+{
+	struct trace_record *rec;
+
+	while (!trace->eof) {
+		if (!(rec = record_read())) {
+			trace->eof = TRUE;
+			break;
+		}
+		if (rec->type == RECORD_DEVICE || rec->type == RECORD_STRING) {
+			replay_absorb(rec);
+			continue;
+		}
+		g_queue_push_tail(trace->lookahead, rec);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean record_matches(const struct trace_record *rec, uint8_t type,
+		const struct trace_device *tdev, int endpoint)
+{
+	if (rec->type != type)
+		return FALSE;
+	if (tdev && (rec->bus != tdev->bus || rec->address != tdev->address))
+		return FALSE;
+
+	return endpoint < 0 || rec->endpoint == endpoint;
+}
+
+/* Find the next record of a type, on any endpoint if endpoint is -1. */
+static GList *replay_find(uint8_t type, const struct trace_device *tdev,
+		int endpoint)
+{
+	GList *l;
+
+	for (l = trace->lookahead->head; ; l = l->next) {
+		if (!l) {
+			if (trace->lookahead->length >= MAX_LOOKAHEAD
+					|| !replay_read_more())
+				return NULL;
+			l = trace->lookahead->tail;
+		}
+		if (record_matches(l->data, type, tdev, endpoint))
+			return l;
+	}
+}
+
+/* Copy the data of a record into a buffer, as far as it fits. */
+static void replay_data(const struct trace_record *rec, unsigned char *buf,
+		unsigned int size)
+{
+	if (buf && rec->data_len)
+		memcpy(buf, rec->data, MIN(rec->data_len, size));
+}
+
+static struct trace_device *handle_device(libusb_device_handle *hdl)
+{
+	return ((struct trace_handle *)hdl)->dev;
+}
+
+/* The oldest pending transfer a completion record is meant for. */
+static GList *replay_pending(const struct trace_record *rec)
+{
+	struct libusb_transfer *transfer;
+	struct trace_device *tdev;
+	GList *l;
+
+	for (l = trace->pending->head; l; l = l->next) {
+		transfer = l->data;
+		tdev = handle_device(transfer->dev_handle);
+		if (transfer->endpoint == rec->endpoint
+				&& tdev->bus == rec->bus
+				&& tdev->address == rec->address)
+			return l;
+	}
+
+	return NULL;
+}
+
+/* When a completion is due in recorded timing, or 0 without timing. */
+static int64_t replay_due(const struct trace_record *rec)
+{
+	if (!trace->timing)
+		return 0;
+	if (!trace->timing_started) {
+		trace->first_time_us = rec->time_us;
+		trace->replay_start_us = g_get_monotonic_time();
+		trace->timing_started = TRUE;
+	}
+
+	return trace->replay_start_us + (rec->time_us - trace->first_time_us);
+}
+
+static void replay_complete(struct libusb_transfer *transfer,
+		enum libusb_transfer_status status, const struct trace_record *rec)
+{
+	unsigned int offset, size;
+
+	offset = 0;
+	if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL)
+		offset = LIBUSB_CONTROL_SETUP_SIZE;
+	size = MAX(transfer->length - (int)offset, 0);
+
+	transfer->status = status;
+	transfer->actual_length = 0;
+	if (rec) {
+		replay_data(rec, transfer->buffer + offset, size);
+		transfer->actual_length = MIN(rec->length, size);
+	}
+	transfer->callback(transfer);
+}
+
+/* Complete the transfers that are due, waiting at most timeout_us. */
+static int replay_events(int64_t timeout_us)
+{
+	struct libusb_transfer *transfer;
+	struct trace_record *rec;
+	GList *l, *p;
+	int64_t deadline, due, now;
+	unsigned int budget, done;
+
+	while ((transfer = g_queue_pop_head(trace->cancelled)))
+		replay_complete(transfer, LIBUSB_TRANSFER_CANCELLED, NULL);
+
+	deadline = g_get_monotonic_time() + timeout_us;
+	/* One round over the transfers in flight, like one poll would do. */
+	budget = trace->pending->length;
+	for (done = 0; done < budget; done++) {
+		if (!(l = replay_find(RECORD_COMPLETE, NULL, -1))) {
+			/* The trace is over; the device is gone. */
+			while ((transfer = g_queue_pop_head(trace->pending)))
+				replay_complete(transfer,
+					LIBUSB_TRANSFER_NO_DEVICE, NULL);
+			return 0;
+		}
+		rec = l->data;
+		if (!(p = replay_pending(rec)))
+			break;
+		if ((due = replay_due(rec)) > (now = g_get_monotonic_time())) {
+			if (due > deadline)
+				break;
+			g_usleep(due - now);
+		}
+		transfer = p->data;
+		g_queue_delete_link(trace->pending, p);
+		g_queue_delete_link(trace->lookahead, l);
+		replay_complete(transfer, rec->result, rec);
+		record_free(rec);
+	}
+
+	if (!done && (now = g_get_monotonic_time()) < deadline)
+		g_usleep(deadline - now);
+
+	return 0;
+}
+
+static void trace_free(void)
+{
+	if (trace->file)
+		fclose(trace->file);
+	if (trace->recorded)
+		g_hash_table_destroy(trace->recorded);
+	if (trace->callbacks)
+		g_hash_table_destroy(trace->callbacks);
+	g_slist_free_full(trace->devices, (GDestroyNotify)device_free);
+	if (trace->lookahead)
+		g_queue_free_full(trace->lookahead, (GDestroyNotify)record_free);
+	if (trace->pending)
+		g_queue_free(trace->pending);
+	if (trace->cancelled)
+		g_queue_free(trace->cancelled);
+	g_mutex_clear(&trace->mutex);
+	g_free(trace);
+	trace = NULL;
+}
+
+/**
+ * Start recording or replaying USB traffic, as the environment says.
+ *
+ * Every call must be matched by a call to sr_usb_trace_exit().
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_trace_init(void)
+{
+	const char *record_path, *replay_path, *timing;
+	char magic[sizeof(TRACE_MAGIC) - 1];
+	uint8_t version;
+
+	if (trace) {
+		trace->refcount++;
+		return;
+	}
+
+	record_path = g_getenv("SIGROK_USB_RECORD");
+	replay_path = g_getenv("SIGROK_USB_REPLAY");
+	if (!record_path && !replay_path)
+		return;
+
+	trace = g_malloc0(sizeof(*trace));
+	trace->refcount = 1;
+	g_mutex_init(&trace->mutex);
+	trace->start_us = g_get_monotonic_time();
+
+	if (replay_path) {
+		trace->replay = TRUE;
+		if (!(trace->file = g_fopen(replay_path, "rb"))) {
+			sr_err("Failed to open USB trace '%s'.", replay_path);
+		} else if (fread(magic, sizeof(magic), 1, trace->file) != 1
+				|| memcmp(magic, TRACE_MAGIC, sizeof(magic))
+				|| fread(&version, 1, 1, trace->file) != 1
+				|| version != TRACE_VERSION) {
+			sr_err("'%s' is not a USB trace.", replay_path);
+			fclose(trace->file);
+			trace->file = NULL;
+		}
+		/* Without a trace, replay an empty bus. */
+		trace->eof = !trace->file;
+		timing = g_getenv("SIGROK_USB_REPLAY_TIMING");
+		trace->timing = timing && !strcmp(timing, "recorded");
+		trace->lookahead = g_queue_new();
+		trace->pending = g_queue_new();
+		trace->cancelled = g_queue_new();
+		sr_info("Replaying USB traffic from '%s'%s.", replay_path,
+			trace->timing ? " in recorded timing" : "");
+		return;
+	}
+
+	trace->recorded = g_hash_table_new(g_direct_hash, g_direct_equal);
+	trace->callbacks = g_hash_table_new(g_direct_hash, g_direct_equal);
+	version = TRACE_VERSION;
+	if (!(trace->file = g_fopen(record_path, "wb"))
+			|| fwrite(TRACE_MAGIC, sizeof(magic), 1, trace->file) != 1
+			|| fwrite(&version, 1, 1, trace->file) != 1) {
+		sr_err("Failed to create USB trace '%s'.", record_path);
+		trace->failed = TRUE;
+		return;
+	}
+	sr_info("Recording USB traffic to '%s'.", record_path);
+}
+
+/**
+ * Stop recording or replaying USB traffic.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_trace_exit(void)
+{
+	if (!trace || --trace->refcount > 0)
+		return;
+
+	if (!trace->replay && trace->callbacks
+			&& g_hash_table_size(trace->callbacks))
+		sr_warn("Transfers still in flight at the end of the recording.");
+	trace_free();
+}
+
+/**
+ * Whether USB traffic is being recorded or replayed.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_usb_trace_active(void)
+{
+	return trace != NULL;
+}
+
+/**
+ * The time in ms until the next replayed transfer is due.
+ *
+ * @retval -1 Nothing is due, or no replay is going on.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_trace_timeout(void)
+{
+	struct trace_record *rec;
+	GList *l;
+	int64_t due, now;
+
+	if (!replaying())
+		return -1;
+	if (trace->cancelled->length)
+		return 0;
+	if (!trace->pending->length)
+		return -1;
+	if (!(l = replay_find(RECORD_COMPLETE, NULL, -1)))
+		return 0;
+	rec = l->data;
+	if (!replay_pending(rec))
+		return -1;
+	if (!(due = replay_due(rec)))
+		return 0;
+	now = g_get_monotonic_time();
+
+	return (MAX(0, due - now) + 999) / 1000;
+}
+
+/** @private */
+SR_PRIV ssize_t sr_usb_trace_get_device_list(libusb_context *ctx,
+		libusb_device ***list)
+{
+	libusb_device **devlist;
+	GSList *l;
+	ssize_t i;
+
+	if (!replaying())
+		return (libusb_get_device_list)(ctx, list);
+
+	/* Take in the devices recorded up to the next transfer. */
+	if (!trace->lookahead->length)
+		replay_read_more();
+
+	devlist = g_malloc0((g_slist_length(trace->devices) + 1)
+		* sizeof(*devlist));
+	for (i = 0, l = trace->devices; l; l = l->next)
+		devlist[i++] = l->data;
+	*list = devlist;
+
+	return i;
+}
+
+/** @private */
+SR_PRIV void sr_usb_trace_free_device_list(libusb_device **list,
+		int unref_devices)
+{
+	if (replaying())
+		g_free(list);
+	else
+		(libusb_free_device_list)(list, unref_devices);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_get_device_descriptor(libusb_device *dev,
+		struct libusb_device_descriptor *desc)
+{
+	int ret;
+
+	if (replaying()) {
+		*desc = ((struct trace_device *)dev)->des;
+		return LIBUSB_SUCCESS;
+	}
+
+	ret = (libusb_get_device_descriptor)(dev, desc);
+	if (ret == LIBUSB_SUCCESS && recording())
+		record_device(dev, desc);
+
+	return ret;
+}
+
+/** @private */
+SR_PRIV uint8_t sr_usb_trace_get_bus_number(libusb_device *dev)
+{
+	if (replaying())
+		return ((struct trace_device *)dev)->bus;
+
+	return (libusb_get_bus_number)(dev);
+}
+
+/** @private */
+SR_PRIV uint8_t sr_usb_trace_get_device_address(libusb_device *dev)
+{
+	if (replaying())
+		return ((struct trace_device *)dev)->address;
+
+	return (libusb_get_device_address)(dev);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_get_port_numbers(libusb_device *dev,
+		uint8_t *port_numbers, int port_numbers_len)
+{
+	struct trace_device *tdev;
+
+	if (!replaying())
+		return (libusb_get_port_numbers)(dev, port_numbers,
+			port_numbers_len);
+
+	tdev = (struct trace_device *)dev;
+	if (tdev->num_ports > port_numbers_len)
+		return LIBUSB_ERROR_OVERFLOW;
+	memcpy(port_numbers, tdev->ports, tdev->num_ports);
+
+	return tdev->num_ports;
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_open(libusb_device *dev,
+		libusb_device_handle **dev_handle)
+{
+	struct trace_handle *thdl;
+
+	if (!replaying())
+		return (libusb_open)(dev, dev_handle);
+
+	thdl = g_malloc0(sizeof(*thdl));
+	thdl->dev = (struct trace_device *)dev;
+	*dev_handle = (libusb_device_handle *)thdl;
+
+	return LIBUSB_SUCCESS;
+}
+
+/** @private */
+SR_PRIV void sr_usb_trace_close(libusb_device_handle *dev_handle)
+{
+	if (replaying())
+		g_free(dev_handle);
+	else
+		(libusb_close)(dev_handle);
+}
+
+/** @private */
+SR_PRIV libusb_device *sr_usb_trace_get_device(libusb_device_handle *dev_handle)
+{
+	if (replaying())
+		return (libusb_device *)handle_device(dev_handle);
+
+	return (libusb_get_device)(dev_handle);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_get_string_descriptor_ascii(
+		libusb_device_handle *dev_handle, uint8_t desc_index,
+		unsigned char *data, int length)
+{
+	struct trace_record rec, *srec;
+	GSList *l;
+	int ret;
+
+	if (replaying()) {
+		for (l = handle_device(dev_handle)->strings; l; l = l->next) {
+			srec = l->data;
+			if (srec->index != desc_index)
+				continue;
+			if (srec->result < 0)
+				return srec->result;
+			if (length <= 0)
+				return LIBUSB_ERROR_INVALID_PARAM;
+			ret = MIN((int)srec->data_len, length - 1);
+			memcpy(data, srec->data, ret);
+			data[ret] = '\0';
+			return ret;
+		}
+		return LIBUSB_ERROR_NOT_FOUND;
+	}
+
+	ret = (libusb_get_string_descriptor_ascii)(dev_handle, desc_index,
+		data, length);
+	if (recording()) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = RECORD_STRING;
+		bus_address(dev_handle, &rec.bus, &rec.address);
+		rec.index = desc_index;
+		rec.result = ret;
+		rec.data_len = MAX(ret, 0);
+		record_write(&rec, data);
+	}
+
+	return ret;
+}
+
+/*
+ * Requests which only change the state of the device or the host, and
+ * which always succeed on replay.
+ */
+
+/** @private */
+SR_PRIV int sr_usb_trace_claim_interface(libusb_device_handle *dev_handle,
+		int interface_number)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_claim_interface)(dev_handle, interface_number);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_release_interface(libusb_device_handle *dev_handle,
+		int interface_number)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_release_interface)(dev_handle, interface_number);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_kernel_driver_active(libusb_device_handle *dev_handle,
+		int interface_number)
+{
+	if (replaying())
+		return 0;
+
+	return (libusb_kernel_driver_active)(dev_handle, interface_number);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_detach_kernel_driver(libusb_device_handle *dev_handle,
+		int interface_number)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_detach_kernel_driver)(dev_handle, interface_number);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_attach_kernel_driver(libusb_device_handle *dev_handle,
+		int interface_number)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_attach_kernel_driver)(dev_handle, interface_number);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_set_configuration(libusb_device_handle *dev_handle,
+		int configuration)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_set_configuration)(dev_handle, configuration);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_get_configuration(libusb_device_handle *dev_handle,
+		int *config)
+{
+	if (replaying()) {
+		*config = 1;
+		return LIBUSB_SUCCESS;
+	}
+
+	return (libusb_get_configuration)(dev_handle, config);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_reset_device(libusb_device_handle *dev_handle)
+{
+	if (replaying())
+		return LIBUSB_SUCCESS;
+
+	return (libusb_reset_device)(dev_handle);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_get_config_descriptor(libusb_device *dev,
+		uint8_t config_index, struct libusb_config_descriptor **config)
+{
+	if (replaying())
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+
+	return (libusb_get_config_descriptor)(dev, config_index, config);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_control_transfer(libusb_device_handle *dev_handle,
+		uint8_t request_type, uint8_t bRequest, uint16_t wValue,
+		uint16_t wIndex, unsigned char *data, uint16_t wLength,
+		unsigned int timeout)
+{
+	struct trace_record rec, *crec;
+	gboolean in;
+	GList *l;
+	int ret;
+
+	in = (request_type & LIBUSB_ENDPOINT_IN) != 0;
+
+	if (replaying()) {
+		l = replay_find(RECORD_CONTROL, handle_device(dev_handle), -1);
+		if (!l) {
+			sr_err("No more control transfers in the USB trace.");
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+		crec = l->data;
+		if (crec->endpoint != request_type || crec->request != bRequest
+				|| crec->value != wValue || crec->index != wIndex)
+			sr_warn("Control request 0x%02x does not match the "
+				"trace, which has 0x%02x.", bRequest,
+				crec->request);
+		if (in)
+			replay_data(crec, data, wLength);
+		ret = crec->result;
+		g_queue_delete_link(trace->lookahead, l);
+		record_free(crec);
+		return ret;
+	}
+
+	ret = (libusb_control_transfer)(dev_handle, request_type, bRequest,
+		wValue, wIndex, data, wLength, timeout);
+	if (recording()) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = RECORD_CONTROL;
+		bus_address(dev_handle, &rec.bus, &rec.address);
+		rec.endpoint = request_type;
+		rec.request = bRequest;
+		rec.value = wValue;
+		rec.index = wIndex;
+		rec.result = ret;
+		rec.length = wLength;
+		rec.data_len = in ? MAX(ret, 0) : wLength;
+		if (!data)
+			rec.data_len = 0;
+		record_write(&rec, data);
+	}
+
+	return ret;
+}
+
+/* Synchronous bulk and interrupt transfers, which work the same. */
+static int sync_transfer(libusb_device_handle *dev_handle, gboolean bulk,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout)
+{
+	struct trace_record rec, *brec;
+	GList *l;
+	int ret;
+
+	if (replaying()) {
+		l = replay_find(RECORD_BULK, handle_device(dev_handle),
+			endpoint);
+		if (!l) {
+			sr_err("No more transfers on endpoint 0x%02x in the "
+				"USB trace.", endpoint);
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+		brec = l->data;
+		if (endpoint & LIBUSB_ENDPOINT_IN)
+			replay_data(brec, data, MAX(length, 0));
+		if (transferred)
+			*transferred = MIN((int)brec->length, length);
+		ret = brec->result;
+		g_queue_delete_link(trace->lookahead, l);
+		record_free(brec);
+		return ret;
+	}
+
+	if (bulk)
+		ret = (libusb_bulk_transfer)(dev_handle, endpoint, data, length,
+			transferred, timeout);
+	else
+		ret = (libusb_interrupt_transfer)(dev_handle, endpoint, data,
+			length, transferred, timeout);
+	if (recording()) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = RECORD_BULK;
+		bus_address(dev_handle, &rec.bus, &rec.address);
+		rec.endpoint = endpoint;
+		rec.result = ret;
+		rec.length = transferred ? MAX(*transferred, 0) : 0;
+		if (endpoint & LIBUSB_ENDPOINT_IN)
+			rec.data_len = rec.length;
+		record_write(&rec, data);
+	}
+
+	return ret;
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_bulk_transfer(libusb_device_handle *dev_handle,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout)
+{
+	return sync_transfer(dev_handle, TRUE, endpoint, data, length,
+		transferred, timeout);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_interrupt_transfer(libusb_device_handle *dev_handle,
+		unsigned char endpoint, unsigned char *data, int length,
+		int *transferred, unsigned int timeout)
+{
+	return sync_transfer(dev_handle, FALSE, endpoint, data, length,
+		transferred, timeout);
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_submit_transfer(struct libusb_transfer *transfer)
+{
+	int ret;
+
+	if (replaying()) {
+		g_queue_push_tail(trace->pending, transfer);
+		return LIBUSB_SUCCESS;
+	}
+	if (!recording() || trace->failed)
+		return (libusb_submit_transfer)(transfer);
+
+	/* Catch the completion on its way to the driver. */
+	g_mutex_lock(&trace->mutex);
+	g_hash_table_insert(trace->callbacks, transfer, transfer->callback);
+	g_mutex_unlock(&trace->mutex);
+	transfer->callback = record_completion;
+
+	ret = (libusb_submit_transfer)(transfer);
+	if (ret != LIBUSB_SUCCESS) {
+		g_mutex_lock(&trace->mutex);
+		transfer->callback = g_hash_table_lookup(trace->callbacks,
+			transfer);
+		g_hash_table_remove(trace->callbacks, transfer);
+		g_mutex_unlock(&trace->mutex);
+	}
+
+	return ret;
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_cancel_transfer(struct libusb_transfer *transfer)
+{
+	if (!replaying())
+		return (libusb_cancel_transfer)(transfer);
+
+	if (!g_queue_remove(trace->pending, transfer))
+		return LIBUSB_ERROR_NOT_FOUND;
+	g_queue_push_tail(trace->cancelled, transfer);
+
+	return LIBUSB_SUCCESS;
+}
+
+/** @private */
+SR_PRIV int sr_usb_trace_handle_events_timeout(libusb_context *ctx,
+		struct timeval *tv)
+{
+	if (!replaying())
+		return (libusb_handle_events_timeout)(ctx, tv);
+
+	return replay_events((int64_t)tv->tv_sec * G_USEC_PER_SEC
+		+ tv->tv_usec);
+}
+
+#ifndef __FreeBSD__
+/** @private */
+SR_PRIV int sr_usb_trace_handle_events_timeout_completed(libusb_context *ctx,
+		struct timeval *tv, int *completed)
+{
+	if (!replaying())
+		return (libusb_handle_events_timeout_completed)(ctx, tv,
+			completed);
+
+	return replay_events((int64_t)tv->tv_sec * G_USEC_PER_SEC
+		+ tv->tv_usec);
+}
+#endif
@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
@@ -85,6 +86,104 @@ START_TEST(test_analog_to_float)
 }
 END_TEST
 
+/* Store the low unitsize bytes of v, in the given byte order. */
+static void put_sample(uint8_t *p, uint64_t v, int unitsize, gboolean be)
+{
+	int i;
+
+	for (i = 0; i < unitsize; i++)
+		p[be ? unitsize - 1 - i : i] = v >> (8 * i);
+}
+
+/* Both ends of the range first, then small values of both signs. */
+static int64_t test_sample(unsigned int i, int unitsize, gboolean is_signed)
+{
+	int bits = 8 * unitsize;
+
+	if (i == 0)
+		return is_signed ? -(1LL << (bits - 1)) : 0;
+	if (i == 1)
+		return (1LL << (bits - is_signed)) - 1;
+	if (i & 1)
+		return is_signed ? -(int64_t)i : (1LL << bits) - i;
+
+	return i * 3;
+}
+
+/*
+ * Check all integer encodings, and floats in both byte orders, with a
+ * scale and offset, for lengths which exercise both the vectorized part
+ * and the tail of the conversion, from an unaligned buffer.
+ */
+START_TEST(test_analog_to_float_encodings)
+{
+	static const struct {
+		int unitsize;
+		gboolean is_float, is_signed;
+	} types[] = {
+		{ 1, FALSE, FALSE }, { 1, FALSE, TRUE },
+		{ 2, FALSE, FALSE }, { 2, FALSE, TRUE },
+		{ 4, FALSE, FALSE }, { 4, FALSE, TRUE },
+		{ 4, TRUE, TRUE },
+	};
+	int ret;
+	unsigned int t, be, n, i;
+	uint32_t bits;
+	float f, expected, out[37];
+	uint8_t raw[1 + ARRAY_SIZE(out) * 4];
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	meaning.channels = g_slist_append(NULL, &ch);
+	analog.data = raw + 1;
+	encoding.scale.p = 1;
+	encoding.scale.q = 4;
+	encoding.offset.p = -3;
+	encoding.offset.q = 2;
+
+	for (t = 0; t < 2 * ARRAY_SIZE(types); t++) {
+		encoding.unitsize = types[t / 2].unitsize;
+		encoding.is_float = types[t / 2].is_float;
+		encoding.is_signed = types[t / 2].is_signed;
+		encoding.is_bigendian = be = t % 2;
+		for (n = 0; n <= ARRAY_SIZE(out); n++) {
+			for (i = 0; i < n; i++) {
+				if (encoding.is_float) {
+					f = i * 2.5f - 20;
+					memcpy(&bits, &f, sizeof(bits));
+					put_sample(raw + 1 + i * 4, bits, 4, be);
+				} else {
+					put_sample(raw + 1 + i * encoding.unitsize,
+						test_sample(i, encoding.unitsize,
+						encoding.is_signed),
+						encoding.unitsize, be);
+				}
+			}
+			analog.num_samples = n;
+			ret = sr_analog_to_float(&analog, out);
+			fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+			for (i = 0; i < n; i++) {
+				if (encoding.is_float)
+					f = i * 2.5f - 20;
+				else
+					f = test_sample(i, encoding.unitsize,
+						encoding.is_signed);
+				expected = 0.25f * f - 1.5f;
+				fail_unless(out[i] == expected,
+					"Type %d, sample %d: %f != %f.",
+					t, i, out[i], expected);
+			}
+		}
+	}
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_to_float_null)
 {
 	int ret;
@@ -374,6 +473,371 @@ START_TEST(test_div_rational)
 }
 END_TEST
 
+/*
+ * Convert a signed 16 bit big endian ramp, scaled to volts, into two
+ * channels of a logic payload: one with a threshold, one with a Schmitt
+ * trigger. The other bits of the logic samples must be left alone.
+ */
+START_TEST(test_a2l_logic)
+{
+	int ret;
+	unsigned int i;
+	int16_t v;
+	uint8_t raw[2 * 200], logic_data[2 * 200], state, expected;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_logic logic;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	meaning.channels = g_slist_append(NULL, &ch);
+	analog.data = raw;
+	analog.num_samples = ARRAY_SIZE(raw) / 2;
+	encoding.is_float = FALSE;
+	encoding.is_signed = TRUE;
+	encoding.is_bigendian = TRUE;
+	encoding.unitsize = 2;
+	encoding.scale.p = 1;
+	encoding.scale.q = 100;
+
+	/* Triangle from -10 V to 9.9 V and back, in 0.1 V steps. */
+	for (i = 0; i < analog.num_samples; i++) {
+		v = (i < 100) ? -1000 + 20 * (int)i : 1000 - 20 * (int)(i - 99);
+		raw[2 * i] = (uint16_t)v >> 8;
+		raw[2 * i + 1] = v & 0xff;
+	}
+
+	memset(logic_data, 0x5a, sizeof(logic_data));
+	logic.data = logic_data;
+	logic.length = sizeof(logic_data);
+	logic.unitsize = 2;
+
+	ret = sr_a2l_threshold_logic(&analog, 1.5, &logic, 0);
+	fail_unless(ret == SR_OK, "sr_a2l_threshold_logic() failed: %d.", ret);
+	state = 1;
+	ret = sr_a2l_schmitt_trigger_logic(&analog, -2.0, 2.0, &state,
+		&logic, 9);
+	fail_unless(ret == SR_OK, "sr_a2l_schmitt_trigger_logic() failed: %d.", ret);
+	fail_unless(state == 0);
+
+	state = 1;
+	for (i = 0; i < analog.num_samples; i++) {
+		v = (i < 100) ? -1000 + 20 * (int)i : 1000 - 20 * (int)(i - 99);
+		expected = (0x5a & ~0x01) | (v >= 150);
+		fail_unless(logic_data[2 * i] == expected,
+			"Threshold, sample %d: 0x%02x != 0x%02x.",
+			i, logic_data[2 * i], expected);
+		if (v < -200)
+			state = 0;
+		else if (v > 200)
+			state = 1;
+		expected = (0x5a & ~0x02) | (state << 1);
+		fail_unless(logic_data[2 * i + 1] == expected,
+			"Schmitt trigger, sample %d: 0x%02x != 0x%02x.",
+			i, logic_data[2 * i + 1], expected);
+	}
+
+	ret = sr_a2l_threshold_logic(&analog, 1.5, &logic, 16);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_a2l_threshold_logic(&analog, 1.5, NULL, 0);
+	fail_unless(ret == SR_ERR_ARG);
+
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+#define A2L_SAMPLES 300
+/* Packet boundary for the Schmitt trigger state, not on a block of 64. */
+#define A2L_SPLIT 137
+
+struct a2l_case {
+	const char *name;
+	uint8_t unitsize;
+	gboolean is_signed;
+	gboolean is_float;
+	gboolean is_bigendian;
+	struct sr_rational scale;
+	struct sr_rational offset;
+	float lo_thr;
+	float hi_thr;
+};
+
+/*
+ * Scales and offsets are powers of two, so the reference below is exact
+ * and there is no rounding to disagree about at the thresholds.
+ */
+static const struct a2l_case a2l_cases[] = {
+	{ "u8", 1, FALSE, FALSE, FALSE, { 1, 4 }, { -1, 2 }, 10.25, 20.5 },
+	{ "s8", 1, TRUE, FALSE, FALSE, { 1, 2 }, { 0, 1 }, -7.5, 3 },
+	{ "s16le", 2, TRUE, FALSE, FALSE, { 1, 256 }, { 1, 4 }, -0.5, 1.5 },
+	{ "u16be", 2, FALSE, FALSE, TRUE, { 1, 1 }, { 0, 1 }, 1000, 40000 },
+	{ "s32le", 4, TRUE, FALSE, FALSE, { 1, 4 }, { 1, 2 }, -1e6, 1e8 },
+	{ "s32be", 4, TRUE, FALSE, TRUE, { 1, 4 }, { 0, 1 }, -100.25, 100.75 },
+	{ "u32le", 4, FALSE, FALSE, FALSE, { 1, 2 }, { 0, 1 }, 1e5, 2e9 },
+	{ "u32be", 4, FALSE, FALSE, TRUE, { 1, 1 }, { -8, 1 }, 3e9, 4e9 },
+	{ "f32le", 4, TRUE, TRUE, FALSE, { 1, 1 }, { 0, 1 }, -1.25, 2.5 },
+	{ "f32be", 4, TRUE, TRUE, TRUE, { 1, 2 }, { 1, 1 }, 0.5, 8 },
+	/* The compare direction flips. */
+	{ "u8 negative", 1, FALSE, FALSE, FALSE, { -1, 1 }, { 0, 1 }, -200, -50 },
+	{ "s16le negative", 2, TRUE, FALSE, FALSE, { -1, 2 }, { 1, 4 }, -3, 2 },
+	{ "s32be negative", 4, TRUE, FALSE, TRUE, { -1, 4 }, { 0, 1 }, -1e8, 5e7 },
+	{ "f32le negative", 4, TRUE, TRUE, FALSE, { -2, 1 }, { 0, 1 }, -4, 1 },
+	/* Outside the encodable range the result is constant. */
+	{ "u8 range", 1, FALSE, FALSE, FALSE, { 1, 1 }, { 0, 1 }, -300, 300 },
+	{ "s8 edge", 1, TRUE, FALSE, FALSE, { 1, 1 }, { 0, 1 }, -127.5, 126.5 },
+	{ "s8 range", 1, TRUE, FALSE, FALSE, { 1, 1 }, { 0, 1 }, 200, 300 },
+	{ "s16be range", 2, TRUE, FALSE, TRUE, { 1, 1 }, { 0, 1 }, -4e4, -3e4 },
+	{ "s32le range", 4, TRUE, FALSE, FALSE, { 1, 1 }, { 0, 1 }, -1e12, 1e12 },
+	{ "u32be range", 4, FALSE, FALSE, TRUE, { -1, 1 }, { 0, 1 }, 1, 1e12 },
+	/* Every compare against NaN is false. */
+	{ "s16be NaN", 2, TRUE, FALSE, TRUE, { 1, 1 }, { 0, 1 }, NAN, 100 },
+	{ "u8 NaN", 1, FALSE, FALSE, FALSE, { 1, 1 }, { 0, 1 }, 100, NAN },
+	{ "f32le NaN", 4, TRUE, TRUE, FALSE, { 1, 1 }, { 0, 1 }, NAN, NAN },
+};
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+static double a2l_rational(const struct sr_rational *r)
+{
+	return r->p / (double)r->q;
+}
+
+/* The raw value which scales to the threshold, and values around it. */
+static unsigned int a2l_near(const struct a2l_case *c, float thr,
+		double *values)
+{
+	double raw;
+	unsigned int n;
+	int k;
+
+	if (isnan(thr))
+		return 0;
+	raw = (thr - a2l_rational(&c->offset)) / a2l_rational(&c->scale);
+	n = 0;
+	if (c->is_float) {
+		for (k = -2; k <= 2; k++)
+			values[n++] = raw + k * 0.25;
+	} else {
+		for (k = -2; k <= 2; k++)
+			values[n++] = floor(raw) + k;
+	}
+
+	return n;
+}
+
+/*
+ * Samples of the case's encoding: the extremes, values at and around
+ * both thresholds, and a run which triggers neither threshold of the
+ * Schmitt trigger across a block of 64 samples.
+ */
+static void a2l_fill(const struct a2l_case *c, uint8_t *raw, double *values)
+{
+	double pick[32], min, max, v;
+	unsigned int num_pick, i, j, bits;
+	uint32_t u;
+	float f;
+
+	num_pick = 0;
+	bits = 8 * c->unitsize;
+	if (c->is_float) {
+		min = -INFINITY;
+		max = INFINITY;
+		pick[num_pick++] = NAN;
+		pick[num_pick++] = -1e30;
+		pick[num_pick++] = 1e30;
+		pick[num_pick++] = 0;
+	} else {
+		min = c->is_signed ? -ldexp(1, bits - 1) : 0;
+		max = ldexp(1, bits - c->is_signed) - 1;
+		pick[num_pick++] = min + 1;
+		pick[num_pick++] = max - 1;
+		pick[num_pick++] = 0;
+	}
+	pick[num_pick++] = min;
+	pick[num_pick++] = max;
+	num_pick += a2l_near(c, c->lo_thr, pick + num_pick);
+	num_pick += a2l_near(c, c->hi_thr, pick + num_pick);
+
+	for (i = 0; i < A2L_SAMPLES; i++) {
+		if (i >= 150 && i < 230 && !isnan(c->lo_thr + c->hi_thr))
+			v = (c->lo_thr + c->hi_thr) / 2;
+		else
+			v = pick[rng_next() % num_pick];
+		if (i >= 150 && i < 230 && !isnan(v)) {
+			v = (v - a2l_rational(&c->offset))
+				/ a2l_rational(&c->scale);
+			if (!c->is_float)
+				v = floor(v);
+		}
+		v = CLAMP(v, min, max);
+		if (c->is_float) {
+			f = v;
+			memcpy(&u, &f, sizeof(u));
+			v = f;
+		} else {
+			u = (uint32_t)(int64_t)v;
+		}
+		values[i] = v * a2l_rational(&c->scale)
+			+ a2l_rational(&c->offset);
+		for (j = 0; j < c->unitsize; j++) {
+			raw[i * c->unitsize + (c->is_bigendian
+				? c->unitsize - 1 - j : j)] = u >> (8 * j);
+		}
+	}
+}
+
+/*
+ * Every encoding against a plain floating point reference, with the
+ * logic and the byte output, and the Schmitt trigger state carried from
+ * one packet to the next.
+ */
+START_TEST(test_a2l_encodings)
+{
+	const struct a2l_case *c;
+	uint8_t raw[4 * A2L_SAMPLES], logic_data[A2L_SAMPLES];
+	uint8_t bytes[A2L_SAMPLES], state, byte_state, ref_state;
+	double values[A2L_SAMPLES];
+	unsigned int i, n;
+	int ret, expected;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_logic logic;
+
+	rng_state = 0x2545f4914f6cdd1d;
+	for (n = 0; n < ARRAY_SIZE(a2l_cases); n++) {
+		c = &a2l_cases[n];
+		a2l_fill(c, raw, values);
+
+		sr_analog_init_(&analog, &encoding, &meaning, &spec, 0);
+		analog.data = raw;
+		analog.num_samples = A2L_SAMPLES;
+		encoding.unitsize = c->unitsize;
+		encoding.is_signed = c->is_signed;
+		encoding.is_float = c->is_float;
+		encoding.is_bigendian = c->is_bigendian;
+		encoding.scale = c->scale;
+		encoding.offset = c->offset;
+
+		memset(logic_data, 0x5a, sizeof(logic_data));
+		logic.data = logic_data;
+		logic.length = sizeof(logic_data);
+		logic.unitsize = 1;
+		ret = sr_a2l_threshold_logic(&analog, c->hi_thr, &logic, 7);
+		fail_unless(ret == SR_OK, "%s: threshold failed.", c->name);
+		state = 1;
+		ret = sr_a2l_schmitt_trigger_logic(&analog, c->lo_thr,
+			c->hi_thr, &state, &logic, 0);
+		fail_unless(ret == SR_OK, "%s: Schmitt trigger failed.",
+			c->name);
+
+		ret = sr_a2l_threshold(&analog, c->lo_thr, bytes, A2L_SAMPLES);
+		fail_unless(ret == SR_OK, "%s: threshold failed.", c->name);
+		for (i = 0; i < A2L_SAMPLES; i++) {
+			expected = values[i] >= c->lo_thr;
+			fail_unless(bytes[i] == expected,
+				"%s: sample %u (%g) against %g gave %d.",
+				c->name, i, values[i], c->lo_thr, bytes[i]);
+			expected = values[i] >= c->hi_thr;
+			fail_unless((logic_data[i] >> 7) == expected,
+				"%s: sample %u (%g) against %g gave %d.",
+				c->name, i, values[i], c->hi_thr,
+				logic_data[i] >> 7);
+			fail_unless((logic_data[i] & 0x7e) == (0x5a & 0x7e),
+				"%s: sample %u: other bits changed.",
+				c->name, i);
+		}
+
+		/* The byte output in two packets. */
+		byte_state = 1;
+		ret = sr_a2l_schmitt_trigger(&analog, c->lo_thr, c->hi_thr,
+			&byte_state, bytes, A2L_SPLIT);
+		fail_unless(ret == SR_OK);
+		analog.data = raw + A2L_SPLIT * c->unitsize;
+		analog.num_samples = A2L_SAMPLES - A2L_SPLIT;
+		ret = sr_a2l_schmitt_trigger(&analog, c->lo_thr, c->hi_thr,
+			&byte_state, bytes + A2L_SPLIT, A2L_SAMPLES - A2L_SPLIT);
+		fail_unless(ret == SR_OK);
+
+		ref_state = 1;
+		for (i = 0; i < A2L_SAMPLES; i++) {
+			if (values[i] < c->lo_thr)
+				ref_state = 0;
+			else if (values[i] > c->hi_thr)
+				ref_state = 1;
+			fail_unless((logic_data[i] & 1) == ref_state,
+				"%s: sample %u (%g) gave Schmitt trigger "
+				"output %d.", c->name, i, values[i],
+				logic_data[i] & 1);
+			fail_unless(bytes[i] == ref_state,
+				"%s: sample %u (%g) gave Schmitt trigger "
+				"byte %d.", c->name, i, values[i], bytes[i]);
+		}
+		fail_unless(state == ref_state && byte_state == ref_state,
+			"%s: final state %d/%d.", c->name, state, byte_state);
+	}
+}
+END_TEST
+
+/* Only the samples both payloads hold are converted. */
+START_TEST(test_a2l_logic_length)
+{
+	int ret;
+	unsigned int i;
+	uint8_t *raw, logic_data[100], state;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_logic logic;
+
+	/* Exactly sized, so that reading past the end shows. */
+	raw = g_malloc(10);
+	for (i = 0; i < 10; i++)
+		raw[i] = i * 20;
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 0);
+	analog.data = raw;
+	analog.num_samples = 10;
+	encoding.unitsize = 1;
+	encoding.is_float = FALSE;
+
+	memset(logic_data, 0x5a, sizeof(logic_data));
+	logic.data = logic_data;
+	logic.length = sizeof(logic_data);
+	logic.unitsize = 1;
+	ret = sr_a2l_threshold_logic(&analog, 90, &logic, 0);
+	fail_unless(ret == SR_OK);
+	state = 0;
+	ret = sr_a2l_schmitt_trigger_logic(&analog, 50, 150, &state, &logic, 7);
+	fail_unless(ret == SR_OK);
+	fail_unless(state == 1);
+
+	for (i = 0; i < ARRAY_SIZE(logic_data); i++) {
+		if (i < 10)
+			fail_unless(logic_data[i] == ((0x5a & 0x7e)
+				| (i * 20 >= 90) | ((i * 20 > 150) << 7)),
+				"Sample %u: 0x%02x.", i, logic_data[i]);
+		else
+			fail_unless(logic_data[i] == 0x5a,
+				"Sample %u past the analog data changed.", i);
+	}
+
+	g_free(raw);
+}
+END_TEST
+
 Suite *suite_analog(void)
 {
 	Suite *s;
@@ -383,6 +847,7 @@ Suite *suite_analog(void)
 
 	tc = tcase_create("analog_to_float");
 	tcase_add_test(tc, test_analog_to_float);
+	tcase_add_test(tc, test_analog_to_float_encodings);
 	tcase_add_test(tc, test_analog_to_float_null);
 	tcase_add_test(tc, test_analog_si_prefix);
 	tcase_add_test(tc, test_analog_si_prefix_null);
@@ -395,5 +860,11 @@ Suite *suite_analog(void)
 	tcase_add_test(tc, test_div_rational);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("analog_to_logic");
+	tcase_add_test(tc, test_a2l_logic);
+	tcase_add_test(tc, test_a2l_encodings);
+	tcase_add_test(tc, test_a2l_logic_length);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,213 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include "hardware/asix-sigma/protocol.h"
+#include "lib.h"
+
+#define NUM_LINES 5
+#define NUM_ROUNDS 1000
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+/* Sample idx of an item, bit by bit: every samples_per_event'th bit. */
+static uint16_t ref_deinterlace(uint16_t item, int samples_per_event, int idx)
+{
+	uint16_t sample;
+	int bit;
+
+	sample = 0;
+	for (bit = 0; bit < 16 / samples_per_event; bit++)
+		if (item & (1 << (bit * samples_per_event + idx)))
+			sample |= 1 << bit;
+
+	return sample;
+}
+
+/* Each 16bit lane is deinterlaced on its own. */
+START_TEST(test_asix_sigma_deinterlace)
+{
+	uint64_t items, out100, out200;
+	uint16_t item;
+	int i, lane, idx;
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		items = rng_next();
+		out100 = sigma_deinterlace_100mhz_data(items);
+		out200 = sigma_deinterlace_200mhz_data(items);
+		for (lane = 0; lane < 4; lane++) {
+			item = items >> (16 * lane);
+			for (idx = 0; idx < 2; idx++)
+				fail_unless(((out100 >> (16 * lane + 8 * idx))
+					& 0xff) == ref_deinterlace(item, 2, idx),
+					"Wrong 100MHz sample %d of 0x%04x.",
+					idx, item);
+			for (idx = 0; idx < 4; idx++)
+				fail_unless(((out200 >> (16 * lane + 4 * idx))
+					& 0x0f) == ref_deinterlace(item, 4, idx),
+					"Wrong 200MHz sample %d of 0x%04x.",
+					idx, item);
+		}
+	}
+}
+END_TEST
+
+static void append_sample(GArray *a, uint16_t sample, uint64_t count)
+{
+	while (count--)
+		g_array_append_val(a, sample);
+}
+
+/*
+ * Build a DRAM image the way the hardware fills it: clusters with
+ * a timestamp and 7 events each, where the timestamps skip the
+ * events without pin changes. Decode it line by line, cluster by
+ * cluster like the driver does, and compare the samples.
+ */
+static void check_dram(int samples_per_event, unsigned int stop_event)
+{
+	struct sigma_dram_line lines[NUM_LINES];
+	struct sigma_dram_cluster *cl;
+	struct sigma_state ss;
+	GArray *expected, *decoded;
+	uint8_t samples[EVENTS_PER_CLUSTER * 2 * 4];
+	uint16_t ts, item, gap, last, value;
+	unsigned int l, c, e, events, events_in_line, clusters;
+	size_t count, i;
+	int idx;
+
+	expected = g_array_new(FALSE, FALSE, sizeof(uint16_t));
+	decoded = g_array_new(FALSE, FALSE, sizeof(uint16_t));
+
+	/* The stop position is in the last line. */
+	events_in_line = 64 * EVENTS_PER_CLUSTER;
+	ts = rng_next();
+	last = 0;
+	for (l = 0; l < NUM_LINES; l++) {
+		if (l == NUM_LINES - 1)
+			events_in_line = stop_event;
+		for (c = 0; c < 64; c++) {
+			cl = &lines[l].cluster[c];
+			/* No gap before the first cluster. */
+			gap = 0;
+			if ((l || c) && rng_next() % 2)
+				gap = rng_next() % 3000;
+			ts += gap;
+			cl->timestamp_lo = ts & 0xff;
+			cl->timestamp_hi = ts >> 8;
+			ts += EVENTS_PER_CLUSTER;
+			if (c * EVENTS_PER_CLUSTER >= events_in_line)
+				continue;
+			append_sample(expected, last,
+				(uint64_t)gap * samples_per_event);
+			events = MIN(EVENTS_PER_CLUSTER,
+				events_in_line - c * EVENTS_PER_CLUSTER);
+			for (e = 0; e < EVENTS_PER_CLUSTER; e++) {
+				item = rng_next();
+				cl->samples[e].sample_lo = item >> 8;
+				cl->samples[e].sample_hi = item & 0xff;
+				if (e >= events)
+					continue;
+				for (idx = 0; idx < samples_per_event; idx++) {
+					last = samples_per_event == 1 ? item :
+						ref_deinterlace(item,
+						samples_per_event, idx);
+					append_sample(expected, last, 1);
+				}
+			}
+		}
+	}
+
+	memset(&ss, 0, sizeof(ss));
+	ss.lastts = sigma_dram_cluster_ts(&lines[0].cluster[0]);
+	events_in_line = 64 * EVENTS_PER_CLUSTER;
+	for (l = 0; l < NUM_LINES; l++) {
+		if (l == NUM_LINES - 1)
+			events_in_line = stop_event;
+		clusters = (events_in_line + EVENTS_PER_CLUSTER - 1)
+			/ EVENTS_PER_CLUSTER;
+		for (c = 0; c < clusters; c++) {
+			last = ss.lastsample;
+			events = MIN(EVENTS_PER_CLUSTER,
+				events_in_line - c * EVENTS_PER_CLUSTER);
+			count = sigma_decode_cluster(&ss, &lines[l].cluster[c],
+				events, samples_per_event, &gap, samples);
+			fail_unless(count == events * samples_per_event,
+				"Got %zu samples from %u events.", count, events);
+			append_sample(decoded, last,
+				(uint64_t)gap * samples_per_event);
+			for (i = 0; i < count; i++) {
+				value = RL16(&samples[2 * i]);
+				g_array_append_val(decoded, value);
+			}
+		}
+	}
+
+	fail_unless(decoded->len == expected->len, "Decoded %u samples, "
+		"expected %u.", decoded->len, expected->len);
+	for (i = 0; i < expected->len; i++)
+		fail_unless(g_array_index(decoded, uint16_t, i)
+			== g_array_index(expected, uint16_t, i),
+			"Sample %zu is 0x%04x, expected 0x%04x (%d per event).",
+			i, g_array_index(decoded, uint16_t, i),
+			g_array_index(expected, uint16_t, i), samples_per_event);
+
+	g_array_free(expected, TRUE);
+	g_array_free(decoded, TRUE);
+}
+
+/* Synthetic captures at 50, 100 and 200MHz. */
+START_TEST(test_asix_sigma_dram)
+{
+	rng_state = 0x0123456789abcdefULL;
+	check_dram(1, 64 * EVENTS_PER_CLUSTER);
+	check_dram(1, 100);
+	check_dram(2, 3);
+	check_dram(2, 64 * EVENTS_PER_CLUSTER - 1);
+	check_dram(4, 200);
+	check_dram(4, 64 * EVENTS_PER_CLUSTER);
+}
+END_TEST
+
+Suite *suite_asix_sigma(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("asix-sigma");
+
+	tc = tcase_create("decode");
+	tcase_add_test(tc, test_asix_sigma_deinterlace);
+	tcase_add_test(tc, test_asix_sigma_dram);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
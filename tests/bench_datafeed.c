@@ -0,0 +1,393 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Datafeed throughput benchmark.
+ *
+ * Runs the demo driver unthrottled, as fast as the session can take its
+ * data, and pushes the data through each transform module and each
+ * output module in turn. A run without any module measures the driver
+ * and the session alone. Reports the input throughput, the packet rate
+ * and, with glibc, the number of heap allocations per packet.
+ *
+ * Usage: bench_datafeed [OPTION...], see --help.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+
+#ifdef __GLIBC__
+/*
+ * Count the heap allocations of the whole process, library included,
+ * by wrapping the allocator. Frees are not interesting here.
+ */
+#define HAVE_ALLOC_COUNT 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t num_allocs;
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (!ptr)
+		__atomic_add_fetch(&num_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static gchar *opt_samplerate = "100M";
+static gchar *opt_samples = "64M";
+static gint opt_logic = 16;
+static gint opt_analog = 0;
+static gchar *opt_pattern = NULL;
+static gchar *opt_modules = NULL;
+static gboolean opt_threaded = FALSE;
+
+static const GOptionEntry optargs[] = {
+	{"samplerate", 'r', 0, G_OPTION_ARG_STRING, &opt_samplerate,
+		"Sample rate (default 100M)", NULL},
+	{"samples", 'n', 0, G_OPTION_ARG_STRING, &opt_samples,
+		"Number of samples per run (default 64M)", NULL},
+	{"logic", 'l', 0, G_OPTION_ARG_INT, &opt_logic,
+		"Number of logic channels (default 16)", NULL},
+	{"analog", 'a', 0, G_OPTION_ARG_INT, &opt_analog,
+		"Number of analog channels (default 0)", NULL},
+	{"pattern", 'p', 0, G_OPTION_ARG_STRING, &opt_pattern,
+		"Logic pattern of the demo driver", NULL},
+	{"modules", 'm', 0, G_OPTION_ARG_STRING, &opt_modules,
+		"Comma separated modules to run, e.g. none,output:vcd,"
+		"transform:nop (default all)", NULL},
+	{"threaded", 't', 0, G_OPTION_ARG_NONE, &opt_threaded,
+		"Run the datafeed callback on a thread of its own", NULL},
+	{NULL, 0, 0, 0, NULL, NULL, NULL},
+};
+
+struct bench_run {
+	const struct sr_output *output;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t out_bytes;
+	unsigned int errors;
+};
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct bench_run *run;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	GString *out;
+
+	(void)sdi;
+
+	run = cb_data;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		run->bytes += logic->length;
+		run->packets++;
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		run->bytes += (uint64_t)analog->num_samples
+			* g_slist_length(analog->meaning->channels)
+			* analog->encoding->unitsize;
+		run->packets++;
+		break;
+	default:
+		break;
+	}
+
+	if (!run->output)
+		return;
+	out = NULL;
+	if (sr_output_send(run->output, packet, &out) != SR_OK)
+		run->errors++;
+	if (out) {
+		run->out_bytes += out->len;
+		g_string_free(out, TRUE);
+	}
+}
+
+static gboolean module_selected(const char *kind, const char *id)
+{
+	gchar **names, *name;
+	gboolean selected;
+	int i;
+
+	if (!opt_modules)
+		return TRUE;
+
+	name = id ? g_strdup_printf("%s:%s", kind, id) : g_strdup(kind);
+	names = g_strsplit(opt_modules, ",", 0);
+	selected = FALSE;
+	for (i = 0; names[i]; i++)
+		if (!strcmp(g_strstrip(names[i]), name))
+			selected = TRUE;
+	g_strfreev(names);
+	g_free(name);
+
+	return selected;
+}
+
+static int run_bench(struct sr_context *ctx, struct sr_dev_inst *sdi,
+		const struct sr_output_module *omod,
+		const struct sr_transform_module *tmod, const char *label)
+{
+	struct sr_session *session;
+	const struct sr_transform *t;
+	struct bench_run run;
+	gchar *filename;
+	int64_t start, elapsed;
+	uint64_t allocs;
+	double secs;
+	int ret;
+
+	if (sr_session_new(ctx, &session) != SR_OK)
+		return SR_ERR;
+	sr_session_dev_add(session, sdi);
+	if (opt_threaded)
+		sr_session_dispatch_set(session, TRUE, 0, SR_DISPATCH_BLOCK);
+
+	memset(&run, 0, sizeof(run));
+	t = NULL;
+	filename = NULL;
+	ret = SR_OK;
+	if (tmod && !(t = sr_transform_new(tmod, NULL, sdi)))
+		ret = SR_ERR;
+	if (omod) {
+		/* Modules which write their own files get a scratch file. */
+		if (sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING))
+			filename = g_build_filename(g_get_tmp_dir(),
+				"bench_datafeed.tmp", NULL);
+		if (!(run.output = sr_output_new(omod, NULL, sdi, filename)))
+			ret = SR_ERR;
+	}
+	if (ret != SR_OK) {
+		printf("%-24s %s\n", label, "(not supported)");
+		goto done;
+	}
+	sr_session_datafeed_callback_add(session, datafeed_in, &run);
+
+#ifdef HAVE_ALLOC_COUNT
+	allocs = __atomic_load_n(&num_allocs, __ATOMIC_RELAXED);
+#else
+	allocs = 0;
+#endif
+	start = g_get_monotonic_time();
+	if ((ret = sr_session_start(session)) == SR_OK)
+		ret = sr_session_run(session);
+	/* Output modules may flush their data only when freed. */
+	if (run.output) {
+		sr_output_free(run.output);
+		run.output = NULL;
+	}
+	elapsed = g_get_monotonic_time() - start;
+#ifdef HAVE_ALLOC_COUNT
+	allocs = __atomic_load_n(&num_allocs, __ATOMIC_RELAXED) - allocs;
+#endif
+
+	if (ret != SR_OK) {
+		printf("%-24s %s\n", label, "(failed)");
+		goto done;
+	}
+	secs = elapsed > 0 ? elapsed / 1e6 : 1e-6;
+	printf("%-24s %10.1f %12.0f %10.1f", label,
+		run.bytes / secs / 1e6, run.packets / secs,
+		run.out_bytes / secs / 1e6);
+#ifdef HAVE_ALLOC_COUNT
+	printf(" %14.2f", run.packets ? (double)allocs / run.packets : 0);
+#else
+	printf(" %14s", "n/a");
+#endif
+	printf("%s\n", run.errors ? "  (errors)" : "");
+
+done:
+	if (run.output)
+		sr_output_free(run.output);
+	/* The transform belongs to the session's sdi, free it first. */
+	if (t)
+		sr_transform_free(t);
+	sr_session_destroy(session);
+	if (filename) {
+		g_unlink(filename);
+		g_free(filename);
+	}
+
+	return ret;
+}
+
+static struct sr_dev_inst *demo_dev_new(struct sr_context *ctx,
+		uint64_t samplerate, uint64_t samples)
+{
+	struct sr_dev_driver **drivers, *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_channel_group *cg;
+	struct sr_config logic, analog;
+	GSList *options, *devices, *l;
+	int i;
+
+	driver = NULL;
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers && drivers[i]; i++)
+		if (!strcmp(drivers[i]->name, "demo"))
+			driver = drivers[i];
+	if (!driver || sr_driver_init(ctx, driver) != SR_OK) {
+		fprintf(stderr, "The demo driver is not available.\n");
+		return NULL;
+	}
+
+	logic.key = SR_CONF_NUM_LOGIC_CHANNELS;
+	logic.data = g_variant_ref_sink(g_variant_new_int32(opt_logic));
+	analog.key = SR_CONF_NUM_ANALOG_CHANNELS;
+	analog.data = g_variant_ref_sink(g_variant_new_int32(opt_analog));
+	options = g_slist_append(g_slist_append(NULL, &logic), &analog);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(logic.data);
+	g_variant_unref(analog.data);
+	if (!devices) {
+		fprintf(stderr, "The demo driver found no device.\n");
+		return NULL;
+	}
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	if (sr_dev_open(sdi) != SR_OK
+			|| sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+				g_variant_new_uint64(samplerate)) != SR_OK
+			|| sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+				g_variant_new_uint64(samples)) != SR_OK
+			|| sr_config_set(sdi, NULL, SR_CONF_UNTHROTTLED,
+				g_variant_new_boolean(TRUE)) != SR_OK) {
+		fprintf(stderr, "Cannot configure the demo device.\n");
+		return NULL;
+	}
+
+	if (opt_pattern) {
+		for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+			cg = l->data;
+			if (strcmp(cg->name, "Logic"))
+				continue;
+			if (sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+					g_variant_new_string(opt_pattern)) != SR_OK) {
+				fprintf(stderr, "Unknown pattern '%s'.\n",
+					opt_pattern);
+				return NULL;
+			}
+		}
+	}
+
+	return sdi;
+}
+
+int main(int argc, char **argv)
+{
+	const struct sr_output_module **omods;
+	const struct sr_transform_module **tmods;
+	struct sr_context *ctx;
+	struct sr_dev_inst *sdi;
+	GOptionContext *context;
+	GError *error;
+	uint64_t samplerate, samples;
+	gchar *label;
+	int i, ret;
+
+	error = NULL;
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, optargs, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if (sr_parse_sizestring(opt_samplerate, &samplerate) != SR_OK
+			|| !samplerate
+			|| sr_parse_sizestring(opt_samples, &samples) != SR_OK
+			|| !samples) {
+		fprintf(stderr, "Invalid sample rate or sample count.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (sr_init(&ctx) != SR_OK)
+		return EXIT_FAILURE;
+	sr_log_loglevel_set(SR_LOG_WARN);
+
+	if (!(sdi = demo_dev_new(ctx, samplerate, samples))) {
+		sr_exit(ctx);
+		return EXIT_FAILURE;
+	}
+
+	printf("%d logic, %d analog channels, %" PRIu64 " samples at %s\n\n",
+		opt_logic, opt_analog, samples, opt_samplerate);
+	printf("%-24s %10s %12s %10s %14s\n", "module",
+		"in MB/s", "packets/s", "out MB/s", "allocs/packet");
+
+	ret = EXIT_SUCCESS;
+	if (module_selected("none", NULL)
+			&& run_bench(ctx, sdi, NULL, NULL, "none") != SR_OK)
+		ret = EXIT_FAILURE;
+
+	tmods = sr_transform_list();
+	for (i = 0; tmods && tmods[i]; i++) {
+		if (!module_selected("transform", sr_transform_id_get(tmods[i])))
+			continue;
+		label = g_strdup_printf("transform:%s",
+			sr_transform_id_get(tmods[i]));
+		if (run_bench(ctx, sdi, NULL, tmods[i], label) != SR_OK)
+			ret = EXIT_FAILURE;
+		g_free(label);
+	}
+
+	omods = sr_output_list();
+	for (i = 0; omods && omods[i]; i++) {
+		if (!module_selected("output", sr_output_id_get(omods[i])))
+			continue;
+		label = g_strdup_printf("output:%s", sr_output_id_get(omods[i]));
+		/* Modules which cannot take this device are no failure. */
+		run_bench(ctx, sdi, omods[i], NULL, label);
+		g_free(label);
+	}
+
+	sr_exit(ctx);
+
+	return ret;
+}
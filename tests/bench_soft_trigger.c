@@ -0,0 +1,318 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Software trigger benchmark.
+ *
+ * Runs the compiled soft-trigger engine (src/soft-trigger.c, linked in
+ * statically since it is private to the library) and the previous
+ * sample-by-sample implementation over the same buffers, checks that
+ * both fire at the same sample, and reports samples per second.
+ *
+ * Usage: bench_soft_trigger [megasamples]
+ */
+
+#include <config.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define DEFAULT_MEGASAMPLES 64
+#define BLOCK_BYTES (1024 * 1024)
+
+static int num_triggers;
+
+/*
+ * The soft-trigger code sends its packets through the session. There is
+ * no session here, only count the triggers.
+ */
+SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	(void)sdi;
+
+	if (packet->type == SR_DF_TRIGGER)
+		num_triggers++;
+
+	return SR_OK;
+}
+
+SR_PRIV int sr_log(int loglevel, const char *format, ...)
+{
+	va_list args;
+
+	if (loglevel > SR_LOG_WARN)
+		return SR_OK;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+
+	return SR_OK;
+}
+
+/* The previous implementation: one sample and one match at a time. */
+struct ref_trigger {
+	const struct sr_trigger *trigger;
+	int unitsize;
+	int count;
+	int cur_stage;
+	uint8_t *prev_sample;
+};
+
+static gboolean ref_check_match(struct ref_trigger *rt,
+		uint8_t *sample, struct sr_trigger_match *match)
+{
+	int bit, prev_bit;
+	gboolean result;
+
+	rt->count++;
+	result = FALSE;
+	bit = *(sample + match->channel->index / 8)
+			& (1 << (match->channel->index % 8));
+	if (match->match == SR_TRIGGER_ZERO)
+		result = bit == 0;
+	else if (match->match == SR_TRIGGER_ONE)
+		result = bit != 0;
+	else {
+		if (rt->count == 1)
+			return FALSE;
+		prev_bit = *(rt->prev_sample + match->channel->index / 8)
+				& (1 << (match->channel->index % 8));
+		if (match->match == SR_TRIGGER_RISING)
+			result = prev_bit == 0 && bit != 0;
+		else if (match->match == SR_TRIGGER_FALLING)
+			result = prev_bit != 0 && bit == 0;
+		else if (match->match == SR_TRIGGER_EDGE)
+			result = prev_bit != bit;
+	}
+
+	return result;
+}
+
+static int ref_check(struct ref_trigger *rt, uint8_t *buf, int len)
+{
+	struct sr_trigger_stage *stage;
+	struct sr_trigger_match *match;
+	GSList *l, *l_stage;
+	int i;
+	gboolean match_found;
+
+	for (i = 0; i < len; i += rt->unitsize) {
+		l_stage = g_slist_nth(rt->trigger->stages, rt->cur_stage);
+		stage = l_stage->data;
+		match_found = TRUE;
+		for (l = stage->matches; l; l = l->next) {
+			match = l->data;
+			if (!match->channel->enabled)
+				continue;
+			if (!ref_check_match(rt, buf + i, match)) {
+				match_found = FALSE;
+				break;
+			}
+		}
+		memcpy(rt->prev_sample, buf + i, rt->unitsize);
+		if (match_found) {
+			if (l_stage->next)
+				rt->cur_stage++;
+			else
+				return i / rt->unitsize;
+		} else if (rt->cur_stage > 0) {
+			i -= rt->cur_stage * rt->unitsize;
+			if (i < -1)
+				i = -1;
+			rt->cur_stage = 0;
+		}
+	}
+
+	return -1;
+}
+
+static struct sr_dev_inst *bench_sdi_new(int num_channels)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	int i;
+
+	sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	for (i = 0; i < num_channels; i++) {
+		ch = g_malloc0(sizeof(struct sr_channel));
+		ch->sdi = sdi;
+		ch->index = i;
+		ch->type = SR_CHANNEL_LOGIC;
+		ch->enabled = TRUE;
+		ch->name = g_strdup_printf("D%d", i);
+		sdi->channels = g_slist_append(sdi->channels, ch);
+	}
+
+	return sdi;
+}
+
+static void bench_sdi_free(struct sr_dev_inst *sdi)
+{
+	GSList *l;
+	struct sr_channel *ch;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		g_free(ch->name);
+		g_free(ch);
+	}
+	g_slist_free(sdi->channels);
+	g_free(sdi);
+}
+
+/*
+ * Random data on all channels, except that the top channel stays low
+ * until the very last sample, where it rises together with channel 0
+ * being high. The trigger (D0 high, top channel rising) therefore only
+ * fires at the end of the buffer.
+ */
+static uint8_t *bench_data_new(int unitsize, uint64_t num_samples)
+{
+	uint8_t *buf, *last;
+	uint64_t i, state;
+	int top;
+
+	buf = g_malloc(num_samples * unitsize);
+	state = 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < num_samples * unitsize; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		buf[i] = state;
+	}
+
+	top = unitsize * 8 - 1;
+	for (i = 0; i < num_samples; i++)
+		buf[i * unitsize + top / 8] &= ~(1 << (top % 8));
+	last = buf + (num_samples - 1) * unitsize;
+	last[0] |= 1;
+	last[top / 8] |= 1 << (top % 8);
+
+	return buf;
+}
+
+static double run_bench(struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		uint8_t *buf, int unitsize, uint64_t num_samples,
+		gboolean compiled, int64_t *trigger_sample)
+{
+	struct soft_trigger_logic *stl;
+	struct ref_trigger rt;
+	uint64_t pos, len, total;
+	int64_t start;
+	int offset;
+
+	stl = NULL;
+	memset(&rt, 0, sizeof(rt));
+	if (compiled) {
+		stl = soft_trigger_logic_new(sdi, trigger, 0);
+	} else {
+		rt.trigger = trigger;
+		rt.unitsize = unitsize;
+		rt.prev_sample = g_malloc0(unitsize);
+	}
+
+	*trigger_sample = -1;
+	total = num_samples * unitsize;
+	start = g_get_monotonic_time();
+	for (pos = 0; pos < total; pos += len) {
+		len = MIN((uint64_t)(BLOCK_BYTES - BLOCK_BYTES % unitsize),
+			total - pos);
+		if (compiled)
+			offset = soft_trigger_logic_check(stl, buf + pos, len, NULL);
+		else
+			offset = ref_check(&rt, buf + pos, len);
+		if (offset >= 0) {
+			*trigger_sample = pos / unitsize + offset;
+			break;
+		}
+	}
+	start = g_get_monotonic_time() - start;
+
+	if (compiled)
+		soft_trigger_logic_free(stl);
+	else
+		g_free(rt.prev_sample);
+
+	return start > 0 ? num_samples * 1e6 / start : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const int channel_counts[] = { 8, 16, 32, 64, 128 };
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	uint64_t num_samples;
+	int64_t ref_sample, new_sample;
+	double ref_rate, new_rate;
+	unsigned int i;
+	int unitsize, ret;
+	uint8_t *buf;
+
+	num_samples = DEFAULT_MEGASAMPLES;
+	if (argc > 1)
+		num_samples = g_ascii_strtoull(argv[1], NULL, 10);
+	num_samples *= 1000 * 1000;
+	if (!num_samples)
+		return EXIT_FAILURE;
+
+	ret = EXIT_SUCCESS;
+	printf("%-9s %16s %16s %8s\n", "channels",
+		"reference MS/s", "compiled MS/s", "speedup");
+	for (i = 0; i < G_N_ELEMENTS(channel_counts); i++) {
+		unitsize = channel_counts[i] / 8;
+		sdi = bench_sdi_new(channel_counts[i]);
+		trigger = sr_trigger_new(NULL);
+		stage = sr_trigger_stage_add(trigger);
+		sr_trigger_match_add(stage, g_slist_nth_data(sdi->channels, 0),
+			SR_TRIGGER_ONE, 0);
+		sr_trigger_match_add(stage, g_slist_last(sdi->channels)->data,
+			SR_TRIGGER_RISING, 0);
+		buf = bench_data_new(unitsize, num_samples);
+
+		ref_rate = run_bench(sdi, trigger, buf, unitsize,
+			num_samples, FALSE, &ref_sample);
+		num_triggers = 0;
+		new_rate = run_bench(sdi, trigger, buf, unitsize,
+			num_samples, TRUE, &new_sample);
+
+		printf("%-9d %16.1f %16.1f %7.1fx\n", channel_counts[i],
+			ref_rate / 1e6, new_rate / 1e6,
+			ref_rate > 0 ? new_rate / ref_rate : 0);
+		if (ref_sample != new_sample || num_triggers != 1) {
+			fprintf(stderr, "Mismatch: reference triggered at %"
+				G_GINT64_FORMAT ", compiled at %" G_GINT64_FORMAT
+				".\n", ref_sample, new_sample);
+			ret = EXIT_FAILURE;
+		}
+
+		g_free(buf);
+		sr_trigger_free(trigger);
+		bench_sdi_free(sdi);
+	}
+
+	return ret;
+}
@@ -29,6 +29,7 @@ enum {
 	CHECK_ALL_LOW,
 	CHECK_ALL_HIGH,
 	CHECK_HELLO_WORLD,
+	CHECK_COUNTING,
 };
 
 static uint64_t df_packet_counter = 0, sample_counter = 0;
@@ -76,6 +77,20 @@ static void check_hello_world(const struct sr_datafeed_logic *logic)
 	}
 }
 
+/* Byte n of the file is n % 251, whatever the unit size. */
+static void check_counting(const struct sr_datafeed_logic *logic)
+{
+	uint64_t i, offset;
+	uint8_t *data;
+
+	data = logic->data;
+	offset = sample_counter * logic->unitsize;
+	for (i = 0; i < logic->length; i++)
+		if (data[i] != (offset + i) % 251)
+			fail("Byte %" PRIu64 " is 0x%02x, expected 0x%02x.",
+			     offset + i, data[i], (unsigned int)((offset + i) % 251));
+}
+
 static void datafeed_in(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *packet, void *cb_data)
 {
@@ -158,6 +173,8 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 			check_all_high(logic);
 		else if (check_to_perform == CHECK_HELLO_WORLD)
 			check_hello_world(logic);
+		else if (check_to_perform == CHECK_COUNTING)
+			check_counting(logic);
 
 		sample_counter += logic->length / logic->unitsize;
 
@@ -221,6 +238,24 @@ static void check_buf(GHashTable *options, const uint8_t *buf, int check,
 	g_string_free(gbuf, TRUE);
 }
 
+/*
+ * Like check_buf(), but feed len bytes from a mapped file. A partial
+ * sample at the end of the file is dropped.
+ */
+static void check_mapped(GHashTable *options, const uint8_t *buf, int check,
+		uint64_t len, unsigned int unitsize, size_t window)
+{
+	df_packet_counter = sample_counter = 0;
+	have_seen_df_end = FALSE;
+	logic_channellist = NULL;
+	check_to_perform = check;
+	expected_samples = len / unitsize;
+	expected_samplerate = NULL;
+
+	srtest_input_run_mapped("binary", options, (const char *)buf, len,
+		window, datafeed_in);
+}
+
 START_TEST(test_input_binary_all_low)
 {
 	uint64_t i, samplerate;
@@ -308,6 +343,59 @@ START_TEST(test_input_binary_hello_world)
 }
 END_TEST
 
+START_TEST(test_input_binary_mapped)
+{
+	uint64_t i;
+	uint8_t *buf;
+
+	buf = g_malloc(BUFSIZE);
+	memset(buf, 0xff, BUFSIZE);
+
+	/* All at once, and in windows which split the data unevenly. */
+	for (i = 0; i < BUFSIZE; i = i * 7 + 1) {
+		check_mapped(NULL, buf, CHECK_ALL_HIGH, i, 1, BUFSIZE);
+		check_mapped(NULL, buf, CHECK_ALL_HIGH, i, 1, 4093);
+	}
+
+	g_free(buf);
+}
+END_TEST
+
+/*
+ * Samples of two and three bytes, in windows which end in the middle of
+ * a sample. The module must carry the partial samples over.
+ */
+START_TEST(test_input_binary_mapped_channels)
+{
+	const uint64_t lengths[] = { 1, 2, 3, 100, 4095, 100003 };
+	const size_t windows[] = { 7, 4093, BUFSIZE };
+	const int num_channels[] = { 16, 24 };
+	GHashTable *options;
+	unsigned int c, l, w;
+	uint64_t i;
+	uint8_t *buf;
+
+	buf = g_malloc(BUFSIZE);
+	for (i = 0; i < BUFSIZE; i++)
+		buf[i] = i % 251;
+
+	for (c = 0; c < G_N_ELEMENTS(num_channels); c++) {
+		options = g_hash_table_new_full(g_str_hash, g_str_equal,
+				g_free, (GDestroyNotify)g_variant_unref);
+		g_hash_table_insert(options, g_strdup("numchannels"),
+			g_variant_ref_sink(g_variant_new_int32(num_channels[c])));
+		for (l = 0; l < G_N_ELEMENTS(lengths); l++)
+			for (w = 0; w < G_N_ELEMENTS(windows); w++)
+				check_mapped(options, buf, CHECK_COUNTING,
+					lengths[l], num_channels[c] / 8,
+					windows[w]);
+		g_hash_table_destroy(options);
+	}
+
+	g_free(buf);
+}
+END_TEST
+
 Suite *suite_input_binary(void)
 {
 	Suite *s;
@@ -321,6 +409,8 @@ Suite *suite_input_binary(void)
 	tcase_add_test(tc, test_input_binary_all_high);
 	tcase_add_loop_test(tc, test_input_binary_all_high_loop, 1, 10);
 	tcase_add_test(tc, test_input_binary_hello_world);
+	tcase_add_test(tc, test_input_binary_mapped);
+	tcase_add_test(tc, test_input_binary_mapped_channels);
 	suite_add_tcase(s, tc);
 
 	return s;
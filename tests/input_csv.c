@@ -0,0 +1,351 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/* Enough text for the input module to use its parser threads. */
+#define NUM_BIG_LINES 100000
+
+/*
+ * A header, comments, blank lines and white space around the values,
+ * with CR LF line ends. The last line has no line end.
+ */
+static const char *csv_multi =
+	"; generated by hand\r\n"
+	"clk,cs,d0,d1,d2,d3,d4,d5,d6,d7,irq\r\n"
+	"0,1,0,0,0,0,0,0,0,0,0\r\n"
+	"1,0,1,0,1,0,1,0,1,0,0 ; first byte\r\n"
+	"\r\n"
+	"0, 0, 1,1,1,1,0,0,0,0, 1\r\n"
+	"; a comment\r\n"
+	"1,0,1,1,1,1,1,1,1,1,1";
+
+static const uint16_t csv_multi_samples[] = {
+	0x0002, 0x0155, 0x043c, 0x07fd,
+};
+
+static const char *csv_multi_names[] = {
+	"clk", "cs", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "irq",
+};
+
+static GByteArray *logic_data;
+static unsigned int logic_unitsize;
+static const char **expected_names;
+static unsigned int num_expected_names;
+
+static void check_names(const struct sr_dev_inst *sdi)
+{
+	struct sr_channel *ch;
+	GSList *l;
+	unsigned int i;
+
+	i = 0;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next, i++) {
+		ch = l->data;
+		fail_unless(i < num_expected_names, "Too many channels.");
+		fail_unless(!strcmp(ch->name, expected_names[i]),
+			"Channel %u is '%s', expected '%s'.",
+			i, ch->name, expected_names[i]);
+	}
+	fail_unless(i == num_expected_names, "Expected %u channels, got %u.",
+		num_expected_names, i);
+}
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		logic_unitsize = logic->unitsize;
+		g_byte_array_append(logic_data, logic->data, logic->length);
+		break;
+	case SR_DF_END:
+		if (expected_names)
+			check_names(sdi);
+		break;
+	default:
+		break;
+	}
+}
+
+static GHashTable *new_options(void)
+{
+	return g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+}
+
+static void add_option(GHashTable *options, const char *key, GVariant *value)
+{
+	g_hash_table_insert(options, g_strdup(key), g_variant_ref_sink(value));
+}
+
+/*
+ * Feed the CSV text to the input module in pieces of chunksize bytes.
+ * The channel names are checked when names is not NULL.
+ */
+static void run_csv(const char *csv, size_t chunksize, GHashTable *options,
+		const char **names, unsigned int num_names)
+{
+	logic_data = g_byte_array_new();
+	logic_unitsize = 0;
+	expected_names = names;
+	num_expected_names = num_names;
+
+	srtest_input_run("csv", options, csv, strlen(csv), chunksize,
+		datafeed_in, FALSE);
+}
+
+/* The samples must not depend on how the file is split up. */
+START_TEST(test_input_csv_multi)
+{
+	GHashTable *options;
+	size_t chunksize;
+	unsigned int i;
+	uint16_t value;
+
+	options = new_options();
+	add_option(options, "header", g_variant_new_boolean(TRUE));
+
+	for (chunksize = 1; chunksize <= strlen(csv_multi); chunksize++) {
+		run_csv(csv_multi, chunksize, options, csv_multi_names,
+			G_N_ELEMENTS(csv_multi_names));
+		fail_unless(logic_unitsize == 2, "Wrong unitsize %u.",
+			logic_unitsize);
+		fail_unless(logic_data->len == sizeof(csv_multi_samples),
+			"Expected %zu samples, got %u (chunk size %zu).",
+			G_N_ELEMENTS(csv_multi_samples), logic_data->len / 2,
+			chunksize);
+		for (i = 0; i < G_N_ELEMENTS(csv_multi_samples); i++) {
+			value = logic_data->data[2 * i]
+				| logic_data->data[2 * i + 1] << 8;
+			fail_unless(value == csv_multi_samples[i],
+				"Sample %u is 0x%04x, expected 0x%04x "
+				"(chunk size %zu).", i, value,
+				csv_multi_samples[i], chunksize);
+		}
+		g_byte_array_free(logic_data, TRUE);
+	}
+
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+static void check_single(const char *csv, const char *format,
+		int first_channel, int num_channels, const uint8_t *expected,
+		size_t len)
+{
+	GHashTable *options;
+
+	options = new_options();
+	add_option(options, "single-column", g_variant_new_int32(2));
+	add_option(options, "numchannels", g_variant_new_int32(num_channels));
+	add_option(options, "format", g_variant_new_string(format));
+	add_option(options, "first-channel", g_variant_new_int32(first_channel));
+
+	run_csv(csv, strlen(csv), options, NULL, 0);
+	fail_unless(logic_data->len == len,
+		"Expected %zu bytes of %s samples, got %u.",
+		len, format, logic_data->len);
+	fail_unless(!memcmp(logic_data->data, expected, len),
+		"Wrong %s samples.", format);
+	g_byte_array_free(logic_data, TRUE);
+
+	g_hash_table_destroy(options);
+}
+
+/* Digits count from the right, 'first-channel' skips the lowest bits. */
+START_TEST(test_input_csv_single)
+{
+	const uint8_t bin[] = {
+		0xa5, 0x0f, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+	const uint8_t bin_skip[] = {
+		0xd2, 0x87, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+	const uint8_t hex[] = {
+		0x6d, 0xbd, 0x00, 0x21, 0x43, 0x05, 0x00, 0x00, 0x00,
+	};
+	const uint8_t hex_skip[] = {
+		0xad, 0x17, 0x00, 0x64, 0xa8, 0x00, 0x00, 0x00, 0x00,
+	};
+	const uint8_t oct[] = { 0x53, 0x02, 0xff, 0x03 };
+
+	check_single("0,x,110000111110100101\n1,y,11\n2,z,0\n",
+		"bin", 0, 20, bin, sizeof(bin));
+	check_single("0,x,110000111110100101\n1,y,11\n2,z,0\n",
+		"bin", 1, 20, bin_skip, sizeof(bin_skip));
+	check_single("0,x,BD6D\n1,y,54321\n2,z,0\n",
+		"hex", 0, 20, hex, sizeof(hex));
+	check_single("0,x,BD6D\n1,y,54321\n2,z,0\n",
+		"hex", 3, 20, hex_skip, sizeof(hex_skip));
+	check_single("0,x,7123\n1,y,1777\n", "oct", 0, 10, oct, sizeof(oct));
+}
+END_TEST
+
+/* Parser threads must give the same samples as the calling thread. */
+START_TEST(test_input_csv_threads)
+{
+	GHashTable *options;
+	GByteArray *expected;
+	GString *csv;
+	uint32_t state;
+	unsigned int i, ch;
+	size_t chunksize;
+
+	/* Some lines take the eight columns fast path, some don't. */
+	csv = g_string_sized_new(NUM_BIG_LINES * 24);
+	state = 1;
+	for (i = 0; i < NUM_BIG_LINES; i++) {
+		for (ch = 0; ch < 10; ch++) {
+			state = state * 1103515245 + 12345;
+			g_string_append_c(csv, (state >> 16) & 1 ? '1' : '0');
+			g_string_append(csv, i % 7 == 3 && ch == 4 ? " , " : ",");
+		}
+		g_string_append(csv, i % 100 ? "x\n" : "x ; comment\n\n");
+	}
+
+	options = new_options();
+	add_option(options, "numchannels", g_variant_new_int32(10));
+	run_csv(csv->str, csv->len, options, NULL, 0);
+	expected = logic_data;
+	fail_unless(expected->len == 2 * NUM_BIG_LINES,
+		"Expected %d samples, got %u.", NUM_BIG_LINES, expected->len / 2);
+
+	add_option(options, "threads", g_variant_new_uint32(3));
+	for (chunksize = 4096; chunksize < csv->len; chunksize *= 8) {
+		run_csv(csv->str, chunksize, options, NULL, 0);
+		fail_unless(logic_data->len == expected->len &&
+			!memcmp(logic_data->data, expected->data, expected->len),
+			"Different samples with threads (chunk size %zu).",
+			chunksize);
+		g_byte_array_free(logic_data, TRUE);
+	}
+	run_csv(csv->str, csv->len, options, NULL, 0);
+	fail_unless(logic_data->len == expected->len &&
+		!memcmp(logic_data->data, expected->data, expected->len),
+		"Different samples with threads.");
+	g_byte_array_free(logic_data, TRUE);
+
+	g_byte_array_free(expected, TRUE);
+	g_hash_table_destroy(options);
+	g_string_free(csv, TRUE);
+}
+END_TEST
+
+/*
+ * A reset input parses the same text again, with its parser threads,
+ * the header and the channels it had before.
+ */
+START_TEST(test_input_csv_reset)
+{
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GHashTable *options;
+	GByteArray *expected;
+	GString *csv, *gbuf;
+	uint32_t state;
+	unsigned int i, ch, pass;
+	int ret;
+
+	csv = g_string_new("\xef\xbb\xbf");
+	g_string_append(csv, "clk,cs,d0,d1,d2,d3,d4,d5,d6,d7,irq\n");
+	state = 1;
+	for (i = 0; i < NUM_BIG_LINES; i++) {
+		for (ch = 0; ch < 11; ch++) {
+			state = state * 1103515245 + 12345;
+			g_string_append_c(csv, (state >> 16) & 1 ? '1' : '0');
+			g_string_append_c(csv, ch < 10 ? ',' : '\n');
+		}
+	}
+
+	options = new_options();
+	add_option(options, "header", g_variant_new_boolean(TRUE));
+	run_csv(csv->str, csv->len, options, csv_multi_names,
+		G_N_ELEMENTS(csv_multi_names));
+	expected = logic_data;
+	fail_unless(expected->len == 2 * NUM_BIG_LINES,
+		"Expected %d samples, got %u.", NUM_BIG_LINES, expected->len / 2);
+
+	add_option(options, "threads", g_variant_new_uint32(3));
+	imod = sr_input_find("csv");
+	in = sr_input_new(imod, options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	expected_names = csv_multi_names;
+	num_expected_names = G_N_ELEMENTS(csv_multi_names);
+
+	for (pass = 0; pass < 3; pass++) {
+		logic_data = g_byte_array_new();
+		gbuf = g_string_new_len(csv->str, csv->len);
+		ret = sr_input_send(in, gbuf);
+		fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+		g_string_free(gbuf, TRUE);
+		if (!pass) {
+			sdi = sr_input_dev_inst_get(in);
+			fail_unless(sdi != NULL, "No device after the header.");
+			sr_session_dev_add(session, sdi);
+		}
+		ret = sr_input_end(in);
+		fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+		fail_unless(logic_data->len == expected->len &&
+			!memcmp(logic_data->data, expected->data, expected->len),
+			"Different samples after %u resets.", pass);
+		g_byte_array_free(logic_data, TRUE);
+		ret = sr_input_reset(in);
+		fail_unless(ret == SR_OK, "sr_input_reset() error: %d", ret);
+	}
+
+	sr_session_destroy(session);
+	sr_input_free(in);
+
+	g_byte_array_free(expected, TRUE);
+	g_hash_table_destroy(options);
+	g_string_free(csv, TRUE);
+}
+END_TEST
+
+Suite *suite_input_csv(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-csv");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_csv_multi);
+	tcase_add_test(tc, test_input_csv_single);
+	tcase_add_test(tc, test_input_csv_threads);
+	tcase_add_test(tc, test_input_csv_reset);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
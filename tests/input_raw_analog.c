@@ -0,0 +1,234 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_SAMPLES 1050
+#define PACKET_SIZE 100
+
+static GArray *packet_sizes;
+static GArray *analog_data;
+static gboolean all_float;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_analog *analog;
+	unsigned int count;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		g_array_append_val(packet_sizes, analog->num_samples);
+		if (!analog->encoding->is_float)
+			all_float = FALSE;
+		count = analog->num_samples
+			* g_slist_length(analog->meaning->channels);
+		g_array_set_size(analog_data, analog_data->len + count);
+		fail_unless(sr_analog_to_float(analog, &g_array_index(analog_data,
+			float, analog_data->len - count)) == SR_OK,
+			"Failed to convert the samples.");
+		break;
+	default:
+		break;
+	}
+}
+
+static GHashTable *new_options(const char *format, int num_channels)
+{
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("format"),
+		g_variant_ref_sink(g_variant_new_string(format)));
+	g_hash_table_insert(options, g_strdup("numchannels"),
+		g_variant_ref_sink(g_variant_new_int32(num_channels)));
+	g_hash_table_insert(options, g_strdup("packetsize"),
+		g_variant_ref_sink(g_variant_new_uint32(PACKET_SIZE)));
+
+	return options;
+}
+
+/*
+ * Feed the file to the input module in pieces of chunksize bytes, or
+ * map it and offer it in windows of chunksize bytes.
+ */
+static void run_raw(const GString *raw, size_t chunksize, GHashTable *options,
+		gboolean mapped)
+{
+	packet_sizes = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+	analog_data = g_array_new(FALSE, FALSE, sizeof(float));
+	all_float = TRUE;
+
+	if (mapped)
+		srtest_input_run_mapped("raw_analog", options, raw->str,
+			raw->len, chunksize, datafeed_in);
+	else
+		srtest_input_run("raw_analog", options, raw->str, raw->len,
+			chunksize, datafeed_in, FALSE);
+}
+
+static void check_run(const float *expected, unsigned int count)
+{
+	unsigned int i, size;
+
+	/* Only the last packet may be short. */
+	for (i = 0; i < packet_sizes->len; i++) {
+		size = g_array_index(packet_sizes, uint32_t, i);
+		fail_unless(size == PACKET_SIZE || (i == packet_sizes->len - 1
+			&& size == NUM_SAMPLES % PACKET_SIZE),
+			"Packet %u has %u samples.", i, size);
+	}
+	fail_unless(packet_sizes->len == (NUM_SAMPLES + PACKET_SIZE - 1)
+		/ PACKET_SIZE, "Got %u packets.", packet_sizes->len);
+
+	fail_unless(analog_data->len == count, "Expected %u values, got %u.",
+		count, analog_data->len);
+	for (i = 0; i < count; i++) {
+		fail_unless(fabsf(g_array_index(analog_data, float, i)
+			- expected[i]) < 1e-5, "Value %u is %g, expected %g.",
+			i, g_array_index(analog_data, float, i), expected[i]);
+	}
+
+	g_array_free(packet_sizes, TRUE);
+	g_array_free(analog_data, TRUE);
+}
+
+/*
+ * Packets have the configured size however the file is split up, and
+ * the short one at the end also comes from a mapped file.
+ */
+START_TEST(test_input_raw_analog_packets)
+{
+	float expected[3 * NUM_SAMPLES];
+	GHashTable *options;
+	GString *raw;
+	size_t chunksize;
+	unsigned int i;
+	int16_t v;
+	gboolean mapped;
+
+	raw = g_string_new(NULL);
+	for (i = 0; i < 3 * NUM_SAMPLES; i++) {
+		v = i * 19 - 30000;
+		g_string_append_c(raw, v & 0xff);
+		g_string_append_c(raw, (v >> 8) & 0xff);
+		expected[i] = v / 32768.0;
+	}
+
+	options = new_options("S16_LE", 3);
+	for (mapped = FALSE; mapped <= TRUE; mapped++) {
+		for (chunksize = 77; chunksize < raw->len; chunksize *= 4) {
+			run_raw(raw, chunksize, options, mapped);
+			fail_unless(!all_float, "Raw samples were converted.");
+			check_run(expected, 3 * NUM_SAMPLES);
+		}
+	}
+
+	g_hash_table_insert(options, g_strdup("output"),
+		g_variant_ref_sink(g_variant_new_string("float")));
+	for (mapped = FALSE; mapped <= TRUE; mapped++) {
+		run_raw(raw, 1000, options, mapped);
+		fail_unless(all_float, "Samples were not converted.");
+		check_run(expected, 3 * NUM_SAMPLES);
+	}
+
+	g_hash_table_destroy(options);
+	g_string_free(raw, TRUE);
+}
+END_TEST
+
+/* Every channel gets its own scale and offset. */
+START_TEST(test_input_raw_analog_scale)
+{
+	float expected[2 * NUM_SAMPLES];
+	GHashTable *options;
+	GString *raw;
+	unsigned int i;
+	uint16_t v;
+
+	raw = g_string_new(NULL);
+	for (i = 0; i < 2 * NUM_SAMPLES; i++) {
+		v = i * 31;
+		g_string_append_c(raw, v >> 8);
+		g_string_append_c(raw, v & 0xff);
+		expected[i] = v / 65535.0 - 0.5;
+		expected[i] = i % 2 ? expected[i] * 0.5 + 1 : expected[i] * 2;
+	}
+
+	options = new_options("U16_BE", 2);
+	g_hash_table_insert(options, g_strdup("scale"),
+		g_variant_ref_sink(g_variant_new_string("2, 0.5")));
+	g_hash_table_insert(options, g_strdup("offset"),
+		g_variant_ref_sink(g_variant_new_string("0,1")));
+	run_raw(raw, 999, options, FALSE);
+	fail_unless(all_float, "Scaled samples must be floats.");
+	check_run(expected, 2 * NUM_SAMPLES);
+
+	g_hash_table_destroy(options);
+	g_string_free(raw, TRUE);
+}
+END_TEST
+
+/* The float buffer of a packet must not wrap around in size. */
+START_TEST(test_input_raw_analog_packet_overflow)
+{
+	const struct sr_input_module *imod;
+	GHashTable *options;
+
+	imod = sr_input_find("raw_analog");
+	fail_unless(imod != NULL, "Failed to find input module.");
+
+	options = new_options("S16_LE", G_MAXINT32);
+	g_hash_table_insert(options, g_strdup("packetsize"),
+		g_variant_ref_sink(g_variant_new_uint32(G_MAXUINT32)));
+	g_hash_table_insert(options, g_strdup("output"),
+		g_variant_ref_sink(g_variant_new_string("float")));
+	fail_unless(sr_input_new(imod, options) == NULL,
+		"Accepted %u samples of %d channels.", G_MAXUINT32, G_MAXINT32);
+
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+Suite *suite_input_raw_analog(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-raw-analog");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_raw_analog_packets);
+	tcase_add_test(tc, test_input_raw_analog_scale);
+	tcase_add_test(tc, test_input_raw_analog_packet_overflow);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
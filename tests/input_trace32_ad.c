@@ -0,0 +1,351 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define NUM_RECORDS 300
+#define HEADER_SIZE 80
+/* 200MHz from the 0.078125ns timestamps. */
+#define SAMPLERATE_MHZ 200
+#define TICKS_PER_SAMPLE 64
+
+enum {
+	PI_250MHZ,
+	PI_500MHZ,
+	IPROBE,
+};
+
+static const char pod_names[] = "ABCDEFJKLMNO";
+
+static uint64_t rng_state;
+
+static GString *logic_data;
+static unsigned int logic_unitsize;
+static size_t trigger_pos;
+static int num_triggers;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_config *src;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		src = meta->config->data;
+		fail_unless(src->key == SR_CONF_SAMPLERATE);
+		fail_unless(g_variant_get_uint64(src->data)
+			== SR_MHZ(SAMPLERATE_MHZ), "Wrong samplerate.");
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		fail_unless(logic->unitsize == logic_unitsize,
+			"Unit size %u, expected %u.", logic->unitsize,
+			logic_unitsize);
+		fail_unless(logic->length % logic->unitsize == 0,
+			"Packet of %" PRIu64 " bytes.", logic->length);
+		g_string_append_len(logic_data, logic->data, logic->length);
+		break;
+	case SR_DF_TRIGGER:
+		trigger_pos = logic_data->len / logic_unitsize;
+		num_triggers++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void write_u64le(uint8_t *p, uint64_t value)
+{
+	WL32(p, value);
+	WL32(p + 4, value >> 32);
+}
+
+static GHashTable *new_options(unsigned int pods)
+{
+	GHashTable *options;
+	unsigned int pod;
+	char id[8];
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	for (pod = 0; pod < strlen(pod_names); pod++) {
+		g_snprintf(id, sizeof(id), "pod%c", pod_names[pod]);
+		g_hash_table_insert(options, g_strdup(id),
+			g_variant_ref_sink(g_variant_new_boolean(
+				(pods >> pod) & 1)));
+	}
+	g_hash_table_insert(options, g_strdup("samplerate"),
+		g_variant_ref_sink(g_variant_new_uint32(SAMPLERATE_MHZ)));
+
+	return options;
+}
+
+static unsigned int record_size(int type)
+{
+	return type == IPROBE ? 11 : type == PI_500MHZ ? 28 : 45;
+}
+
+/*
+ * An uncompressed file of random records. The timestamps are the same
+ * or go back at times, and have long gaps now and then. The trigger is
+ * at the timestamp of the given record, none if that is past the end.
+ */
+static GString *make_file(int type, unsigned int trigger)
+{
+	GString *file;
+	uint8_t header[HEADER_SIZE], *record;
+	uint64_t timestamp, gap;
+	unsigned int size, i, j;
+
+	size = record_size(type);
+	file = g_string_sized_new(HEADER_SIZE + NUM_RECORDS * size);
+	g_string_set_size(file, HEADER_SIZE + NUM_RECORDS * size);
+	record = (uint8_t *)file->str + HEADER_SIZE;
+	timestamp = rng_next() >> 24;
+	for (i = 0; i < NUM_RECORDS; i++, record += size) {
+		for (j = 0; j < size; j++)
+			record[j] = rng_next();
+		write_u64le(record, timestamp);
+		if (i == trigger)
+			write_u64le(header + 32, timestamp);
+
+		switch (rng_next() % 8) {
+		case 0:
+			gap = 0;
+			break;
+		case 1:
+			gap = -(uint64_t)(rng_next() % 1000);
+			break;
+		case 2:
+			gap = rng_next() % TICKS_PER_SAMPLE;
+			break;
+		case 3:
+			/* Multiple flushes of the output buffer. */
+			gap = rng_next() % 100 ? 1000 : 300000;
+			gap = gap * TICKS_PER_SAMPLE + 1;
+			break;
+		default:
+			gap = rng_next() % 50 * TICKS_PER_SAMPLE
+				+ 1 + rng_next() % (TICKS_PER_SAMPLE - 1);
+			break;
+		}
+		timestamp += gap;
+	}
+
+	memset(header, ' ', 32);
+	if (type == IPROBE)
+		memcpy(header, "trace32 iprobe data \x1a", 21);
+	else
+		memcpy(header, "trace32 power integrator data \x1a", 31);
+	if (trigger >= NUM_RECORDS)
+		write_u64le(header + 32, 0);
+	memset(header + 40, 0, HEADER_SIZE - 40);
+	header[55] = type == PI_500MHZ;
+	header[56] = size;
+	WL32(header + 60, NUM_RECORDS);
+	WL32(header + 64, NUM_RECORDS - 1);
+	memcpy(file->str, header, HEADER_SIZE);
+
+	return file;
+}
+
+/* The 16 channels and the clock of the pod, at bits 0-16. */
+static uint32_t ref_pod(int type, const uint8_t *record, unsigned int pod)
+{
+	unsigned int data_offset, clk_offset, clk_bit;
+
+	if (type == IPROBE) {
+		data_offset = 8;
+		clk_offset = 10;
+		clk_bit = 0;
+	} else if (pod < 6) {
+		data_offset = 8 + 2 * pod;
+		clk_offset = type == PI_500MHZ ? 24 : 40;
+		clk_bit = pod;
+	} else {
+		data_offset = 24 + 2 * (pod - 6);
+		clk_offset = 41;
+		clk_bit = pod - 6;
+	}
+
+	return RL16(record + data_offset)
+		| ((record[clk_offset] >> clk_bit) & 1) << 16;
+}
+
+/* The size of a sample with the 17 channels of each pod. */
+static unsigned int pods_unitsize(unsigned int pods)
+{
+	unsigned int num;
+
+	for (num = 0; pods; pods >>= 1)
+		num += pods & 1;
+
+	return (num * 17 + 7) / 8;
+}
+
+/*
+ * The samples the file must give: each record's pods one after the
+ * other, 17 bits each, repeated up to the next record's timestamp. The
+ * trigger goes before the first record at the trigger timestamp.
+ */
+static GString *ref_samples(int type, const GString *file, unsigned int pods,
+		size_t *ref_trigger)
+{
+	GString *samples;
+	const uint8_t *record;
+	uint8_t sample[(12 * 17 + 7) / 8];
+	uint64_t timestamp, next, count, trigger_timestamp;
+	unsigned int size, unitsize, i, pod, bit, num;
+	uint32_t data;
+
+	size = record_size(type);
+	unitsize = pods_unitsize(pods);
+	trigger_timestamp = RL64(file->str + 32);
+	*ref_trigger = SIZE_MAX;
+	samples = g_string_new(NULL);
+	record = (const uint8_t *)file->str + HEADER_SIZE;
+	for (i = 0; i < NUM_RECORDS; i++, record += size) {
+		memset(sample, 0, sizeof(sample));
+		num = 0;
+		for (pod = 0; pod < 12; pod++) {
+			if (!((pods >> pod) & 1))
+				continue;
+			data = ref_pod(type, record, pod);
+			for (bit = 0; bit < 17; bit++, num++)
+				if ((data >> bit) & 1)
+					sample[num / 8] |= 1 << (num % 8);
+		}
+
+		timestamp = RL64(record);
+		if (timestamp == trigger_timestamp && *ref_trigger == SIZE_MAX)
+			*ref_trigger = samples->len / unitsize;
+		count = 1;
+		if (i < NUM_RECORDS - 1) {
+			next = RL64(record + size);
+			if (next > timestamp)
+				count = MAX((next - timestamp)
+					/ TICKS_PER_SAMPLE, 1);
+		}
+		while (count--)
+			g_string_append_len(samples, (const char *)sample,
+				unitsize);
+	}
+
+	return samples;
+}
+
+static void check_file(int type, unsigned int pods, unsigned int trigger)
+{
+	const size_t chunksizes[] = { 1, 44, 45, 46, 4096, SIZE_MAX };
+	GHashTable *options;
+	GString *file, *expected;
+	size_t ref_trigger, i, n;
+
+	file = make_file(type, trigger);
+	expected = ref_samples(type, file, pods, &ref_trigger);
+	logic_unitsize = pods_unitsize(pods);
+	options = new_options(pods);
+
+	for (i = 0; i < G_N_ELEMENTS(chunksizes); i++) {
+		logic_data = g_string_new(NULL);
+		num_triggers = 0;
+		trigger_pos = SIZE_MAX;
+		srtest_input_run("trace32_ad", options, file->str, file->len,
+			chunksizes[i], datafeed_in, FALSE);
+
+		fail_unless(logic_data->len == expected->len,
+			"Got %zu samples, expected %zu (chunk %zu).",
+			logic_data->len / logic_unitsize,
+			expected->len / logic_unitsize, chunksizes[i]);
+		for (n = 0; n < expected->len; n++)
+			fail_unless(logic_data->str[n] == expected->str[n],
+				"Sample %zu differs (pods 0x%03x, chunk %zu).",
+				n / logic_unitsize, pods, chunksizes[i]);
+		fail_unless(num_triggers == (ref_trigger != SIZE_MAX),
+			"Got %d triggers.", num_triggers);
+		fail_unless(trigger_pos == ref_trigger,
+			"Trigger at sample %zu, expected %zu.", trigger_pos,
+			ref_trigger);
+		g_string_free(logic_data, TRUE);
+	}
+
+	g_hash_table_destroy(options);
+	g_string_free(expected, TRUE);
+	g_string_free(file, TRUE);
+}
+
+/* Pods from both halves of the record, with their clocks in two bytes. */
+START_TEST(test_input_trace32_ad_pods)
+{
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	check_file(PI_250MHZ, 0x001, 17);
+	check_file(PI_250MHZ, 0x845, 123);
+	check_file(PI_250MHZ, 0xfff, 0);
+	check_file(PI_500MHZ, 0x022, NUM_RECORDS - 1);
+	check_file(PI_500MHZ, 0x03f, 200);
+	check_file(IPROBE, 0x001, 50);
+}
+END_TEST
+
+/* The trigger at the first and the last record, and none at all. */
+START_TEST(test_input_trace32_ad_trigger)
+{
+	rng_state = 0x0123456789abcdefULL;
+	check_file(PI_250MHZ, 0x0c1, 0);
+	check_file(PI_250MHZ, 0x0c1, NUM_RECORDS - 1);
+	check_file(PI_250MHZ, 0x0c1, NUM_RECORDS);
+	check_file(IPROBE, 0x001, NUM_RECORDS);
+}
+END_TEST
+
+Suite *suite_input_trace32_ad(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-trace32_ad");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_trace32_ad_pods);
+	tcase_add_test(tc, test_input_trace32_ad_trigger);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
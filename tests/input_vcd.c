@@ -0,0 +1,279 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/*
+ * Scalars with and without a space before the identifier, vectors
+ * with a bit range, a real, an alias, and a comment which looks like
+ * data. The last line has no newline.
+ */
+static const char *vcd_mixed =
+	"$timescale 1 us $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 ! clk $end\n"
+	"$var wire 4 \" bus [3:0] $end\n"
+	"$var reg 3 #x data [0:2] $end\n"
+	"$var real 64 % volt $end\n"
+	"$var wire 1 ! clk_alias $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n"
+	"$dumpvars\n"
+	"0!\n"
+	"b1010 \"\n"
+	"b1 #x\n"
+	"r1.5 %\n"
+	"$end\n"
+	"#3\n"
+	"1!\n"
+	"$comment 0! #99 $end\n"
+	"#5 b11 \" r-2.25 %\n"
+	"#7\n"
+	"0 !\n"
+	"b110 #x\n"
+	"#10";
+
+/* The samples of vcd_mixed, as (value, count) runs. */
+static const struct {
+	uint16_t logic;
+	float analog;
+	unsigned int count;
+} vcd_mixed_runs[] = {
+	{ 0x0034, 1.5, 3 },
+	{ 0x0135, 1.5, 2 },
+	{ 0x0127, -2.25, 2 },
+	{ 0x00c6, -2.25, 3 },
+};
+
+static GByteArray *logic_data;
+static GArray *analog_data;
+static unsigned int logic_unitsize;
+static gboolean take_runs;
+static uint64_t num_runs;
+static uint64_t samplerate;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_analog *analog;
+	struct sr_logic_rle_pos pos;
+	struct sr_config *src;
+	uint64_t count;
+	GSList *l;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		logic_unitsize = logic->unitsize;
+		g_byte_array_append(logic_data, logic->data, logic->length);
+		break;
+	case SR_DF_LOGIC_RLE:
+		fail_unless(take_runs, "Runs for a plain callback.");
+		rle = packet->payload;
+		logic_unitsize = rle->unitsize;
+		num_runs += rle->num_runs;
+		count = sr_logic_rle_num_samples(rle);
+		g_byte_array_set_size(logic_data,
+			logic_data->len + count * rle->unitsize);
+		memset(&pos, 0, sizeof(pos));
+		sr_logic_rle_expand(rle, &pos, logic_data->data
+			+ logic_data->len - count * rle->unitsize, count);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		g_array_append_vals(analog_data, analog->data,
+			analog->num_samples);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Feed the VCD text to the input module in pieces of chunksize bytes. */
+static void run_vcd(const char *vcd, size_t chunksize, GHashTable *options)
+{
+	logic_data = g_byte_array_new();
+	analog_data = g_array_new(FALSE, FALSE, sizeof(float));
+	logic_unitsize = 0;
+	num_runs = 0;
+	samplerate = 0;
+
+	srtest_input_run("vcd", options, vcd, strlen(vcd), chunksize,
+		datafeed_in, take_runs);
+}
+
+static void free_data(void)
+{
+	g_byte_array_free(logic_data, TRUE);
+	g_array_free(analog_data, TRUE);
+}
+
+static void check_mixed(size_t chunksize)
+{
+	unsigned int i, j, n;
+	uint16_t value;
+	float real;
+
+	run_vcd(vcd_mixed, chunksize, NULL);
+
+	fail_unless(samplerate == SR_MHZ(1), "Wrong samplerate %" PRIu64 ".",
+		samplerate);
+	fail_unless(logic_unitsize == 2, "Wrong unitsize %u.", logic_unitsize);
+	fail_unless(logic_data->len == 2 * analog_data->len,
+		"Different numbers of logic and analog samples.");
+
+	n = 0;
+	for (i = 0; i < G_N_ELEMENTS(vcd_mixed_runs); i++) {
+		for (j = 0; j < vcd_mixed_runs[i].count; j++, n++) {
+			fail_unless(2 * n < logic_data->len,
+				"Too few samples with chunk size %zu.", chunksize);
+			value = logic_data->data[2 * n]
+				| logic_data->data[2 * n + 1] << 8;
+			real = g_array_index(analog_data, float, n);
+			fail_unless(value == vcd_mixed_runs[i].logic,
+				"Sample %u is 0x%04x, expected 0x%04x "
+				"(chunk size %zu).", n, value,
+				vcd_mixed_runs[i].logic, chunksize);
+			fail_unless(real == vcd_mixed_runs[i].analog,
+				"Sample %u is %f, expected %f "
+				"(chunk size %zu).", n, real,
+				vcd_mixed_runs[i].analog, chunksize);
+		}
+	}
+	fail_unless(2 * n == logic_data->len,
+		"Too many samples with chunk size %zu.", chunksize);
+
+	free_data();
+}
+
+/* The samples must not depend on how the file is split up. */
+START_TEST(test_input_vcd_mixed)
+{
+	size_t chunksize;
+
+	for (chunksize = 1; chunksize <= 64; chunksize++)
+		check_mixed(chunksize);
+	check_mixed(strlen(vcd_mixed));
+}
+END_TEST
+
+/* A long idle period spans many packets, and a chunk boundary. */
+START_TEST(test_input_vcd_idle)
+{
+	const char *vcd =
+		"$timescale 1 ns $end\n"
+		"$var wire 1 aa! sig $end\n"
+		"$enddefinitions $end\n"
+		"#0 1aa!\n"
+		"#5000000 0aa!\n"
+		"#5000001\n";
+	unsigned int i;
+
+	for (take_runs = FALSE; take_runs <= TRUE; take_runs++) {
+		run_vcd(vcd, 50, NULL);
+
+		fail_unless(logic_unitsize == 1);
+		fail_unless(logic_data->len == 5000001,
+			"Expected 5000001 samples, got %u.", logic_data->len);
+		for (i = 0; i < 5000000; i++)
+			if (logic_data->data[i] != 0x01)
+				fail("Sample %u is 0x%02x, expected 0x01.",
+					i, logic_data->data[i]);
+		fail_unless(logic_data->data[5000000] == 0x00);
+		if (take_runs)
+			fail_unless(num_runs == 2, "Expected 2 runs, got %"
+				PRIu64 ".", num_runs);
+
+		free_data();
+	}
+	take_runs = FALSE;
+}
+END_TEST
+
+START_TEST(test_input_vcd_skip_downsample)
+{
+	const char *vcd =
+		"$timescale 1 ns $end\n"
+		"$var wire 1 ! a $end\n"
+		"$var wire 1 \" b $end\n"
+		"$enddefinitions $end\n"
+		"#0 0! 0\"\n"
+		"#10 1!\n"
+		"#20 1\"\n"
+		"#40\n";
+	const uint8_t expected[] = { 0x01, 0x03, 0x03, 0x03, 0x03, 0x03 };
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("skip"),
+		g_variant_ref_sink(g_variant_new_int32(16)));
+	g_hash_table_insert(options, g_strdup("downsample"),
+		g_variant_ref_sink(g_variant_new_int32(4)));
+
+	run_vcd(vcd, 7, options);
+
+	fail_unless(samplerate == SR_MHZ(250), "Wrong samplerate %" PRIu64 ".",
+		samplerate);
+	fail_unless(logic_data->len == sizeof(expected),
+		"Expected %zu samples, got %u.", sizeof(expected),
+		logic_data->len);
+	fail_unless(!memcmp(logic_data->data, expected, sizeof(expected)),
+		"Wrong samples after skip and downsample.");
+
+	free_data();
+	g_hash_table_destroy(options);
+}
+END_TEST
+
+Suite *suite_input_vcd(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-vcd");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_vcd_mixed);
+	tcase_add_test(tc, test_input_vcd_idle);
+	tcase_add_test(tc, test_input_vcd_skip_downsample);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
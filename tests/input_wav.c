@@ -0,0 +1,278 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_FRAMES 1000
+
+static GArray *analog_data;
+static unsigned int num_channels;
+static uint64_t samplerate;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_analog *analog;
+	struct sr_config *src;
+	unsigned int count;
+	GSList *l;
+
+	(void)sdi;
+	(void)cb_data;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		num_channels = g_slist_length(analog->meaning->channels);
+		count = analog->num_samples * num_channels;
+		g_array_set_size(analog_data, analog_data->len + count);
+		fail_unless(sr_analog_to_float(analog, &g_array_index(analog_data,
+			float, analog_data->len - count)) == SR_OK,
+			"Failed to convert the samples.");
+		break;
+	default:
+		break;
+	}
+}
+
+static void append_le(GString *s, uint64_t value, unsigned int size)
+{
+	while (size--) {
+		g_string_append_c(s, value & 0xff);
+		value >>= 8;
+	}
+}
+
+static void append_chunk(GString *s, const char *id, const char *data,
+		size_t len)
+{
+	g_string_append_len(s, id, 4);
+	append_le(s, len, 4);
+	g_string_append_len(s, data, len);
+	if (len & 1)
+		g_string_append_c(s, 0);
+}
+
+/* A format chunk, in the extensible layout when valid_bits is not 0. */
+static void append_fmt(GString *s, unsigned int format, unsigned int channels,
+		unsigned int bits, unsigned int valid_bits)
+{
+	GString *fmt;
+	unsigned int blockalign;
+
+	fmt = g_string_new(NULL);
+	blockalign = channels * bits / 8;
+	append_le(fmt, valid_bits ? 0xfffe : format, 2);
+	append_le(fmt, channels, 2);
+	append_le(fmt, 48000, 4);
+	append_le(fmt, 48000 * blockalign, 4);
+	append_le(fmt, blockalign, 2);
+	append_le(fmt, bits, 2);
+	if (valid_bits) {
+		append_le(fmt, 22, 2);
+		append_le(fmt, valid_bits, 2);
+		append_le(fmt, 0, 4);
+		/* The GUID, which starts with the format code. */
+		append_le(fmt, format, 2);
+		g_string_append_len(fmt, "\x00\x00\x00\x00\x10\x00\x80\x00"
+			"\x00\xaa\x00\x38\x9b\x71", 14);
+	}
+	append_chunk(s, "fmt ", fmt->str, fmt->len);
+	g_string_free(fmt, TRUE);
+}
+
+/*
+ * Feed the file to the input module in pieces of chunksize bytes, or
+ * from a mapped file in windows of that size.
+ */
+static void run_wav(const GString *wav, size_t chunksize, gboolean mapped)
+{
+	analog_data = g_array_new(FALSE, FALSE, sizeof(float));
+	num_channels = 0;
+	samplerate = 0;
+
+	if (mapped)
+		srtest_input_run_mapped("wav", NULL, wav->str, wav->len,
+			chunksize, datafeed_in);
+	else
+		srtest_input_run("wav", NULL, wav->str, wav->len, chunksize,
+			datafeed_in, FALSE);
+	fail_unless(samplerate == 48000, "Wrong samplerate %" PRIu64 ".",
+		samplerate);
+}
+
+static void check_values(const GString *wav, const float *expected,
+		unsigned int channels, unsigned int count)
+{
+	size_t chunksize;
+	unsigned int i;
+	float value;
+	int mapped;
+
+	for (chunksize = 7; chunksize < wav->len; chunksize *= 3) {
+		for (mapped = 0; mapped < 2; mapped++) {
+			run_wav(wav, chunksize, mapped);
+			fail_unless(num_channels == channels, "Expected %u "
+				"channels, got %u.", channels, num_channels);
+			fail_unless(analog_data->len == count, "Expected %u "
+				"values, got %u (chunk size %zu, mapped %d).",
+				count, analog_data->len, chunksize, mapped);
+			for (i = 0; i < count; i++) {
+				value = g_array_index(analog_data, float, i);
+				fail_unless(fabsf(value - expected[i]) < 1e-6,
+					"Value %u is %g, expected %g (chunk "
+					"size %zu, mapped %d).", i, value,
+					expected[i], chunksize, mapped);
+			}
+			g_array_free(analog_data, TRUE);
+		}
+	}
+}
+
+/* Interleaved 16-bit stereo, with chunks before and after the samples. */
+START_TEST(test_input_wav_pcm16)
+{
+	float expected[2 * NUM_FRAMES];
+	GString *wav, *data;
+	unsigned int i;
+	int16_t v;
+
+	data = g_string_new(NULL);
+	for (i = 0; i < 2 * NUM_FRAMES; i++) {
+		v = i * 37 - 30000;
+		append_le(data, (uint16_t)v, 2);
+		expected[i] = v / 32767.0;
+	}
+
+	wav = g_string_new("RIFF");
+	append_le(wav, 0, 4);
+	g_string_append(wav, "WAVE");
+	append_fmt(wav, 1, 2, 16, 0);
+	append_chunk(wav, "LIST", "odd", 3);
+	append_chunk(wav, "data", data->str, data->len);
+	append_chunk(wav, "id3 ", "trailer", 7);
+
+	check_values(wav, expected, 2, 2 * NUM_FRAMES);
+
+	g_string_free(data, TRUE);
+	g_string_free(wav, TRUE);
+}
+END_TEST
+
+/* 24-bit samples in the extensible format, three channels. */
+START_TEST(test_input_wav_pcm24)
+{
+	float expected[3 * NUM_FRAMES];
+	GString *wav, *data;
+	unsigned int i;
+	int32_t v;
+
+	data = g_string_new(NULL);
+	for (i = 0; i < 3 * NUM_FRAMES; i++) {
+		v = i * 5591 - 8388607;
+		append_le(data, (uint32_t)v, 3);
+		expected[i] = v / 8388607.0;
+	}
+
+	wav = g_string_new("RIFF");
+	append_le(wav, 0, 4);
+	g_string_append(wav, "WAVE");
+	append_fmt(wav, 1, 3, 24, 24);
+	append_chunk(wav, "data", data->str, data->len);
+
+	check_values(wav, expected, 3, 3 * NUM_FRAMES);
+
+	g_string_free(data, TRUE);
+	g_string_free(wav, TRUE);
+}
+END_TEST
+
+/* RF64 with the data size in the ds64 chunk, float samples. */
+START_TEST(test_input_wav_rf64)
+{
+	float expected[NUM_FRAMES];
+	GString *wav, *data, *ds64;
+	unsigned int i;
+	union {
+		float f;
+		uint32_t u;
+	} v;
+
+	data = g_string_new(NULL);
+	for (i = 0; i < NUM_FRAMES; i++) {
+		v.f = sinf(i / 10.0) * 3;
+		append_le(data, v.u, 4);
+		expected[i] = v.f;
+	}
+
+	ds64 = g_string_new(NULL);
+	append_le(ds64, 0xffffffffffULL, 8);
+	append_le(ds64, data->len, 8);
+	append_le(ds64, NUM_FRAMES, 8);
+	append_le(ds64, 0, 4);
+
+	wav = g_string_new("RF64");
+	append_le(wav, 0xffffffff, 4);
+	g_string_append(wav, "WAVE");
+	append_chunk(wav, "ds64", ds64->str, ds64->len);
+	append_fmt(wav, 3, 1, 32, 0);
+	g_string_append(wav, "data");
+	append_le(wav, 0xffffffff, 4);
+	g_string_append_len(wav, data->str, data->len);
+	/* Not part of the samples, as the ds64 chunk says. */
+	append_chunk(wav, "LIST", "trailer", 7);
+
+	check_values(wav, expected, 1, NUM_FRAMES);
+
+	g_string_free(ds64, TRUE);
+	g_string_free(data, TRUE);
+	g_string_free(wav, TRUE);
+}
+END_TEST
+
+Suite *suite_input_wav(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-wav");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_wav_pcm16);
+	tcase_add_test(tc, test_input_wav_pcm24);
+	tcase_add_test(tc, test_input_wav_rf64);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -18,12 +18,15 @@
  */
 
 #include <config.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
 #include "lib.h"
 
 struct sr_context *srtest_ctx;
@@ -160,3 +163,144 @@ GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi)
 
 	return channels;
 }
+
+struct input_run {
+	sr_datafeed_callback cb;
+	gboolean have_seen_df_end;
+};
+
+static void input_datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct input_run *run;
+
+	run = cb_data;
+	fail_unless(!run->have_seen_df_end, "Packet after SR_DF_END.");
+	if (packet->type == SR_DF_END)
+		run->have_seen_df_end = TRUE;
+
+	run->cb(sdi, packet, NULL);
+}
+
+/*
+ * Feed data to an input module, either from memory in pieces of chunksize
+ * bytes, or from a mapped file in windows of chunksize bytes.
+ */
+static void input_run(const char *id, GHashTable *options,
+		const char *filename, const char *data, size_t len,
+		size_t chunksize, sr_datafeed_callback cb, gboolean take_runs)
+{
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct input_run run;
+	GString *gbuf;
+	size_t pos, remaining;
+	int ret;
+
+	imod = sr_input_find(id);
+	fail_unless(imod != NULL, "Failed to find input module '%s'.", id);
+	in = sr_input_new(imod, options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+	if (filename) {
+		ret = sr_input_map_file(in, filename);
+		fail_unless(ret == SR_OK, "sr_input_map_file() error: %d", ret);
+	}
+
+	run.cb = cb;
+	run.have_seen_df_end = FALSE;
+	sr_session_new(srtest_ctx, &session);
+	if (take_runs)
+		sr_session_datafeed_rle_callback_add(session,
+			input_datafeed_in, &run);
+	else
+		sr_session_datafeed_callback_add(session,
+			input_datafeed_in, &run);
+
+	sdi = NULL;
+	pos = 0;
+	do {
+		if (filename) {
+			ret = sr_input_send_mapped(in, chunksize, &remaining);
+			fail_unless(ret == SR_OK,
+				"sr_input_send_mapped() error: %d", ret);
+		} else if (pos < len) {
+			gbuf = g_string_new_len(data + pos,
+				MIN(chunksize, len - pos));
+			pos += gbuf->len;
+			ret = sr_input_send(in, gbuf);
+			fail_unless(ret == SR_OK, "sr_input_send() error: %d",
+				ret);
+			g_string_free(gbuf, TRUE);
+			remaining = len - pos;
+		} else {
+			remaining = 0;
+		}
+		/* The device is complete once the module has seen enough. */
+		if (!sdi && (sdi = sr_input_dev_inst_get(in)))
+			sr_session_dev_add(session, sdi);
+	} while (remaining);
+	fail_unless(sdi != NULL, "No device after the whole file.");
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	fail_unless(run.have_seen_df_end, "No SR_DF_END.");
+
+	/* The session goes first, the input instance owns the device. */
+	sr_session_destroy(session);
+	sr_input_free(in);
+}
+
+/*
+ * Feed data to an input module in pieces of chunksize bytes, and pass
+ * the packets to cb. The callback gets run-length encoded logic packets
+ * when take_runs is TRUE. Fails unless the module sends SR_DF_END at
+ * the end, and nothing after it.
+ */
+void srtest_input_run(const char *id, GHashTable *options, const char *data,
+		size_t len, size_t chunksize, sr_datafeed_callback cb,
+		gboolean take_runs)
+{
+	input_run(id, options, NULL, data, len, chunksize, cb, take_runs);
+}
+
+/* Like srtest_input_run(), but from a file mapped in windows. */
+void srtest_input_run_mapped(const char *id, GHashTable *options,
+		const char *data, size_t len, size_t window,
+		sr_datafeed_callback cb)
+{
+	gchar *filename;
+	int fd;
+
+	fd = g_file_open_tmp("sigrok-test-XXXXXX", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	fail_unless(write(fd, data, len) == (ssize_t)len);
+	close(fd);
+
+	input_run(id, options, filename, NULL, 0, window, cb, FALSE);
+
+	g_unlink(filename);
+	g_free(filename);
+}
+
+#ifdef HAVE_LIBUSB_1_0
+/*
+ * The private USB code linked into the tests logs through this, since
+ * libsigrok does not export its own sr_log().
+ */
+SR_PRIV int sr_log(int loglevel, const char *format, ...)
+{
+	va_list args;
+
+	if (loglevel > sr_log_loglevel_get())
+		return SR_OK;
+
+	va_start(args, format);
+	fputs("sr: ", stderr);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+
+	return SR_OK;
+}
+#endif
@@ -41,17 +41,42 @@ void srtest_check_samplerate(struct sr_context *sr_ctx, const char *drivername,
 
 GArray *srtest_get_enabled_logic_channels(const struct sr_dev_inst *sdi);
 
+void srtest_input_run(const char *id, GHashTable *options, const char *data,
+		size_t len, size_t chunksize, sr_datafeed_callback cb,
+		gboolean take_runs);
+void srtest_input_run_mapped(const char *id, GHashTable *options,
+		const char *data, size_t len, size_t window,
+		sr_datafeed_callback cb);
+
 Suite *suite_core(void);
 Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
 Suite *suite_input_binary(void);
+Suite *suite_input_csv(void);
+Suite *suite_input_raw_analog(void);
+Suite *suite_input_trace32_ad(void);
+Suite *suite_input_vcd(void);
+Suite *suite_input_wav(void);
 Suite *suite_output_all(void);
+Suite *suite_output_csv(void);
+Suite *suite_output_vcd(void);
+Suite *suite_output_wav(void);
 Suite *suite_transform_all(void);
 Suite *suite_session(void);
+Suite *suite_session_file(void);
 Suite *suite_strutil(void);
 Suite *suite_version(void);
 Suite *suite_device(void);
 Suite *suite_trigger(void);
 Suite *suite_analog(void);
+Suite *suite_transpose(void);
+Suite *suite_ols_decode(void);
+#ifdef HAVE_LIBUSB_1_0
+Suite *suite_usb_stream(void);
+Suite *suite_usb_trace(void);
+#endif
+#ifdef HAVE_HW_ASIX_SIGMA
+Suite *suite_asix_sigma(void);
+#endif
 
 #endif
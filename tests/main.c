@@ -37,14 +37,32 @@ int main(void)
 	srunner_add_suite(srunner, suite_driver_all());
 	srunner_add_suite(srunner, suite_input_all());
 	srunner_add_suite(srunner, suite_input_binary());
+	srunner_add_suite(srunner, suite_input_csv());
+	srunner_add_suite(srunner, suite_input_raw_analog());
+	srunner_add_suite(srunner, suite_input_trace32_ad());
+	srunner_add_suite(srunner, suite_input_vcd());
+	srunner_add_suite(srunner, suite_input_wav());
 	srunner_add_suite(srunner, suite_output_all());
+	srunner_add_suite(srunner, suite_output_csv());
+	srunner_add_suite(srunner, suite_output_vcd());
+	srunner_add_suite(srunner, suite_output_wav());
 	srunner_add_suite(srunner, suite_transform_all());
 	srunner_add_suite(srunner, suite_session());
+	srunner_add_suite(srunner, suite_session_file());
 	srunner_add_suite(srunner, suite_strutil());
 	srunner_add_suite(srunner, suite_version());
 	srunner_add_suite(srunner, suite_device());
 	srunner_add_suite(srunner, suite_trigger());
 	srunner_add_suite(srunner, suite_analog());
+	srunner_add_suite(srunner, suite_transpose());
+	srunner_add_suite(srunner, suite_ols_decode());
+#ifdef HAVE_LIBUSB_1_0
+	srunner_add_suite(srunner, suite_usb_stream());
+	srunner_add_suite(srunner, suite_usb_trace());
+#endif
+#ifdef HAVE_HW_ASIX_SIGMA
+	srunner_add_suite(srunner, suite_asix_sigma());
+#endif
 
 	srunner_run_all(srunner, CK_VERBOSE);
 	ret = srunner_ntests_failed(srunner);
@@ -0,0 +1,273 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define NUM_SAMPLES 5000
+
+#define FLAG_RLE   (1 << 8)
+#define FLAG_DEMUX (1 << 0)
+/* Disable channel group n (0-3). */
+#define FLAG_NO_GROUP(n) (1 << (2 + (n)))
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+static unsigned int enabled_groups(uint16_t flag_reg)
+{
+	return ~(flag_reg >> 2) & ((flag_reg & FLAG_DEMUX) ? 0x03 : 0x0f);
+}
+
+/*
+ * Random samples in runs of random length, with only the enabled channel
+ * groups set. With RLE the top channel is the count flag, keep it clear.
+ */
+static void make_samples(uint32_t *samples, unsigned int count,
+		uint16_t flag_reg)
+{
+	unsigned int groups, i, n, top;
+	uint32_t mask, value;
+
+	groups = enabled_groups(flag_reg);
+	mask = 0;
+	for (i = 0; i < 4; i++)
+		if (groups & (1 << i))
+			mask |= 0xffU << (8 * i);
+	top = 31;
+	while (!(mask & (1U << top)))
+		top--;
+	if (flag_reg & FLAG_RLE)
+		mask &= ~(1U << top);
+
+	i = 0;
+	while (i < count) {
+		/* Mostly short runs, some long ones, few distinct values. */
+		n = 1 + rng_next() % (rng_next() % 8 ? 3 : 400);
+		value = (rng_next() % 4 ? rng_next() % 4 * 0x11111111 :
+			rng_next()) & mask;
+		while (n-- && i < count)
+			samples[i++] = value;
+	}
+}
+
+/* The enabled groups of a sample, as the device sends them. */
+static void append_sample(GString *s, uint32_t sample, unsigned int groups)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+		if (groups & (1 << i))
+			g_string_append_c(s, (sample >> (8 * i)) & 0xff);
+}
+
+static void append_count(GString *s, uint32_t count, unsigned int unit_size)
+{
+	unsigned int i;
+
+	count |= 0x80U << (8 * (unit_size - 1));
+	for (i = 0; i < unit_size; i++)
+		g_string_append_c(s, (count >> (8 * i)) & 0xff);
+}
+
+/*
+ * Encode samples the way the device sends them: newest first, and in
+ * demux mode as pairs of the later sample followed by the earlier one.
+ */
+static GString *encode(const uint32_t *samples, unsigned int count,
+		uint16_t flag_reg)
+{
+	GString *s;
+	unsigned int groups, bytes, unit_size, step, i, n, max_count;
+	gboolean demux;
+
+	demux = (flag_reg & FLAG_DEMUX) && (flag_reg & FLAG_RLE);
+	groups = enabled_groups(flag_reg);
+	bytes = 0;
+	for (i = 0; i < 4; i++)
+		if (groups & (1 << i))
+			bytes++;
+	step = demux ? 2 : 1;
+	unit_size = bytes * step;
+	max_count = unit_size < 4 ? (1U << (8 * unit_size - 1)) - 1 : 1000000;
+
+	s = g_string_new(NULL);
+	for (i = count; i >= step; i -= n * step) {
+		/* Units repeating the one at i - step. */
+		n = 1;
+		while ((flag_reg & FLAG_RLE) && i >= (n + 1) * step && n <= max_count
+				&& samples[i - (n + 1) * step] == samples[i - step]
+				&& (!demux || samples[i - (n + 1) * step + 1]
+					== samples[i - 1]))
+			n++;
+		if (n > 1)
+			append_count(s, n - 1, unit_size);
+		append_sample(s, samples[i - 1], groups);
+		if (demux)
+			append_sample(s, samples[i - 2], groups);
+	}
+
+	return s;
+}
+
+/* Decode the stream in blocks, read it back in pieces and compare. */
+static void check_decode(const GString *stream, uint16_t flag_reg,
+		uint64_t limit, const uint32_t *expected, unsigned int count,
+		size_t blocksize, uint64_t readsize)
+{
+	struct sr_ols_decoder dec;
+	struct sr_datafeed_logic_rle rle;
+	uint64_t i, r, n, pos;
+	size_t used, len;
+
+	memset(&dec, 0, sizeof(dec));
+	sr_ols_decoder_init(&dec, flag_reg, limit);
+
+	used = 0;
+	for (pos = 0; pos < stream->len; pos += len) {
+		len = MIN(blocksize, stream->len - pos);
+		used += sr_ols_decoder_feed(&dec, (const uint8_t *)stream->str + pos,
+			len);
+	}
+	fail_unless(dec.num_samples == count, "Decoded %" PRIu64
+		" samples, expected %u (flags 0x%x).", dec.num_samples, count,
+		flag_reg);
+	fail_unless(limit < NUM_SAMPLES || used == stream->len,
+		"Only %zu of %zu bytes used.", used, stream->len);
+	fail_unless(count < 100 || dec.runs->len < count,
+		"No runs were merged.");
+
+	pos = 0;
+	while ((n = sr_ols_decoder_read(&dec, &rle, readsize)) > 0) {
+		fail_unless(n <= readsize, "Read %" PRIu64 " samples.", n);
+		fail_unless(rle.unitsize == 4);
+		for (r = 0; r < rle.num_runs; r++) {
+			fail_unless(rle.lengths[r] > 0, "Empty run.");
+			for (i = 0; i < rle.lengths[r]; i++, pos++) {
+				fail_unless(pos < count, "Too many samples.");
+				fail_unless(RL32((uint8_t *)rle.data + 4 * r)
+					== expected[pos], "Sample %" PRIu64 " is "
+					"0x%08x, expected 0x%08x (flags 0x%x).", pos,
+					RL32((uint8_t *)rle.data + 4 * r),
+					expected[pos], flag_reg);
+			}
+		}
+	}
+	fail_unless(pos == count, "Read %" PRIu64 " samples, expected %u.",
+		pos, count);
+
+	sr_ols_decoder_clear(&dec);
+}
+
+static void check_flags(uint16_t flag_reg)
+{
+	static uint32_t samples[NUM_SAMPLES];
+	GString *stream;
+	size_t blocksize;
+
+	make_samples(samples, NUM_SAMPLES, flag_reg);
+	stream = encode(samples, NUM_SAMPLES, flag_reg);
+	for (blocksize = 1; blocksize < stream->len; blocksize = blocksize * 5 + 2)
+		check_decode(stream, flag_reg, NUM_SAMPLES, samples, NUM_SAMPLES,
+			blocksize, blocksize % 2 ? UINT64_MAX : 333);
+	g_string_free(stream, TRUE);
+}
+
+/* All channel groups, without and with RLE. */
+START_TEST(test_ols_decode_plain)
+{
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	check_flags(0);
+	check_flags(FLAG_RLE);
+}
+END_TEST
+
+/* Disabled channel groups are not sent, they read as zero. */
+START_TEST(test_ols_decode_groups)
+{
+	rng_state = 0x0123456789abcdefULL;
+	check_flags(FLAG_NO_GROUP(1) | FLAG_NO_GROUP(2));
+	check_flags(FLAG_RLE | FLAG_NO_GROUP(0) | FLAG_NO_GROUP(3));
+	check_flags(FLAG_RLE | FLAG_NO_GROUP(0) | FLAG_NO_GROUP(1)
+		| FLAG_NO_GROUP(2));
+}
+END_TEST
+
+/* In demux mode with RLE the counts apply to sample pairs. */
+START_TEST(test_ols_decode_demux)
+{
+	rng_state = 0xfedcba9876543210ULL;
+	check_flags(FLAG_DEMUX | FLAG_RLE | FLAG_NO_GROUP(2) | FLAG_NO_GROUP(3));
+	check_flags(FLAG_DEMUX | FLAG_RLE | FLAG_NO_GROUP(1) | FLAG_NO_GROUP(2)
+		| FLAG_NO_GROUP(3));
+}
+END_TEST
+
+/* Only the newest samples up to the limit are kept. */
+START_TEST(test_ols_decode_limit)
+{
+	static uint32_t samples[NUM_SAMPLES];
+	const uint16_t flags[] = {
+		0, FLAG_RLE, FLAG_DEMUX | FLAG_RLE | FLAG_NO_GROUP(2)
+			| FLAG_NO_GROUP(3),
+	};
+	GString *stream;
+	unsigned int i, limit;
+
+	rng_state = 0x0f1e2d3c4b5a6978ULL;
+	for (i = 0; i < G_N_ELEMENTS(flags); i++) {
+		make_samples(samples, NUM_SAMPLES, flags[i]);
+		stream = encode(samples, NUM_SAMPLES, flags[i]);
+		for (limit = 1; limit < NUM_SAMPLES; limit = limit * 3 + 1)
+			check_decode(stream, flags[i], limit,
+				samples + NUM_SAMPLES - limit, limit, 100, 77);
+		g_string_free(stream, TRUE);
+	}
+}
+END_TEST
+
+Suite *suite_ols_decode(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("ols-decode");
+
+	tc = tcase_create("basic");
+	tcase_add_test(tc, test_ols_decode_plain);
+	tcase_add_test(tc, test_ols_decode_groups);
+	tcase_add_test(tc, test_ols_decode_demux);
+	tcase_add_test(tc, test_ols_decode_limit);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
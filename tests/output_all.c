@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -96,6 +97,64 @@ START_TEST(test_output_options)
 }
 END_TEST
 
+/*
+ * Check that runs are expanded for modules which only take SR_DF_LOGIC,
+ * in pieces which split runs, into one output string.
+ */
+START_TEST(test_output_expand_runs)
+{
+	const unsigned int unitsizes[] = { 1, 3, 8 };
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	GString *out, *expected;
+	uint64_t lengths[1000], rng, i, j;
+	uint8_t values[1000 * 8];
+	unsigned int u;
+	int ret;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+	o = sr_output_new(sr_output_find("binary"), NULL, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the binary output.");
+
+	rng = 0x9e3779b97f4a7c15ULL;
+	for (u = 0; u < G_N_ELEMENTS(unitsizes); u++) {
+		expected = g_string_new(NULL);
+		for (i = 0; i < G_N_ELEMENTS(lengths); i++) {
+			rng ^= rng << 13;
+			rng ^= rng >> 7;
+			rng ^= rng << 17;
+			/* Mostly short runs, some longer than a piece. */
+			lengths[i] = i % 300 == 7 ? 1000003 + rng % 7 : 1 + rng % 5;
+			memcpy(values + i * unitsizes[u], &rng, unitsizes[u]);
+			for (j = 0; j < lengths[i]; j++)
+				g_string_append_len(expected,
+					(const char *)values + i * unitsizes[u],
+					unitsizes[u]);
+		}
+		rle.num_runs = G_N_ELEMENTS(lengths);
+		rle.unitsize = unitsizes[u];
+		rle.data = values;
+		rle.lengths = lengths;
+		packet.type = SR_DF_LOGIC_RLE;
+		packet.payload = &rle;
+		ret = sr_output_send(o, &packet, &out);
+		fail_unless(ret == SR_OK, "Failed to send runs: %d.", ret);
+		fail_unless(out != NULL, "No output for the runs.");
+		fail_unless(out->len == expected->len,
+			"Got %zu bytes, expected %zu.", out->len, expected->len);
+		fail_unless(!memcmp(out->str, expected->str, out->len),
+			"Wrong samples for unit size %u.", unitsizes[u]);
+		g_string_free(out, TRUE);
+		g_string_free(expected, TRUE);
+	}
+
+	sr_output_free(o);
+}
+END_TEST
+
 Suite *suite_output_all(void)
 {
 	Suite *s;
@@ -112,5 +171,10 @@ Suite *suite_output_all(void)
 	tcase_add_test(tc, test_output_options);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("runs");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_expand_runs);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
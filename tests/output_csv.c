@@ -0,0 +1,261 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_LOGIC 10
+#define NUM_RANDOM 100000
+#define PACKET_SAMPLES 1000
+#define SEPARATOR " :: "
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+static GHashTable *new_options(void)
+{
+	GHashTable *options;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("value"),
+		g_variant_ref_sink(g_variant_new_string(SEPARATOR)));
+	g_hash_table_insert(options, g_strdup("header"),
+		g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+	g_hash_table_insert(options, g_strdup("label"),
+		g_variant_ref_sink(g_variant_new_string("off")));
+	g_hash_table_insert(options, g_strdup("time"),
+		g_variant_ref_sink(g_variant_new_boolean(FALSE)));
+
+	return options;
+}
+
+/*
+ * One record per sample: the logic channels, then two analog channels.
+ * The records must match what "%g" gives for the values, separated by
+ * the multi-character separator.
+ */
+static void check_values(const float *values, unsigned int count)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	GHashTable *options;
+	GString *out, *expected;
+	uint16_t lbuf[PACKET_SAMPLES];
+	unsigned int i, j, n, pos;
+	char name[8], buf[G_ASCII_DTOSTR_BUF_SIZE];
+	int ret;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < NUM_LOGIC; i++) {
+		g_snprintf(name, sizeof(name), "D%u", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_dev_inst_channel_add(sdi, NUM_LOGIC, SR_CHANNEL_ANALOG, "A0");
+	sr_dev_inst_channel_add(sdi, NUM_LOGIC + 1, SR_CHANNEL_ANALOG, "A1");
+
+	omod = sr_output_find("csv");
+	fail_unless(omod != NULL, "Couldn't find the 'csv' output module.");
+	options = new_options();
+	o = sr_output_new(omod, options, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the csv output.");
+	g_hash_table_destroy(options);
+
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	meaning.channels = g_slist_copy(g_slist_nth(
+		sr_dev_inst_channels_get(sdi), NUM_LOGIC));
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	expected = g_string_new(NULL);
+	for (pos = 0; pos < count; pos += 2 * n) {
+		n = MIN(PACKET_SAMPLES, (count - pos) / 2);
+		g_string_truncate(expected, 0);
+		for (i = 0; i < n; i++) {
+			lbuf[i] = rng_next() & ((1 << NUM_LOGIC) - 1);
+			for (j = 0; j < NUM_LOGIC; j++) {
+				g_string_append_c(expected,
+					'0' + ((lbuf[i] >> j) & 1));
+				g_string_append(expected, SEPARATOR);
+			}
+			for (j = 0; j < 2; j++) {
+				g_ascii_formatd(buf, sizeof(buf), "%g",
+					values[pos + 2 * i + j]);
+				g_string_append(expected, buf);
+				g_string_append(expected, j ? "\n" : SEPARATOR);
+			}
+			lbuf[i] = GUINT16_TO_LE(lbuf[i]);
+		}
+
+		logic.length = n * sizeof(uint16_t);
+		logic.unitsize = sizeof(uint16_t);
+		logic.data = lbuf;
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		ret = sr_output_send(o, &packet, &out);
+		fail_unless(ret == SR_OK, "Failed to send logic: %d.", ret);
+		fail_unless(out == NULL, "Output before the analog samples.");
+
+		analog.data = (float *)values + pos;
+		analog.num_samples = n;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		ret = sr_output_send(o, &packet, &out);
+		fail_unless(ret == SR_OK, "Failed to send analog: %d.", ret);
+		fail_unless(out != NULL, "No records.");
+		fail_unless(!strcmp(out->str, expected->str),
+			"Wrong records for values %u to %u:\n%s\nexpected:\n%s",
+			pos, pos + 2 * n - 1, out->str, expected->str);
+		g_string_free(out, TRUE);
+	}
+
+	g_string_free(expected, TRUE);
+	g_slist_free(meaning.channels);
+	sr_output_free(o);
+}
+
+/* Append the value and its negation. */
+static void add_value(GArray *values, float v)
+{
+	g_array_append_val(values, v);
+	v = -v;
+	g_array_append_val(values, v);
+}
+
+/*
+ * Values where the style, the number of digits or the exponent changes,
+ * and exact ties of the sixth digit, which round to even like printf.
+ */
+START_TEST(test_output_csv_float_edges)
+{
+	GArray *values;
+	float v, p, lo, hi;
+	int k, i;
+
+	values = g_array_new(FALSE, FALSE, sizeof(float));
+	add_value(values, 0.0f);
+	add_value(values, NAN);
+	add_value(values, INFINITY);
+	add_value(values, FLT_MIN);
+	add_value(values, FLT_MAX);
+	add_value(values, nextafterf(0, 1));
+	/* Ties: the float is exactly halfway between two six digit values. */
+	add_value(values, 123456.5f);
+	add_value(values, 123457.5f);
+	add_value(values, 999999.5f);
+	add_value(values, 999998.5f);
+	add_value(values, 12345.25f);
+	/* Around every power of ten, and where rounding carries into it. */
+	for (k = -12; k <= 12; k++) {
+		p = powf(10, k);
+		lo = p * (1 - 5e-7f);
+		hi = p * (1 + 5e-7f);
+		for (v = lo, i = 0; v <= hi && i < 100; i++) {
+			add_value(values, v);
+			v = nextafterf(v, INFINITY);
+		}
+		add_value(values, p);
+		add_value(values, p * 0.9999995f);
+		add_value(values, p * 1.000005f);
+	}
+	/* The switch to exponents below 1e-4, and down to 1e-7. */
+	add_value(values, 1e-4f);
+	add_value(values, 9.999995e-5f);
+	add_value(values, 1e-5f);
+	add_value(values, 1e-7f);
+	add_value(values, nextafterf(1e-7f, 0));
+	add_value(values, nextafterf(1e-7f, 1));
+	add_value(values, 9.9999995e-8f);
+	add_value(values, 1e6f);
+	add_value(values, nextafterf(1e6f, 0));
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	check_values((const float *)values->data, values->len);
+	g_array_free(values, TRUE);
+}
+END_TEST
+
+/* Random floats of all magnitudes, and some with few digits. */
+START_TEST(test_output_csv_float_random)
+{
+	float *values;
+	uint32_t u;
+	unsigned int i;
+
+	rng_state = 0x0123456789abcdefULL;
+	values = g_malloc(NUM_RANDOM * sizeof(float));
+	for (i = 0; i < NUM_RANDOM; i++) {
+		u = rng_next();
+		if (i % 4 == 0) {
+			values[i] = (int)(u % 2000001) - 1000000;
+			values[i] /= powf(10, u % 13);
+		} else {
+			memcpy(&values[i], &u, sizeof(u));
+		}
+	}
+	check_values(values, NUM_RANDOM);
+	g_free(values);
+}
+END_TEST
+
+Suite *suite_output_csv(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("output-csv");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_csv_float_edges);
+	tcase_add_test(tc, test_output_csv_float_random);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,417 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define NUM_SAMPLES 3000
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+/* Identifiers of up to two characters: '!' to '~', then "!!", "\"!" etc. */
+static void ref_identifier(char *id, unsigned int n)
+{
+	if (n < 94) {
+		id[0] = '!' + n;
+		id[1] = '\0';
+	} else {
+		n -= 94;
+		id[0] = '!' + n % 94;
+		id[1] = '!' + n / 94;
+		id[2] = '\0';
+	}
+}
+
+/* n / samplerate in units of 1 / period, rounded half to even. */
+static uint64_t ref_timestamp(uint64_t n, uint64_t period, uint64_t samplerate)
+{
+	uint64_t q, r;
+
+	q = n * period / samplerate;
+	r = n * period % samplerate;
+	if (2 * r > samplerate || (2 * r == samplerate && (q & 1)))
+		q++;
+
+	return q;
+}
+
+/* Every disabled'th channel is disabled, none if disabled is 0. */
+static struct sr_dev_inst *make_sdi(unsigned int num_channels,
+		unsigned int disabled)
+{
+	struct sr_dev_inst *sdi;
+	GSList *l;
+	unsigned int i;
+	char name[16];
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < num_channels; i++) {
+		g_snprintf(name, sizeof(name), "D%u", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	for (i = 0, l = sr_dev_inst_channels_get(sdi); l; l = l->next, i++)
+		if (disabled && i % disabled == 1)
+			sr_dev_channel_enable(l->data, FALSE);
+
+	return sdi;
+}
+
+/*
+ * The runs of identical samples in the data. Some runs are split in
+ * two, which must not give a line for the second part.
+ */
+static size_t make_runs(const uint8_t *data, unsigned int unitsize,
+		size_t num_samples, uint8_t *values, uint64_t *lengths)
+{
+	size_t n, num_runs;
+
+	num_runs = 0;
+	for (n = 0; n < num_samples; n++) {
+		if (n > 0 && !memcmp(data + n * unitsize,
+				data + (n - 1) * unitsize, unitsize)
+				&& rng_next() % 8) {
+			lengths[num_runs - 1]++;
+			continue;
+		}
+		memcpy(values + num_runs * unitsize, data + n * unitsize,
+			unitsize);
+		lengths[num_runs++] = 1;
+	}
+
+	return num_runs;
+}
+
+/*
+ * The whole output for the samples, sent in packets of chunk samples,
+ * or as runs in packets of chunk runs.
+ */
+static GString *run_vcd(const struct sr_dev_inst *sdi, uint64_t samplerate,
+		const uint8_t *data, unsigned int unitsize, size_t num_samples,
+		size_t chunk, gboolean runs)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle rle;
+	struct sr_config src;
+	GString *text, *out;
+	uint8_t *values;
+	uint64_t *lengths;
+	size_t pos, num_runs;
+	int ret;
+
+	omod = sr_output_find("vcd");
+	fail_unless(omod != NULL, "Couldn't find the 'vcd' output module.");
+	o = sr_output_new(omod, NULL, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the vcd output.");
+	text = g_string_new(NULL);
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(samplerate);
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Failed to send meta packet: %d.", ret);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	values = g_malloc(num_samples * unitsize);
+	lengths = g_malloc(num_samples * sizeof(uint64_t));
+	num_runs = runs ? make_runs(data, unitsize, num_samples, values,
+		lengths) : 0;
+	for (pos = 0; pos < (runs ? num_runs : num_samples); pos += chunk) {
+		if (runs) {
+			rle.num_runs = MIN(chunk, num_runs - pos);
+			rle.unitsize = unitsize;
+			rle.data = values + pos * unitsize;
+			rle.lengths = lengths + pos;
+			packet.type = SR_DF_LOGIC_RLE;
+			packet.payload = &rle;
+		} else {
+			logic.unitsize = unitsize;
+			logic.length = MIN(chunk, num_samples - pos) * unitsize;
+			logic.data = (uint8_t *)data + pos * unitsize;
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+		}
+		ret = sr_output_send(o, &packet, &out);
+		fail_unless(ret == SR_OK, "Failed to send logic: %d.", ret);
+		if (out) {
+			g_string_append_len(text, out->str, out->len);
+			g_string_free(out, TRUE);
+		}
+	}
+	g_free(values);
+	g_free(lengths);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Failed to send end packet: %d.", ret);
+	fail_unless(out != NULL, "No final timestamp.");
+	g_string_append_len(text, out->str, out->len);
+	g_string_free(out, TRUE);
+
+	sr_output_free(o);
+
+	return text;
+}
+
+/* The expected header lines from $timescale to $enddefinitions. */
+static GString *expected_header(const struct sr_dev_inst *sdi,
+		const char *timescale)
+{
+	struct sr_channel *ch;
+	GString *s;
+	GSList *l;
+	unsigned int pos;
+	char id[4];
+
+	s = g_string_new(NULL);
+	g_string_append_printf(s, "$timescale %s $end\n", timescale);
+	g_string_append_printf(s, "$scope module %s $end\n", PACKAGE_NAME);
+	pos = 0;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled)
+			continue;
+		ref_identifier(id, pos++);
+		g_string_append_printf(s, "$var wire 1 %s %s $end\n",
+			id, ch->name);
+	}
+	g_string_append(s, "$upscope $end\n$enddefinitions $end\n");
+
+	return s;
+}
+
+/*
+ * The expected value changes: a line for every sample in which an enabled
+ * channel differs from the previous sample, all channels for the first.
+ */
+static GString *expected_body(const struct sr_dev_inst *sdi,
+		const uint8_t *data, unsigned int unitsize, size_t num_samples,
+		uint64_t period, uint64_t samplerate)
+{
+	struct sr_channel *ch;
+	const uint8_t *sample, *prev;
+	GString *s;
+	GSList *l;
+	size_t n;
+	unsigned int pos;
+	int bit;
+	gboolean changed;
+	char id[4];
+
+	s = g_string_new(NULL);
+	prev = NULL;
+	for (n = 0; n < num_samples; n++) {
+		sample = data + n * unitsize;
+		changed = FALSE;
+		pos = 0;
+		for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+			ch = l->data;
+			if (!ch->enabled)
+				continue;
+			ref_identifier(id, pos++);
+			bit = (sample[ch->index / 8] >> (ch->index % 8)) & 1;
+			if (prev && bit == ((prev[ch->index / 8]
+					>> (ch->index % 8)) & 1))
+				continue;
+			if (!changed)
+				g_string_append_printf(s, "#%" PRIu64,
+					ref_timestamp(n, period, samplerate));
+			changed = TRUE;
+			g_string_append_printf(s, " %d%s", bit, id);
+		}
+		if (changed) {
+			g_string_append_c(s, '\n');
+			prev = sample;
+		}
+	}
+	g_string_append_printf(s, "#%" PRIu64 "\n",
+		ref_timestamp(num_samples, period, samplerate));
+
+	return s;
+}
+
+static void check_vcd(const struct sr_dev_inst *sdi, uint64_t samplerate,
+		const uint8_t *data, unsigned int unitsize, size_t num_samples,
+		uint64_t period, const char *timescale)
+{
+	GString *text, *header, *body;
+	const char *start;
+	size_t chunk;
+	gboolean runs;
+
+	header = expected_header(sdi, timescale);
+	body = expected_body(sdi, data, unitsize, num_samples, period,
+		samplerate);
+
+	for (runs = FALSE; runs <= TRUE; runs++) {
+		for (chunk = 1; chunk <= num_samples; chunk = chunk * 5 + 2) {
+			text = run_vcd(sdi, samplerate, data, unitsize,
+				num_samples, chunk, runs);
+			start = strstr(text->str, "$timescale");
+			fail_unless(start != NULL, "No timescale in the header.");
+			fail_unless(!strncmp(start, header->str, header->len),
+				"Wrong header, expected:\n%s", header->str);
+			fail_unless(!strcmp(start + header->len, body->str),
+				"Wrong value changes (%u channels, chunk %zu%s).",
+				g_slist_length(sr_dev_inst_channels_get(sdi)),
+				chunk, runs ? " runs" : "");
+			g_string_free(text, TRUE);
+		}
+	}
+
+	g_string_free(header, TRUE);
+	g_string_free(body, TRUE);
+}
+
+/*
+ * Runs of unchanged samples, one in every change_rate samples is a
+ * change of some random bits.
+ */
+static uint8_t *make_samples(unsigned int unitsize, size_t num_samples,
+		unsigned int change_rate)
+{
+	uint8_t *data;
+	size_t n;
+	unsigned int i;
+
+	data = g_malloc(unitsize * num_samples);
+	for (i = 0; i < unitsize; i++)
+		data[i] = rng_next();
+	for (n = 1; n < num_samples; n++) {
+		memcpy(data + n * unitsize, data + (n - 1) * unitsize, unitsize);
+		if (rng_next() % change_rate)
+			continue;
+		for (i = 1 + rng_next() % 3; i > 0; i--)
+			data[n * unitsize + rng_next() % unitsize]
+				^= 1 << (rng_next() % 8);
+	}
+
+	return data;
+}
+
+/*
+ * Unit sizes with and without the word-sized compare loops, more than
+ * 94 channels, and disabled channels whose changes must not show up.
+ */
+START_TEST(test_output_vcd_channels)
+{
+	const unsigned int num_channels[] = { 5, 12, 30, 64, 200 };
+	struct sr_dev_inst *sdi;
+	unsigned int i, unitsize, disabled;
+	uint8_t *data;
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < G_N_ELEMENTS(num_channels); i++) {
+		unitsize = (num_channels[i] + 7) / 8;
+		data = make_samples(unitsize, NUM_SAMPLES, 3);
+		for (disabled = 0; disabled < 6; disabled += 3) {
+			sdi = make_sdi(num_channels[i], disabled);
+			check_vcd(sdi, SR_MHZ(3), data, unitsize, NUM_SAMPLES,
+				SR_GHZ(1), "1 ns");
+		}
+		g_free(data);
+	}
+}
+END_TEST
+
+/* Long runs, and runs where no enabled channel changes. */
+START_TEST(test_output_vcd_runs)
+{
+	const unsigned int num_channels[] = { 3, 16, 70 };
+	struct sr_dev_inst *sdi;
+	unsigned int i, unitsize;
+	uint8_t *data;
+
+	rng_state = 0x0123456789abcdefULL;
+	for (i = 0; i < G_N_ELEMENTS(num_channels); i++) {
+		unitsize = (num_channels[i] + 7) / 8;
+		data = make_samples(unitsize, 20 * NUM_SAMPLES, 500);
+		sdi = make_sdi(num_channels[i], 2);
+		check_vcd(sdi, SR_KHZ(7), data, unitsize, 20 * NUM_SAMPLES,
+			SR_MHZ(1), "1 us");
+		g_free(data);
+	}
+}
+END_TEST
+
+/*
+ * At 400MHz every other sample is exactly between two nanoseconds, these
+ * round to the even one. The other samplerates don't divide the period.
+ */
+START_TEST(test_output_vcd_timestamps)
+{
+	const char *ties = "#0 0!\n#2 1!\n#5 0!\n#8 1!\n#10 0!\n#12 1!\n";
+	struct sr_dev_inst *sdi;
+	GString *text;
+	uint8_t data[64];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i & 1;
+	sdi = make_sdi(1, 0);
+
+	text = run_vcd(sdi, SR_MHZ(400), data, 1, sizeof(data), 7, FALSE);
+	fail_unless(strstr(text->str, ties) != NULL,
+		"Ties are not rounded half to even.");
+	fail_unless(g_str_has_suffix(text->str, "1!\n#160\n"),
+		"Wrong final timestamp.");
+	g_string_free(text, TRUE);
+
+	check_vcd(sdi, SR_MHZ(400), data, 1, sizeof(data), SR_GHZ(1), "1 ns");
+	check_vcd(sdi, SR_MHZ(3), data, 1, sizeof(data), SR_GHZ(1), "1 ns");
+	check_vcd(sdi, SR_KHZ(7), data, 1, sizeof(data), SR_MHZ(1), "1 us");
+	check_vcd(sdi, 30, data, 1, sizeof(data), SR_KHZ(1), "1 ms");
+}
+END_TEST
+
+Suite *suite_output_vcd(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("output-vcd");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_vcd_channels);
+	tcase_add_test(tc, test_output_vcd_timestamps);
+	tcase_add_test(tc, test_output_vcd_runs);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,470 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define NUM_CHANNELS 3
+#define NUM_FRAMES 165
+#define SAMPLERATE 48000
+
+/* The header up to the samples, with the JUNK or ds64 chunk. */
+#define HEADER_SIZE 82
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+/*
+ * The packets the values are sent in, as (channel mask, samples): whole
+ * frames, then single channels and pairs which leave frames pending.
+ */
+static const struct {
+	unsigned int channels;
+	unsigned int count;
+} packets[] = {
+	{ 0x7, 50 },
+	{ 0x2, 30 }, { 0x1, 70 }, { 0x4, 10 }, { 0x2, 40 }, { 0x4, 60 },
+	{ 0x5, 20 }, { 0x2, 20 },
+	{ 0x7, 25 },
+};
+
+static GArray *analog_data;
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_analog *analog;
+	unsigned int count;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type != SR_DF_ANALOG)
+		return;
+	analog = packet->payload;
+	fail_unless(g_slist_length(analog->meaning->channels) == NUM_CHANNELS,
+		"Read back %u channels.",
+		g_slist_length(analog->meaning->channels));
+	count = analog->num_samples * NUM_CHANNELS;
+	g_array_set_size(analog_data, analog_data->len + count);
+	fail_unless(sr_analog_to_float(analog, &g_array_index(analog_data,
+		float, analog_data->len - count)) == SR_OK,
+		"Failed to convert the samples.");
+}
+
+/* A demo device with the analog channels and the sample limit. */
+static struct sr_dev_inst *open_demo(int num_analog, uint64_t limit_samples)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_config src;
+	GSList *options, *devices;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+	src.key = SR_CONF_NUM_ANALOG_CHANNELS;
+	src.data = g_variant_new_int32(num_analog);
+	options = g_slist_append(NULL, &src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	fail_unless(devices != NULL, "No demo device.");
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "sr_dev_open() failed: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(limit_samples));
+	fail_unless(ret == SR_OK, "Failed to set the sample limit: %d.", ret);
+
+	return sdi;
+}
+
+static GSList *analog_channels(const struct sr_dev_inst *sdi)
+{
+	struct sr_channel *ch;
+	GSList *l, *channels;
+
+	channels = NULL;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			channels = g_slist_append(channels, ch);
+	}
+
+	return channels;
+}
+
+static void send_packet(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *file)
+{
+	GString *out;
+	int ret;
+
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "sr_output_send() error: %d.", ret);
+	if (out) {
+		g_string_append_len(file, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/*
+ * Write values[channel][frame] of the demo device's analog channels to
+ * a file in the format, in the packets above.
+ */
+static GString *run_wav(const struct sr_dev_inst *sdi, const char *format,
+		float values[][NUM_FRAMES])
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	GHashTable *options;
+	GSList *channels;
+	GString *file;
+	float buf[NUM_CHANNELS * NUM_FRAMES];
+	unsigned int p, c, i, n, pos[NUM_CHANNELS];
+
+	omod = sr_output_find("wav");
+	fail_unless(omod != NULL, "Couldn't find the 'wav' output module.");
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			(GDestroyNotify)g_variant_unref);
+	g_hash_table_insert(options, g_strdup("format"),
+		g_variant_ref_sink(g_variant_new_string(format)));
+	o = sr_output_new(omod, options, sdi, NULL);
+	fail_unless(o != NULL, "Failed to create the wav output.");
+	g_hash_table_destroy(options);
+	file = g_string_new(NULL);
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(SAMPLERATE);
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	send_packet(o, &packet, file);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	channels = analog_channels(sdi);
+	memset(pos, 0, sizeof(pos));
+	for (p = 0; p < G_N_ELEMENTS(packets); p++) {
+		/* The channels in reverse order, to test the mapping. */
+		meaning.channels = NULL;
+		for (c = 0; c < NUM_CHANNELS; c++)
+			if (packets[p].channels & (1 << c))
+				meaning.channels = g_slist_prepend(
+					meaning.channels,
+					g_slist_nth_data(channels, c));
+		n = 0;
+		for (i = 0; i < packets[p].count; i++)
+			for (c = NUM_CHANNELS; c-- > 0;)
+				if (packets[p].channels & (1 << c))
+					buf[n++] = values[c][pos[c] + i];
+		for (c = 0; c < NUM_CHANNELS; c++)
+			if (packets[p].channels & (1 << c))
+				pos[c] += packets[p].count;
+		analog.data = buf;
+		analog.num_samples = packets[p].count;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		send_packet(o, &packet, file);
+		g_slist_free(meaning.channels);
+	}
+	for (c = 0; c < NUM_CHANNELS; c++)
+		fail_unless(pos[c] == NUM_FRAMES);
+	g_slist_free(channels);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	send_packet(o, &packet, file);
+	sr_output_free(o);
+
+	return file;
+}
+
+/* The fmt and data chunk headers. */
+static void check_fmt(const GString *file, unsigned int channels,
+		unsigned int format_code, unsigned int bytes)
+{
+	const uint8_t *h;
+
+	h = (const uint8_t *)file->str;
+	fail_unless(!memcmp(h + 48, "fmt ", 4), "No fmt chunk.");
+	fail_unless(RL32(h + 52) == 18, "Wrong fmt chunk size.");
+	fail_unless(RL16(h + 56) == format_code, "Wrong format code.");
+	fail_unless(RL16(h + 58) == channels, "Wrong number of channels.");
+	fail_unless(RL32(h + 60) == SAMPLERATE, "Wrong samplerate.");
+	fail_unless(RL32(h + 64) == SAMPLERATE * channels * bytes,
+		"Wrong byte rate.");
+	fail_unless(RL16(h + 68) == channels * bytes, "Wrong block align.");
+	fail_unless(RL16(h + 70) == bytes * 8, "Wrong bits per sample.");
+	fail_unless(RL16(h + 72) == 0, "Wrong extension size.");
+	fail_unless(!memcmp(h + 74, "data", 4), "No data chunk.");
+}
+
+/* A RIFF header with maxed out sizes, and a JUNK chunk for ds64. */
+static void check_riff(const GString *file)
+{
+	const uint8_t *h;
+	unsigned int i;
+
+	h = (const uint8_t *)file->str;
+	fail_unless(file->len >= HEADER_SIZE, "No header.");
+	fail_unless(!memcmp(h, "RIFF", 4), "No RIFF header.");
+	fail_unless(RL32(h + 4) == 0xffffffff, "RIFF size not maxed out.");
+	fail_unless(!memcmp(h + 8, "WAVE", 4), "Not a WAVE file.");
+	fail_unless(!memcmp(h + 12, "JUNK", 4), "No JUNK chunk.");
+	fail_unless(RL32(h + 16) == 28, "Wrong JUNK chunk size.");
+	for (i = 20; i < 48; i++)
+		fail_unless(h[i] == 0, "JUNK chunk not zeroed.");
+	fail_unless(RL32(h + 78) == 0xffffffff, "Data size not maxed out.");
+}
+
+/* An RF64 header with the sizes for the sample limit in ds64. */
+static void check_rf64(const GString *file, uint64_t limit,
+		unsigned int frame_size)
+{
+	const uint8_t *h;
+
+	h = (const uint8_t *)file->str;
+	fail_unless(file->len >= HEADER_SIZE, "No header.");
+	fail_unless(!memcmp(h, "RF64", 4), "No RF64 header.");
+	fail_unless(RL32(h + 4) == 0xffffffff, "RF64 size not maxed out.");
+	fail_unless(!memcmp(h + 8, "WAVE", 4), "Not a WAVE file.");
+	fail_unless(!memcmp(h + 12, "ds64", 4), "No ds64 chunk.");
+	fail_unless(RL32(h + 16) == 28, "Wrong ds64 chunk size.");
+	fail_unless(RL64(h + 20) == HEADER_SIZE - 8 + limit * frame_size,
+		"Wrong RIFF size %" PRIu64 ".", RL64(h + 20));
+	fail_unless(RL64(h + 28) == limit * frame_size,
+		"Wrong data size %" PRIu64 ".", RL64(h + 28));
+	fail_unless(RL64(h + 36) == limit, "Wrong sample count.");
+	fail_unless(RL32(h + 44) == 0, "Unexpected ds64 table.");
+	fail_unless(RL32(h + 78) == 0xffffffff, "Data size not maxed out.");
+}
+
+/*
+ * The value as integer PCM, -1..1 on full scale with clipping. The
+ * product is a float, which is rounded half away from zero.
+ */
+static int32_t ref_pcm(float value, float max)
+{
+	value *= max;
+	if (isnan(value))
+		return 0;
+
+	return lround(CLAMP(value, -max, max));
+}
+
+/* A signed little endian 16 or 24 bit sample. */
+static int32_t read_pcm(const uint8_t *data, unsigned int bytes)
+{
+	if (bytes == 2)
+		return (int16_t)RL16(data);
+
+	return (int32_t)((uint32_t)RL16(data) << 8 | (uint32_t)data[2] << 24) >> 8;
+}
+
+/*
+ * Check the samples in the file, then read it back with the WAV input
+ * module and check that it reads the same.
+ */
+static void check_samples(const GString *file, const char *format,
+		float values[][NUM_FRAMES])
+{
+	const uint8_t *data;
+	unsigned int bytes, i, c;
+	float max;
+	float value;
+	int32_t pcm;
+
+	bytes = !strcmp(format, "int16") ? 2 : !strcmp(format, "int24") ? 3 : 4;
+	max = bytes == 2 ? 32767 : 8388607;
+	fail_unless(file->len == HEADER_SIZE
+		+ (size_t)NUM_FRAMES * NUM_CHANNELS * bytes,
+		"File size %zu for %d frames.", file->len, NUM_FRAMES);
+
+	data = (const uint8_t *)file->str + HEADER_SIZE;
+	for (i = 0; i < NUM_FRAMES; i++) {
+		for (c = 0; c < NUM_CHANNELS; c++, data += bytes) {
+			value = values[c][i];
+			if (bytes == 4) {
+				fail_unless(!memcmp(data, &value, 4) ||
+					(isnan(value) && isnan(RLFL(data))),
+					"Frame %u channel %u is %g, "
+					"expected %g.", i, c, RLFL(data),
+					value);
+				continue;
+			}
+			pcm = read_pcm(data, bytes);
+			fail_unless(pcm == ref_pcm(value, max),
+				"Frame %u channel %u is %d for %g (%s).",
+				i, c, pcm, value, format);
+		}
+	}
+
+	analog_data = g_array_new(FALSE, FALSE, sizeof(float));
+	srtest_input_run("wav", NULL, file->str, file->len, 4096,
+		datafeed_in, FALSE);
+	fail_unless(analog_data->len == NUM_FRAMES * NUM_CHANNELS,
+		"Read back %u values.", analog_data->len);
+	data = (const uint8_t *)file->str + HEADER_SIZE;
+	for (i = 0; i < analog_data->len; i++, data += bytes) {
+		value = g_array_index(analog_data, float, i);
+		if (bytes == 4)
+			fail_unless(value == RLFL(data)
+				|| (isnan(value) && isnan(RLFL(data))),
+				"Value %u read back as %g.", i, value);
+		else
+			fail_unless(lrint(value * max) == read_pcm(data, bytes),
+				"Value %u read back as %g.", i, value);
+	}
+	g_array_free(analog_data, TRUE);
+}
+
+/* Values in -1.25..1.25, and some beyond full scale which clip. */
+static void make_values(float values[][NUM_FRAMES])
+{
+	static const float special[] = {
+		1, -1, 0, -0.0, 1.5, -2, 1e9, -1e9, INFINITY, -INFINITY, NAN,
+		0.5 / 32767, -0.5 / 32767, 1.5 / 32767, 0.5 / 8388607,
+	};
+	unsigned int i, c;
+
+	for (c = 0; c < NUM_CHANNELS; c++)
+		for (i = 0; i < NUM_FRAMES; i++)
+			values[c][i] = (int32_t)(rng_next() % 2000001
+				- 1000000) / 800000.0;
+	for (i = 0; i < G_N_ELEMENTS(special); i++)
+		values[i % NUM_CHANNELS][i * 7 % NUM_FRAMES] = special[i];
+}
+
+/* Packets with all channels and with some, in each sample format. */
+START_TEST(test_output_wav_formats)
+{
+	const char *formats[] = { "float", "int16", "int24" };
+	const unsigned int codes[] = { 3, 1, 1 }, bytes[] = { 4, 2, 3 };
+	float values[NUM_CHANNELS][NUM_FRAMES];
+	struct sr_dev_inst *sdi;
+	GString *file;
+	unsigned int f;
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	sdi = open_demo(NUM_CHANNELS, 1000);
+	for (f = 0; f < G_N_ELEMENTS(formats); f++) {
+		make_values(values);
+		file = run_wav(sdi, formats[f], values);
+		check_riff(file);
+		check_fmt(file, NUM_CHANNELS, codes[f], bytes[f]);
+		check_samples(file, formats[f], values);
+		g_string_free(file, TRUE);
+	}
+	sr_dev_close(sdi);
+}
+END_TEST
+
+/*
+ * A sample limit which makes the data too large for RIFF gives an RF64
+ * header. The limit is right at the edge for int16.
+ */
+START_TEST(test_output_wav_rf64)
+{
+	const uint64_t riff_max = (0xffffffffULL - (HEADER_SIZE - 8))
+		/ (NUM_CHANNELS * 2);
+	float values[NUM_CHANNELS][NUM_FRAMES];
+	struct sr_dev_inst *sdi;
+	GString *file;
+
+	rng_state = 0x0123456789abcdefULL;
+	make_values(values);
+
+	sdi = open_demo(NUM_CHANNELS, riff_max);
+	file = run_wav(sdi, "int16", values);
+	check_riff(file);
+	check_samples(file, "int16", values);
+	g_string_free(file, TRUE);
+	sr_dev_close(sdi);
+
+	sdi = open_demo(NUM_CHANNELS, riff_max + 1);
+	file = run_wav(sdi, "int16", values);
+	check_rf64(file, riff_max + 1, NUM_CHANNELS * 2);
+	check_fmt(file, NUM_CHANNELS, 1, 2);
+	check_samples(file, "int16", values);
+	g_string_free(file, TRUE);
+	sr_dev_close(sdi);
+
+	sdi = open_demo(NUM_CHANNELS, 1ULL << 40);
+	file = run_wav(sdi, "float", values);
+	check_rf64(file, 1ULL << 40, NUM_CHANNELS * 4);
+	check_fmt(file, NUM_CHANNELS, 3, 4);
+	check_samples(file, "float", values);
+	g_string_free(file, TRUE);
+	sr_dev_close(sdi);
+}
+END_TEST
+
+Suite *suite_output_wav(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("output-wav");
+
+	tc = tcase_create("basic");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_wav_formats);
+	tcase_add_test(tc, test_output_wav_rf64);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -19,6 +19,7 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -185,6 +186,516 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+/* Check whether a borrowed logic packet is copied by sr_packet_retain(). */
+START_TEST(test_packet_retain_logic)
+{
+	struct sr_datafeed_packet packet, *retained;
+	struct sr_datafeed_logic logic;
+	const struct sr_datafeed_logic *logic_copy;
+	uint8_t data[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+
+	logic.length = sizeof(data);
+	logic.unitsize = 2;
+	logic.data = data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	/* Not a pooled packet, so there is nothing to reference. */
+	retained = sr_packet_retain(&packet, FALSE);
+	fail_unless(retained == NULL);
+
+	retained = sr_packet_retain(&packet, TRUE);
+	fail_unless(retained != NULL);
+	fail_unless(retained->type == SR_DF_LOGIC);
+	logic_copy = retained->payload;
+	fail_unless(logic_copy != &logic);
+	fail_unless(logic_copy->data != logic.data);
+	fail_unless(logic_copy->length == logic.length);
+	fail_unless(logic_copy->unitsize == logic.unitsize);
+	fail_unless(!memcmp(logic_copy->data, data, sizeof(data)));
+
+	/* The copy must survive changes to the original. */
+	memset(data, 0, sizeof(data));
+	fail_unless(((uint8_t *)logic_copy->data)[0] == 0x01);
+
+	fail_unless(sr_packet_ref(retained) == retained);
+	sr_packet_unref(retained);
+	sr_packet_unref(retained);
+}
+END_TEST
+
+/* Check whether packets without payload can be retained. */
+START_TEST(test_packet_retain_no_payload)
+{
+	struct sr_datafeed_packet packet, *retained;
+
+	packet.type = SR_DF_TRIGGER;
+	packet.payload = NULL;
+
+	retained = sr_packet_retain(&packet, TRUE);
+	fail_unless(retained != NULL);
+	fail_unless(retained->type == SR_DF_TRIGGER);
+	fail_unless(retained->payload == NULL);
+	sr_packet_unref(retained);
+
+	/* NULL packets must not segfault. */
+	fail_unless(sr_packet_retain(NULL, TRUE) == NULL);
+	sr_packet_unref(NULL);
+}
+END_TEST
+
+/* Check whether runs can be expanded in pieces of any size. */
+START_TEST(test_logic_rle_expand)
+{
+	struct sr_datafeed_logic_rle rle;
+	struct sr_logic_rle_pos pos;
+	uint16_t values[] = { 0x0102, 0xa0b0, 0x0000, 0xffff };
+	uint64_t lengths[] = { 3, 0, 1000, 17 };
+	uint16_t expected[1020], buf[1020];
+	uint64_t count, max, total;
+	unsigned int i, j, n;
+
+	rle.num_runs = G_N_ELEMENTS(values);
+	rle.unitsize = sizeof(uint16_t);
+	rle.data = values;
+	rle.lengths = lengths;
+	fail_unless(sr_logic_rle_num_samples(&rle) == 1020);
+
+	for (i = 0, n = 0; i < rle.num_runs; i++)
+		for (j = 0; j < lengths[i]; j++)
+			expected[n++] = values[i];
+
+	for (max = 1; max <= 1024; max = max * 3 + 1) {
+		memset(buf, 0x55, sizeof(buf));
+		memset(&pos, 0, sizeof(pos));
+		total = 0;
+		while ((count = sr_logic_rle_expand(&rle, &pos, buf + total, max))) {
+			fail_unless(count <= max, "Expanded %" PRIu64 " samples.",
+				count);
+			total += count;
+		}
+		fail_unless(total == 1020, "Expanded %" PRIu64 " samples in "
+			"pieces of %" PRIu64 ".", total, max);
+		fail_unless(!memcmp(buf, expected, sizeof(expected)),
+			"Wrong samples in pieces of %" PRIu64 ".", max);
+	}
+
+	fail_unless(sr_logic_rle_expand(NULL, &pos, buf, 10) == 0);
+	fail_unless(sr_logic_rle_num_samples(NULL) == 0);
+}
+END_TEST
+
+/* Check whether a borrowed run-length encoded packet is copied. */
+START_TEST(test_packet_retain_logic_rle)
+{
+	struct sr_datafeed_packet packet, *retained;
+	struct sr_datafeed_logic_rle rle;
+	const struct sr_datafeed_logic_rle *rle_copy;
+	uint8_t values[] = { 0x01, 0x02, 0x03 };
+	uint64_t lengths[] = { 5, 1, 1000000 };
+
+	rle.num_runs = G_N_ELEMENTS(values);
+	rle.unitsize = 1;
+	rle.data = values;
+	rle.lengths = lengths;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+
+	retained = sr_packet_retain(&packet, TRUE);
+	fail_unless(retained != NULL);
+	fail_unless(retained->type == SR_DF_LOGIC_RLE);
+	rle_copy = retained->payload;
+	fail_unless(rle_copy != &rle);
+	fail_unless(rle_copy->num_runs == rle.num_runs);
+	fail_unless(rle_copy->unitsize == rle.unitsize);
+	fail_unless(rle_copy->data != rle.data);
+	fail_unless(rle_copy->lengths != rle.lengths);
+	fail_unless(!memcmp(rle_copy->data, values, sizeof(values)));
+	fail_unless(!memcmp(rle_copy->lengths, lengths, sizeof(lengths)));
+	sr_packet_unref(retained);
+}
+END_TEST
+
+/* Check whether the packet pool can be configured. */
+START_TEST(test_session_packet_pool_set)
+{
+	int ret;
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_packet_pool_set(sess, 64 * 1024, 16 * 1024, 4);
+	fail_unless(ret == SR_OK);
+	ret = sr_session_packet_pool_set(sess, 0, 16 * 1024, 4);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_session_packet_pool_set(NULL, 64 * 1024, 16 * 1024, 4);
+	fail_unless(ret == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* One channel, 1000 samples in runs of 100 to 400. */
+static const char *vcd_pooled =
+	"$timescale 1 us $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 ! d $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n";
+static const char *vcd_pooled_data =
+	"#0\n0!\n#100\n1!\n#300\n0!\n#700\n1!\n#1000\n0!\n";
+
+struct pool_run {
+	unsigned int logic_packets;
+	/* Retained packets, and the buffer of the first one. */
+	struct sr_datafeed_packet *held_first, *held;
+	const void *first_buf;
+	gboolean reused;
+};
+
+/*
+ * Retain the first packet until the third one, which is retained until
+ * the fourth. With one free buffer in the pool, the fourth packet must
+ * get the first one's buffer back.
+ */
+static void pool_datafeed_in(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct pool_run *run;
+	struct sr_datafeed_packet *retained;
+	const struct sr_datafeed_logic *logic, *logic_retained;
+
+	(void)sdi;
+
+	run = cb_data;
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	logic = packet->payload;
+
+	/* A pooled packet is referenced, not copied. */
+	retained = sr_packet_retain(packet, FALSE);
+	fail_unless(retained == packet, "Packet %u was not referenced.",
+		run->logic_packets);
+	logic_retained = retained->payload;
+	fail_unless(logic_retained->data == logic->data);
+
+	switch (run->logic_packets++) {
+	case 0:
+		run->held_first = retained;
+		run->first_buf = logic->data;
+		break;
+	case 1:
+		fail_unless(logic->data != run->first_buf,
+			"A retained buffer was handed out again.");
+		sr_packet_unref(retained);
+		break;
+	case 2:
+		fail_unless(logic->data != run->first_buf,
+			"A retained buffer was handed out again.");
+		run->held = retained;
+		sr_packet_unref(run->held_first);
+		break;
+	case 3:
+		run->reused = logic->data == run->first_buf;
+		sr_packet_unref(run->held);
+		sr_packet_unref(retained);
+		break;
+	default:
+		sr_packet_unref(retained);
+		break;
+	}
+}
+
+/*
+ * Check whether pooled packets reach a callback without a copy, and
+ * whether their buffers go back to the pool. The runs of the VCD input
+ * are expanded into pooled packets, which pass through a transform to
+ * the callback.
+ */
+START_TEST(test_session_packet_pool_owned)
+{
+	const struct sr_input_module *imod;
+	const struct sr_transform_module *tmod;
+	const struct sr_transform *t;
+	struct sr_input *in;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct pool_run run;
+	GString *buf;
+	int ret;
+
+	imod = sr_input_find("vcd");
+	fail_unless(imod != NULL);
+	tmod = sr_transform_find("nop");
+	fail_unless(tmod != NULL);
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL);
+
+	sr_session_new(srtest_ctx, &sess);
+	/* 64 samples per packet, and one spare buffer. */
+	ret = sr_session_packet_pool_set(sess, 64, 64, 1);
+	fail_unless(ret == SR_OK);
+	memset(&run, 0, sizeof(run));
+	sr_session_datafeed_callback_add(sess, pool_datafeed_in, &run);
+
+	buf = g_string_new(vcd_pooled);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	sdi = sr_input_dev_inst_get(in);
+	fail_unless(sdi != NULL, "No device after the header.");
+	sr_session_dev_add(sess, sdi);
+	t = sr_transform_new(tmod, NULL, sdi);
+	fail_unless(t != NULL);
+
+	g_string_assign(buf, vcd_pooled_data);
+	ret = sr_input_send(in, buf);
+	fail_unless(ret == SR_OK, "sr_input_send() error: %d", ret);
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+
+	fail_unless(run.logic_packets >= 4, "Got %u logic packets.",
+		run.logic_packets);
+	fail_unless(run.reused, "A released buffer was not reused.");
+
+	g_string_free(buf, TRUE);
+	sr_transform_free(t);
+	sr_session_destroy(sess);
+	sr_input_free(in);
+}
+END_TEST
+
+/* Check whether the dispatch mode can only be set to valid values. */
+START_TEST(test_session_dispatch_set)
+{
+	int ret;
+	struct sr_session *sess;
+	struct sr_datafeed_stats stats;
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_dispatch_set(sess, TRUE, 16, SR_DISPATCH_BLOCK);
+	fail_unless(ret == SR_OK);
+	ret = sr_session_dispatch_set(sess, TRUE, 0, SR_DISPATCH_DROP);
+	fail_unless(ret == SR_OK);
+	ret = sr_session_dispatch_set(sess, TRUE, 16, 0);
+	fail_unless(ret == SR_ERR_ARG);
+	ret = sr_session_dispatch_set(NULL, TRUE, 16, SR_DISPATCH_BLOCK);
+	fail_unless(ret == SR_ERR_ARG);
+
+	/* Unknown callbacks have no statistics. */
+	ret = sr_session_datafeed_stats_get(sess, NULL, NULL, &stats);
+	fail_unless(ret == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+#define DISPATCH_SAMPLES (256 * 4096)
+
+struct dispatch_run {
+	struct sr_session *session;
+	GThread *session_thread;
+	gboolean on_session_thread;
+	unsigned int callbacks;
+	unsigned int logic_packets;
+	uint64_t samples;
+	gboolean have_seen_df_header;
+	gboolean have_seen_df_end;
+	gboolean out_of_order;
+	gboolean end_before_stopped;
+	uint8_t next_sample;
+	gulong delay_us;
+	uint64_t stop_after;
+};
+
+static void dispatch_datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct dispatch_run *run;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *data;
+	uint64_t i;
+
+	(void)sdi;
+
+	run = cb_data;
+	run->callbacks++;
+	if (g_thread_self() == run->session_thread)
+		run->on_session_thread = TRUE;
+	if (run->have_seen_df_end)
+		run->out_of_order = TRUE;
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (run->have_seen_df_header || run->callbacks != 1)
+			run->out_of_order = TRUE;
+		run->have_seen_df_header = TRUE;
+		break;
+	case SR_DF_LOGIC:
+		if (!run->have_seen_df_header)
+			run->out_of_order = TRUE;
+		logic = packet->payload;
+		data = logic->data;
+		/* The incremental pattern counts up by one per sample. */
+		if (run->logic_packets == 0)
+			run->next_sample = data[0];
+		for (i = 0; i < logic->length; i++)
+			if (data[i] != run->next_sample++)
+				run->out_of_order = TRUE;
+		run->logic_packets++;
+		run->samples += logic->length;
+		if (run->stop_after && run->samples >= run->stop_after) {
+			run->stop_after = 0;
+			sr_session_stop(run->session);
+		}
+		if (run->delay_us)
+			g_usleep(run->delay_us);
+		break;
+	case SR_DF_END:
+		run->have_seen_df_end = TRUE;
+		break;
+	default:
+		break;
+	}
+}
+
+static void dispatch_stopped(void *cb_data)
+{
+	struct dispatch_run *run;
+
+	run = cb_data;
+	run->end_before_stopped = run->have_seen_df_end;
+}
+
+/* Run a demo device with 8 channels counting up in threaded mode. */
+static void run_dispatch(struct dispatch_run *run, unsigned int queue_size,
+		int policy, uint64_t limit_samples)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_channel_group *cg;
+	struct sr_config src;
+	struct sr_datafeed_stats stats;
+	GSList *options, *devices, *l;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+	src.key = SR_CONF_NUM_ANALOG_CHANNELS;
+	src.data = g_variant_new_int32(0);
+	options = g_slist_append(NULL, &src);
+	devices = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	fail_unless(devices != NULL, "No demo device.");
+	sdi = devices->data;
+	g_slist_free(devices);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "sr_dev_open() failed: %d.", ret);
+	if (limit_samples)
+		sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+			g_variant_new_uint64(limit_samples));
+	sr_config_set(sdi, NULL, SR_CONF_UNTHROTTLED,
+		g_variant_new_boolean(TRUE));
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (!strcmp(cg->name, "Logic"))
+			sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+				g_variant_new_string("incremental"));
+	}
+
+	sr_session_new(srtest_ctx, &run->session);
+	sr_session_dev_add(run->session, sdi);
+	ret = sr_session_dispatch_set(run->session, TRUE, queue_size, policy);
+	fail_unless(ret == SR_OK);
+	sr_session_datafeed_callback_add(run->session, dispatch_datafeed_in,
+		run);
+	sr_session_stopped_callback_set(run->session, dispatch_stopped, run);
+
+	run->session_thread = g_thread_self();
+	ret = sr_session_start(run->session);
+	fail_unless(ret == SR_OK, "sr_session_start() failed: %d.", ret);
+	ret = sr_session_run(run->session);
+	fail_unless(ret == SR_OK, "sr_session_run() failed: %d.", ret);
+
+	/* All packets the callback got were counted as queued. */
+	ret = sr_session_datafeed_stats_get(run->session,
+		dispatch_datafeed_in, run, &stats);
+	fail_unless(ret == SR_OK);
+	fail_unless(stats.packets == run->callbacks, "Queued %" PRIu64
+		" packets, the callback got %u.", stats.packets, run->callbacks);
+	fail_unless(stats.max_queue_depth <= queue_size);
+
+	fail_unless(!run->on_session_thread,
+		"The callback ran on the session thread.");
+	fail_unless(run->have_seen_df_header, "No SR_DF_HEADER.");
+	fail_unless(run->have_seen_df_end, "No SR_DF_END.");
+	fail_unless(run->end_before_stopped,
+		"The session stopped before the callback got SR_DF_END.");
+
+	if (policy == SR_DISPATCH_DROP) {
+		fail_unless(stats.dropped > 0, "No packets were dropped.");
+	} else {
+		fail_unless(stats.dropped == 0);
+		fail_unless(!run->out_of_order, "Packets out of order.");
+	}
+
+	sr_session_destroy(run->session);
+	sr_dev_close(sdi);
+}
+
+/* Check whether all packets reach a threaded callback, in order. */
+START_TEST(test_session_dispatch_block)
+{
+	struct dispatch_run run;
+
+	memset(&run, 0, sizeof(run));
+	run_dispatch(&run, 4, SR_DISPATCH_BLOCK, DISPATCH_SAMPLES);
+	fail_unless(run.samples == DISPATCH_SAMPLES, "Got %" PRIu64
+		" samples.", run.samples);
+}
+END_TEST
+
+/* Check whether a slow threaded callback makes the session drop data. */
+START_TEST(test_session_dispatch_drop)
+{
+	struct dispatch_run run;
+
+	memset(&run, 0, sizeof(run));
+	run.delay_us = 1000;
+	run_dispatch(&run, 1, SR_DISPATCH_DROP, DISPATCH_SAMPLES);
+	fail_unless(run.samples < DISPATCH_SAMPLES, "Nothing was dropped.");
+}
+END_TEST
+
+/* Check whether stopping the session waits for the threaded callback. */
+START_TEST(test_session_dispatch_stop)
+{
+	struct dispatch_run run;
+
+	memset(&run, 0, sizeof(run));
+	run.stop_after = 16 * 4096;
+	run.delay_us = 100;
+	run_dispatch(&run, 8, SR_DISPATCH_BLOCK, 0);
+	fail_unless(run.samples >= 16 * 4096, "Got %" PRIu64 " samples.",
+		run.samples);
+}
+END_TEST
+
+/* Check whether the USB thread can be switched while stopped. */
+START_TEST(test_session_usb_thread_set)
+{
+	int ret;
+	struct sr_session *sess;
+
+	sr_session_new(srtest_ctx, &sess);
+	ret = sr_session_usb_thread_set(sess, TRUE);
+	fail_unless(ret == SR_OK);
+	ret = sr_session_usb_thread_set(sess, FALSE);
+	fail_unless(ret == SR_OK);
+	ret = sr_session_usb_thread_set(NULL, TRUE);
+	fail_unless(ret == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -209,5 +720,25 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("packet");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_packet_retain_logic);
+	tcase_add_test(tc, test_packet_retain_no_payload);
+	tcase_add_test(tc, test_logic_rle_expand);
+	tcase_add_test(tc, test_packet_retain_logic_rle);
+	tcase_add_test(tc, test_session_packet_pool_set);
+	tcase_add_test(tc, test_session_packet_pool_owned);
+	tcase_add_test(tc, test_session_dispatch_set);
+	tcase_add_test(tc, test_session_usb_thread_set);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("dispatch");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_set_timeout(tc, 60);
+	tcase_add_test(tc, test_session_dispatch_block);
+	tcase_add_test(tc, test_session_dispatch_drop);
+	tcase_add_test(tc, test_session_dispatch_stop);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
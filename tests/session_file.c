@@ -0,0 +1,399 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#define SAMPLERATE		SR_MHZ(10)
+/* Enough to span several 4 MiB chunks in the file. */
+#define NUM_LOGIC_SAMPLES	5000000
+#define NUM_ANALOG_SAMPLES	2500000
+#define LOGIC_PACKET_SAMPLES	500001
+#define ANALOG_PACKET_SAMPLES	300007
+#define CHUNK_LOGIC_SAMPLES	(4 * 1024 * 1024 / 2)
+
+static char *filename;
+/* Whether the file is written from runs of identical samples. */
+static gboolean use_runs;
+
+/*
+ * Every sample differs, or for the file written from runs: runs of 65536
+ * samples, which are split in runs of 8 in every other 262144 samples.
+ */
+static uint16_t logic_sample(uint64_t i)
+{
+	if (use_runs)
+		return (i >> 16) * 0x9e37 ^ ((i >> 18) & 1 ? (i >> 3) & 1 : 0);
+
+	return i ^ (i >> 5);
+}
+
+/* Send the samples as runs, the way a device with RLE would. */
+static void send_runs(const struct sr_output *o, const uint16_t *samples,
+		uint64_t n)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	GString *out;
+	uint16_t *values;
+	uint64_t *lengths, i;
+	int ret;
+
+	values = g_malloc(n * sizeof(uint16_t));
+	lengths = g_malloc(n * sizeof(uint64_t));
+	rle.num_runs = 0;
+	for (i = 0; i < n; i++) {
+		if (i > 0 && samples[i] == samples[i - 1]) {
+			lengths[rle.num_runs - 1]++;
+			continue;
+		}
+		values[rle.num_runs] = samples[i];
+		lengths[rle.num_runs++] = 1;
+	}
+	rle.unitsize = sizeof(uint16_t);
+	rle.data = values;
+	rle.lengths = lengths;
+	packet.type = SR_DF_LOGIC_RLE;
+	packet.payload = &rle;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Failed to send runs: %d.", ret);
+	g_free(values);
+	g_free(lengths);
+}
+
+static float analog_sample(uint64_t i)
+{
+	return (float)(i % 1000) - 500;
+}
+
+/* Write a session file with 16 logic channels and one analog channel. */
+static void write_session_file(void)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	GString *out;
+	uint16_t *lbuf;
+	float *abuf;
+	uint64_t i, n, pos;
+	char name[8];
+	int fd, ret;
+
+	fd = g_file_open_tmp("sr-test-XXXXXX", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	close(fd);
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < 16; i++) {
+		g_snprintf(name, sizeof(name), "D%d", (int)i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_dev_inst_channel_add(sdi, 16, SR_CHANNEL_ANALOG, "A0");
+
+	omod = sr_output_find("srzip");
+	fail_unless(omod != NULL, "Couldn't find the 'srzip' output module.");
+	o = sr_output_new(omod, NULL, sdi, filename);
+	fail_unless(o != NULL, "Failed to create the srzip output.");
+
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_new_uint64(SAMPLERATE);
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Failed to send meta packet: %d.", ret);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	memset(&encoding, 0, sizeof(encoding));
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	encoding.unitsize = sizeof(float);
+	encoding.is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding.is_bigendian = TRUE;
+#endif
+	encoding.scale.p = encoding.scale.q = 1;
+	encoding.offset.q = 1;
+	meaning.channels = g_slist_append(NULL,
+			g_slist_last(sr_dev_inst_channels_get(sdi))->data);
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+
+	lbuf = g_malloc(LOGIC_PACKET_SAMPLES * sizeof(uint16_t));
+	abuf = g_malloc(ANALOG_PACKET_SAMPLES * sizeof(float));
+	for (pos = 0; pos < MAX(NUM_LOGIC_SAMPLES, NUM_ANALOG_SAMPLES);
+			pos += MAX(LOGIC_PACKET_SAMPLES, ANALOG_PACKET_SAMPLES)) {
+		if (pos < NUM_LOGIC_SAMPLES) {
+			n = MIN(LOGIC_PACKET_SAMPLES, NUM_LOGIC_SAMPLES - pos);
+			for (i = 0; i < n; i++)
+				lbuf[i] = GUINT16_TO_LE(logic_sample(pos + i));
+			if (use_runs) {
+				send_runs(o, lbuf, n);
+			} else {
+				logic.length = n * sizeof(uint16_t);
+				logic.unitsize = sizeof(uint16_t);
+				logic.data = lbuf;
+				packet.type = SR_DF_LOGIC;
+				packet.payload = &logic;
+				ret = sr_output_send(o, &packet, &out);
+				fail_unless(ret == SR_OK,
+					"Failed to send logic: %d.", ret);
+			}
+		}
+		/* The analog packets are smaller, send as many to keep up. */
+		for (n = pos; n < MIN(pos + LOGIC_PACKET_SAMPLES, NUM_ANALOG_SAMPLES);
+				n += analog.num_samples) {
+			analog.num_samples = MIN(ANALOG_PACKET_SAMPLES,
+					NUM_ANALOG_SAMPLES - n);
+			analog.num_samples = MIN(analog.num_samples,
+					pos + LOGIC_PACKET_SAMPLES - n);
+			for (i = 0; i < analog.num_samples; i++)
+				abuf[i] = analog_sample(n + i);
+			analog.data = abuf;
+			packet.type = SR_DF_ANALOG;
+			packet.payload = &analog;
+			ret = sr_output_send(o, &packet, &out);
+			fail_unless(ret == SR_OK, "Failed to send analog: %d.", ret);
+		}
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Failed to send end packet: %d.", ret);
+	sr_output_free(o);
+
+	g_slist_free(meaning.channels);
+	g_free(lbuf);
+	g_free(abuf);
+}
+
+static void setup(void)
+{
+	use_runs = FALSE;
+	write_session_file();
+}
+
+/* The same file, with the logic samples sent as runs. */
+static void setup_runs(void)
+{
+	use_runs = TRUE;
+	write_session_file();
+}
+
+static void teardown(void)
+{
+	g_unlink(filename);
+	g_free(filename);
+	filename = NULL;
+}
+
+static void check_logic_range(struct sr_session_file *sf,
+		uint64_t start, uint64_t count)
+{
+	uint16_t *buf;
+	uint64_t i;
+	int ret;
+
+	buf = g_malloc(count * sizeof(uint16_t));
+	ret = sr_session_file_logic_read(sf, start, count, (uint8_t *)buf);
+	fail_unless(ret == SR_OK, "Failed to read samples %" PRIu64
+		"+%" PRIu64 ": %d.", start, count, ret);
+	for (i = 0; i < count; i++) {
+		fail_unless(GUINT16_FROM_LE(buf[i]) == logic_sample(start + i),
+			"Wrong logic sample %" PRIu64 ".", start + i);
+	}
+	g_free(buf);
+}
+
+/* Check whether sr_session_file_open() rejects invalid arguments. */
+START_TEST(test_session_file_open_bogus)
+{
+	struct sr_session_file *sf;
+
+	fail_unless(sr_session_file_open(NULL, &sf) != SR_OK);
+	fail_unless(sr_session_file_open(filename, NULL) != SR_OK);
+	fail_unless(sr_session_file_open("/nonexistent.sr", &sf) != SR_OK);
+	fail_unless(sr_session_file_close(NULL) == SR_ERR_ARG);
+}
+END_TEST
+
+/* Check the metadata and sample counts of the file. */
+START_TEST(test_session_file_info)
+{
+	struct sr_session_file *sf;
+	uint64_t samplerate, num_samples;
+	unsigned int unitsize, num_analog;
+	int ret;
+
+	ret = sr_session_file_open(filename, &sf);
+	fail_unless(ret == SR_OK, "sr_session_file_open() failed: %d.", ret);
+	sr_session_file_info_get(sf, &samplerate, &unitsize, &num_samples,
+			&num_analog);
+	fail_unless(samplerate == SAMPLERATE);
+	fail_unless(unitsize == 2);
+	fail_unless(num_samples == NUM_LOGIC_SAMPLES);
+	fail_unless(num_analog == 1);
+	ret = sr_session_file_analog_samples_get(sf, 0, &num_samples);
+	fail_unless(ret == SR_OK);
+	fail_unless(num_samples == NUM_ANALOG_SAMPLES);
+	fail_unless(sr_session_file_analog_samples_get(sf, 1,
+			&num_samples) == SR_ERR_ARG);
+	sr_session_file_close(sf);
+}
+END_TEST
+
+/* Check reading logic ranges, in and across chunks, in any order. */
+START_TEST(test_session_file_logic_read)
+{
+	struct sr_session_file *sf;
+	uint8_t buf[4];
+	int ret;
+
+	ret = sr_session_file_open(filename, &sf);
+	fail_unless(ret == SR_OK, "sr_session_file_open() failed: %d.", ret);
+	check_logic_range(sf, NUM_LOGIC_SAMPLES - 1000, 1000);
+	check_logic_range(sf, 0, 1000);
+	check_logic_range(sf, CHUNK_LOGIC_SAMPLES - 3, 7);
+	check_logic_range(sf, 2 * CHUNK_LOGIC_SAMPLES + 12345, 1);
+	check_logic_range(sf, 1, CHUNK_LOGIC_SAMPLES * 2);
+
+	ret = sr_session_file_logic_read(sf, NUM_LOGIC_SAMPLES - 1, 2, buf);
+	fail_unless(ret == SR_ERR_ARG, "Read beyond the end: %d.", ret);
+	ret = sr_session_file_logic_read(sf, G_MAXUINT64, 2, buf);
+	fail_unless(ret == SR_ERR_ARG, "Read beyond the end: %d.", ret);
+	sr_session_file_close(sf);
+}
+END_TEST
+
+/* Check reading analog ranges. */
+START_TEST(test_session_file_analog_read)
+{
+	struct sr_session_file *sf;
+	float *buf;
+	uint64_t i, start;
+	int ret;
+
+	ret = sr_session_file_open(filename, &sf);
+	fail_unless(ret == SR_OK, "sr_session_file_open() failed: %d.", ret);
+	start = 1024 * 1024 - 10;
+	buf = g_malloc(100 * sizeof(float));
+	ret = sr_session_file_analog_read(sf, 0, start, 100, buf);
+	fail_unless(ret == SR_OK, "Analog read failed: %d.", ret);
+	for (i = 0; i < 100; i++)
+		fail_unless(buf[i] == analog_sample(start + i));
+	ret = sr_session_file_analog_read(sf, 0, NUM_ANALOG_SAMPLES - 99,
+			100, buf);
+	fail_unless(ret == SR_ERR_ARG, "Read beyond the end: %d.", ret);
+	ret = sr_session_file_analog_read(sf, 1, 0, 1, buf);
+	fail_unless(ret == SR_ERR_ARG, "Read of a missing channel: %d.", ret);
+	g_free(buf);
+	sr_session_file_close(sf);
+}
+END_TEST
+
+/* Check the decimated overviews against the samples. */
+START_TEST(test_session_file_decimate)
+{
+	struct sr_session_file *sf;
+	uint16_t min[16], max[16], emin, emax, v;
+	float fmin[8], fmax[8];
+	uint64_t i, j, start, step;
+	int ret;
+
+	ret = sr_session_file_open(filename, &sf);
+	fail_unless(ret == SR_OK, "sr_session_file_open() failed: %d.", ret);
+
+	/* Bins straddle chunks, and the last one is cut short. */
+	step = 333333;
+	start = NUM_LOGIC_SAMPLES - 15 * step - 1000;
+	ret = sr_session_file_logic_decimate(sf, start, step, 16,
+			(uint8_t *)min, (uint8_t *)max);
+	fail_unless(ret == SR_OK, "Logic decimate failed: %d.", ret);
+	for (i = 0; i < 16; i++) {
+		emin = 0xffff;
+		emax = 0;
+		for (j = start + i * step;
+				j < MIN(start + (i + 1) * step, NUM_LOGIC_SAMPLES); j++) {
+			v = logic_sample(j);
+			emin &= v;
+			emax |= v;
+		}
+		fail_unless(GUINT16_FROM_LE(min[i]) == emin, "Bin %d min.", (int)i);
+		fail_unless(GUINT16_FROM_LE(max[i]) == emax, "Bin %d max.", (int)i);
+	}
+	ret = sr_session_file_logic_decimate(sf, start, step, 17,
+			(uint8_t *)min, (uint8_t *)max);
+	fail_unless(ret == SR_ERR_ARG, "Bin beyond the end: %d.", ret);
+
+	ret = sr_session_file_analog_decimate(sf, 0, 250, 500, 8, fmin, fmax);
+	fail_unless(ret == SR_OK, "Analog decimate failed: %d.", ret);
+	for (i = 0; i < 8; i++) {
+		fail_unless(fmin[i] == (i % 2 ? -500 : -250), "Bin %d min.", (int)i);
+		fail_unless(fmax[i] == (i % 2 ? 499 : 249), "Bin %d max.", (int)i);
+	}
+	sr_session_file_close(sf);
+}
+END_TEST
+
+Suite *suite_session_file(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("session_file");
+
+	tc = tcase_create("random_access");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_unchecked_fixture(tc, setup, teardown);
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_session_file_open_bogus);
+	tcase_add_test(tc, test_session_file_info);
+	tcase_add_test(tc, test_session_file_logic_read);
+	tcase_add_test(tc, test_session_file_analog_read);
+	tcase_add_test(tc, test_session_file_decimate);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("runs");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_unchecked_fixture(tc, setup_runs, teardown);
+	tcase_set_timeout(tc, 30);
+	tcase_add_test(tc, test_session_file_info);
+	tcase_add_test(tc, test_session_file_logic_read);
+	tcase_add_test(tc, test_session_file_decimate);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
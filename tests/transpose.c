@@ -0,0 +1,165 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+#define NUM_ROUNDS 100
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+/* Check sr_transpose_8x8() against a bit-by-bit transpose. */
+START_TEST(test_transpose_8x8)
+{
+	uint64_t m, t, ref;
+	int i, r, c;
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		m = rng_next();
+		ref = 0;
+		for (r = 0; r < 8; r++)
+			for (c = 0; c < 8; c++)
+				if (m & (1ULL << (8 * r + c)))
+					ref |= 1ULL << (8 * c + r);
+		t = sr_transpose_8x8(m);
+		fail_unless(t == ref, "Wrong 8x8 transpose of 0x%016" PRIx64
+			": 0x%016" PRIx64 ".", m, t);
+		fail_unless(sr_transpose_8x8(t) == m);
+	}
+}
+END_TEST
+
+/* Check sr_transpose_16x16() against a bit-by-bit transpose. */
+START_TEST(test_transpose_16x16)
+{
+	uint16_t m[16], ref[16];
+	int i, r, c;
+
+	rng_state = 0x0123456789abcdefULL;
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		for (r = 0; r < 16; r++)
+			m[r] = rng_next();
+		memset(ref, 0, sizeof(ref));
+		for (r = 0; r < 16; r++)
+			for (c = 0; c < 16; c++)
+				if (m[r] & (1 << c))
+					ref[c] |= 1 << r;
+		sr_transpose_16x16(m);
+		fail_unless(!memcmp(m, ref, sizeof(ref)),
+			"Wrong 16x16 transpose in round %d.", i);
+	}
+}
+END_TEST
+
+/* Check sr_transpose_64x64() against a bit-by-bit transpose. */
+START_TEST(test_transpose_64x64)
+{
+	uint64_t m[64], ref[64];
+	int i, r, c;
+
+	rng_state = 0xfedcba9876543210ULL;
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		for (r = 0; r < 64; r++)
+			m[r] = rng_next();
+		memset(ref, 0, sizeof(ref));
+		for (r = 0; r < 64; r++)
+			for (c = 0; c < 64; c++)
+				if (m[r] & (1ULL << c))
+					ref[c] |= 1ULL << r;
+		sr_transpose_64x64(m);
+		fail_unless(!memcmp(m, ref, sizeof(ref)),
+			"Wrong 64x64 transpose in round %d.", i);
+	}
+}
+END_TEST
+
+/*
+ * Check sr_transpose_planes16() for all sample counts, in both bit
+ * orders, with some channels missing.
+ */
+START_TEST(test_transpose_planes16)
+{
+	uint64_t planes[16];
+	uint16_t samples[64 + 1], ref;
+	unsigned int n, k, ch, bit;
+	int msb_first, i;
+
+	rng_state = 0x5555aaaa3333ccccULL;
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		for (ch = 0; ch < 16; ch++)
+			planes[ch] = rng_next();
+		/* Missing channels have all-zero planes. */
+		planes[i % 16] = 0;
+		for (msb_first = 0; msb_first < 2; msb_first++) {
+			for (n = 8; n <= 64; n += 8) {
+				samples[n] = 0xa5a5;
+				sr_transpose_planes16(planes, samples, n, msb_first);
+				fail_unless(samples[n] == 0xa5a5,
+					"Wrote past %u samples.", n);
+				for (k = 0; k < n; k++) {
+					bit = msb_first ? (k & ~7) + 7 - k % 8 : k;
+					ref = 0;
+					for (ch = 0; ch < 16; ch++)
+						if (planes[ch] & (1ULL << bit))
+							ref |= 1 << ch;
+					fail_unless(samples[k] == ref,
+						"Sample %u of %u is 0x%04x, "
+						"expected 0x%04x.", k, n,
+						samples[k], ref);
+				}
+			}
+		}
+	}
+}
+END_TEST
+
+Suite *suite_transpose(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("transpose");
+
+	tc = tcase_create("matrix");
+	tcase_add_test(tc, test_transpose_8x8);
+	tcase_add_test(tc, test_transpose_16x16);
+	tcase_add_test(tc, test_transpose_64x64);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("planes");
+	tcase_add_test(tc, test_transpose_planes16);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
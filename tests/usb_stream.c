@@ -0,0 +1,495 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* 1 MB/s in 10 ms transfers of 10240 bytes, 4 of them at first. */
+#define BYTES_PER_MS 1000
+#define SIZE (20 * 512)
+#define FILL_US (SIZE * 1000 / BYTES_PER_MS)
+#define QUIET_ROUNDS 4
+
+static void init_stream(struct sr_usb_stream *stream, uint64_t bytes_per_ms,
+		unsigned int total_ms)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->config.bytes_per_ms = bytes_per_ms;
+	stream->config.total_ms = total_ms;
+	sr_usb_stream_size_pool(stream);
+}
+
+/* The time the device needs to fill a transfer, and the whole pool. */
+static int64_t fill_us(const struct sr_usb_stream *stream)
+{
+	return (uint64_t)stream->size * 1000 / stream->config.bytes_per_ms;
+}
+
+static int64_t pool_us(const struct sr_usb_stream *stream)
+{
+	return (uint64_t)stream->target * stream->size * 1000
+		/ stream->config.bytes_per_ms;
+}
+
+/* The timeout covers the pool, with 25% headroom. */
+static void check_timeout(const struct sr_usb_stream *stream)
+{
+	unsigned int ms;
+
+	ms = (uint64_t)stream->target * stream->size
+		/ stream->config.bytes_per_ms;
+	fail_unless(stream->timeout == ms + ms / 4,
+		"Timeout %u ms for %u transfers of %zu bytes.",
+		stream->timeout, stream->target, stream->size);
+}
+
+/*
+ * One round of full transfers, each reaped backlog_us late, with every
+ * callback taking callback_us. The pool may only change at the end of
+ * the round.
+ */
+static void run_round(struct sr_usb_stream *stream, int64_t backlog_us,
+		uint64_t callback_us)
+{
+	unsigned int target, i;
+	size_t size;
+
+	target = stream->target;
+	size = stream->size;
+	for (i = 0; i < target; i++) {
+		fail_unless(stream->target == target && stream->size == size,
+			"The pool changed after %u of %u transfers.", i,
+			target);
+		sr_usb_stream_adapt(stream, backlog_us, callback_us, size);
+	}
+	check_timeout(stream);
+}
+
+START_TEST(test_usb_stream_size_pool)
+{
+	struct sr_usb_stream stream;
+
+	init_stream(&stream, BYTES_PER_MS, 40);
+	fail_unless(stream.config.block_size == 512);
+	fail_unless(stream.config.transfer_ms == 10);
+	fail_unless(stream.config.max_transfers == USB_STREAM_MAX_TRANSFERS);
+	fail_unless(stream.config.max_empty_transfers
+		== 2 * USB_STREAM_MAX_TRANSFERS);
+	fail_unless(stream.size == SIZE && stream.min_size == SIZE);
+	fail_unless(stream.config.max_transfer_size == 4 * SIZE);
+	fail_unless(stream.target == 4 && stream.min_target == 2);
+	check_timeout(&stream);
+
+	/* Sizes are rounded up to blocks, the pool to whole transfers. */
+	memset(&stream, 0, sizeof(stream));
+	stream.config.bytes_per_ms = 300;
+	stream.config.total_ms = 95;
+	stream.config.max_transfer_size = 5000;
+	sr_usb_stream_size_pool(&stream);
+	fail_unless(stream.size == 3072, "Size %zu.", stream.size);
+	fail_unless(stream.config.max_transfer_size == 5120);
+	fail_unless(stream.target == 10 && stream.min_target == 5);
+	check_timeout(&stream);
+
+	/* At most 32 transfers, and at least 1. */
+	init_stream(&stream, BYTES_PER_MS, 1000);
+	fail_unless(stream.target == USB_STREAM_MAX_TRANSFERS);
+	fail_unless(stream.min_target == USB_STREAM_MAX_TRANSFERS / 2);
+	init_stream(&stream, BYTES_PER_MS, 1);
+	fail_unless(stream.target == 1 && stream.min_target == 1);
+	init_stream(&stream, BYTES_PER_MS, 25);
+	fail_unless(stream.target == 3 && stream.min_target == 2);
+}
+END_TEST
+
+/*
+ * Transfers reaped one fill time apart are in time. After a stall, the
+ * first transfer reaped is late by the stall less its own fill time, the
+ * ones reaped right after it are less late by their fill time each.
+ */
+START_TEST(test_usb_stream_backlog)
+{
+	struct sr_usb_stream stream;
+	int64_t t, backlog;
+	int i;
+
+	init_stream(&stream, BYTES_PER_MS, 40);
+	t = stream.last_reaped_us = 1000000;
+	for (i = 0; i < 10; i++) {
+		t += FILL_US;
+		backlog = sr_usb_stream_update_backlog(&stream, t, SIZE);
+		fail_unless(backlog == 0, "In time, but %" PRIi64 " us late.",
+			backlog);
+		fail_unless(stream.last_reaped_us == t);
+	}
+
+	t += 50000;
+	for (i = 0; i < 6; i++) {
+		backlog = sr_usb_stream_update_backlog(&stream, t, SIZE);
+		fail_unless(backlog == MAX(50000 - (i + 1) * FILL_US, 0),
+			"Transfer %d after the stall %" PRIi64 " us late.", i,
+			backlog);
+	}
+
+	/* Short transfers take less time to fill. */
+	t += 50000;
+	backlog = sr_usb_stream_update_backlog(&stream, t, 512);
+	fail_unless(backlog == 50000 - 512, "%" PRIi64 " us late.", backlog);
+	t += FILL_US;
+	backlog = sr_usb_stream_update_backlog(&stream, t, 2 * SIZE);
+	fail_unless(backlog == 50000 - 512 - FILL_US, "%" PRIi64 " us late.",
+		backlog);
+
+	/* Reaped sooner than the device could fill them, but not early. */
+	for (i = 0; i < 10; i++)
+		sr_usb_stream_update_backlog(&stream, t, SIZE);
+	fail_unless(stream.backlog_us == 0);
+	t += FILL_US;
+	fail_unless(sr_usb_stream_update_backlog(&stream, t, SIZE) == 0);
+	t += FILL_US + 1;
+	fail_unless(sr_usb_stream_update_backlog(&stream, t, SIZE) == 1);
+}
+END_TEST
+
+/*
+ * Reaped later than half the pool lasts: the pool grows by a quarter,
+ * at least by one transfer, up to the most transfers allowed. This goes
+ * before making the transfers larger, which follows once the pool has
+ * all the transfers it can have.
+ */
+START_TEST(test_usb_stream_grow)
+{
+	const unsigned int targets[] = {
+		4, 5, 6, 7, 8, 10, 12, 15, 18, 22, 27, 32, 32, 32,
+	};
+	struct sr_usb_stream stream;
+	unsigned int i;
+
+	init_stream(&stream, BYTES_PER_MS, 40);
+	run_round(&stream, pool_us(&stream) / 2, FILL_US / 2);
+	fail_unless(stream.target == 4 && stream.stats.grown == 0,
+		"Grew for half the pool.");
+
+	for (i = 0; i < G_N_ELEMENTS(targets); i++) {
+		fail_unless(stream.target == targets[i],
+			"%u transfers in round %u, expected %u.",
+			stream.target, i, targets[i]);
+		fail_unless(stream.size == (i < 12 ? 1 : 1 << (i - 11)) * SIZE,
+			"Size %zu in round %u.", stream.size, i);
+		run_round(&stream, pool_us(&stream) / 2 + 1, fill_us(&stream));
+	}
+	fail_unless(stream.size == 4 * SIZE);
+	fail_unless(stream.stats.grown == 13, "Grew %u times.",
+		stream.stats.grown);
+	fail_unless(stream.stats.shrunk == 0);
+}
+END_TEST
+
+/*
+ * Callbacks taking more than half the fill time make the transfers twice
+ * as large, up to the largest size allowed.
+ */
+START_TEST(test_usb_stream_enlarge)
+{
+	struct sr_usb_stream stream;
+	unsigned int i;
+
+	init_stream(&stream, BYTES_PER_MS, 40);
+	run_round(&stream, 0, FILL_US / 2);
+	fail_unless(stream.size == SIZE, "Larger for half the fill time.");
+
+	run_round(&stream, 0, FILL_US / 2 + 1);
+	fail_unless(stream.size == 2 * SIZE, "Size %zu.", stream.size);
+	run_round(&stream, 0, FILL_US + 1);
+	fail_unless(stream.size == 4 * SIZE, "Size %zu.", stream.size);
+	run_round(&stream, 0, 4 * FILL_US);
+	fail_unless(stream.size == 4 * SIZE, "Larger than the largest size.");
+	fail_unless(stream.target == 4);
+	fail_unless(stream.stats.grown == 2 && stream.stats.shrunk == 0);
+
+	/* Short transfers are filled sooner. */
+	init_stream(&stream, BYTES_PER_MS, 40);
+	for (i = 0; i < stream.target; i++)
+		sr_usb_stream_adapt(&stream, 0, FILL_US / 4 + 1, SIZE / 2);
+	fail_unless(stream.size == 2 * SIZE, "Size %zu.", stream.size);
+}
+END_TEST
+
+/*
+ * After four quiet rounds in a row, the transfers are made half as
+ * large, rounded up to blocks, down to the size at the start. Then the
+ * pool is made one transfer smaller, down to half its size at the start.
+ * A round with a quarter of the pool late, or callbacks taking a tenth
+ * of the fill time, is not quiet. Neither is a round which grows the
+ * pool.
+ */
+START_TEST(test_usb_stream_shrink)
+{
+	struct sr_usb_stream stream;
+	unsigned int target, i;
+
+	/* Just not quiet, and just quiet. */
+	init_stream(&stream, BYTES_PER_MS, 80);
+	fail_unless(stream.target == 8 && stream.min_target == 4);
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	run_round(&stream, pool_us(&stream) / 4, 0);
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	run_round(&stream, 0, FILL_US / 10);
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, pool_us(&stream) / 4 - 1, FILL_US / 10 - 1);
+	fail_unless(stream.target == 8 && stream.stats.shrunk == 0,
+		"Smaller after rounds which were not quiet.");
+	run_round(&stream, 0, 0);
+	fail_unless(stream.target == 7 && stream.stats.shrunk == 1);
+
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	run_round(&stream, pool_us(&stream), 0);
+	fail_unless(stream.target == 8);
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	fail_unless(stream.target == 8, "Smaller right after growing.");
+	run_round(&stream, 0, 0);
+	fail_unless(stream.target == 7);
+
+	/* 4 transfers of 3 blocks at first, up to 7 blocks. */
+	memset(&stream, 0, sizeof(stream));
+	stream.config.bytes_per_ms = 150;
+	stream.config.total_ms = 40;
+	stream.config.max_transfer_size = 7 * 512;
+	sr_usb_stream_size_pool(&stream);
+	fail_unless(stream.target == 4 && stream.size == 3 * 512);
+
+	for (i = 0; i < 3; i++)
+		run_round(&stream, pool_us(&stream), 0);
+	for (i = 0; i < 2; i++)
+		run_round(&stream, 0, G_USEC_PER_SEC);
+	fail_unless(stream.target == 7 && stream.size == 7 * 512,
+		"%u transfers of %zu bytes.", stream.target, stream.size);
+	fail_unless(stream.stats.grown == 5);
+
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	fail_unless(stream.size == 7 * 512);
+	run_round(&stream, 0, 0);
+	fail_unless(stream.size == 4 * 512, "Size %zu.", stream.size);
+	for (i = 0; i < QUIET_ROUNDS - 1; i++)
+		run_round(&stream, 0, 0);
+	fail_unless(stream.size == 4 * 512);
+	run_round(&stream, 0, 0);
+	fail_unless(stream.size == 3 * 512, "Size %zu.", stream.size);
+
+	for (target = 7; target > 2; target--) {
+		for (i = 0; i < QUIET_ROUNDS; i++) {
+			fail_unless(stream.target == target,
+				"%u transfers, expected %u.", stream.target,
+				target);
+			run_round(&stream, 0, 0);
+		}
+	}
+	for (i = 0; i < 2 * QUIET_ROUNDS; i++)
+		run_round(&stream, 0, 0);
+	fail_unless(stream.target == 2, "%u transfers.", stream.target);
+	fail_unless(stream.size == 3 * 512);
+	fail_unless(stream.stats.shrunk == 7, "Shrunk %u times.",
+		stream.stats.shrunk);
+	fail_unless(stream.stats.grown == 5);
+}
+END_TEST
+
+/*
+ * The rings only pass pointers, the test's slots carry a sequence
+ * number and its complement, written before the slot is pushed.
+ */
+struct ring_item {
+	uint64_t seq;
+	uint64_t check;
+};
+
+#define RING_POISON UINT64_MAX
+#define RING_ITEMS 1000000
+
+/* Like a stream on its own thread: done and spare slots go round. */
+struct ring_test {
+	struct sr_usb_stream_ring done;
+	struct sr_usb_stream_ring spare;
+	struct ring_item *items;
+	unsigned int num_items;
+	/* Slots the producer got back still in use, only read after join. */
+	unsigned int reused;
+};
+
+static void push_item(struct sr_usb_stream_ring *ring, struct ring_item *item)
+{
+	sr_usb_stream_ring_push(ring, (struct usb_stream_slot *)item);
+}
+
+static gboolean pop_item(struct sr_usb_stream_ring *ring,
+		struct ring_item **item)
+{
+	struct usb_stream_slot *slot;
+
+	if (!sr_usb_stream_ring_pop(ring, &slot))
+		return FALSE;
+	*item = (struct ring_item *)slot;
+
+	return TRUE;
+}
+
+/* The USB thread: fills spare slots and hands them over as done. */
+static gpointer ring_producer(gpointer data)
+{
+	struct ring_test *t;
+	struct ring_item *item;
+	uint64_t seq;
+
+	t = data;
+	for (seq = 0; seq < RING_ITEMS; seq++) {
+		while (!pop_item(&t->spare, &item))
+			g_thread_yield();
+		if (item->seq != RING_POISON || item->check != RING_POISON)
+			t->reused++;
+		item->seq = seq;
+		item->check = ~seq;
+		push_item(&t->done, item);
+	}
+
+	return NULL;
+}
+
+static void ring_test_init(struct ring_test *t, unsigned int num_items)
+{
+	unsigned int i;
+
+	t->num_items = num_items;
+	t->items = g_malloc_n(num_items, sizeof(*t->items));
+	t->reused = 0;
+	sr_usb_stream_ring_init(&t->done, num_items);
+	sr_usb_stream_ring_init(&t->spare, num_items);
+	for (i = 0; i < num_items; i++) {
+		t->items[i].seq = t->items[i].check = RING_POISON;
+		push_item(&t->spare, &t->items[i]);
+	}
+}
+
+static void ring_test_free(struct ring_test *t)
+{
+	g_free(t->done.items);
+	g_free(t->spare.items);
+	g_free(t->items);
+}
+
+START_TEST(test_usb_stream_ring)
+{
+	struct sr_usb_stream_ring ring;
+	struct ring_item items[3], *item;
+	unsigned int round, n, i;
+
+	sr_usb_stream_ring_init(&ring, 3);
+	fail_unless(!pop_item(&ring, &item));
+
+	/* Wrap around with every fill level, up to a full ring. */
+	for (round = 0; round < 20; round++) {
+		n = round % 3 + 1;
+		for (i = 0; i < n; i++) {
+			push_item(&ring, &items[i]);
+			fail_unless(sr_usb_stream_ring_depth(&ring) == i + 1);
+		}
+		for (i = 0; i < n; i++) {
+			fail_unless(pop_item(&ring, &item));
+			fail_unless(item == &items[i],
+				"Round %u: item %u out of order.", round, i);
+			fail_unless(sr_usb_stream_ring_depth(&ring) == n - i - 1);
+		}
+		fail_unless(!pop_item(&ring, &item));
+	}
+
+	g_free(ring.items);
+}
+END_TEST
+
+/*
+ * The session thread's side, against a producer on a thread of its own:
+ * every slot arrives once, in order, and fully written.
+ */
+START_TEST(test_usb_stream_ring_threads)
+{
+	static const unsigned int sizes[] = { 1, 3, 16 };
+	struct ring_test t;
+	struct ring_item *item;
+	GThread *producer;
+	unsigned int i, depth;
+	uint64_t seq;
+
+	for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+		ring_test_init(&t, sizes[i]);
+		producer = g_thread_new("ring-producer", ring_producer, &t);
+
+		for (seq = 0; seq < RING_ITEMS; seq++) {
+			while (!pop_item(&t.done, &item))
+				g_thread_yield();
+			fail_unless(item->seq == seq && item->check == ~seq,
+				"%u slots: got %" PRIu64 "/%" PRIx64
+				", expected %" PRIu64 ".", sizes[i], item->seq,
+				item->check, seq);
+			depth = sr_usb_stream_ring_depth(&t.done);
+			fail_unless(depth < sizes[i], "%u of %u slots queued.",
+				depth, sizes[i]);
+			item->seq = item->check = RING_POISON;
+			push_item(&t.spare, item);
+		}
+
+		g_thread_join(producer);
+		fail_unless(t.reused == 0, "%u slots reused.", t.reused);
+		fail_unless(!pop_item(&t.done, &item));
+		fail_unless(sr_usb_stream_ring_depth(&t.spare) == sizes[i]);
+		ring_test_free(&t);
+	}
+}
+END_TEST
+
+Suite *suite_usb_stream(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb-stream");
+
+	tc = tcase_create("pool");
+	tcase_add_test(tc, test_usb_stream_size_pool);
+	tcase_add_test(tc, test_usb_stream_backlog);
+	tcase_add_test(tc, test_usb_stream_grow);
+	tcase_add_test(tc, test_usb_stream_enlarge);
+	tcase_add_test(tc, test_usb_stream_shrink);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("ring");
+	tcase_add_test(tc, test_usb_stream_ring);
+	tcase_add_test(tc, test_usb_stream_ring_threads);
+	tcase_set_timeout(tc, 30);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,531 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 The sigrok project
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* The trace format, as in usb_trace.c. */
+#define TRACE_HEADER "SRUSBTRC\x01"
+#define RECORD_SIZE 29
+
+enum {
+	TRACE_DEVICE = 1,
+	TRACE_STRING,
+	TRACE_CONTROL,
+	TRACE_BULK,
+	TRACE_COMPLETE,
+};
+
+#define BUS 3
+#define ADDRESS_1 7
+#define ADDRESS_2 12
+
+#define NUM_STREAMS 3
+#define NUM_COMPLETIONS 200
+#define NUM_INFLIGHT 4
+#define BUFFER_SIZE 64
+/* Some completions are longer than the buffer, and get cut. */
+#define MAX_LENGTH 80
+
+struct record {
+	uint8_t type;
+	uint8_t address;
+	uint8_t endpoint;
+	uint8_t request;
+	uint16_t value;
+	uint16_t index;
+	int32_t result;
+	uint32_t length;
+	uint32_t data_len;
+	const void *data;
+};
+
+/* Asynchronous transfers on one endpoint of one of the devices. */
+struct stream {
+	uint8_t address;
+	uint8_t endpoint;
+	libusb_device_handle *hdl;
+	/* The transfers submitted, oldest first. */
+	GQueue *inflight;
+	/* The next completion of the trace to look at. */
+	unsigned int next;
+};
+
+struct completion {
+	unsigned int stream;
+	int status;
+	uint32_t length;
+	uint8_t data[MAX_LENGTH];
+};
+
+static const uint8_t control_data[] = { 0x12, 0x34, 0x56, 0x78 };
+static const uint8_t bulk_data[] = "0123456789";
+static const uint8_t other_data[] = "abcdef";
+
+static uint64_t rng_state;
+
+static struct stream streams[NUM_STREAMS];
+static struct completion completions[NUM_COMPLETIONS];
+/* The completions which made it into the trace in full. */
+static unsigned int num_valid;
+static unsigned int num_completed, num_gone;
+
+static uint64_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+
+	return rng_state;
+}
+
+static void put_record(GString *trace, const struct record *rec)
+{
+	uint8_t header[RECORD_SIZE];
+
+	memset(header, 0, sizeof(header));
+	W8(header + 0, rec->type);
+	W8(header + 1, BUS);
+	W8(header + 2, rec->address);
+	W8(header + 3, rec->endpoint);
+	W8(header + 4, rec->request);
+	WL16(header + 5, rec->value);
+	WL16(header + 7, rec->index);
+	WL32(header + 9, rec->result);
+	WL32(header + 13, rec->length);
+	WL32(header + 25, rec->data_len);
+	g_string_append_len(trace, (const char *)header, sizeof(header));
+	g_string_append_len(trace, (const char *)rec->data, rec->data_len);
+}
+
+static void put_device(GString *trace, uint8_t address, uint16_t vid,
+		uint16_t pid, const uint8_t *ports, unsigned int num_ports)
+{
+	struct record rec;
+	uint8_t data[18 + 8];
+
+	memset(data, 0, sizeof(data));
+	W8(data + 0, 18);
+	W8(data + 1, 1);
+	WL16(data + 2, 0x0200);
+	W8(data + 7, 64);
+	WL16(data + 8, vid);
+	WL16(data + 10, pid);
+	WL16(data + 12, 0x0100);
+	W8(data + 14, 1);
+	W8(data + 15, 2);
+	W8(data + 17, 1);
+	memcpy(data + 18, ports, num_ports);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_DEVICE;
+	rec.address = address;
+	rec.result = num_ports;
+	rec.data_len = 18 + num_ports;
+	rec.data = data;
+	put_record(trace, &rec);
+}
+
+static void put_string(GString *trace, uint8_t address, uint16_t index,
+		const char *s)
+{
+	struct record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_STRING;
+	rec.address = address;
+	rec.index = index;
+	rec.result = strlen(s);
+	rec.data_len = strlen(s);
+	rec.data = s;
+	put_record(trace, &rec);
+}
+
+/*
+ * Two devices with their strings, a control transfer and bulk transfers
+ * on them, and the completions of random transfers
+ * on the streams, mixed across the endpoints and the devices.
+ */
+static GString *make_trace(void)
+{
+	const uint8_t ports_1[] = { 1, 4 }, ports_2[] = { 2 };
+	struct completion *c;
+	struct record rec;
+	GString *trace;
+	unsigned int i, j;
+
+	trace = g_string_new(NULL);
+	g_string_append_len(trace, TRACE_HEADER, strlen(TRACE_HEADER));
+
+	put_device(trace, ADDRESS_1, 0xa600, 0xa000, ports_1, 2);
+	put_string(trace, ADDRESS_1, 1, "sigrok");
+	put_string(trace, ADDRESS_1, 2, "fx2lafw");
+	put_device(trace, ADDRESS_2, 0x1d50, 0x608c, ports_2, 1);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_CONTROL;
+	rec.address = ADDRESS_1;
+	rec.endpoint = LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR;
+	rec.request = 0xb0;
+	rec.value = 0x1234;
+	rec.index = 0x5678;
+	rec.result = sizeof(control_data);
+	rec.length = sizeof(control_data);
+	rec.data_len = sizeof(control_data);
+	rec.data = control_data;
+	put_record(trace, &rec);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_BULK;
+	rec.address = ADDRESS_2;
+	rec.endpoint = 0x81;
+	rec.length = rec.data_len = sizeof(other_data);
+	rec.data = other_data;
+	put_record(trace, &rec);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_BULK;
+	rec.address = ADDRESS_1;
+	rec.endpoint = 0x01;
+	rec.length = 64;
+	put_record(trace, &rec);
+
+	rec.endpoint = 0x81;
+	rec.length = rec.data_len = sizeof(bulk_data);
+	rec.data = bulk_data;
+	put_record(trace, &rec);
+
+	for (i = 0; i < NUM_COMPLETIONS; i++) {
+		c = &completions[i];
+		c->stream = rng_next() % NUM_STREAMS;
+		if (rng_next() % 10) {
+			c->status = LIBUSB_TRANSFER_COMPLETED;
+			c->length = 1 + rng_next() % MAX_LENGTH;
+		} else {
+			c->status = LIBUSB_TRANSFER_TIMED_OUT;
+			c->length = 0;
+		}
+		for (j = 0; j < c->length; j++)
+			c->data[j] = rng_next();
+
+		memset(&rec, 0, sizeof(rec));
+		rec.type = TRACE_COMPLETE;
+		rec.address = streams[c->stream].address;
+		rec.endpoint = streams[c->stream].endpoint;
+		rec.result = c->status;
+		rec.length = rec.data_len = c->length;
+		rec.data = c->data;
+		put_record(trace, &rec);
+	}
+
+	return trace;
+}
+
+static void LIBUSB_CALL transfer_done(struct libusb_transfer *transfer)
+{
+	struct stream *st;
+	struct completion *c;
+	unsigned int s;
+	int ret;
+
+	st = transfer->user_data;
+	s = st - streams;
+	fail_unless(g_queue_pop_head(st->inflight) == transfer,
+		"Not the oldest transfer completed on stream %u.", s);
+
+	if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+		fail_unless(transfer->actual_length == 0);
+		num_gone++;
+		return;
+	}
+
+	while (st->next < num_valid && completions[st->next].stream != s)
+		st->next++;
+	fail_unless(st->next < num_valid,
+		"Completion on stream %u which is not in the trace.", s);
+	c = &completions[st->next++];
+	fail_unless(transfer->status == c->status,
+		"Status %d, expected %d.", transfer->status, c->status);
+	fail_unless(transfer->actual_length == (int)MIN(c->length, BUFFER_SIZE),
+		"Got %d bytes, expected %u.", transfer->actual_length,
+		c->length);
+	fail_unless(!memcmp(transfer->buffer, c->data,
+		transfer->actual_length), "Wrong data on stream %u.", s);
+	num_completed++;
+
+	/* Resubmit, like the drivers do. */
+	g_queue_push_tail(st->inflight, transfer);
+	ret = libusb_submit_transfer(transfer);
+	fail_unless(ret == LIBUSB_SUCCESS, "Failed to resubmit: %d.", ret);
+}
+
+static libusb_device_handle *open_device(libusb_device *dev,
+		uint8_t address, uint16_t vid, const uint8_t *ports,
+		int num_ports)
+{
+	struct libusb_device_descriptor des;
+	libusb_device_handle *hdl;
+	uint8_t port_numbers[8];
+	int ret;
+
+	ret = libusb_get_device_descriptor(dev, &des);
+	fail_unless(ret == LIBUSB_SUCCESS);
+	fail_unless(des.idVendor == vid, "Vendor 0x%04x, expected 0x%04x.",
+		des.idVendor, vid);
+	fail_unless(des.bLength == 18 && des.bcdUSB == 0x0200
+		&& des.bMaxPacketSize0 == 64 && des.bcdDevice == 0x0100
+		&& des.iManufacturer == 1 && des.iProduct == 2
+		&& des.iSerialNumber == 0 && des.bNumConfigurations == 1,
+		"Wrong device descriptor.");
+	fail_unless(libusb_get_bus_number(dev) == BUS);
+	fail_unless(libusb_get_device_address(dev) == address);
+
+	ret = libusb_get_port_numbers(dev, port_numbers, sizeof(port_numbers));
+	fail_unless(ret == num_ports, "%d ports, expected %d.", ret, num_ports);
+	fail_unless(!memcmp(port_numbers, ports, num_ports));
+	ret = libusb_get_port_numbers(dev, port_numbers, num_ports - 1);
+	fail_unless(ret == LIBUSB_ERROR_OVERFLOW);
+
+	ret = libusb_open(dev, &hdl);
+	fail_unless(ret == LIBUSB_SUCCESS, "Failed to open: %d.", ret);
+	fail_unless(libusb_get_device(hdl) == dev);
+
+	return hdl;
+}
+
+/* Enumeration, string descriptors and synchronous transfers. */
+static void check_sync(libusb_device_handle **hdl_1,
+		libusb_device_handle **hdl_2)
+{
+	const uint8_t ports_1[] = { 1, 4 }, ports_2[] = { 2 };
+	libusb_device **devlist;
+	unsigned char buf[BUFFER_SIZE];
+	ssize_t num;
+	int ret, transferred;
+
+	num = libusb_get_device_list(NULL, &devlist);
+	fail_unless(num == 2, "Got %zd devices, expected 2.", num);
+	fail_unless(devlist[2] == NULL);
+	*hdl_1 = open_device(devlist[0], ADDRESS_1, 0xa600, ports_1, 2);
+	*hdl_2 = open_device(devlist[1], ADDRESS_2, 0x1d50, ports_2, 1);
+	libusb_free_device_list(devlist, 1);
+
+	ret = libusb_get_string_descriptor_ascii(*hdl_1, 2, buf, sizeof(buf));
+	fail_unless(ret == 7 && !strcmp((char *)buf, "fx2lafw"),
+		"Wrong product string.");
+	ret = libusb_get_string_descriptor_ascii(*hdl_1, 1, buf, 4);
+	fail_unless(ret == 3 && !strcmp((char *)buf, "sig"),
+		"Wrong cut manufacturer string.");
+	ret = libusb_get_string_descriptor_ascii(*hdl_1, 3, buf, sizeof(buf));
+	fail_unless(ret == LIBUSB_ERROR_NOT_FOUND);
+	ret = libusb_get_string_descriptor_ascii(*hdl_2, 1, buf, sizeof(buf));
+	fail_unless(ret == LIBUSB_ERROR_NOT_FOUND);
+
+	memset(buf, 0, sizeof(buf));
+	ret = libusb_control_transfer(*hdl_1,
+		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR, 0xb0, 0x1234,
+		0x5678, buf, sizeof(control_data), 100);
+	fail_unless(ret == sizeof(control_data), "Control transfer: %d.", ret);
+	fail_unless(!memcmp(buf, control_data, sizeof(control_data)));
+
+	/* Past the transfers of the other device and endpoint before it. */
+	memset(buf, 0, sizeof(buf));
+	ret = libusb_bulk_transfer(*hdl_1, 0x81, buf, sizeof(buf),
+		&transferred, 100);
+	fail_unless(ret == LIBUSB_SUCCESS, "Bulk IN transfer: %d.", ret);
+	fail_unless(transferred == sizeof(bulk_data));
+	fail_unless(!memcmp(buf, bulk_data, sizeof(bulk_data)));
+	ret = libusb_bulk_transfer(*hdl_1, 0x01, buf, 64, &transferred, 100);
+	fail_unless(ret == LIBUSB_SUCCESS, "Bulk OUT transfer: %d.", ret);
+	fail_unless(transferred == 64);
+	memset(buf, 0, sizeof(buf));
+	ret = libusb_bulk_transfer(*hdl_2, 0x81, buf, sizeof(buf),
+		&transferred, 100);
+	fail_unless(ret == LIBUSB_SUCCESS, "Bulk transfer of the other "
+		"device: %d.", ret);
+	fail_unless(transferred == sizeof(other_data));
+	fail_unless(!memcmp(buf, other_data, sizeof(other_data)));
+}
+
+/*
+ * Keep NUM_INFLIGHT transfers submitted on every stream until the trace
+ * is over, when the transfers in flight must fail with NO_DEVICE.
+ */
+static void check_async(void)
+{
+	struct libusb_transfer *transfers[NUM_STREAMS * NUM_INFLIGHT];
+	struct libusb_transfer *transfer;
+	struct stream *st;
+	struct timeval tv;
+	unsigned int i, n;
+	int ret;
+
+	num_completed = num_gone = 0;
+	for (i = 0; i < NUM_STREAMS * NUM_INFLIGHT; i++) {
+		st = &streams[i % NUM_STREAMS];
+		transfer = transfers[i] = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, st->hdl, st->endpoint,
+			g_malloc(BUFFER_SIZE), BUFFER_SIZE, transfer_done, st, 0);
+		g_queue_push_tail(st->inflight, transfer);
+		ret = libusb_submit_transfer(transfer);
+		fail_unless(ret == LIBUSB_SUCCESS, "Failed to submit: %d.", ret);
+	}
+
+	fail_unless(sr_usb_trace_timeout() == 0, "No completion is due.");
+	for (n = 0; num_gone < G_N_ELEMENTS(transfers); n++) {
+		fail_unless(n < 2 * NUM_COMPLETIONS, "Replay got stuck.");
+		tv.tv_sec = tv.tv_usec = 0;
+		libusb_handle_events_timeout(NULL, &tv);
+	}
+	fail_unless(num_completed == num_valid, "%u completions, expected %u.",
+		num_completed, num_valid);
+	fail_unless(sr_usb_trace_timeout() == -1, "A completion is due.");
+
+	for (i = 0; i < G_N_ELEMENTS(transfers); i++) {
+		g_free(transfers[i]->buffer);
+		libusb_free_transfer(transfers[i]);
+	}
+}
+
+/* Replay the trace, cut to the given size. */
+static void check_replay(const GString *trace, size_t size)
+{
+	libusb_device_handle *hdl_1, *hdl_2;
+	unsigned char buf[BUFFER_SIZE];
+	gchar *filename;
+	unsigned int s;
+	int fd, ret;
+
+	fd = g_file_open_tmp("sr-test-XXXXXX", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create a temporary file.");
+	fail_unless(write(fd, trace->str, size) == (ssize_t)size);
+	close(fd);
+
+	g_setenv("SIGROK_USB_REPLAY", filename, TRUE);
+	sr_usb_trace_init();
+	g_unsetenv("SIGROK_USB_REPLAY");
+	fail_unless(sr_usb_trace_active(), "Not replaying.");
+
+	check_sync(&hdl_1, &hdl_2);
+	streams[0].hdl = streams[1].hdl = hdl_1;
+	streams[2].hdl = hdl_2;
+	for (s = 0; s < NUM_STREAMS; s++) {
+		streams[s].inflight = g_queue_new();
+		streams[s].next = 0;
+	}
+	check_async();
+	for (s = 0; s < NUM_STREAMS; s++)
+		g_queue_free(streams[s].inflight);
+
+	/* The devices are gone with the end of the trace. */
+	ret = libusb_control_transfer(hdl_1, LIBUSB_ENDPOINT_IN, 0, 0, 0,
+		buf, sizeof(buf), 100);
+	fail_unless(ret == LIBUSB_ERROR_NO_DEVICE);
+	ret = libusb_bulk_transfer(hdl_2, 0x81, buf, sizeof(buf), NULL, 100);
+	fail_unless(ret == LIBUSB_ERROR_NO_DEVICE);
+
+	libusb_close(hdl_1);
+	libusb_close(hdl_2);
+	sr_usb_trace_exit();
+	fail_unless(!sr_usb_trace_active());
+
+	g_unlink(filename);
+	g_free(filename);
+}
+
+static void setup_streams(void)
+{
+	streams[0].address = ADDRESS_1;
+	streams[0].endpoint = 0x82;
+	streams[1].address = ADDRESS_1;
+	streams[1].endpoint = 0x86;
+	/* The same endpoint as the first stream, on the other device. */
+	streams[2].address = ADDRESS_2;
+	streams[2].endpoint = 0x82;
+}
+
+/*
+ * The devices and the synchronous transfers of the trace, and the
+ * completions, each going to the oldest transfer on its endpoint.
+ */
+START_TEST(test_usb_trace_replay)
+{
+	GString *trace;
+
+	rng_state = 0x9e3779b97f4a7c15ULL;
+	setup_streams();
+	trace = make_trace();
+	num_valid = NUM_COMPLETIONS;
+	check_replay(trace, trace->len);
+	g_string_free(trace, TRUE);
+}
+END_TEST
+
+/*
+ * A trace which ends in the middle of the last completion's data or
+ * header. The completions before it are replayed, then the device is
+ * gone.
+ */
+START_TEST(test_usb_trace_truncated)
+{
+	GString *trace;
+	size_t last;
+
+	rng_state = 0x0123456789abcdefULL;
+	setup_streams();
+	trace = make_trace();
+	/* Make sure the last completion has data to cut. */
+	last = trace->len - RECORD_SIZE - completions[NUM_COMPLETIONS - 1].length;
+	if (!completions[NUM_COMPLETIONS - 1].length) {
+		completions[NUM_COMPLETIONS - 1].length = 1;
+		WL32(trace->str + last + 13, 1);
+		WL32(trace->str + last + 25, 1);
+		g_string_append_c(trace, completions[NUM_COMPLETIONS - 1].data[0]);
+	}
+	num_valid = NUM_COMPLETIONS - 1;
+	check_replay(trace, trace->len - 1);
+	check_replay(trace, last + RECORD_SIZE);
+	check_replay(trace, last + RECORD_SIZE - 1);
+	check_replay(trace, last + 1);
+	num_valid = NUM_COMPLETIONS;
+	check_replay(trace, trace->len);
+	g_string_free(trace, TRUE);
+}
+END_TEST
+
+Suite *suite_usb_trace(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("usb-trace");
+
+	tc = tcase_create("replay");
+	tcase_add_test(tc, test_usb_trace_replay);
+	tcase_add_test(tc, test_usb_trace_truncated);
+	suite_add_tcase(s, tc);
+
+	return s;
+}